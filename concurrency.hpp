@@ -1,25 +1,194 @@
 #ifndef CONCURRENCY_HPP
 #define CONCURRENCY_HPP
 
-#include <atomic>
+#include <array>
 #include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <exception>
+#include <fstream>
 #include <future>
+#include <iostream>
+#include <limits>
 #include <list>
 #include <memory>
-#include <mutex>
 #include <optional>
-#include <thread>
+#include <set>
+#include <sstream>
+#include <string_view>
 #include <type_traits>
+#include <unordered_map>
+#include <utility>
 
-#define CHANNEL_ITER_HPP
+#define BLOCKING_HPP
+#define BARRIER_HPP
 #define CONTAINER_RING_BUFFER_HPP
+#define CONTAINER_BYTE_RING_HPP
+#define MEMORY_GOVERNOR_HPP
+#define CONTAINER_BUDGETED_HPP
+#define CONTAINER_CONFLATING_HPP
+#define CODEC_HPP
+#define CONTAINER_SPILLING_HPP
 #define CONTAINER_THREAD_SAFE_HPP
+#define BYTE_CHANNEL_HPP
+#define CHANNEL_ITER_HPP
 #define CHANNEL_HPP
-#define LOCKFREE_LIST_HPP
-#define SELECT_HPP
+#define DURABLE_CHANNEL_HPP
+#define HISTOGRAM_HPP
 #define THREAD_POOL_HPP
+#define FILE_SOURCE_HPP
+#define INSTRUMENTED_MUTEX_HPP
+#define IO_SERVICE_HPP
+#define LOCKFREE_LIST_HPP
 #define WAIT_GROUP_HPP
+#define METRICS_HPP
+#define NET_CHANNEL_HPP
+#define NETPOLLER_HPP
+#define SELECT_HPP
+#define SHARED_CHANNEL_HPP
+#define TASK_GRAPH_HPP
+#define TASK_SCOPE_HPP
+#define WATCHDOG_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <new>
+
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#endif
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include <cstdint>
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <thread>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <linux/stat.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#elif !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#ifndef _WIN32
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <string>
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#include <unistd.h>
+#elif !defined(_WIN32)
+#include <poll.h>
+#endif
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+#include <cerrno>
+#include <cstddef>
+#include <string>
+#include <atomic>
+#include <csignal>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
 
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <pthread.h>
+#include <time.h>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
 #include <chrono>
 
 
@@ -31,275 +200,8227 @@ namespace platform {
     // constexpr auto prevent_deadlock = 150us;  // for personal mac
     constexpr auto prevent_deadlock = 500us;  // for azure-pipeline mac
 #endif
+
+    // gcc warns the standard constant is not abi stable across -mtune
+#if defined(__cpp_lib_hardware_interference_size) && !defined(__GNUC__)
+    constexpr size_t cache_line = std::hardware_destructive_interference_size;
+#elif defined(__APPLE__) && defined(__aarch64__)
+    constexpr size_t cache_line = 128;
+#else
+    constexpr size_t cache_line = 64;
+#endif
+
+    // alignment of a member starting its own cache line, or its natural
+    // alignment for the unpadded layout
+    template <typename T, bool Padded>
+    constexpr size_t line_align = Padded ? cache_line : alignof(T);
 }  // namespace platform
 
 
-template <typename T, typename Channel>
-class ChannelIterator {
-public:
-    ChannelIterator(Channel& channel, std::optional<T>&& item)
-        : channel(channel), item(std::move(item)) {
-        // Do Nothing
-    }
+namespace platform {
+    // Pollable descriptor which stays readable once signalled until it
+    // is drained. Nonblocking eventfd on linux, a self pipe on other
+    // posix systems, unsupported on windows where open fails.
+    class EventFd {
+    public:
+        EventFd() : read_end(-1), write_end(-1) {
+            // Do Nothing
+        }
 
-    T& operator*() {
-        return item.value();
-    }
+        ~EventFd() {
+            close();
+        }
 
-    T const& operator*() const {
-        return item.value();
-    }
+        EventFd(EventFd const&) = delete;
+        EventFd(EventFd&&) = delete;
 
-    ChannelIterator& operator++() {
-        item = channel.Get();
-        return *this;
-    }
+        EventFd& operator=(EventFd const&) = delete;
+        EventFd& operator=(EventFd&&) = delete;
 
-    bool operator!=(ChannelIterator const& other) const {
-        return item != other.item;
-    }
+#if defined(__linux__)
+        bool open() {
+            close();
+            read_end = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            write_end = read_end;
+            return read_end >= 0;
+        }
 
-private:
-    Channel& channel;
-    std::optional<T> item;
-};
+        void signal() {
+            uint64_t one = 1;
+            ssize_t res = ::write(write_end, &one, sizeof(one));
+            (void)res;
+        }
 
+        void drain() {
+            uint64_t count = 0;
+            ssize_t res = ::read(read_end, &count, sizeof(count));
+            (void)res;
+        }
+#elif !defined(_WIN32)
+        bool open() {
+            close();
+            int fds[2];
+            if (::pipe(fds) != 0) {
+                return false;
+            }
 
-template <typename T, typename = void>  // for stl compatiblity
-class RingBuffer {
-public:
-    using value_type = T;
+            for (int fd : fds) {
+                ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+                ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+            }
+            read_end = fds[0];
+            write_end = fds[1];
+            return true;
+        }
 
-    static_assert(std::is_default_constructible_v<T>,
-                  "RingBuffer base type must be default constructible");
+        // a full pipe is readable already
+        void signal() {
+            char one = 1;
+            ssize_t res = ::write(write_end, &one, 1);
+            (void)res;
+        }
 
-    RingBuffer() : RingBuffer(1) {
-        // Do Nothing
-    }
+        void drain() {
+            char buf[64];
+            while (::read(read_end, buf, sizeof(buf)) > 0) {
+                // Do Nothing
+            }
+        }
+#else
+        bool open() {
+            return false;
+        }
 
-    RingBuffer(size_t size_buffer)
-        : size_buffer(size_buffer), buffer(std::make_unique<T[]>(size_buffer)) {
-        // Do Nothing
-    }
+        void signal() {
+            // Do Nothing
+        }
 
-    RingBuffer(RingBuffer const&) = delete;
-    RingBuffer(RingBuffer&&) = delete;
+        void drain() {
+            // Do Nothing
+        }
+#endif
 
-    RingBuffer& operator=(RingBuffer const&) = delete;
-    RingBuffer& operator=(RingBuffer&&) = delete;
+        void close() {
+#ifndef _WIN32
+            if (write_end >= 0 && write_end != read_end) {
+                ::close(write_end);
+            }
+            if (read_end >= 0) {
+                ::close(read_end);
+            }
+#endif
+            read_end = -1;
+            write_end = -1;
+        }
 
-    template <typename... U>
-    void emplace_back(U&&... args) {
-        buffer[ptr_tail] = T(std::forward<U>(args)...);
+        bool is_open() const {
+            return read_end >= 0;
+        }
 
-        num_data += 1;
-        ptr_tail = (ptr_tail + 1) % size_buffer;
-    }
+        // descriptor to poll for readability
+        int fd() const {
+            return read_end;
+        }
 
-    void pop_front() {
-        num_data -= 1;
-        ptr_head = (ptr_head + 1) % size_buffer;
-    }
+    private:
+        int read_end;
+        int write_end;
+    };
+}  // namespace platform
 
-    T& front() {
-        return buffer[ptr_head];
-    }
 
-    T const& front() const {
-        return buffer[ptr_head];
-    }
+namespace platform {
+    // Park while `word` holds `expected`, at most `timeout` unless it is
+    // zero. Returns spuriously, callers recheck their condition. Words
+    // in memory shared between processes need `shared`. Without futex,
+    // waiters sleep briefly and wake calls do nothing.
+    inline void futex_wait(std::atomic<uint32_t>& word,
+                           uint32_t expected,
+                           bool shared = false,
+                           std::chrono::microseconds timeout
+                           = std::chrono::microseconds(0)) {
+#if defined(__linux__)
+        timespec ts;
+        timespec* pts = nullptr;
+        if (timeout.count() > 0) {
+            ts.tv_sec = static_cast<time_t>(timeout.count() / 1'000'000);
+            ts.tv_nsec = static_cast<long>(timeout.count() % 1'000'000) * 1000;
+            pts = &ts;
+        }
 
-    size_t size() const {
-        return num_data;
+        int op = shared ? FUTEX_WAIT : FUTEX_WAIT_PRIVATE;
+        ::syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), op,
+                  expected, pts, nullptr, 0);
+#else
+        (void)shared;
+        if (word.load(std::memory_order_acquire) == expected) {
+            auto nap = std::chrono::microseconds(50);
+            std::this_thread::sleep_for(
+                timeout.count() > 0 && timeout < nap ? timeout : nap);
+        }
+#endif
     }
 
-    size_t max_size() const {
-        return size_buffer;
+    // wake up to `count` waiters of `word`
+    inline void futex_wake(std::atomic<uint32_t>& word,
+                           bool shared = false,
+                           int count = INT_MAX) {
+#if defined(__linux__)
+        int op = shared ? FUTEX_WAKE : FUTEX_WAKE_PRIVATE;
+        ::syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), op, count,
+                  nullptr, nullptr, 0);
+#else
+        (void)word;
+        (void)shared;
+        (void)count;
+#endif
     }
+}  // namespace platform
 
-private:
-    size_t size_buffer;
-    std::unique_ptr<T[]> buffer;
 
-    size_t num_data = 0;
-    size_t ptr_head = 0;
-    size_t ptr_tail = 0;
-};
+namespace platform {
+    // File read front to back, either with positional reads or through
+    // a read only mapping, with hints for the kernel readahead. Every
+    // call fails on windows.
+    class InputFile {
+    public:
+        InputFile() : fd(-1), length(0), ptr(nullptr) {
+            // Do Nothing
+        }
 
+        ~InputFile() {
+            close();
+        }
 
-template <typename Cont, typename Mutex = std::mutex>
-class ThreadSafe {
-public:
-    using value_type = typename Cont::value_type;
+        InputFile(InputFile const&) = delete;
+        InputFile(InputFile&&) = delete;
 
-    template <typename... Args>
-    ThreadSafe(Args&&... args)
-        : m_runnable(true), buffer(std::forward<Args>(args)...) {
-        // Do Nothing
-    }
+        InputFile& operator=(InputFile const&) = delete;
+        InputFile& operator=(InputFile&&) = delete;
 
-    ~ThreadSafe() {
-        close();
-    }
+#ifndef _WIN32
+        bool open(std::string const& path) {
+            close();
+            fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
 
-    ThreadSafe(ThreadSafe const&) = delete;
-    ThreadSafe(ThreadSafe&&) = delete;
+            struct stat st;
+            if (fd < 0 || ::fstat(fd, &st) != 0) {
+                close();
+                return false;
+            }
+            length = static_cast<uint64_t>(st.st_size);
+            return true;
+        }
 
-    ThreadSafe& operator=(ThreadSafe const&) = delete;
-    ThreadSafe& operator=(ThreadSafe&&) = delete;
+        void close() {
+            if (ptr != nullptr) {
+                ::munmap(ptr, length);
+            }
+            if (fd >= 0) {
+                ::close(fd);
+            }
+            fd = -1;
+            ptr = nullptr;
+            length = 0;
+        }
 
-    template <typename... U>
-    void emplace_back(U&&... args) {
-        std::unique_lock lock(mutex);
-        cond.wait(lock, [&] {
-            return !m_runnable || buffer.size() < buffer.max_size();
-        });
+        // the whole file will be read once, front to back
+        void sequential() {
+#if defined(POSIX_FADV_SEQUENTIAL)
+            ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+        }
 
-        if (m_runnable) {
-            buffer.emplace_back(std::forward<U>(args)...);
+        // start reading `len` bytes at `offset` into the page cache
+        void prefetch(uint64_t offset, size_t len) {
+#if defined(__linux__)
+            ::readahead(fd, static_cast<off64_t>(offset), len);
+#elif defined(POSIX_FADV_WILLNEED)
+            ::posix_fadvise(fd, static_cast<off_t>(offset),
+                            static_cast<off_t>(len), POSIX_FADV_WILLNEED);
+#endif
         }
-        cond.notify_all();
-    }
 
-    void push_back(value_type const& value) {
-        std::unique_lock lock(mutex);
-        cond.wait(lock, [&] {
-            return !m_runnable || buffer.size() < buffer.max_size();
-        });
+        // read up to `len` bytes at `offset`, short only at the end of
+        // the file, -1 on error
+        long read(void* buf, size_t len, uint64_t offset) {
+            size_t done = 0;
+            while (done < len) {
+                ssize_t res =
+                    ::pread(fd, static_cast<char*>(buf) + done, len - done,
+                            static_cast<off_t>(offset + done));
+                if (res < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (res < 0) {
+                    return -1;
+                }
+                if (res == 0) {
+                    break;
+                }
+                done += static_cast<size_t>(res);
+            }
+            return static_cast<long>(done);
+        }
 
-        if (m_runnable) {
-            buffer.push_back(value);
+        // map the whole file read only, nullptr on failure or if empty
+        char const* map() {
+            if (ptr == nullptr && fd >= 0 && length > 0) {
+                void* addr = ::mmap(
+                    nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (addr == MAP_FAILED) {
+                    return nullptr;
+                }
+                ::madvise(addr, length, MADV_SEQUENTIAL);
+                ptr = addr;
+            }
+            return static_cast<char const*>(ptr);
+        }
+#else
+        bool open(std::string const&) {
+            return false;
         }
-        cond.notify_all();
-    }
 
-    void push_back(value_type&& value) {
-        std::unique_lock lock(mutex);
-        cond.wait(lock, [&] {
-            return !m_runnable || buffer.size() < buffer.max_size();
-        });
+        void close() {
+            // Do Nothing
+        }
 
-        if (m_runnable) {
-            buffer.push_back(std::move(value));
+        void sequential() {
+            // Do Nothing
         }
-        cond.notify_all();
-    }
 
-    std::optional<value_type> pop_front() {
-        std::unique_lock lock(mutex);
-        cond.wait(lock, [&] { return !m_runnable || buffer.size() > 0; });
+        void prefetch(uint64_t, size_t) {
+            // Do Nothing
+        }
 
-        if (!m_runnable && buffer.size() == 0) {
-            return std::nullopt;
+        long read(void*, size_t, uint64_t) {
+            return -1;
         }
 
-        value_type given = std::move(buffer.front());
-        buffer.pop_front();
+        char const* map() {
+            return nullptr;
+        }
+#endif
 
-        cond.notify_all();
-        return std::make_optional(std::move(given));
-    }
+        bool is_open() const {
+            return fd >= 0;
+        }
 
-    std::optional<value_type> try_pop() {
-        std::unique_lock lock(mutex, std::try_to_lock);
-        if (lock.owns_lock() && buffer.size() > 0) {
-            value_type given = std::move(buffer.front());
-            buffer.pop_front();
+        uint64_t size() const {
+            return length;
+        }
 
-            cond.notify_all();
-            return std::make_optional(std::move(given));
+    private:
+        int fd;
+        uint64_t length;
+        void* ptr;
+    };
+}  // namespace platform
+
+
+namespace platform {
+    enum class IoOp : unsigned char { Nop, Read, Write, Open, Stat };
+
+    // statx result on linux, struct stat elsewhere
+    struct StatBuffer {
+        alignas(8) unsigned char raw[256];
+        bool is_statx;
+    };
+
+    struct FileStat {
+        uint64_t size;
+        uint32_t mode;
+        int64_t mtime_sec;
+        uint32_t mtime_nsec;
+    };
+
+    // Positional read and write, open relative to the working directory
+    // with `flags` and `mode`, stat of `path` into `stat`. `key` comes
+    // back with the completion.
+    struct IoRequest {
+        IoOp op = IoOp::Nop;
+        int fd = -1;
+        void* buf = nullptr;
+        size_t len = 0;
+        uint64_t offset = 0;
+        char const* path = nullptr;
+        int flags = 0;
+        unsigned mode = 0;
+        StatBuffer* stat = nullptr;
+        uint64_t key = 0;
+    };
+
+    struct IoEvent {
+        uint64_t key;
+        long result;
+    };
+
+    inline FileStat to_file_stat(StatBuffer const& buffer) {
+        FileStat stat{};
+#if defined(__linux__)
+        if (buffer.is_statx) {
+            struct statx stx;
+            std::memcpy(&stx, buffer.raw, sizeof(stx));
+            stat.size = stx.stx_size;
+            stat.mode = stx.stx_mode;
+            stat.mtime_sec = stx.stx_mtime.tv_sec;
+            stat.mtime_nsec = stx.stx_mtime.tv_nsec;
+            return stat;
         }
-        return std::nullopt;
+#endif
+#ifndef _WIN32
+        struct stat st;
+        std::memcpy(&st, buffer.raw, sizeof(st));
+        stat.size = static_cast<uint64_t>(st.st_size);
+        stat.mode = static_cast<uint32_t>(st.st_mode);
+        stat.mtime_sec = static_cast<int64_t>(st.st_mtime);
+#endif
+        return stat;
     }
 
-    void close() {
-        m_runnable = false;
-        cond.notify_all();
+    // run a request with blocking syscalls, -errno on failure
+    inline long io_execute(IoRequest const& request) {
+#ifndef _WIN32
+        long res = 0;
+        switch (request.op) {
+        case IoOp::Nop:
+            return 0;
+        case IoOp::Read:
+            res = ::pread(request.fd, request.buf, request.len,
+                          static_cast<off_t>(request.offset));
+            break;
+        case IoOp::Write:
+            res = ::pwrite(request.fd, request.buf, request.len,
+                           static_cast<off_t>(request.offset));
+            break;
+        case IoOp::Open:
+            res = ::open(request.path, request.flags, request.mode);
+            break;
+        case IoOp::Stat: {
+            static_assert(sizeof(struct stat) <= sizeof(StatBuffer::raw));
+            struct stat st;
+            res = ::stat(request.path, &st);
+            std::memcpy(request.stat->raw, &st, sizeof(st));
+            request.stat->is_statx = false;
+            break;
+        }
+        }
+        return res < 0 ? -errno : res;
+#else
+        (void)request;
+        return -38;
+#endif
     }
 
-    bool runnable() const {
-        return m_runnable;
-    }
+    // Submission and completion rings of io_uring set up with raw
+    // syscalls, unavailable before linux 5.6 and on other systems where
+    // open fails, as it does when the kernel lacks one of the opcodes.
+    // Pushes need external serialization, completions are reaped by a
+    // single thread.
+    class IoRing {
+    public:
+        IoRing() : ring_fd(-1) {
+            // Do Nothing
+        }
 
-    bool readable() {
-        std::unique_lock lock(mutex);
-        return m_runnable || buffer.size() > 0;
-    }
+        ~IoRing() {
+            close();
+        }
 
-private:
-    bool m_runnable;
-    Cont buffer;
+        IoRing(IoRing const&) = delete;
+        IoRing(IoRing&&) = delete;
 
-    Mutex mutex;
-    std::condition_variable cond;
-};
+        IoRing& operator=(IoRing const&) = delete;
+        IoRing& operator=(IoRing&&) = delete;
 
-template <typename T>
-using TSList = ThreadSafe<std::list<T>>;
+#if defined(__linux__)
+        bool open(unsigned entries) {
+            close();
+            if (entries == 0) {
+                return false;
+            }
 
-template <typename T>
-using TSRingBuffer = ThreadSafe<RingBuffer<T>>;
+            io_uring_params params;
+            std::memset(&params, 0, sizeof(params));
+            ring_fd = static_cast<int>(
+                ::syscall(__NR_io_uring_setup, entries, &params));
+            if (ring_fd < 0) {
+                ring_fd = -1;
+                return false;
+            }
 
+            if (!probe()) {
+                close();
+                return false;
+            }
 
-template <typename Container>
-class Channel {
-public:
+            sq_size = params.sq_off.array
+                      + params.sq_entries * sizeof(unsigned);
+            cq_size = params.cq_off.cqes
+                      + params.cq_entries * sizeof(io_uring_cqe);
+            bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+            if (single) {
+                sq_size = cq_size = sq_size > cq_size ? sq_size : cq_size;
+            }
+
+            sq_ptr = map(sq_size, IORING_OFF_SQ_RING);
+            cq_ptr = single ? sq_ptr : map(cq_size, IORING_OFF_CQ_RING);
+            sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+            sqes = static_cast<io_uring_sqe*>(
+                map(sqes_size, IORING_OFF_SQES));
+            if (sq_ptr == nullptr || cq_ptr == nullptr || sqes == nullptr) {
+                close();
+                return false;
+            }
+
+            auto sq = static_cast<unsigned char*>(sq_ptr);
+            sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+            sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+            sq_mask =
+                *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+            sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+            auto cq = static_cast<unsigned char*>(cq_ptr);
+            cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+            cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+            cq_mask =
+                *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+            cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+            sq_entries = params.sq_entries;
+            cq_entries = params.cq_entries;
+            return true;
+        }
+
+        void close() {
+            if (sqes != nullptr) {
+                ::munmap(sqes, sqes_size);
+            }
+            if (cq_ptr != nullptr && cq_ptr != sq_ptr) {
+                ::munmap(cq_ptr, cq_size);
+            }
+            if (sq_ptr != nullptr) {
+                ::munmap(sq_ptr, sq_size);
+            }
+            if (ring_fd >= 0) {
+                ::close(ring_fd);
+            }
+            ring_fd = -1;
+            sq_ptr = cq_ptr = nullptr;
+            sqes = nullptr;
+        }
+
+        // false while the submission ring is full
+        bool push(IoRequest const& request) {
+            unsigned tail = *sq_tail;
+            if (tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE)
+                >= sq_entries) {
+                return false;
+            }
+
+            unsigned idx = tail & sq_mask;
+            io_uring_sqe& sqe = sqes[idx];
+            std::memset(&sqe, 0, sizeof(sqe));
+            sqe.user_data = request.key;
+
+            switch (request.op) {
+            case IoOp::Nop:
+                sqe.opcode = IORING_OP_NOP;
+                break;
+            case IoOp::Read:
+            case IoOp::Write:
+                sqe.opcode = request.op == IoOp::Read ? IORING_OP_READ
+                                                      : IORING_OP_WRITE;
+                sqe.fd = request.fd;
+                sqe.addr = reinterpret_cast<uint64_t>(request.buf);
+                // a transfer stops short at the cap of pread and pwrite
+                sqe.len = static_cast<uint32_t>(
+                    request.len < max_transfer ? request.len : max_transfer);
+                sqe.off = request.offset;
+                break;
+            case IoOp::Open:
+                sqe.opcode = IORING_OP_OPENAT;
+                sqe.fd = AT_FDCWD;
+                sqe.addr = reinterpret_cast<uint64_t>(request.path);
+                sqe.len = request.mode;
+                sqe.open_flags = static_cast<uint32_t>(request.flags);
+                break;
+            case IoOp::Stat:
+                sqe.opcode = IORING_OP_STATX;
+                sqe.fd = AT_FDCWD;
+                sqe.addr = reinterpret_cast<uint64_t>(request.path);
+                sqe.len = STATX_BASIC_STATS;
+                sqe.off = reinterpret_cast<uint64_t>(request.stat->raw);
+                request.stat->is_statx = true;
+                break;
+            }
+
+            sq_array[idx] = idx;
+            __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+            return true;
+        }
+
+        // hand `count` pushed requests to the kernel, the number handed,
+        // fewer with errno set if io_uring_enter failed
+        unsigned submit(unsigned count) {
+            unsigned handed = 0;
+            while (handed < count) {
+                long res = ::syscall(__NR_io_uring_enter, ring_fd,
+                                     count - handed, 0, 0, nullptr, 0);
+                if (res < 0 && errno != EINTR && errno != EAGAIN) {
+                    break;
+                }
+                handed += res > 0 ? static_cast<unsigned>(res) : 0;
+            }
+            return handed;
+        }
+
+        // Take back the `num` oldest requests the kernel has not consumed,
+        // after a failed submit, and return their keys. Later requests
+        // move up, pushes and submits must be stopped meanwhile.
+        std::vector<uint64_t> drop(unsigned num) {
+            unsigned head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+            unsigned tail = *sq_tail;
+            num = num < tail - head ? num : tail - head;
+
+            std::vector<uint64_t> keys;
+            keys.reserve(num);
+            for (unsigned pos = head; pos != head + num; ++pos) {
+                keys.push_back(sqes[sq_array[pos & sq_mask]].user_data);
+            }
+            for (unsigned pos = head + num; pos != tail; ++pos) {
+                unsigned idx = (pos - num) & sq_mask;
+                sqes[idx] = sqes[sq_array[pos & sq_mask]];
+                sq_array[idx] = idx;
+            }
+
+            __atomic_store_n(sq_tail, tail - num, __ATOMIC_RELEASE);
+            return keys;
+        }
+
+        // reap up to `max` completions, waiting for one if `block`
+        size_t reap(IoEvent* out, size_t max, bool block) {
+            unsigned head = *cq_head;
+            if (block && head == __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+                ::syscall(__NR_io_uring_enter, ring_fd, 0, 1,
+                          IORING_ENTER_GETEVENTS, nullptr, 0);
+            }
+
+            size_t num = 0;
+            unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+            while (head != tail && num < max) {
+                io_uring_cqe const& cqe = cqes[head & cq_mask];
+                out[num++] = IoEvent{ cqe.user_data, cqe.res };
+                head += 1;
+            }
+            __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+            return num;
+        }
+
+        bool available() const {
+            return ring_fd >= 0;
+        }
+
+        // requests in flight that neither fill the submission ring nor
+        // overflow the completion ring
+        size_t capacity() const {
+            return sq_entries < cq_entries ? sq_entries : cq_entries;
+        }
+#else
+        bool open(unsigned) {
+            return false;
+        }
+
+        void close() {
+            // Do Nothing
+        }
+
+        bool push(IoRequest const&) {
+            return false;
+        }
+
+        unsigned submit(unsigned) {
+            return 0;
+        }
+
+        std::vector<uint64_t> drop(unsigned) {
+            return {};
+        }
+
+        size_t reap(IoEvent*, size_t, bool) {
+            return 0;
+        }
+
+        bool available() const {
+            return false;
+        }
+
+        size_t capacity() const {
+            return 0;
+        }
+#endif
+
+    private:
+#if defined(__linux__)
+        // MAX_RW_COUNT of linux, sqe lengths are 32 bits
+        static constexpr size_t max_transfer = 0x7ffff000;
+
+        // Kernels 5.1 to 5.5 set up rings without the read, write, openat
+        // or statx opcodes, and fail each request with -EINVAL. Probing
+        // came with 5.6, so it fails on those.
+        bool probe() {
+            constexpr unsigned num_ops = 256;
+            alignas(io_uring_probe) unsigned char
+                raw[sizeof(io_uring_probe)
+                    + num_ops * sizeof(io_uring_probe_op)];
+            std::memset(raw, 0, sizeof(raw));
+
+            auto probe = reinterpret_cast<io_uring_probe*>(raw);
+            if (::syscall(__NR_io_uring_register, ring_fd,
+                          IORING_REGISTER_PROBE, probe, num_ops)
+                < 0) {
+                return false;
+            }
+
+            unsigned const ops[] = { IORING_OP_READ, IORING_OP_WRITE,
+                                     IORING_OP_OPENAT, IORING_OP_STATX };
+            for (unsigned op : ops) {
+                if (op > probe->last_op
+                    || (probe->ops[op].flags & IO_URING_OP_SUPPORTED) == 0) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        void* map(size_t size, uint64_t offset) {
+            void* addr = ::mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                                MAP_SHARED | MAP_POPULATE, ring_fd,
+                                static_cast<off_t>(offset));
+            return addr == MAP_FAILED ? nullptr : addr;
+        }
+
+        void* sq_ptr = nullptr;
+        void* cq_ptr = nullptr;
+        io_uring_sqe* sqes = nullptr;
+        size_t sq_size = 0;
+        size_t cq_size = 0;
+        size_t sqes_size = 0;
+
+        unsigned* sq_head = nullptr;
+        unsigned* sq_tail = nullptr;
+        unsigned* sq_array = nullptr;
+        unsigned sq_mask = 0;
+        unsigned sq_entries = 0;
+
+        unsigned* cq_head = nullptr;
+        unsigned* cq_tail = nullptr;
+        io_uring_cqe* cqes = nullptr;
+        unsigned cq_mask = 0;
+        unsigned cq_entries = 0;
+#endif
+        int ring_fd;
+    };
+}  // namespace platform
+
+
+namespace platform {
+    // Append only file with explicit data sync, unsupported on windows
+    // where every call fails.
+    class LogFile {
+    public:
+        LogFile() : fd(-1) {
+            // Do Nothing
+        }
+
+        ~LogFile() {
+            close();
+        }
+
+        LogFile(LogFile const&) = delete;
+        LogFile(LogFile&&) = delete;
+
+        LogFile& operator=(LogFile const&) = delete;
+        LogFile& operator=(LogFile&&) = delete;
+
+#ifndef _WIN32
+        // create `path` or append to its end
+        bool open(std::string const& path) {
+            close();
+            fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0600);
+            return fd >= 0;
+        }
+
+        // create `path` or discard its content
+        bool create(std::string const& path) {
+            close();
+            fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+            return fd >= 0;
+        }
+
+        bool write(void const* src, size_t size) {
+            auto ptr = static_cast<char const*>(src);
+            while (size > 0) {
+                ssize_t num = ::write(fd, ptr, size);
+                if (num < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (num <= 0) {
+                    return false;
+                }
+                ptr += num;
+                size -= static_cast<size_t>(num);
+            }
+            return true;
+        }
+
+        // flush written data to the device, metadata only if required
+        // to read it back
+        bool sync() {
+#ifdef __linux__
+            return ::fdatasync(fd) == 0;
+#else
+            return ::fsync(fd) == 0;
+#endif
+        }
+
+        void close() {
+            if (fd >= 0) {
+                ::close(fd);
+            }
+            fd = -1;
+        }
+#else
+        bool open(std::string const&) {
+            return false;
+        }
+
+        bool create(std::string const&) {
+            return false;
+        }
+
+        bool write(void const*, size_t) {
+            return false;
+        }
+
+        bool sync() {
+            return false;
+        }
+
+        void close() {
+            // Do Nothing
+        }
+#endif
+
+        bool is_open() const {
+            return fd >= 0;
+        }
+
+    private:
+        int fd;
+    };
+
+    // whole content of `path`, false if it can not be read
+    inline bool read_file(std::string const& path, std::string& out) {
+        std::FILE* file = std::fopen(path.c_str(), "rb");
+        if (file == nullptr) {
+            return false;
+        }
+
+        out.clear();
+        char buf[1 << 16];
+        size_t num = 0;
+        while ((num = std::fread(buf, 1, sizeof(buf), file)) > 0) {
+            out.append(buf, num);
+        }
+
+        bool ok = std::ferror(file) == 0;
+        std::fclose(file);
+        return ok;
+    }
+
+    // make creation and renames of entries in the directory of `path`
+    // durable
+    inline bool sync_directory(std::string const& path) {
+#ifndef _WIN32
+        size_t slash = path.rfind('/');
+        std::string dir = slash == std::string::npos
+                              ? std::string(".")
+                              : path.substr(0, std::max<size_t>(slash, 1));
+
+        int fd = ::open(dir.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+
+        bool ok = ::fsync(fd) == 0;
+        ::close(fd);
+        return ok;
+#else
+        (void)path;
+        return false;
+#endif
+    }
+
+    // move `from` over `to`, atomically where the platform allows it
+    inline bool rename_file(std::string const& from, std::string const& to) {
+#ifdef _WIN32
+        // rename does not replace an existing file there
+        std::remove(to.c_str());
+#endif
+        return std::rename(from.c_str(), to.c_str()) == 0;
+    }
+
+    // replace `path` atomically with synced content, readers see either
+    // the old or the new file after a crash
+    inline bool replace_file(std::string const& path,
+                             void const* src,
+                             size_t size) {
+#ifndef _WIN32
+        std::string tmp = path + ".tmp";
+        {
+            int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+            if (fd < 0) {
+                return false;
+            }
+
+            bool ok = ::write(fd, src, size) == static_cast<ssize_t>(size)
+                      && ::fsync(fd) == 0;
+            ::close(fd);
+            if (!ok) {
+                ::unlink(tmp.c_str());
+                return false;
+            }
+        }
+        return ::rename(tmp.c_str(), path.c_str()) == 0
+               && sync_directory(path);
+#else
+        (void)path;
+        (void)src;
+        (void)size;
+        return false;
+#endif
+    }
+
+    // create `path` if it does not exist yet
+    inline bool make_directory(std::string const& path) {
+#ifndef _WIN32
+        return ::mkdir(path.c_str(), 0700) == 0 || errno == EEXIST;
+#else
+        (void)path;
+        return false;
+#endif
+    }
+
+    // names of the entries in `path`, empty if it can not be listed
+    inline std::vector<std::string> list_directory(std::string const& path) {
+        std::vector<std::string> names;
+#ifndef _WIN32
+        DIR* dir = ::opendir(path.c_str());
+        if (dir == nullptr) {
+            return names;
+        }
+
+        while (dirent* entry = ::readdir(dir)) {
+            std::string name = entry->d_name;
+            if (name != "." && name != "..") {
+                names.push_back(std::move(name));
+            }
+        }
+        ::closedir(dir);
+#else
+        (void)path;
+#endif
+        return names;
+    }
+}  // namespace platform
+
+
+namespace platform {
+    // Shared read-write mapping of a whole file, unsupported on windows
+    // where every call fails.
+    class MappedFile {
+    public:
+        MappedFile() : fd(-1), ptr(nullptr), length(0) {
+            // Do Nothing
+        }
+
+        ~MappedFile() {
+            close();
+        }
+
+        MappedFile(MappedFile const&) = delete;
+        MappedFile(MappedFile&&) = delete;
+
+        MappedFile& operator=(MappedFile const&) = delete;
+        MappedFile& operator=(MappedFile&&) = delete;
+
+#ifndef _WIN32
+        // Create or truncate `path` to `size` bytes and map it. The blocks
+        // are allocated up front, a full disk fails here instead of
+        // raising SIGBUS on a write through the mapping.
+        bool create(std::string const& path, size_t size) {
+            close();
+            fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+            if (fd < 0) {
+                return false;
+            }
+            if (!allocate(size)) {
+                close();
+                return false;
+            }
+            return map(size);
+        }
+
+        // map an existing file
+        bool open(std::string const& path) {
+            close();
+            fd = ::open(path.c_str(), O_RDWR);
+
+            struct stat st;
+            if (fd < 0 || ::fstat(fd, &st) != 0) {
+                close();
+                return false;
+            }
+            return map(static_cast<size_t>(st.st_size));
+        }
+
+        void close() {
+            if (ptr != nullptr) {
+                ::munmap(ptr, length);
+            }
+            if (fd >= 0) {
+                ::close(fd);
+            }
+            fd = -1;
+            ptr = nullptr;
+            length = 0;
+        }
+#else
+        bool create(std::string const&, size_t) {
+            return false;
+        }
+
+        bool open(std::string const&) {
+            return false;
+        }
+
+        void close() {
+            // Do Nothing
+        }
+#endif
+
+        bool mapped() const {
+            return ptr != nullptr;
+        }
+
+        unsigned char* data() {
+            return static_cast<unsigned char*>(ptr);
+        }
+
+        size_t size() const {
+            return length;
+        }
+
+    private:
+#ifndef _WIN32
+        bool allocate(size_t size) {
+#ifndef __APPLE__
+            return ::posix_fallocate(fd, 0, static_cast<off_t>(size)) == 0;
+#else
+            // no posix_fallocate, write the zeros out
+            char zeros[1 << 12] = {};
+            for (size_t done = 0; done < size;) {
+                size_t num = std::min(sizeof(zeros), size - done);
+                ssize_t res =
+                    ::pwrite(fd, zeros, num, static_cast<off_t>(done));
+                if (res < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (res <= 0) {
+                    return false;
+                }
+                done += static_cast<size_t>(res);
+            }
+            return true;
+#endif
+        }
+
+        bool map(size_t size) {
+            void* addr = ::mmap(
+                nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (addr == MAP_FAILED) {
+                close();
+                return false;
+            }
+
+            ptr = addr;
+            length = size;
+            return true;
+        }
+#endif
+
+        int fd;
+        void* ptr;
+        size_t length;
+    };
+
+    inline bool remove_file(std::string const& path) {
+#ifndef _WIN32
+        return ::unlink(path.c_str()) == 0;
+#else
+        return std::remove(path.c_str()) == 0;
+#endif
+    }
+
+    inline long process_id() {
+#ifndef _WIN32
+        return static_cast<long>(::getpid());
+#else
+        return 0;
+#endif
+    }
+}  // namespace platform
+
+
+namespace platform {
+    constexpr uint32_t poll_read = 1;
+    constexpr uint32_t poll_write = 2;
+
+    struct PollEvent {
+        uint64_t key;
+        uint32_t events;
+    };
+
+    // One shot readiness of file descriptors, an armed descriptor is
+    // reported once and disarmed until armed again. Level triggered, so
+    // arming a descriptor which is still ready reports it right away.
+    // epoll on linux, poll on other posix systems where arming waits for
+    // the next wakeup of at most 10ms, unsupported on windows.
+    class Poller {
+    public:
+        Poller() : epfd(-1) {
+            // Do Nothing
+        }
+
+        ~Poller() {
+            close();
+        }
+
+        Poller(Poller const&) = delete;
+        Poller(Poller&&) = delete;
+
+        Poller& operator=(Poller const&) = delete;
+        Poller& operator=(Poller&&) = delete;
+
+#if defined(__linux__)
+        bool open() {
+            close();
+            epfd = ::epoll_create1(EPOLL_CLOEXEC);
+            return epfd >= 0;
+        }
+
+        void close() {
+            if (epfd >= 0) {
+                ::close(epfd);
+            }
+            epfd = -1;
+        }
+
+        // registers `fd` on first use
+        bool arm(int fd, uint32_t events, uint64_t key) {
+            epoll_event ev{};
+            ev.events = EPOLLONESHOT | EPOLLRDHUP;
+            if (events & poll_read) {
+                ev.events |= EPOLLIN;
+            }
+            if (events & poll_write) {
+                ev.events |= EPOLLOUT;
+            }
+            ev.data.u64 = key;
+
+            if (::epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev) == 0) {
+                return true;
+            }
+            return errno == ENOENT
+                   && ::epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) == 0;
+        }
+
+        void remove(int fd) {
+            epoll_event ev{};
+            ::epoll_ctl(epfd, EPOLL_CTL_DEL, fd, &ev);
+        }
+
+        // errors and hangups are reported as both read and write
+        size_t wait(PollEvent* out,
+                    size_t max,
+                    std::chrono::milliseconds timeout) {
+            epoll_event evs[256];
+            auto cap = static_cast<int>(std::min<size_t>(max, 256));
+            int num = ::epoll_wait(
+                epfd, evs, cap, static_cast<int>(timeout.count()));
+            for (int i = 0; i < num; ++i) {
+                uint32_t events = 0;
+                if (evs[i].events & (EPOLLIN | EPOLLRDHUP)) {
+                    events |= poll_read;
+                }
+                if (evs[i].events & EPOLLOUT) {
+                    events |= poll_write;
+                }
+                if (evs[i].events & (EPOLLERR | EPOLLHUP)) {
+                    events |= poll_read | poll_write;
+                }
+                out[i] = PollEvent{ evs[i].data.u64, events };
+            }
+            return num > 0 ? static_cast<size_t>(num) : 0;
+        }
+#elif !defined(_WIN32)
+        bool open() {
+            epfd = 0;
+            return true;
+        }
+
+        void close() {
+            std::unique_lock lock(mutex);
+            armed.clear();
+            epfd = -1;
+        }
+
+        bool arm(int fd, uint32_t events, uint64_t key) {
+            std::unique_lock lock(mutex);
+            for (auto& entry : armed) {
+                if (entry.fd == fd) {
+                    entry.events |= events;
+                    entry.key = key;
+                    return true;
+                }
+            }
+            armed.push_back(Entry{ fd, events, key });
+            return true;
+        }
+
+        void remove(int fd) {
+            std::unique_lock lock(mutex);
+            armed.erase(std::remove_if(armed.begin(), armed.end(),
+                                       [&](Entry const& entry) {
+                                           return entry.fd == fd;
+                                       }),
+                        armed.end());
+        }
+
+        size_t wait(PollEvent* out,
+                    size_t max,
+                    std::chrono::milliseconds timeout) {
+            std::vector<pollfd> fds;
+            {
+                std::unique_lock lock(mutex);
+                for (auto const& entry : armed) {
+                    short events = 0;
+                    events |= (entry.events & poll_read) ? POLLIN : 0;
+                    events |= (entry.events & poll_write) ? POLLOUT : 0;
+                    fds.push_back(pollfd{ entry.fd, events, 0 });
+                }
+            }
+
+            auto nap = std::min<long long>(timeout.count(), 10);
+            if (::poll(fds.data(), fds.size(), static_cast<int>(nap)) <= 0) {
+                return 0;
+            }
+
+            std::unique_lock lock(mutex);
+            size_t num = 0;
+            for (auto const& pfd : fds) {
+                if (pfd.revents == 0 || num == max) {
+                    continue;
+                }
+
+                uint32_t events = 0;
+                if (pfd.revents & POLLIN) {
+                    events |= poll_read;
+                }
+                if (pfd.revents & POLLOUT) {
+                    events |= poll_write;
+                }
+                if (pfd.revents & (POLLERR | POLLHUP | POLLNVAL)) {
+                    events |= poll_read | poll_write;
+                }
+
+                for (auto iter = armed.begin(); iter != armed.end(); ++iter) {
+                    if (iter->fd == pfd.fd) {
+                        out[num++] = PollEvent{ iter->key, events };
+                        armed.erase(iter);
+                        break;
+                    }
+                }
+            }
+            return num;
+        }
+#else
+        bool open() {
+            return false;
+        }
+
+        void close() {
+            // Do Nothing
+        }
+
+        bool arm(int, uint32_t, uint64_t) {
+            return false;
+        }
+
+        void remove(int) {
+            // Do Nothing
+        }
+
+        size_t wait(PollEvent*, size_t, std::chrono::milliseconds timeout) {
+            std::this_thread::sleep_for(timeout);
+            return 0;
+        }
+#endif
+
+    private:
+#if !defined(__linux__) && !defined(_WIN32)
+        struct Entry {
+            int fd;
+            uint32_t events;
+            uint64_t key;
+        };
+
+        std::mutex mutex;
+        std::vector<Entry> armed;
+#endif
+        int epfd;
+    };
+}  // namespace platform
+
+
+namespace platform {
+    // Named shared memory object mapped read-write, visible to every
+    // process opening the same name. Unsupported on windows where every
+    // call fails.
+    class SharedMemory {
+    public:
+        SharedMemory() : ptr(nullptr), length(0) {
+            // Do Nothing
+        }
+
+        ~SharedMemory() {
+            close();
+        }
+
+        SharedMemory(SharedMemory const&) = delete;
+        SharedMemory(SharedMemory&&) = delete;
+
+        SharedMemory& operator=(SharedMemory const&) = delete;
+        SharedMemory& operator=(SharedMemory&&) = delete;
+
+#ifndef _WIN32
+        // create a zero filled object, fails if `name` already exists
+        bool create(std::string const& name, size_t size) {
+            close();
+            int fd = ::shm_open(path(name).c_str(),
+                                O_RDWR | O_CREAT | O_EXCL, 0600);
+            if (fd < 0) {
+                return false;
+            }
+
+            bool ok = ::ftruncate(fd, static_cast<off_t>(size)) == 0
+                      && map(fd, size);
+            ::close(fd);
+            if (!ok) {
+                unlink(name);
+            }
+            return ok;
+        }
+
+        bool open(std::string const& name) {
+            close();
+            int fd = ::shm_open(path(name).c_str(), O_RDWR, 0600);
+            if (fd < 0) {
+                return false;
+            }
+
+            struct stat st;
+            bool ok = ::fstat(fd, &st) == 0 && st.st_size > 0
+                      && map(fd, static_cast<size_t>(st.st_size));
+            ::close(fd);
+            return ok;
+        }
+
+        void close() {
+            if (ptr != nullptr) {
+                ::munmap(ptr, length);
+            }
+            ptr = nullptr;
+            length = 0;
+        }
+
+        // remove the name, mappings stay valid until closed
+        static bool unlink(std::string const& name) {
+            return ::shm_unlink(path(name).c_str()) == 0;
+        }
+#else
+        bool create(std::string const&, size_t) {
+            return false;
+        }
+
+        bool open(std::string const&) {
+            return false;
+        }
+
+        void close() {
+            // Do Nothing
+        }
+
+        static bool unlink(std::string const&) {
+            return false;
+        }
+#endif
+
+        bool mapped() const {
+            return ptr != nullptr;
+        }
+
+        void* data() {
+            return ptr;
+        }
+
+        size_t size() const {
+            return length;
+        }
+
+    private:
+#ifndef _WIN32
+        static std::string path(std::string const& name) {
+            return name.empty() || name[0] != '/' ? '/' + name : name;
+        }
+
+        bool map(int fd, size_t size) {
+            void* addr = ::mmap(
+                nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (addr == MAP_FAILED) {
+                return false;
+            }
+
+            ptr = addr;
+            length = size;
+            return true;
+        }
+#endif
+
+        void* ptr;
+        size_t length;
+    };
+
+    // False once process `pid` has exited, even before its parent reaps
+    // it, always true on windows. A pidfd polls readable on exit, kill
+    // would still find the zombie.
+    inline bool process_alive(long pid) {
+#ifndef _WIN32
+        auto id = static_cast<pid_t>(pid);
+#ifdef SYS_pidfd_open
+        int fd = static_cast<int>(::syscall(SYS_pidfd_open, id, 0));
+        if (fd >= 0) {
+            pollfd watch{ fd, POLLIN, 0 };
+            bool exited = ::poll(&watch, 1, 0) > 0;
+            ::close(fd);
+            return !exited;
+        }
+        if (errno == ESRCH) {
+            return false;
+        }
+#endif
+        // without pidfds, an exited child of ours is seen without
+        // reaping it
+        siginfo_t info{};
+        if (::waitid(P_PID, static_cast<id_t>(id), &info,
+                     WEXITED | WNOHANG | WNOWAIT)
+                == 0
+            && info.si_pid == id) {
+            return false;
+        }
+        return ::kill(id, 0) == 0 || errno == EPERM;
+#else
+        (void)pid;
+        return true;
+#endif
+    }
+}  // namespace platform
+
+
+namespace platform {
+    using namespace std::literals;
+#if defined(SIGUSR1)
+    constexpr int dump_signal = SIGUSR1;
+#elif defined(SIGBREAK)
+    constexpr int dump_signal = SIGBREAK;
+#else
+    constexpr int dump_signal = SIGINT;
+#endif
+
+    // Signal handlers may only touch lock-free atomics, so callbacks run on
+    // a watcher thread which polls the pending signal mask.
+    class SignalWatcher {
+    public:
+        static SignalWatcher& instance() {
+            // never destroyed, static objects may detach after exit
+            static SignalWatcher* watcher = new SignalWatcher();
+            return *watcher;
+        }
+
+        size_t attach(int signo, std::function<void()> callback) {
+            std::unique_lock lock(mutex);
+            std::signal(signo, handler);
+
+            callbacks.emplace(++last_id, std::make_pair(signo, callback));
+            return last_id;
+        }
+
+        void detach(size_t id) {
+            std::unique_lock lock(mutex);
+            callbacks.erase(id);
+        }
+
+    private:
+        SignalWatcher() : last_id(0), watcher([this] { run(); }) {
+            watcher.detach();
+        }
+
+        static void handler(int signo) {
+            pending.fetch_or(1ull << (signo & 63));
+        }
+
+        void run() {
+            while (true) {
+                std::this_thread::sleep_for(100ms);
+
+                unsigned long long mask = pending.exchange(0);
+                if (mask == 0) {
+                    continue;
+                }
+
+                std::unique_lock lock(mutex);
+                for (auto const& [id, callback] : callbacks) {
+                    if (mask & (1ull << (callback.first & 63))) {
+                        callback.second();
+                    }
+                }
+            }
+        }
+
+        inline static std::atomic<unsigned long long> pending = 0;
+
+        std::mutex mutex;
+        size_t last_id;
+        std::map<size_t, std::pair<int, std::function<void()>>> callbacks;
+
+        std::thread watcher;
+    };
+}  // namespace platform
+
+
+namespace platform {
+    // Thin wrapper over bsd sockets, sockets are unsupported on windows
+    // and every call fails with `invalid_socket` or -1.
+    using socket_t = int;
+    constexpr socket_t invalid_socket = -1;
+
+    // one buffer of a vectored send
+    struct IoSlice {
+        void const* data;
+        size_t size;
+    };
+
+#ifndef _WIN32
+    constexpr bool has_socket = true;
+
+#ifdef MSG_NOSIGNAL
+    constexpr int send_flags = MSG_NOSIGNAL;
+#else
+    constexpr int send_flags = 0;
+#endif
+
+    inline void no_sigpipe(socket_t fd) {
+#ifdef SO_NOSIGPIPE
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#else
+        (void)fd;
+#endif
+    }
+
+    inline void close_socket(socket_t fd) {
+        if (fd != invalid_socket) {
+            ::close(fd);
+        }
+    }
+
+    // wakes up a peer blocked on `fd` without releasing the descriptor
+    inline void shutdown_socket(socket_t fd) {
+        if (fd != invalid_socket) {
+            ::shutdown(fd, SHUT_RDWR);
+        }
+    }
+
+    inline socket_t listen_inet(uint16_t port, uint32_t host, int backlog) {
+        socket_t fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        if (fd == invalid_socket) {
+            return invalid_socket;
+        }
+
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(host);
+
+        if (::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0
+            || ::listen(fd, backlog) != 0) {
+            close_socket(fd);
+            return invalid_socket;
+        }
+        return fd;
+    }
+
+    // listen on loopback, port 0 picks an ephemeral port
+    inline socket_t listen_local(uint16_t port, int backlog = 16) {
+        return listen_inet(port, INADDR_LOOPBACK, backlog);
+    }
+
+    // listen on every interface
+    inline socket_t listen_tcp(uint16_t port, int backlog = 16) {
+        return listen_inet(port, INADDR_ANY, backlog);
+    }
+
+    // connect to `host`, a name or an address, with nagle disabled
+    inline socket_t connect_tcp(std::string const& host, uint16_t port) {
+        addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+
+        addrinfo* res = nullptr;
+        std::string service = std::to_string(port);
+        if (::getaddrinfo(host.c_str(), service.c_str(), &hints, &res) != 0) {
+            return invalid_socket;
+        }
+
+        socket_t fd = invalid_socket;
+        for (addrinfo* ai = res; ai != nullptr; ai = ai->ai_next) {
+            fd = ::socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+            if (fd == invalid_socket) {
+                continue;
+            }
+            if (::connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+                break;
+            }
+            close_socket(fd);
+            fd = invalid_socket;
+        }
+        ::freeaddrinfo(res);
+
+        if (fd != invalid_socket) {
+            int on = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+            no_sigpipe(fd);
+        }
+        return fd;
+    }
+
+    inline bool unix_address(std::string const& path, sockaddr_un& addr) {
+        addr = sockaddr_un{};
+        addr.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(addr.sun_path)) {
+            return false;
+        }
+        std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+        return true;
+    }
+
+    // listen on a unix domain socket, a stale `path` is replaced
+    inline socket_t listen_unix(std::string const& path, int backlog = 16) {
+        sockaddr_un addr;
+        socket_t fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd == invalid_socket || !unix_address(path, addr)) {
+            close_socket(fd);
+            return invalid_socket;
+        }
+
+        ::unlink(path.c_str());
+        if (::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0
+            || ::listen(fd, backlog) != 0) {
+            close_socket(fd);
+            return invalid_socket;
+        }
+        return fd;
+    }
+
+    inline socket_t connect_unix(std::string const& path) {
+        sockaddr_un addr;
+        socket_t fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd == invalid_socket || !unix_address(path, addr)
+            || ::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr))
+                   != 0) {
+            close_socket(fd);
+            return invalid_socket;
+        }
+
+        no_sigpipe(fd);
+        return fd;
+    }
+
+    // connected pair of unix domain sockets
+    inline bool socket_pair(socket_t (&fds)[2]) {
+        if (::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+            return false;
+        }
+        no_sigpipe(fds[0]);
+        no_sigpipe(fds[1]);
+        return true;
+    }
+
+    inline uint16_t local_port(socket_t fd) {
+        sockaddr_in addr{};
+        socklen_t len = sizeof(addr);
+        if (::getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &len) != 0) {
+            return 0;
+        }
+        return ntohs(addr.sin_port);
+    }
+
+    inline socket_t accept_socket(socket_t fd) {
+        socket_t client = ::accept(fd, nullptr, nullptr);
+        if (client != invalid_socket) {
+            no_sigpipe(client);
+        }
+        return client;
+    }
+
+    inline bool wait_readable(socket_t fd, std::chrono::milliseconds timeout) {
+        pollfd pfd{ fd, POLLIN, 0 };
+        return ::poll(&pfd, 1, static_cast<int>(timeout.count())) > 0;
+    }
+
+    inline long send_some(socket_t fd, void const* data, size_t size) {
+        return ::send(fd, data, size, send_flags);
+    }
+
+    inline long recv_some(socket_t fd, void* data, size_t size) {
+        return ::recv(fd, data, size, 0);
+    }
+
+    // gather `count` slices into one sendmsg, like writev without
+    // SIGPIPE
+    inline long send_vectored(socket_t fd, IoSlice const* slices,
+                              size_t count) {
+        iovec iov[64];
+        size_t num = count < 64 ? count : 64;
+        for (size_t i = 0; i < num; ++i) {
+            iov[i].iov_base = const_cast<void*>(slices[i].data);
+            iov[i].iov_len = slices[i].size;
+        }
+
+        msghdr msg{};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = num;
+        return ::sendmsg(fd, &msg, send_flags);
+    }
+#else
+    constexpr bool has_socket = false;
+
+    inline void close_socket(socket_t) {
+        // Do Nothing
+    }
+
+    inline socket_t listen_local(uint16_t, int = 16) {
+        return invalid_socket;
+    }
+
+    inline uint16_t local_port(socket_t) {
+        return 0;
+    }
+
+    inline socket_t accept_socket(socket_t) {
+        return invalid_socket;
+    }
+
+    inline bool wait_readable(socket_t, std::chrono::milliseconds) {
+        return false;
+    }
+
+    inline long send_some(socket_t, void const*, size_t) {
+        return -1;
+    }
+
+    inline long recv_some(socket_t, void*, size_t) {
+        return -1;
+    }
+
+    inline void shutdown_socket(socket_t) {
+        // Do Nothing
+    }
+
+    inline socket_t listen_tcp(uint16_t, int = 16) {
+        return invalid_socket;
+    }
+
+    inline socket_t connect_tcp(std::string const&, uint16_t) {
+        return invalid_socket;
+    }
+
+    inline socket_t listen_unix(std::string const&, int = 16) {
+        return invalid_socket;
+    }
+
+    inline socket_t connect_unix(std::string const&) {
+        return invalid_socket;
+    }
+
+    inline bool socket_pair(socket_t (&)[2]) {
+        return false;
+    }
+
+    inline long send_vectored(socket_t, IoSlice const*, size_t) {
+        return -1;
+    }
+#endif
+
+    inline bool send_all(socket_t fd, void const* data, size_t size) {
+        auto ptr = static_cast<char const*>(data);
+        while (size > 0) {
+            long sent = send_some(fd, ptr, size);
+            if (sent <= 0) {
+                return false;
+            }
+            ptr += sent;
+            size -= static_cast<size_t>(sent);
+        }
+        return true;
+    }
+
+    // send every slice, advancing past partial writes
+    inline bool send_all_vectored(socket_t fd, std::vector<IoSlice> slices) {
+        size_t first = 0;
+        while (first < slices.size()) {
+            long sent =
+                send_vectored(fd, &slices[first], slices.size() - first);
+            if (sent <= 0) {
+                return false;
+            }
+
+            auto left = static_cast<size_t>(sent);
+            while (first < slices.size() && left >= slices[first].size) {
+                left -= slices[first].size;
+                first += 1;
+            }
+            if (left > 0) {
+                auto data = static_cast<char const*>(slices[first].data);
+                slices[first].data = data + left;
+                slices[first].size -= left;
+            }
+        }
+        return true;
+    }
+}  // namespace platform
+
+
+namespace platform {
+    // linux limits thread names to 15 characters, longer names are ignored
+    inline void set_thread_name(char const* name) {
+#if defined(__linux__)
+        pthread_setname_np(pthread_self(), name);
+#elif defined(__APPLE__)
+        pthread_setname_np(name);
+#else
+        (void)name;
+#endif
+    }
+
+    // cpu time consumed by the calling thread, zero if unsupported
+    inline std::chrono::nanoseconds thread_cpu_time() {
+#if defined(CLOCK_THREAD_CPUTIME_ID)
+        timespec ts;
+        if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0) {
+            return std::chrono::seconds(ts.tv_sec)
+                   + std::chrono::nanoseconds(ts.tv_nsec);
+        }
+#endif
+        return std::chrono::nanoseconds(0);
+    }
+
+    // spin loop hint, yields the core to a sibling hyperthread
+    inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__)
+        asm volatile("yield");
+#elif defined(_M_X64) || defined(_M_IX86)
+        _mm_pause();
+#endif
+    }
+}  // namespace platform
+
+
+enum class WorkerState { Idle, Running, Blocked };
+
+inline char const* to_string(WorkerState state) {
+    switch (state) {
+    case WorkerState::Idle:
+        return "idle";
+    case WorkerState::Running:
+        return "running";
+    case WorkerState::Blocked:
+        return "blocked";
+    }
+    return "unknown";
+}
+
+struct WorkerStatus {
+    using clock = std::chrono::steady_clock;
+
+    std::atomic<WorkerState> state;
+    std::atomic<char const*> label;
+    std::atomic<clock::rep> since;
+    std::atomic<size_t> executed;
+
+    WorkerStatus()
+        : state(WorkerState::Idle), label(nullptr), since(0), executed(0) {
+        // Do Nothing
+    }
+
+    void start(char const* task_label) {
+        label.store(task_label, std::memory_order_relaxed);
+        since.store(clock::now().time_since_epoch().count(),
+                    std::memory_order_relaxed);
+        state.store(WorkerState::Running, std::memory_order_release);
+    }
+
+    void finish() {
+        state.store(WorkerState::Idle, std::memory_order_release);
+        label.store(nullptr, std::memory_order_relaxed);
+        executed.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    static WorkerStatus*& current() {
+        thread_local WorkerStatus* status = nullptr;
+        return status;
+    }
+};
+
+struct ThreadRecord {
+    using clock = std::chrono::steady_clock;
+
+    std::string name;
+    bool worker = false;
+
+    std::atomic<void const*> object{ nullptr };
+    std::atomic<char const*> kind{ nullptr };
+    std::atomic<bool> idle{ false };
+    std::atomic<clock::rep> since{ 0 };
+};
+
+// Threads blocked on channels and wait groups, kept for the deadlock
+// watchdog. Pool workers always register, other threads register the
+// first time they use or block on a channel or wait group while
+// tracking is enabled, and count as running until they block.
+class BlockingRegistry {
+public:
+    static BlockingRegistry& Instance() {
+        // never destroyed, thread_local records may detach after exit
+        static BlockingRegistry* registry = new BlockingRegistry();
+        return *registry;
+    }
+
+    bool Enabled() const {
+        return enabled.load(std::memory_order_relaxed);
+    }
+
+    void Enable(bool enable) {
+        enabled.store(enable, std::memory_order_relaxed);
+    }
+
+    // Called on every operation which may wake a blocked thread, which
+    // registers the caller unless it is no `participant`, like the
+    // netpoller thread.
+    void Progress(bool participant = true) {
+        if (Enabled()) {
+            if (participant) {
+                Current();
+            }
+            epoch.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    size_t Epoch() const {
+        return epoch.load(std::memory_order_relaxed);
+    }
+
+    ThreadRecord& Current() {
+        thread_local Handle handle(*this);
+        return *handle.record;
+    }
+
+    void Describe(std::string name, bool worker) {
+        ThreadRecord& record = Current();
+
+        std::unique_lock lock(mutex);
+        record.name = std::move(name);
+        record.worker = worker;
+    }
+
+    void Name(void const* object, std::string name) {
+        std::unique_lock lock(mutex);
+        names[object] = std::move(name);
+    }
+
+    void Unname(void const* object) {
+        std::unique_lock lock(mutex);
+        names.erase(object);
+    }
+
+    template <typename F>
+    void ForEach(F&& func) {
+        std::unique_lock lock(mutex);
+        for (auto& record : records) {
+            func(record);
+        }
+    }
+
+    std::string NameOf(void const* object) {
+        std::unique_lock lock(mutex);
+        auto iter = names.find(object);
+        return iter != names.end() ? iter->second : std::string();
+    }
+
+private:
+    struct Handle {
+        BlockingRegistry& registry;
+        ThreadRecord* record;
+
+        Handle(BlockingRegistry& registry) : registry(registry) {
+            std::unique_lock lock(registry.mutex);
+            record = &registry.records.emplace_back();
+
+            std::ostringstream stream;
+            stream << "thread " << std::this_thread::get_id();
+            record->name = stream.str();
+        }
+
+        ~Handle() {
+            std::unique_lock lock(registry.mutex);
+            registry.records.remove_if(
+                [&](ThreadRecord const& elem) { return &elem == record; });
+        }
+    };
+
+    BlockingRegistry() : enabled(false), epoch(0) {
+        // Do Nothing
+    }
+
+    std::atomic<bool> enabled;
+    std::atomic<size_t> epoch;
+
+    std::mutex mutex;
+    std::list<ThreadRecord> records;
+    std::unordered_map<void const*, std::string> names;
+};
+
+// Marks the running pool worker of the current thread as blocked
+// while a channel or wait group parks it, and records the wait for
+// the deadlock watchdog. An `external` wait, on descriptors woken from
+// outside the process, is no deadlock, like netpoll waits of golang,
+// and the thread counts as running for the watchdog.
+class BlockingScope {
+public:
+    BlockingScope(void const* object, char const* kind, bool external = false)
+        : status(WorkerStatus::current()), record(nullptr) {
+        bool idle = false;
+        if (status != nullptr
+            && status->state.load(std::memory_order_relaxed)
+                   == WorkerState::Running) {
+            status->state.store(WorkerState::Blocked,
+                                std::memory_order_relaxed);
+            idle = false;
+        }
+        else {
+            idle = status != nullptr;
+            status = nullptr;
+        }
+
+        BlockingRegistry& registry = BlockingRegistry::Instance();
+        if (registry.Enabled() && external) {
+            registry.Current();
+        }
+        else if (registry.Enabled()) {
+            record = &registry.Current();
+            record->kind.store(kind, std::memory_order_relaxed);
+            record->idle.store(idle, std::memory_order_relaxed);
+            record->since.store(
+                ThreadRecord::clock::now().time_since_epoch().count(),
+                std::memory_order_relaxed);
+            record->object.store(object, std::memory_order_release);
+        }
+    }
+
+    ~BlockingScope() {
+        if (status != nullptr) {
+            status->state.store(WorkerState::Running,
+                                std::memory_order_relaxed);
+        }
+        if (record != nullptr) {
+            record->object.store(nullptr, std::memory_order_release);
+            BlockingRegistry::Instance().Progress();
+        }
+    }
+
+    BlockingScope(BlockingScope const&) = delete;
+    BlockingScope(BlockingScope&&) = delete;
+
+    BlockingScope& operator=(BlockingScope const&) = delete;
+    BlockingScope& operator=(BlockingScope&&) = delete;
+
+private:
+    WorkerStatus* status;
+    ThreadRecord* record;
+};
+
+
+// Phase word shared by Barrier and Phaser. Waiters remember the phase
+// they arrived in and wait for the word to move past it, the generalized
+// form of sense reversal, so the same word serves every phase. They spin
+// first, a short phase ends without a syscall, then park on a futex.
+class PhaseWord {
+public:
+    // on a single core the other parties only run when the waiter yields
+    PhaseWord(uint32_t phase, size_t spins)
+        : word(phase), waiters(0), spins(spins),
+          yield_every(std::thread::hardware_concurrency() > 1 ? 64 : 1) {
+        // Do Nothing
+    }
+
+    uint32_t Load() const {
+        return word.load(std::memory_order_acquire);
+    }
+
+    // block until a phase later than `phase` is published
+    void Await(uint32_t phase) {
+        for (size_t i = 0; i < spins; ++i) {
+            if (passed(word.load(std::memory_order_acquire), phase)) {
+                return;
+            }
+            if ((i + 1) % yield_every == 0) {
+                std::this_thread::yield();
+            }
+            else {
+                platform::cpu_relax();
+            }
+        }
+
+        BlockingScope scope(this, "barrier");
+        waiters.fetch_add(1);
+        for (uint32_t now = word.load(); !passed(now, phase);
+             now = word.load()) {
+            platform::futex_wait(word, now);
+        }
+        waiters.fetch_sub(1);
+    }
+
+    // release the waiters of every earlier phase
+    void Publish(uint32_t phase) {
+        word.store(phase);
+        BlockingRegistry::Instance().Progress();
+        if (waiters.load() > 0) {
+            platform::futex_wake(word);
+        }
+    }
+
+private:
+    // wraps around like the phase
+    static bool passed(uint32_t now, uint32_t phase) {
+        return static_cast<int32_t>(now - phase) > 0;
+    }
+
+    std::atomic<uint32_t> word;
+    std::atomic<uint32_t> waiters;
+    size_t spins;
+    size_t yield_every;
+};
+
+// Reusable barrier for a fixed number of parties. The last to arrive
+// runs the completion, then releases the others into the next phase.
+//
+//     Barrier barrier(num_workers, [&] { swap(current, next); });
+//     for (int step = 0; step < num_steps; ++step) {
+//         relax(current, next, part);
+//         barrier.ArriveAndWait();
+//     }
+class Barrier {
+public:
+    Barrier(size_t parties,
+            std::function<void()> completion = nullptr,
+            size_t spins = 4096)
+        : parties(parties), remaining(parties), phase(0, spins),
+          completion(std::move(completion)) {
+        // Do Nothing
+    }
+
+    Barrier(Barrier const&) = delete;
+    Barrier(Barrier&&) = delete;
+
+    Barrier& operator=(Barrier const&) = delete;
+    Barrier& operator=(Barrier&&) = delete;
+
+    // true for the party which ran the completion
+    bool ArriveAndWait() {
+        uint32_t current = phase.Load();
+        if (remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            if (completion) {
+                completion();
+            }
+
+            // reset before the release, early arrivals of the next
+            // phase count down from the full number
+            remaining.store(parties, std::memory_order_relaxed);
+            phase.Publish(current + 1);
+            return true;
+        }
+
+        phase.Await(current);
+        return false;
+    }
+
+    // phases completed so far
+    uint32_t Phase() const {
+        return phase.Load();
+    }
+
+    size_t Parties() const {
+        return parties;
+    }
+
+private:
+    size_t const parties;
+    std::atomic<size_t> remaining;
+    PhaseWord phase;
+    std::function<void()> completion;
+};
+
+// Barrier whose parties register and deregister at any time, like the
+// Phaser of java. Registered parties, unarrived parties and the phase
+// share one atomic word, so an arrival never races a registration. While
+// the last arrival runs the completion, registrations and arrivals for
+// the next phase wait for it.
+//
+// At most 32767 parties may be registered at once.
+class Phaser {
+public:
+    // completion receives the phase it completes
+    Phaser(size_t parties = 0,
+           std::function<void(uint32_t)> completion = nullptr,
+           size_t spins = 4096)
+        : state(pack(0, parties, parties)), epoch(0, spins),
+          completion(std::move(completion)) {
+        // Do Nothing
+    }
+
+    Phaser(Phaser const&) = delete;
+    Phaser(Phaser&&) = delete;
+
+    Phaser& operator=(Phaser const&) = delete;
+    Phaser& operator=(Phaser&&) = delete;
+
+    // Add `count` parties to the current phase, which they must arrive
+    // at, returns that phase.
+    uint32_t Register(size_t count = 1) {
+        uint64_t current = state.load(std::memory_order_acquire);
+        while (true) {
+            if (current & advancing) {
+                epoch.Await(phase_of(current));
+                current = state.load(std::memory_order_acquire);
+                continue;
+            }
+
+            uint64_t next = current + count * (one_party + 1);
+            if (state.compare_exchange_weak(
+                    current, next, std::memory_order_acq_rel)) {
+                return phase_of(current);
+            }
+        }
+    }
+
+    // arrive without waiting, returns the phase arrived at
+    uint32_t Arrive() {
+        return arrive(false);
+    }
+
+    // arrive and leave, later phases no longer wait for the party
+    uint32_t ArriveAndDeregister() {
+        return arrive(true);
+    }
+
+    // arrive and wait for the other parties, returns the phase arrived at
+    uint32_t ArriveAndAwait() {
+        uint32_t phase = arrive(false);
+        AwaitAdvance(phase);
+        return phase;
+    }
+
+    // wait until `phase` is completed, immediately for past phases
+    void AwaitAdvance(uint32_t phase) {
+        epoch.Await(phase);
+    }
+
+    uint32_t Phase() const {
+        return phase_of(state.load(std::memory_order_acquire));
+    }
+
+    size_t Registered() const {
+        return parties_of(state.load(std::memory_order_acquire));
+    }
+
+    size_t Unarrived() const {
+        return unarrived_of(state.load(std::memory_order_acquire));
+    }
+
+private:
+    // phase in the high half, then the advancing bit, 15 bits of
+    // registered and 16 bits of unarrived parties
+    static constexpr uint64_t advancing = uint64_t(1) << 31;
+    static constexpr uint64_t one_party = uint64_t(1) << 16;
+
+    static constexpr uint64_t pack(uint32_t phase,
+                                   size_t parties,
+                                   size_t unarrived) {
+        return (uint64_t(phase) << 32) | (uint64_t(parties) << 16)
+               | uint64_t(unarrived);
+    }
+
+    static constexpr uint32_t phase_of(uint64_t state) {
+        return static_cast<uint32_t>(state >> 32);
+    }
+
+    static constexpr size_t parties_of(uint64_t state) {
+        return static_cast<size_t>((state >> 16) & 0x7fff);
+    }
+
+    static constexpr size_t unarrived_of(uint64_t state) {
+        return static_cast<size_t>(state & 0xffff);
+    }
+
+    uint32_t arrive(bool deregister) {
+        uint64_t current = state.load(std::memory_order_acquire);
+        while (true) {
+            uint32_t phase = phase_of(current);
+            if (current & advancing) {
+                epoch.Await(phase);
+                current = state.load(std::memory_order_acquire);
+                continue;
+            }
+
+            // no party is registered
+            size_t unarrived = unarrived_of(current);
+            if (unarrived == 0) {
+                return phase;
+            }
+
+            size_t parties = parties_of(current) - (deregister ? 1 : 0);
+            uint64_t next = current - 1 - (deregister ? one_party : 0);
+            if (unarrived == 1) {
+                next = pack(phase, parties, 0) | advancing;
+            }
+            if (!state.compare_exchange_weak(
+                    current, next, std::memory_order_acq_rel)) {
+                continue;
+            }
+
+            if (unarrived == 1) {
+                advance(phase, parties);
+            }
+            return phase;
+        }
+    }
+
+    // the state is frozen by the advancing bit meanwhile
+    void advance(uint32_t phase, size_t parties) {
+        if (completion) {
+            completion(phase);
+        }
+        state.store(pack(phase + 1, parties, parties),
+                    std::memory_order_release);
+        epoch.Publish(phase + 1);
+    }
+
+    std::atomic<uint64_t> state;
+    PhaseWord epoch;
+    std::function<void(uint32_t)> completion;
+};
+
+
+constexpr size_t next_power_of_two(size_t size) {
+    size_t power = 1;
+    while (power < size) {
+        power <<= 1;
+    }
+    return power;
+}
+
+template <typename T>
+struct RingSlot {
+    alignas(T) unsigned char data[sizeof(T)];
+};
+
+// Producers claim a slot then commit or abandon it, consumers borrow
+// a committed slot then release it.
+enum class SlotState : unsigned char {
+    Free,
+    Claimed,
+    Committed,
+    Abandoned,
+    Borrowed
+};
+
+// Heap allocated slots, capacity given at runtime.
+template <typename T>
+class HeapSlots {
+public:
+    HeapSlots() : HeapSlots(1) {
+        // Do Nothing
+    }
+
+    HeapSlots(size_t capacity)
+        : capacity(capacity), mask(next_power_of_two(capacity) - 1),
+          slots(new RingSlot<T>[mask + 1]),
+          states(new SlotState[mask + 1]()) {
+        // Do Nothing
+    }
+
+    RingSlot<T>& operator[](size_t idx) {
+        return slots[idx];
+    }
+
+    RingSlot<T> const& operator[](size_t idx) const {
+        return slots[idx];
+    }
+
+    SlotState& state(size_t idx) {
+        return states[idx];
+    }
+
+    size_t max_size() const {
+        return capacity;
+    }
+
+    size_t capacity;
+    size_t mask;
+
+private:
+    std::unique_ptr<RingSlot<T>[]> slots;
+    std::unique_ptr<SlotState[]> states;
+};
+
+// Inline slots, capacity and mask are compile-time constants.
+template <typename T, size_t N>
+class InlineSlots {
+public:
+    static_assert(N > 0, "InlineSlots capacity must be positive");
+
+    static constexpr size_t capacity = N;
+    static constexpr size_t mask = next_power_of_two(N) - 1;
+
+    RingSlot<T>& operator[](size_t idx) {
+        return slots[idx];
+    }
+
+    RingSlot<T> const& operator[](size_t idx) const {
+        return slots[idx];
+    }
+
+    SlotState& state(size_t idx) {
+        return states[idx];
+    }
+
+    constexpr size_t max_size() const {
+        return N;
+    }
+
+private:
+    RingSlot<T> slots[mask + 1];
+    SlotState states[mask + 1] = {};
+};
+
+// Slots are raw storage, elements are constructed in place by
+// emplace_back and destroyed by pop_front. Storage is rounded up to
+// a power of two so indices wrap with a mask, while max_size keeps
+// the requested capacity.
+//
+// For zero-copy transfer a slot may also be claimed, constructed in
+// place without holding any lock and committed, or borrowed, read in
+// place and released. Slots are published in claim order and freed in
+// borrow order, so the cursors advance over a slot only once every
+// earlier slot has been committed or released:
+//
+//     head ... borrow ... tail ... claim
+//     [borrowed][ readable ][ claimed ][ free ]
+template <typename T, typename Slots>
+class BasicRingBuffer {
+public:
+    using value_type = T;
+
+    template <typename... Args>
+    BasicRingBuffer(Args&&... args) : slots(std::forward<Args>(args)...) {
+        // Do Nothing
+    }
+
+    ~BasicRingBuffer() {
+        if constexpr (!std::is_trivially_destructible_v<T>) {
+            for (size_t i = 0, idx = ptr_head; i < num_used;
+                 ++i, idx = (idx + 1) & slots.mask) {
+                if (slots.state(idx) == SlotState::Committed) {
+                    at(idx)->~T();
+                }
+            }
+        }
+    }
+
+    BasicRingBuffer(BasicRingBuffer const&) = delete;
+    BasicRingBuffer(BasicRingBuffer&&) = delete;
+
+    BasicRingBuffer& operator=(BasicRingBuffer const&) = delete;
+    BasicRingBuffer& operator=(BasicRingBuffer&&) = delete;
+
+    template <typename... U>
+    void emplace_back(U&&... args) {
+        size_t idx = claim();
+        try {
+            new (storage(idx)) T(std::forward<U>(args)...);
+        }
+        catch (...) {
+            // still the latest claim, take it back
+            slots.state(idx) = SlotState::Free;
+            num_used -= 1;
+            num_pending -= 1;
+            ptr_claim = idx;
+            throw;
+        }
+        commit(idx);
+    }
+
+    void push_back(T const& value) {
+        emplace_back(value);
+    }
+
+    void push_back(T&& value) {
+        emplace_back(std::move(value));
+    }
+
+    void pop_front() {
+        release(borrow());
+    }
+
+    // Copy up to `count` elements while space remains, returns the number
+    // copied. Trivially copyable elements are copied with memcpy in at most
+    // two contiguous segments.
+    size_t push_bulk(T const* src, size_t count) {
+        count = std::min(count, max_size() - num_used);
+        if constexpr (std::is_trivially_copyable_v<T>) {
+            size_t first = std::min(count, (slots.mask + 1) - ptr_claim);
+            std::memcpy(slots[ptr_claim].data, src, first * sizeof(T));
+            std::memcpy(
+                slots[0].data, src + first, (count - first) * sizeof(T));
+
+            mark(ptr_claim, count, SlotState::Committed);
+            num_used += count;
+            num_pending += count;
+            ptr_claim = (ptr_claim + count) & slots.mask;
+            publish();
+        }
+        else {
+            for (size_t i = 0; i < count; ++i) {
+                emplace_back(src[i]);
+            }
+        }
+        return count;
+    }
+
+    // Move up to `count` elements into `dst`, returns the number moved.
+    size_t pop_bulk(T* dst, size_t count) {
+        count = std::min(count, num_data);
+        if constexpr (std::is_trivially_copyable_v<T>) {
+            // abandoned slots break the readable run into pieces
+            if (num_ready == num_data) {
+                size_t first = std::min(count, (slots.mask + 1) - ptr_borrow);
+                std::memcpy(dst, slots[ptr_borrow].data, first * sizeof(T));
+                std::memcpy(
+                    dst + first, slots[0].data, (count - first) * sizeof(T));
+
+                mark(ptr_borrow, count, SlotState::Free);
+                num_data -= count;
+                num_ready -= count;
+                ptr_borrow = (ptr_borrow + count) & slots.mask;
+                reclaim();
+                return count;
+            }
+        }
+
+        for (size_t i = 0; i < count; ++i) {
+            dst[i] = std::move(front());
+            pop_front();
+        }
+        return count;
+    }
+
+    // Reserve the next slot for construction in place, requires !full().
+    size_t claim() {
+        size_t idx = ptr_claim;
+        slots.state(idx) = SlotState::Claimed;
+
+        num_used += 1;
+        num_pending += 1;
+        ptr_claim = (ptr_claim + 1) & slots.mask;
+        return idx;
+    }
+
+    // Publish a claimed slot holding a constructed element.
+    void commit(size_t idx) {
+        slots.state(idx) = SlotState::Committed;
+        publish();
+    }
+
+    // Give a claimed slot back without an element, consumers skip it.
+    void abandon(size_t idx) {
+        slots.state(idx) = SlotState::Abandoned;
+        publish();
+    }
+
+    // Take the front element for reading in place, requires size() > 0.
+    size_t borrow() {
+        size_t idx = ptr_borrow;
+        slots.state(idx) = SlotState::Borrowed;
+
+        num_data -= 1;
+        num_ready -= 1;
+        ptr_borrow = (ptr_borrow + 1) & slots.mask;
+        skip_abandoned();
+        return idx;
+    }
+
+    // Destroy a borrowed element and free its slot.
+    void release(size_t idx) {
+        at(idx)->~T();
+        slots.state(idx) = SlotState::Free;
+        reclaim();
+    }
+
+    // Slot memory stays put, claimed and borrowed slots may be accessed
+    // without synchronization by their owner.
+    void* storage(size_t idx) {
+        return slots[idx].data;
+    }
+
+    T* at(size_t idx) {
+        return std::launder(reinterpret_cast<T*>(slots[idx].data));
+    }
+
+    T& front() {
+        return *at(ptr_borrow);
+    }
+
+    T const& front() const {
+        return *std::launder(
+            reinterpret_cast<T const*>(slots[ptr_borrow].data));
+    }
+
+    // readable elements
+    size_t size() const {
+        return num_data;
+    }
+
+    // every slot is readable, claimed or borrowed
+    bool full() const {
+        return num_used >= max_size();
+    }
+
+    size_t max_size() const {
+        return slots.max_size();
+    }
+
+private:
+    void mark(size_t idx, size_t count, SlotState state) {
+        size_t first = std::min(count, (slots.mask + 1) - idx);
+        std::fill_n(&slots.state(idx), first, state);
+        std::fill_n(&slots.state(0), count - first, state);
+    }
+
+    // advance tail over the committed or abandoned prefix of claims
+    void publish() {
+        while (num_pending > 0) {
+            SlotState state = slots.state(ptr_tail);
+            if (state == SlotState::Claimed) {
+                break;
+            }
+
+            num_data += state == SlotState::Committed ? 1 : 0;
+            num_ready += 1;
+            num_pending -= 1;
+            ptr_tail = (ptr_tail + 1) & slots.mask;
+        }
+        skip_abandoned();
+    }
+
+    // keep an element at the borrow cursor whenever one is readable
+    void skip_abandoned() {
+        while (num_ready > 0
+               && slots.state(ptr_borrow) == SlotState::Abandoned) {
+            slots.state(ptr_borrow) = SlotState::Free;
+
+            num_ready -= 1;
+            ptr_borrow = (ptr_borrow + 1) & slots.mask;
+        }
+        reclaim();
+    }
+
+    // advance head over the released prefix of borrows
+    void reclaim() {
+        while (num_used > 0 && slots.state(ptr_head) == SlotState::Free) {
+            num_used -= 1;
+            ptr_head = (ptr_head + 1) & slots.mask;
+        }
+    }
+
+    Slots slots;
+
+    size_t num_data = 0;     // committed in [borrow, tail)
+    size_t num_ready = 0;    // [borrow, tail), with abandoned slots
+    size_t num_pending = 0;  // [tail, claim)
+    size_t num_used = 0;     // [head, claim)
+
+    size_t ptr_head = 0;
+    size_t ptr_borrow = 0;
+    size_t ptr_tail = 0;
+    size_t ptr_claim = 0;
+};
+
+template <typename T, typename = void>  // for stl compatiblity
+using RingBuffer = BasicRingBuffer<T, HeapSlots<T>>;
+
+template <typename T, size_t N>
+using StaticRingBuffer = BasicRingBuffer<T, InlineSlots<T, N>>;
+
+
+// Length prefixed variable size records stored contiguously, capacity
+// is bounded in bytes. A record which does not fit before the end of
+// the storage is preceded by an abandoned padding record and starts
+// again at offset zero. Records and their payloads are 8 byte aligned.
+//
+// Like BasicRingBuffer, records are claimed, constructed in place and
+// committed, then borrowed, read in place and released. Cursors are
+// monotonic byte positions, storage offsets are positions masked by
+// the power of two storage size.
+class ByteRing {
+public:
+    struct Header {
+        uint32_t length;
+        SlotState state;
+    };
+
+    static constexpr size_t header_size = sizeof(Header);
+    static_assert(header_size == 8, "record header must be 8 bytes");
+
+    ByteRing(size_t capacity)
+        : capacity(capacity), mask(next_power_of_two(align(capacity)) - 1),
+          headers(new Header[(mask + 1) / header_size]) {
+        // Do Nothing
+    }
+
+    ByteRing(ByteRing const&) = delete;
+    ByteRing(ByteRing&&) = delete;
+
+    ByteRing& operator=(ByteRing const&) = delete;
+    ByteRing& operator=(ByteRing&&) = delete;
+
+    static constexpr size_t align(size_t size) {
+        return (size + header_size - 1) & ~(header_size - 1);
+    }
+
+    // bytes a record of `length` payload bytes occupies
+    static constexpr size_t record_size(size_t length) {
+        return header_size + align(length);
+    }
+
+    // largest payload which fits into an empty ring
+    size_t max_length() const {
+        size_t bound = capacity & ~(header_size - 1);
+        return bound > header_size ? bound - header_size : 0;
+    }
+
+    // whether a record of `length` payload bytes can be claimed now
+    bool fits(size_t length) const {
+        size_t need = record_size(length);
+        if (pos_claim == pos_head) {
+            return need <= capacity;
+        }
+
+        size_t contiguous = (mask + 1) - (pos_claim & mask);
+        size_t padding = contiguous < need ? contiguous : 0;
+        return used() + padding + need <= capacity;
+    }
+
+    // Reserve a record, requires fits(length), returns its position.
+    uint64_t claim(size_t length) {
+        size_t need = record_size(length);
+        size_t contiguous = (mask + 1) - (pos_claim & mask);
+        if (contiguous < need) {
+            if (pos_claim == pos_head) {
+                // nothing in flight, jump to the start of the storage
+                pos_claim += contiguous;
+                pos_tail = pos_borrow = pos_head = pos_claim;
+            }
+            else {
+                *header(pos_claim) = Header{
+                    static_cast<uint32_t>(contiguous - header_size),
+                    SlotState::Abandoned
+                };
+                pos_claim += contiguous;
+            }
+        }
+
+        uint64_t pos = pos_claim;
+        *header(pos) =
+            Header{ static_cast<uint32_t>(length), SlotState::Claimed };
+        pos_claim += need;
+        return pos;
+    }
+
+    void commit(uint64_t pos) {
+        header(pos)->state = SlotState::Committed;
+        publish();
+    }
+
+    void abandon(uint64_t pos) {
+        header(pos)->state = SlotState::Abandoned;
+        publish();
+    }
+
+    // Take the front record, requires size() > 0.
+    uint64_t borrow() {
+        uint64_t pos = pos_borrow;
+        header(pos)->state = SlotState::Borrowed;
+
+        num_records -= 1;
+        pos_borrow += record_size(header(pos)->length);
+        skip_abandoned();
+        return pos;
+    }
+
+    void release(uint64_t pos) {
+        header(pos)->state = SlotState::Free;
+        reclaim();
+    }
+
+    // record memory stays put, owners access it without synchronization
+    unsigned char* data(uint64_t pos) {
+        return reinterpret_cast<unsigned char*>(header(pos) + 1);
+    }
+
+    size_t length(uint64_t pos) {
+        return header(pos)->length;
+    }
+
+    // readable records
+    size_t size() const {
+        return num_records;
+    }
+
+    // bytes held by readable, claimed and borrowed records and padding
+    size_t used() const {
+        return static_cast<size_t>(pos_claim - pos_head);
+    }
+
+    size_t max_size() const {
+        return capacity;
+    }
+
+private:
+    Header* header(uint64_t pos) {
+        return headers.get() + (pos & mask) / header_size;
+    }
+
+    void publish() {
+        while (pos_tail < pos_claim) {
+            Header* head = header(pos_tail);
+            if (head->state == SlotState::Claimed) {
+                break;
+            }
+
+            num_records += head->state == SlotState::Committed ? 1 : 0;
+            pos_tail += record_size(head->length);
+        }
+        skip_abandoned();
+    }
+
+    void skip_abandoned() {
+        while (pos_borrow < pos_tail) {
+            Header* head = header(pos_borrow);
+            if (head->state != SlotState::Abandoned) {
+                break;
+            }
+
+            head->state = SlotState::Free;
+            pos_borrow += record_size(head->length);
+        }
+        reclaim();
+    }
+
+    void reclaim() {
+        while (pos_head < pos_borrow) {
+            Header* head = header(pos_head);
+            if (head->state != SlotState::Free) {
+                break;
+            }
+            pos_head += record_size(head->length);
+        }
+    }
+
+    size_t capacity;
+    size_t mask;
+    std::unique_ptr<Header[]> headers;
+
+    size_t num_records = 0;
+
+    uint64_t pos_head = 0;
+    uint64_t pos_borrow = 0;
+    uint64_t pos_tail = 0;
+    uint64_t pos_claim = 0;
+};
+
+
+// Process wide budget of bytes buffered by governed channels. Once the
+// total crosses the high water mark, producers of channels holding at
+// least their fair share, low water mark / number of channels, are
+// parked until the total falls to the low water mark. The largest
+// channels are throttled first, while the smaller ones keep flowing
+// and together stay under the low water mark.
+//
+// Producers are parked before they take the channel lock, and channels
+// charge the governor under their own lock, so the governor never
+// waits on a channel.
+class MemoryGovernor {
+public:
+    struct Account {
+        MemoryGovernor* governor{ nullptr };
+        std::atomic<size_t> bytes{ 0 };
+        std::atomic<bool> closed{ false };
+    };
+
+    MemoryGovernor()
+        : MemoryGovernor(std::numeric_limits<size_t>::max(),
+                         std::numeric_limits<size_t>::max()) {
+        // Do Nothing
+    }
+
+    MemoryGovernor(size_t high, size_t low)
+        : high(high), low(std::min(low, high)), total(0), throttling(false),
+          num_accounts(0), num_parks(0) {
+        // Do Nothing
+    }
+
+    MemoryGovernor(MemoryGovernor const&) = delete;
+    MemoryGovernor(MemoryGovernor&&) = delete;
+
+    MemoryGovernor& operator=(MemoryGovernor const&) = delete;
+    MemoryGovernor& operator=(MemoryGovernor&&) = delete;
+
+    // unlimited until SetLimits
+    static MemoryGovernor& Global() {
+        // never destroyed, static channels may leave after exit
+        static MemoryGovernor* governor = new MemoryGovernor();
+        return *governor;
+    }
+
+    void SetLimits(size_t high, size_t low) {
+        {
+            std::unique_lock lock(mutex);
+            this->high.store(high, std::memory_order_relaxed);
+            this->low = std::min(low, high);
+            update();
+        }
+        cond.notify_all();
+    }
+
+    Account* Join() {
+        std::unique_lock lock(mutex);
+        num_accounts.fetch_add(1, std::memory_order_relaxed);
+        Account& account = accounts.emplace_back();
+        account.governor = this;
+        return &account;
+    }
+
+    void Leave(Account* account) {
+        auto bytes = static_cast<std::ptrdiff_t>(account->bytes.load());
+        Charge(*account, -bytes);
+        {
+            std::unique_lock lock(mutex);
+            num_accounts.fetch_sub(1, std::memory_order_relaxed);
+            accounts.remove_if(
+                [&](Account const& elem) { return &elem == account; });
+            update();
+        }
+        cond.notify_all();
+    }
+
+    // called by channels under their lock whenever buffered bytes change
+    void Charge(Account& account, std::ptrdiff_t delta) {
+        if (delta == 0) {
+            return;
+        }
+
+        auto diff = static_cast<size_t>(delta);
+        account.bytes.fetch_add(diff, std::memory_order_relaxed);
+        size_t now = total.fetch_add(diff, std::memory_order_relaxed) + diff;
+
+        if (throttling.load(std::memory_order_relaxed)) {
+            if (delta < 0) {
+                {
+                    std::unique_lock lock(mutex);
+                    update();
+                }
+                cond.notify_all();
+            }
+        }
+        else if (now > high.load(std::memory_order_relaxed)) {
+            std::unique_lock lock(mutex);
+            update();
+        }
+    }
+
+    // called by producers before they take the channel lock
+    void Admit(Account& account) {
+        if (!throttling.load(std::memory_order_relaxed)) {
+            return;
+        }
+
+        std::unique_lock lock(mutex);
+        if (!throttled(account)) {
+            return;
+        }
+
+        BlockingScope scope(this, "memory");
+        num_parks.fetch_add(1, std::memory_order_relaxed);
+        cond.wait(lock, [&] { return !throttled(account); });
+    }
+
+    // wake producers of a closed channel
+    void Wake() {
+        {
+            std::unique_lock lock(mutex);
+        }
+        cond.notify_all();
+    }
+
+    size_t Bytes() const {
+        return total.load(std::memory_order_relaxed);
+    }
+
+    bool Throttling() const {
+        return throttling.load(std::memory_order_relaxed);
+    }
+
+    size_t Parks() const {
+        return num_parks.load(std::memory_order_relaxed);
+    }
+
+private:
+    // hysteresis between the water marks, called under the mutex
+    void update() {
+        size_t now = total.load(std::memory_order_relaxed);
+        if (now > high.load(std::memory_order_relaxed)) {
+            throttling.store(true, std::memory_order_relaxed);
+        }
+        else if (now <= low) {
+            throttling.store(false, std::memory_order_relaxed);
+        }
+        BlockingRegistry::Instance().Progress();
+    }
+
+    bool throttled(Account const& account) const {
+        size_t share = low / std::max<size_t>(num_accounts.load(), 1);
+        return throttling.load(std::memory_order_relaxed)
+               && !account.closed.load(std::memory_order_relaxed)
+               && account.bytes.load(std::memory_order_relaxed) >= share;
+    }
+
+    std::atomic<size_t> high;
+    size_t low;
+
+    std::atomic<size_t> total;
+    std::atomic<bool> throttling;
+    std::atomic<size_t> num_accounts;
+    std::atomic<size_t> num_parks;
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::list<Account> accounts;
+};
+
+
+// Bounds a container by the bytes of its elements, measured by a user
+// supplied size function. The container is full once the budget is
+// reached, so the last accepted element may overshoot it, and a single
+// element larger than the whole budget still passes an empty channel.
+template <typename Cont>
+class Budgeted {
+public:
+    using value_type = typename Cont::value_type;
+    using Sizer = std::function<size_t(value_type const&)>;
+
+    template <typename... Args>
+    Budgeted(size_t budget, Sizer sizer, Args&&... args)
+        : budget(budget), num_bytes(0), sizer(std::move(sizer)),
+          buffer(std::forward<Args>(args)...), front_measured(false),
+          front_bytes(0) {
+        // Do Nothing
+    }
+
+    template <typename... U>
+    void emplace_back(U&&... args) {
+        push_back(value_type(std::forward<U>(args)...));
+    }
+
+    void push_back(value_type const& value) {
+        num_bytes += sizer(value);
+        buffer.push_back(value);
+    }
+
+    void push_back(value_type&& value) {
+        num_bytes += sizer(value);
+        buffer.push_back(std::move(value));
+    }
+
+    void pop_front() {
+        measure_front();
+        num_bytes -= front_bytes;
+        front_measured = false;
+        buffer.pop_front();
+    }
+
+    // measured here, callers move the front out before pop_front
+    value_type& front() {
+        measure_front();
+        return buffer.front();
+    }
+
+    size_t size() const {
+        return buffer.size();
+    }
+
+    size_t max_size() const {
+        return buffer.max_size();
+    }
+
+    bool full() const {
+        return num_bytes >= budget || buffer.size() >= buffer.max_size();
+    }
+
+    size_t bytes() const {
+        return num_bytes;
+    }
+
+    size_t max_bytes() const {
+        return budget;
+    }
+
+private:
+    void measure_front() {
+        if (!front_measured) {
+            front_bytes = sizer(buffer.front());
+            front_measured = true;
+        }
+    }
+
+    size_t budget;
+    size_t num_bytes;
+    Sizer sizer;
+    Cont buffer;
+
+    bool front_measured;
+    size_t front_bytes;
+};
+
+
+// Keeps only the latest value per key. A send to a pending key
+// overwrites its value in place, keys are popped in the order they
+// first became pending. Size is the number of pending keys, a full
+// buffer still takes values of pending keys.
+template <typename K, typename V, typename Hash = std::hash<K>>
+class Conflating {
+public:
+    using value_type = std::pair<K, V>;
+    using entry_type = std::pair<K const, V>;
+
+    Conflating() : Conflating(std::numeric_limits<size_t>::max()) {
+        // Do Nothing
+    }
+
+    Conflating(size_t max_keys) : max_keys(max_keys), num_conflated(0) {
+        // Do Nothing
+    }
+
+    template <typename... U>
+    void emplace_back(U&&... args) {
+        push_back(value_type(std::forward<U>(args)...));
+    }
+
+    void push_back(value_type const& value) {
+        push_back(value_type(value));
+    }
+
+    void push_back(value_type&& value) {
+        auto [iter, inserted] =
+            values.try_emplace(std::move(value.first), std::move(value.second));
+        if (inserted) {
+            order.push_back(&*iter);
+        }
+        else {
+            iter->second = std::move(value.second);
+            num_conflated += 1;
+        }
+    }
+
+    void pop_front() {
+        values.erase(order.front()->first);
+        order.pop_front();
+    }
+
+    // key stays intact when the entry is moved out, so pop_front still
+    // finds it
+    entry_type& front() {
+        return *order.front();
+    }
+
+    size_t push_bulk(value_type const* src, size_t count) {
+        size_t num = 0;
+        for (; num < count && (size() < max_size() || pending(src[num]));
+             ++num) {
+            push_back(src[num]);
+        }
+        return num;
+    }
+
+    // drains up to `count` pending keys in one batch
+    size_t pop_bulk(value_type* dst, size_t count) {
+        size_t num = 0;
+        for (; num < count && !order.empty(); ++num) {
+            dst[num] = std::move(front());
+            pop_front();
+        }
+        return num;
+    }
+
+    // whether the key of `value` is pending, its value is replaced
+    bool pending(value_type const& value) const {
+        return values.find(value.first) != values.end();
+    }
+
+    size_t size() const {
+        return order.size();
+    }
+
+    size_t max_size() const {
+        return max_keys;
+    }
+
+    // values overwritten before being popped
+    size_t conflated() const {
+        return num_conflated;
+    }
+
+private:
+    size_t max_keys;
+    size_t num_conflated;
+
+    std::unordered_map<K, V, Hash> values;
+    std::deque<entry_type*> order;
+};
+
+
+// Codec of trivially copyable messages, a codec serializes messages to
+// bytes for channels backed by files or sockets and reads them back.
+template <typename T>
+struct TrivialCodec {
+    static_assert(std::is_trivially_copyable_v<T>,
+                  "TrivialCodec requires trivially copyable messages");
+
+    size_t size(T const&) const {
+        return sizeof(T);
+    }
+
+    void encode(T const& value, unsigned char* dst) const {
+        std::memcpy(dst, &value, sizeof(T));
+    }
+
+    T decode(unsigned char const* src, size_t) const {
+        T value;
+        std::memcpy(&value, src, sizeof(T));
+        return value;
+    }
+};
+
+
+// unique across channels and processes sharing `directory`
+inline std::string spill_path(std::string const& directory) {
+    static std::atomic<size_t> num_files{ 0 };
+    return directory + "/spill-" + std::to_string(platform::process_id())
+           + '-' + std::to_string(num_files.fetch_add(1)) + ".seg";
+}
+
+// Unbounded container which keeps at most `threshold` messages in
+// memory. Beyond that, messages are encoded into memory mapped segment
+// files under `directory` and decoded back in order as consumers catch
+// up. Only the segments being written and read stay mapped, and drained
+// segments are deleted. If a segment can not be created, spilled
+// messages are read back and the container keeps growing in memory, so
+// no message is lost.
+//
+// Spilling and reading back happen under the channel lock, they only
+// slow down a channel which is already falling behind.
+template <typename T, typename Codec = TrivialCodec<T>>
+class Spilling {
+public:
+    using value_type = T;
+
+    Spilling(std::string directory,
+             size_t threshold,
+             Codec codec = Codec(),
+             size_t segment_size = 64 << 20)
+        : directory(std::move(directory)),
+          threshold(std::max<size_t>(threshold, 1)),
+          segment_size(segment_size), codec(std::move(codec)),
+          num_spilled(0), num_segments(0) {
+        // Do Nothing
+    }
+
+    ~Spilling() {
+        for (auto& segment : segments) {
+            segment.file.close();
+            platform::remove_file(segment.path);
+        }
+    }
+
+    Spilling(Spilling const&) = delete;
+    Spilling(Spilling&&) = delete;
+
+    Spilling& operator=(Spilling const&) = delete;
+    Spilling& operator=(Spilling&&) = delete;
+
+    template <typename... U>
+    void emplace_back(U&&... args) {
+        if (num_spilled == 0 && memory.size() < threshold) {
+            memory.emplace_back(std::forward<U>(args)...);
+        }
+        else {
+            push_back(T(std::forward<U>(args)...));
+        }
+    }
+
+    void push_back(T const& value) {
+        if ((num_spilled == 0 && memory.size() < threshold) || !spill(value)) {
+            memory.push_back(value);
+        }
+    }
+
+    void push_back(T&& value) {
+        if ((num_spilled == 0 && memory.size() < threshold) || !spill(value)) {
+            memory.push_back(std::move(value));
+        }
+    }
+
+    void pop_front() {
+        memory.pop_front();
+        refill();
+    }
+
+    T& front() {
+        return memory.front();
+    }
+
+    T const& front() const {
+        return memory.front();
+    }
+
+    size_t size() const {
+        return memory.size() + num_spilled;
+    }
+
+    size_t max_size() const {
+        return memory.max_size();
+    }
+
+    // in memory, as charged to a MemoryGovernor, spilled messages cost
+    // none
+    size_t bytes() const {
+        return memory.size() * sizeof(T);
+    }
+
+    // messages on disk
+    size_t spilled() const {
+        return num_spilled;
+    }
+
+    // segment files created so far
+    size_t segments_created() const {
+        return num_segments;
+    }
+
+private:
+    struct Segment {
+        std::string path;
+        platform::MappedFile file;
+
+        size_t written = 0;
+        size_t read = 0;
+        size_t count = 0;
+        size_t consumed = 0;
+    };
+
+    static constexpr size_t prefix = sizeof(uint32_t);
+
+    // append to the last segment, false if no segment could be created
+    bool spill(T const& value) {
+        size_t length = codec.size(value);
+        size_t need = prefix + length;
+
+        if (segments.empty() || !segments.back().file.mapped()
+            || segments.back().written + need
+                   > segments.back().file.size()) {
+            if (!segments.empty()) {
+                segments.back().file.close();
+            }
+
+            Segment& segment = segments.emplace_back();
+            segment.path = spill_path(directory);
+            if (!segment.file.create(segment.path,
+                                     std::max(segment_size, need))) {
+                platform::remove_file(segment.path);
+                segments.pop_back();
+
+                unspill();
+                return false;
+            }
+            num_segments += 1;
+        }
+
+        Segment& segment = segments.back();
+        unsigned char* dst = segment.file.data() + segment.written;
+
+        auto header = static_cast<uint32_t>(length);
+        std::memcpy(dst, &header, prefix);
+        codec.encode(value, dst + prefix);
+
+        segment.written += need;
+        segment.count += 1;
+        num_spilled += 1;
+        return true;
+    }
+
+    // read back spilled messages while memory is below the threshold
+    void refill() {
+        while (memory.size() < threshold && read_one()) {
+            // Do Nothing
+        }
+    }
+
+    // read back every spilled message
+    void unspill() {
+        while (read_one()) {
+            // Do Nothing
+        }
+    }
+
+    bool read_one() {
+        if (num_spilled == 0) {
+            return false;
+        }
+
+        Segment& segment = segments.front();
+        if (!segment.file.mapped() && !segment.file.open(segment.path)) {
+            // segment vanished from the disk, nothing left to read back
+            num_spilled -= segment.count - segment.consumed;
+            drop_front();
+            return num_spilled > 0;
+        }
+
+        unsigned char const* src = segment.file.data() + segment.read;
+        uint32_t length = 0;
+        std::memcpy(&length, src, prefix);
+        memory.push_back(codec.decode(src + prefix, length));
+
+        segment.read += prefix + length;
+        segment.consumed += 1;
+        num_spilled -= 1;
+
+        if (segment.consumed == segment.count) {
+            drop_front();
+        }
+        return true;
+    }
+
+    void drop_front() {
+        segments.front().file.close();
+        platform::remove_file(segments.front().path);
+        segments.pop_front();
+    }
+
+    std::string directory;
+    size_t threshold;
+    size_t segment_size;
+    Codec codec;
+
+    std::list<T> memory;
+    std::deque<Segment> segments;
+
+    size_t num_spilled;
+    size_t num_segments;
+};
+
+
+struct QueueStat {
+    size_t size;
+    size_t pushed;
+    size_t popped;
+    size_t push_parks;
+    size_t pop_parks;
+    size_t spurious_wakeups;
+    size_t dropped;
+    size_t evicted;
+    size_t rejected;
+};
+
+// What a full channel does with a new message, Block waits for space,
+// DropNewest discards the message, DropOldest evicts buffered messages
+// and Fail refuses the message.
+enum class Overflow { Block, DropNewest, DropOldest, Fail };
+
+// Sent or Evicted when the message is buffered.
+enum class SendStatus { Sent, Evicted, Dropped, Full, Closed };
+
+// Padded false packs the fields, only to measure the padding.
+template <typename Cont, typename Mutex = std::mutex, bool Padded = true>
+class ThreadSafe {
+public:
+    using value_type = typename Cont::value_type;
+
+    template <typename... Args>
+    ThreadSafe(Args&&... args)
+        : ThreadSafe(Overflow::Block, std::forward<Args>(args)...) {
+        // Do Nothing
+    }
+
+    // eg. ThreadSafe<RingBuffer<T>>(Overflow::DropOldest, 1024)
+    template <typename... Args>
+    ThreadSafe(Overflow overflow, Args&&... args)
+        : overflow(overflow), m_runnable(true),
+          buffer(std::forward<Args>(args)...), account(nullptr), charged(0),
+          m_size(0), num_push(0), num_pop(0), num_push_park(0),
+          num_pop_park(0), num_spurious(0), num_dropped(0), num_evicted(0),
+          num_rejected(0) {
+        // Do Nothing
+    }
+
+    ~ThreadSafe() {
+        close();
+        if (auto* current = account.load(std::memory_order_acquire)) {
+            current->governor->Leave(current);
+        }
+    }
+
+    ThreadSafe(ThreadSafe const&) = delete;
+    ThreadSafe(ThreadSafe&&) = delete;
+
+    ThreadSafe& operator=(ThreadSafe const&) = delete;
+    ThreadSafe& operator=(ThreadSafe&&) = delete;
+
+    template <typename... U>
+    SendStatus emplace_back(U&&... args) {
+        if constexpr (has_pending<Cont>::value) {
+            // the key decides whether the value needs space
+            value_type value(std::forward<U>(args)...);
+            return send(&value, std::move(value));
+        }
+        else {
+            return send(nullptr, std::forward<U>(args)...);
+        }
+    }
+
+    SendStatus push_back(value_type const& value) {
+        return emplace_back(value);
+    }
+
+    SendStatus push_back(value_type&& value) {
+        return emplace_back(std::move(value));
+    }
+
+    // Pushes all `count` elements unless the channel closes or the
+    // overflow policy drops or rejects the rest, returns the number pushed.
+    size_t push_bulk(value_type const* src, size_t count) {
+        size_t done = 0;
+        admit();
+        std::unique_lock lock(mutex);
+        while (done < count) {
+            if (!accepted(make_space(lock, count - done, src + done))) {
+                break;
+            }
+
+            size_t before = buffer.size();
+            size_t num = 0;
+            if constexpr (has_bulk<Cont>::value) {
+                num = buffer.push_bulk(src + done, count - done);
+            }
+            else {
+                for (; done + num < count && has_space(); ++num) {
+                    buffer.push_back(src[done + num]);
+                }
+            }
+            done += num;
+            pushed(before, num);
+            cond.notify_all();
+        }
+        return done;
+    }
+
+    // Blocks until at least one element is available, then moves up to
+    // `count` elements, returns zero once closed and drained.
+    size_t pop_bulk(value_type* dst, size_t count) {
+        std::unique_lock lock(mutex);
+        wait(lock, num_pop_park, "receive", [&] {
+            return !m_runnable || buffer.size() > 0;
+        });
+
+        size_t num = 0;
+        if constexpr (has_bulk<Cont>::value) {
+            num = buffer.pop_bulk(dst, count);
+        }
+        else {
+            for (; num < count && buffer.size() > 0; ++num) {
+                dst[num] = std::move(buffer.front());
+                buffer.pop_front();
+            }
+        }
+
+        if (num > 0) {
+            popped(num);
+            cond.notify_all();
+        }
+        return num;
+    }
+
+    std::optional<value_type> pop_front() {
+        std::unique_lock lock(mutex);
+        wait(lock, num_pop_park, "receive", [&] {
+            return !m_runnable || buffer.size() > 0;
+        });
+
+        if (!m_runnable && buffer.size() == 0) {
+            return std::nullopt;
+        }
+
+        value_type given = std::move(buffer.front());
+        buffer.pop_front();
+        popped();
+
+        cond.notify_all();
+        return std::make_optional(std::move(given));
+    }
+
+    std::optional<value_type> try_pop() {
+        std::unique_lock lock(mutex, std::try_to_lock);
+        if (lock.owns_lock() && buffer.size() > 0) {
+            value_type given = std::move(buffer.front());
+            buffer.pop_front();
+            popped();
+
+            cond.notify_all();
+            return std::make_optional(std::move(given));
+        }
+        return std::nullopt;
+    }
+
+    // Reserve a slot for construction in place, blocks until space is
+    // available, returns nullopt once closed or refused by the overflow
+    // policy.
+    std::optional<size_t> claim() {
+        admit();
+        std::unique_lock lock(mutex);
+        if (!accepted(make_space(lock, 1))) {
+            return std::nullopt;
+        }
+        return buffer.claim();
+    }
+
+    void commit(size_t idx) {
+        std::unique_lock lock(mutex);
+        size_t before = buffer.size();
+        buffer.commit(idx);
+        pushed(before);
+
+        cond.notify_all();
+    }
+
+    // may publish slots committed after `idx`
+    void abandon(size_t idx) {
+        std::unique_lock lock(mutex);
+        size_t before = buffer.size();
+        buffer.abandon(idx);
+        pushed(before, 0);
+
+        cond.notify_all();
+    }
+
+    // Take the front element for reading in place, blocks until one is
+    // available, returns nullopt once closed and drained.
+    std::optional<size_t> borrow() {
+        std::unique_lock lock(mutex);
+        wait(lock, num_pop_park, "receive", [&] {
+            return !m_runnable || buffer.size() > 0;
+        });
+
+        if (buffer.size() == 0) {
+            return std::nullopt;
+        }
+
+        size_t idx = buffer.borrow();
+        popped();
+        return idx;
+    }
+
+    void release(size_t idx) {
+        std::unique_lock lock(mutex);
+        buffer.release(idx);
+
+        cond.notify_all();
+    }
+
+    // claimed and borrowed slots are accessed without the lock
+    void* storage(size_t idx) {
+        return buffer.storage(idx);
+    }
+
+    value_type* at(size_t idx) {
+        return buffer.at(idx);
+    }
+
+    void close() {
+        m_runnable = false;
+        cond.notify_all();
+        {
+            std::unique_lock lock(mutex);
+            if (readiness.is_open()) {
+                readiness.signal();
+            }
+            wake_selectors();
+        }
+        if (auto* current = account.load(std::memory_order_acquire)) {
+            current->closed.store(true, std::memory_order_relaxed);
+            current->governor->Wake();
+        }
+        BlockingRegistry::Instance().Progress();
+    }
+
+    // Charge buffered bytes to `governor`, producers are throttled by it
+    // before taking the lock. Bytes are reported by the container, or
+    // estimated by the element size. Safe while producers run, false if
+    // already governed, producers may be parked on the first account.
+    bool govern(MemoryGovernor& governor) {
+        std::unique_lock lock(mutex);
+        if (account.load(std::memory_order_relaxed) != nullptr) {
+            return false;
+        }
+
+        account.store(governor.Join(), std::memory_order_release);
+        charged = 0;
+        charge();
+        return true;
+    }
+
+    // Descriptor readable once the container goes from empty to non
+    // empty or is closed, -1 if unsupported. Created on first use.
+    int ready_fd() {
+        std::unique_lock lock(mutex);
+        if (!readiness.is_open() && readiness.open()
+            && (buffer.size() > 0 || !m_runnable)) {
+            readiness.signal();
+        }
+        return readiness.fd();
+    }
+
+    // Set `word` to one and wake it once the container goes from empty
+    // to non empty or is closed, for a select parked on several
+    // channels. False without attaching if a message is readable or the
+    // container is closed already.
+    bool attach(std::atomic<uint32_t>* word) {
+        std::unique_lock lock(mutex);
+        if (buffer.size() > 0 || !m_runnable) {
+            return false;
+        }
+        selectors.push_back(word);
+        return true;
+    }
+
+    void detach(std::atomic<uint32_t>* word) {
+        std::unique_lock lock(mutex);
+        selectors.erase(std::remove(selectors.begin(), selectors.end(), word),
+                        selectors.end());
+    }
+
+    // called after draining with try_pop, the fd stays readable if
+    // messages are left, eg. when try_pop lost the lock
+    void clear_ready() {
+        std::unique_lock lock(mutex);
+        readiness.drain();
+        if (buffer.size() > 0 || !m_runnable) {
+            readiness.signal();
+        }
+    }
+
+    bool runnable() const {
+        return m_runnable;
+    }
+
+    bool readable() {
+        std::unique_lock lock(mutex);
+        return m_runnable || buffer.size() > 0;
+    }
+
+    QueueStat stat() const {
+        return QueueStat{ m_size.load(std::memory_order_relaxed),
+                          num_push.load(std::memory_order_relaxed),
+                          num_pop.load(std::memory_order_relaxed),
+                          num_push_park.load(std::memory_order_relaxed),
+                          num_pop_park.load(std::memory_order_relaxed),
+                          num_spurious.load(std::memory_order_relaxed),
+                          num_dropped.load(std::memory_order_relaxed),
+                          num_evicted.load(std::memory_order_relaxed),
+                          num_rejected.load(std::memory_order_relaxed) };
+    }
+
+private:
+    using cond_type = std::conditional_t<std::is_same_v<Mutex, std::mutex>,
+                                         std::condition_variable,
+                                         std::condition_variable_any>;
+
+    template <typename C, typename = void>
+    struct has_bulk : std::false_type {};
+
+    template <typename C>
+    struct has_bulk<C,
+                    std::void_t<decltype(std::declval<C&>().pop_bulk(
+                        std::declval<value_type*>(), size_t()))>>
+        : std::true_type {};
+
+    template <typename C, typename = void>
+    struct has_pending : std::false_type {};
+
+    template <typename C>
+    struct has_pending<C,
+                       std::void_t<decltype(std::declval<C const&>().pending(
+                           std::declval<value_type const&>()))>>
+        : std::true_type {};
+
+    template <typename C, typename = void>
+    struct has_full : std::false_type {};
+
+    template <typename C>
+    struct has_full<C, std::void_t<decltype(std::declval<C const&>().full())>>
+        : std::true_type {};
+
+    // an `incoming` value replacing a pending one always fits
+    bool has_space(value_type const* incoming = nullptr) const {
+        if constexpr (has_pending<Cont>::value) {
+            if (incoming != nullptr && buffer.pending(*incoming)) {
+                return true;
+            }
+        }
+        else {
+            (void)incoming;
+        }
+
+        if constexpr (has_full<Cont>::value) {
+            return !buffer.full();
+        }
+        else {
+            return buffer.size() < buffer.max_size();
+        }
+    }
+
+    template <typename C, typename = void>
+    struct has_bytes : std::false_type {};
+
+    template <typename C>
+    struct has_bytes<C,
+                     std::void_t<decltype(std::declval<C const&>().bytes())>>
+        : std::true_type {};
+
+    template <typename... U>
+    SendStatus send(value_type const* incoming, U&&... args) {
+        admit();
+        std::unique_lock lock(mutex);
+        SendStatus status = make_space(lock, 1, incoming);
+
+        if (accepted(status)) {
+            size_t before = buffer.size();
+            buffer.emplace_back(std::forward<U>(args)...);
+            pushed(before);
+        }
+        cond.notify_all();
+        return status;
+    }
+
+    // Applies the overflow policy until there is space for `incoming`,
+    // or one element if unknown, `pending` elements are counted when
+    // dropped or rejected.
+    SendStatus make_space(std::unique_lock<Mutex>& lock,
+                          size_t pending,
+                          value_type const* incoming = nullptr) {
+        if (overflow == Overflow::Block) {
+            wait(lock, num_push_park, "send", [&] {
+                return !m_runnable || has_space(incoming);
+            });
+        }
+
+        if (!m_runnable) {
+            return SendStatus::Closed;
+        }
+        if (has_space(incoming)) {
+            return SendStatus::Sent;
+        }
+
+        if (overflow == Overflow::DropNewest) {
+            bump(num_dropped, pending);
+            return SendStatus::Dropped;
+        }
+        if (overflow == Overflow::Fail) {
+            bump(num_rejected, pending);
+            return SendStatus::Full;
+        }
+
+        size_t num = 0;
+        for (; !has_space(incoming) && buffer.size() > 0; ++num) {
+            buffer.pop_front();
+        }
+        bump(num_evicted, num);
+
+        // claimed and borrowed slots can not be evicted
+        wait(lock, num_push_park, "send", [&] {
+            return !m_runnable || has_space(incoming);
+        });
+        if (!m_runnable) {
+            return SendStatus::Closed;
+        }
+        return num > 0 ? SendStatus::Evicted : SendStatus::Sent;
+    }
+
+    static bool accepted(SendStatus status) {
+        return status == SendStatus::Sent || status == SendStatus::Evicted;
+    }
+
+    static void bump(std::atomic<size_t>& counter, size_t num) {
+        counter.store(counter.load(std::memory_order_relaxed) + num,
+                      std::memory_order_relaxed);
+    }
+
+    void admit() {
+        if (auto* current = account.load(std::memory_order_acquire)) {
+            current->governor->Admit(*current);
+        }
+    }
+
+    void charge() {
+        auto* current = account.load(std::memory_order_relaxed);
+        if (current == nullptr) {
+            return;
+        }
+
+        size_t bytes = 0;
+        if constexpr (has_bytes<Cont>::value) {
+            bytes = buffer.bytes();
+        }
+        else {
+            bytes = buffer.size() * sizeof(value_type);
+        }
+
+        current->governor->Charge(*current,
+                                  static_cast<std::ptrdiff_t>(bytes)
+                                      - static_cast<std::ptrdiff_t>(charged));
+        charged = bytes;
+    }
+
+    // counters are written under the lock and read lock-free by metrics
+    void pushed(size_t before, size_t num = 1) {
+        // Signal the transition only, later sends find the fd readable.
+        // Commits out of claim order make several messages readable at
+        // once, or none.
+        if (before == 0 && buffer.size() > 0) {
+            if (readiness.is_open()) {
+                readiness.signal();
+            }
+            wake_selectors();
+        }
+        charge();
+        BlockingRegistry::Instance().Progress();
+        m_size.store(buffer.size(), std::memory_order_relaxed);
+        bump(num_push, num);
+    }
+
+    void wake_selectors() {
+        for (auto* word : selectors) {
+            word->store(1, std::memory_order_release);
+            platform::futex_wake(*word);
+        }
+    }
+
+    void popped(size_t num = 1) {
+        charge();
+        BlockingRegistry::Instance().Progress();
+        m_size.store(buffer.size(), std::memory_order_relaxed);
+        bump(num_pop, num);
+    }
+
+    template <typename F>
+    void wait(std::unique_lock<Mutex>& lock,
+              std::atomic<size_t>& parks,
+              char const* kind,
+              F&& pred) {
+        if (pred()) {
+            return;
+        }
+
+        BlockingScope scope(this, kind);
+        parks.fetch_add(1, std::memory_order_relaxed);
+
+        cond.wait(lock);
+        while (!pred()) {
+            num_spurious.fetch_add(1, std::memory_order_relaxed);
+            cond.wait(lock);
+        }
+    }
+
+    // Every field but the counters is guarded by the mutex, producers
+    // and consumers already serialize on it. Align the guarded state so
+    // it does not share a line with neighbouring objects, and keep the
+    // counters read by metrics on their own line.
+    alignas(platform::line_align<Mutex, Padded>) Mutex mutex;
+    cond_type cond;
+
+    Overflow overflow;
+    bool m_runnable;
+    Cont buffer;
+
+    // set once under the lock, read without it by producers
+    std::atomic<MemoryGovernor::Account*> account;
+    size_t charged;
+
+    platform::EventFd readiness;
+    std::vector<std::atomic<uint32_t>*> selectors;
+
+    alignas(platform::line_align<std::atomic<size_t>, Padded>)
+        std::atomic<size_t> m_size;
+    std::atomic<size_t> num_push;
+    std::atomic<size_t> num_pop;
+    std::atomic<size_t> num_push_park;
+    std::atomic<size_t> num_pop_park;
+    std::atomic<size_t> num_spurious;
+    std::atomic<size_t> num_dropped;
+    std::atomic<size_t> num_evicted;
+    std::atomic<size_t> num_rejected;
+};
+
+// Producer side of a zero-copy transfer. Construct the message in
+// place with emplace, or access a default initialized one through * and
+// ->, then Commit. A slot dropped without Commit is skipped.
+template <typename Queue>
+class ClaimedSlot {
+public:
+    using value_type = typename Queue::value_type;
+
+    ClaimedSlot(Queue& queue, std::optional<size_t> idx)
+        : queue(queue), idx(idx), constructed(false) {
+        // Do Nothing
+    }
+
+    ~ClaimedSlot() {
+        if (idx.has_value()) {
+            if (constructed) {
+                queue.at(idx.value())->~value_type();
+            }
+            queue.abandon(idx.value());
+        }
+    }
+
+    ClaimedSlot(ClaimedSlot const&) = delete;
+    ClaimedSlot(ClaimedSlot&&) = delete;
+
+    ClaimedSlot& operator=(ClaimedSlot const&) = delete;
+    ClaimedSlot& operator=(ClaimedSlot&&) = delete;
+
+    // false once the channel is closed
+    explicit operator bool() const {
+        return idx.has_value();
+    }
+
+    template <typename... U>
+    value_type& emplace(U&&... args) {
+        if (constructed) {
+            queue.at(idx.value())->~value_type();
+            constructed = false;
+        }
+
+        new (queue.storage(idx.value()))
+            value_type(std::forward<U>(args)...);
+        constructed = true;
+        return *queue.at(idx.value());
+    }
+
+    value_type& operator*() {
+        if (!constructed) {
+            new (queue.storage(idx.value())) value_type;
+            constructed = true;
+        }
+        return *queue.at(idx.value());
+    }
+
+    value_type* operator->() {
+        return &**this;
+    }
+
+    void Commit() {
+        if (idx.has_value() && constructed) {
+            queue.commit(idx.value());
+            idx.reset();
+        }
+    }
+
+private:
+    Queue& queue;
+    std::optional<size_t> idx;
+    bool constructed;
+};
+
+// Consumer side of a zero-copy transfer, the message is read in place
+// and destroyed on Release or destruction.
+template <typename Queue>
+class BorrowedSlot {
+public:
+    using value_type = typename Queue::value_type;
+
+    BorrowedSlot(Queue& queue, std::optional<size_t> idx)
+        : queue(queue), idx(idx) {
+        // Do Nothing
+    }
+
+    ~BorrowedSlot() {
+        Release();
+    }
+
+    BorrowedSlot(BorrowedSlot const&) = delete;
+    BorrowedSlot(BorrowedSlot&&) = delete;
+
+    BorrowedSlot& operator=(BorrowedSlot const&) = delete;
+    BorrowedSlot& operator=(BorrowedSlot&&) = delete;
+
+    // false once the channel is closed and drained
+    explicit operator bool() const {
+        return idx.has_value();
+    }
+
+    value_type& operator*() {
+        return *queue.at(idx.value());
+    }
+
+    value_type* operator->() {
+        return queue.at(idx.value());
+    }
+
+    void Release() {
+        if (idx.has_value()) {
+            queue.release(idx.value());
+            idx.reset();
+        }
+    }
+
+private:
+    Queue& queue;
+    std::optional<size_t> idx;
+};
+
+template <typename T>
+using TSList = ThreadSafe<std::list<T>>;
+
+template <typename T>
+using TSRingBuffer = ThreadSafe<RingBuffer<T>>;
+
+template <typename T, size_t N>
+using TSStaticRingBuffer = ThreadSafe<StaticRingBuffer<T, N>>;
+
+template <typename T>
+using TSBudgetedList = ThreadSafe<Budgeted<std::list<T>>>;
+
+template <typename T>
+using TSBudgetedRingBuffer = ThreadSafe<Budgeted<RingBuffer<T>>>;
+
+template <typename K, typename V>
+using TSConflating = ThreadSafe<Conflating<K, V>>;
+
+template <typename T, typename Codec = TrivialCodec<T>>
+using TSSpilling = ThreadSafe<Spilling<T, Codec>>;
+
+
+class ByteChannel;
+
+// Producer side reservation of a record, write `size()` bytes into
+// `data()` then Commit. A claim dropped without Commit is skipped.
+class ByteClaim {
+public:
+    ByteClaim(ByteChannel& channel, std::optional<uint64_t> pos)
+        : channel(channel), pos(pos) {
+        // Do Nothing
+    }
+
+    inline ~ByteClaim();
+
+    ByteClaim(ByteClaim const&) = delete;
+    ByteClaim(ByteClaim&&) = delete;
+
+    ByteClaim& operator=(ByteClaim const&) = delete;
+    ByteClaim& operator=(ByteClaim&&) = delete;
+
+    // false once the channel is closed, or if the record never fits
+    explicit operator bool() const {
+        return pos.has_value();
+    }
+
+    inline unsigned char* data();
+    inline size_t size();
+    inline void Commit();
+
+private:
+    ByteChannel& channel;
+    std::optional<uint64_t> pos;
+};
+
+// Consumer side of a record, read in place and released on Release or
+// destruction.
+class ByteRecord {
+public:
+    ByteRecord(ByteChannel& channel, std::optional<uint64_t> pos)
+        : channel(channel), pos(pos) {
+        // Do Nothing
+    }
+
+    inline ~ByteRecord();
+
+    ByteRecord(ByteRecord const&) = delete;
+    ByteRecord(ByteRecord&&) = delete;
+
+    ByteRecord& operator=(ByteRecord const&) = delete;
+    ByteRecord& operator=(ByteRecord&&) = delete;
+
+    // false once the channel is closed and drained
+    explicit operator bool() const {
+        return pos.has_value();
+    }
+
+    inline unsigned char const* data();
+    inline size_t size();
+    inline void Release();
+
+private:
+    ByteChannel& channel;
+    std::optional<uint64_t> pos;
+};
+
+// Channel of variable size byte records, bounded in bytes. Records are
+// written and read in place, so a send costs one copy into the ring at
+// most and no allocation.
+class ByteChannel {
+public:
+    ByteChannel(size_t capacity)
+        : m_runnable(true), ring(capacity), m_used(0), num_push(0),
+          num_pop(0), num_push_park(0), num_pop_park(0), num_spurious(0) {
+        // Do Nothing
+    }
+
+    ~ByteChannel() {
+        Close();
+    }
+
+    ByteChannel(ByteChannel const&) = delete;
+    ByteChannel(ByteChannel&&) = delete;
+
+    ByteChannel& operator=(ByteChannel const&) = delete;
+    ByteChannel& operator=(ByteChannel&&) = delete;
+
+    // Reserve `size` bytes, blocks until they fit.
+    ByteClaim Claim(size_t size) {
+        std::unique_lock lock(mutex);
+        if (size > ring.max_length()) {
+            return ByteClaim(*this, std::nullopt);
+        }
+
+        wait(lock, num_push_park, "send", [&] {
+            return !m_runnable || ring.fits(size);
+        });
+
+        if (!m_runnable) {
+            return ByteClaim(*this, std::nullopt);
+        }
+        return ByteClaim(*this, ring.claim(size));
+    }
+
+    // Copy a record into the ring, false if closed or too large.
+    bool Add(void const* src, size_t size) {
+        ByteClaim claim = Claim(size);
+        if (!claim) {
+            return false;
+        }
+
+        std::memcpy(claim.data(), src, size);
+        claim.Commit();
+        return true;
+    }
+
+    // Borrow the front record, blocks until one is available.
+    ByteRecord Get() {
+        std::unique_lock lock(mutex);
+        wait(lock, num_pop_park, "receive", [&] {
+            return !m_runnable || ring.size() > 0;
+        });
+
+        if (ring.size() == 0) {
+            return ByteRecord(*this, std::nullopt);
+        }
+
+        uint64_t pos = ring.borrow();
+        popped();
+        return ByteRecord(*this, pos);
+    }
+
+    ByteRecord TryGet() {
+        std::unique_lock lock(mutex, std::try_to_lock);
+        if (lock.owns_lock() && ring.size() > 0) {
+            uint64_t pos = ring.borrow();
+            popped();
+            return ByteRecord(*this, pos);
+        }
+        return ByteRecord(*this, std::nullopt);
+    }
+
+    void Close() {
+        {
+            std::unique_lock lock(mutex);
+            m_runnable = false;
+        }
+        cond.notify_all();
+        BlockingRegistry::Instance().Progress();
+    }
+
+    bool Runnable() const {
+        return m_runnable;
+    }
+
+    bool Readable() {
+        std::unique_lock lock(mutex);
+        return m_runnable || ring.size() > 0;
+    }
+
+    // largest record accepted by Claim
+    size_t MaxRecord() const {
+        return ring.max_length();
+    }
+
+    // size is the number of buffered bytes, records and padding
+    QueueStat Stat() const {
+        return QueueStat{ m_used.load(std::memory_order_relaxed),
+                          num_push.load(std::memory_order_relaxed),
+                          num_pop.load(std::memory_order_relaxed),
+                          num_push_park.load(std::memory_order_relaxed),
+                          num_pop_park.load(std::memory_order_relaxed),
+                          num_spurious.load(std::memory_order_relaxed),
+                          0,
+                          0,
+                          0 };
+    }
+
+private:
+    friend class ByteClaim;
+    friend class ByteRecord;
+
+    void commit(uint64_t pos) {
+        {
+            std::unique_lock lock(mutex);
+            ring.commit(pos);
+            pushed();
+        }
+        cond.notify_all();
+    }
+
+    void abandon(uint64_t pos) {
+        {
+            std::unique_lock lock(mutex);
+            ring.abandon(pos);
+            m_used.store(ring.used(), std::memory_order_relaxed);
+        }
+        cond.notify_all();
+    }
+
+    void release(uint64_t pos) {
+        {
+            std::unique_lock lock(mutex);
+            ring.release(pos);
+            m_used.store(ring.used(), std::memory_order_relaxed);
+        }
+        cond.notify_all();
+        BlockingRegistry::Instance().Progress();
+    }
+
+    // counters are written under the lock and read lock-free by Stat
+    void pushed() {
+        BlockingRegistry::Instance().Progress();
+        m_used.store(ring.used(), std::memory_order_relaxed);
+        num_push.store(num_push.load(std::memory_order_relaxed) + 1,
+                       std::memory_order_relaxed);
+    }
+
+    void popped() {
+        BlockingRegistry::Instance().Progress();
+        num_pop.store(num_pop.load(std::memory_order_relaxed) + 1,
+                      std::memory_order_relaxed);
+    }
+
+    template <typename F>
+    void wait(std::unique_lock<std::mutex>& lock,
+              std::atomic<size_t>& parks,
+              char const* kind,
+              F&& pred) {
+        if (pred()) {
+            return;
+        }
+
+        BlockingScope scope(this, kind);
+        parks.fetch_add(1, std::memory_order_relaxed);
+
+        cond.wait(lock);
+        while (!pred()) {
+            num_spurious.fetch_add(1, std::memory_order_relaxed);
+            cond.wait(lock);
+        }
+    }
+
+    alignas(platform::cache_line) std::mutex mutex;
+    std::condition_variable cond;
+
+    bool m_runnable;
+    ByteRing ring;
+
+    alignas(platform::cache_line) std::atomic<size_t> m_used;
+    std::atomic<size_t> num_push;
+    std::atomic<size_t> num_pop;
+    std::atomic<size_t> num_push_park;
+    std::atomic<size_t> num_pop_park;
+    std::atomic<size_t> num_spurious;
+};
+
+ByteClaim::~ByteClaim() {
+    if (pos.has_value()) {
+        channel.abandon(pos.value());
+    }
+}
+
+unsigned char* ByteClaim::data() {
+    return channel.ring.data(pos.value());
+}
+
+size_t ByteClaim::size() {
+    return channel.ring.length(pos.value());
+}
+
+void ByteClaim::Commit() {
+    if (pos.has_value()) {
+        channel.commit(pos.value());
+        pos.reset();
+    }
+}
+
+ByteRecord::~ByteRecord() {
+    Release();
+}
+
+unsigned char const* ByteRecord::data() {
+    return channel.ring.data(pos.value());
+}
+
+size_t ByteRecord::size() {
+    return channel.ring.length(pos.value());
+}
+
+void ByteRecord::Release() {
+    if (pos.has_value()) {
+        channel.release(pos.value());
+        pos.reset();
+    }
+}
+
+
+template <typename T, typename Channel>
+class ChannelIterator {
+public:
+    ChannelIterator(Channel& channel, std::optional<T>&& item)
+        : channel(channel), item(std::move(item)) {
+        // Do Nothing
+    }
+
+    T& operator*() {
+        return item.value();
+    }
+
+    T const& operator*() const {
+        return item.value();
+    }
+
+    ChannelIterator& operator++() {
+        item = channel.Get();
+        return *this;
+    }
+
+    bool operator!=(ChannelIterator const& other) const {
+        return item != other.item;
+    }
+
+private:
+    Channel& channel;
+    std::optional<T> item;
+};
+
+
+template <typename Container>
+class Channel {
+public:
     using value_type = typename Container::value_type;
     using iterator = ChannelIterator<value_type, Channel<Container>>;
 
-    template <typename... U>
-    Channel(U&&... args) : buffer(std::forward<U>(args)...) {
+    template <typename... U>
+    Channel(U&&... args) : buffer(std::forward<U>(args)...) {
+        // Do Nothing
+    }
+
+    Channel(Channel const&) = delete;
+    Channel(Channel&&) = delete;
+
+    Channel& operator=(const Channel&) = delete;
+    Channel& operator=(Channel&&) = delete;
+
+    // SendStatus of ThreadSafe containers, see Overflow
+    template <typename... U>
+    auto Add(U&&... args) {
+        return buffer.emplace_back(std::forward<U>(args)...);
+    }
+
+    template <typename U>
+    Channel& operator<<(U&& task) {
+        Add(std::forward<U>(task));
+        return *this;
+    }
+
+    // Batch transfer, trivially copyable messages are copied with memcpy
+    // when the container supports it.
+    size_t AddBulk(value_type const* src, size_t count) {
+        return buffer.push_bulk(src, count);
+    }
+
+    size_t GetBulk(value_type* dst, size_t count) {
+        return buffer.pop_bulk(dst, count);
+    }
+
+    // Zero-copy transfer for containers with slot reservation, eg.
+    //     if (auto slot = channel.Claim()) {
+    //         slot.emplace(args...);
+    //         slot.Commit();
+    //     }
+    //     if (auto slot = channel.Borrow()) {
+    //         use(*slot);
+    //     }
+    ClaimedSlot<Container> Claim() {
+        return ClaimedSlot<Container>(buffer, buffer.claim());
+    }
+
+    BorrowedSlot<Container> Borrow() {
+        return BorrowedSlot<Container>(buffer, buffer.borrow());
+    }
+
+    std::optional<value_type> Get() {
+        return buffer.pop_front();
+    }
+
+    std::optional<value_type> TryGet() {
+        return buffer.try_pop();
+    }
+
+    Channel& operator>>(std::optional<value_type>& get) {
+        get = Get();
+        return *this;
+    }
+
+    Channel& operator>>(value_type& get) {
+        std::optional<value_type> res = Get();
+        if (res.has_value()) {
+            get = std::move(res.value());
+        }
+        return *this;
+    }
+
+    void Close() {
+        buffer.close();
+    }
+
+    bool Runnable() const {
+        return buffer.runnable();
+    }
+
+    bool Readable() {
+        return buffer.readable();
+    }
+
+    // Pollable descriptor for event loops, readable once the channel
+    // goes from empty to non empty or is closed. Drain with TryGet,
+    // then ClearReady.
+    int ReadyFd() {
+        return buffer.ready_fd();
+    }
+
+    void ClearReady() {
+        buffer.clear_ready();
+    }
+
+    // wake `word` for a select parked on this and other channels, false
+    // if a message is readable or the channel is closed already
+    bool Attach(std::atomic<uint32_t>* word) {
+        return buffer.attach(word);
+    }
+
+    void Detach(std::atomic<uint32_t>* word) {
+        buffer.detach(word);
+    }
+
+    // charge buffered bytes to a process wide memory budget, false if
+    // the channel is already governed
+    bool Govern(MemoryGovernor& governor = MemoryGovernor::Global()) {
+        return buffer.govern(governor);
+    }
+
+    auto Stat() const {
+        return buffer.stat();
+    }
+
+    iterator begin() {
+        return iterator(*this, Get());
+    }
+
+    iterator end() {
+        return iterator(*this, std::nullopt);
+    }
+
+private:
+    Container buffer;
+};
+
+template <typename T>
+using LChannel = Channel<TSList<T>>;
+
+template <typename T>
+using RChannel = Channel<TSRingBuffer<T>>;
+
+// capacity known at compile time, no heap allocation
+template <typename T, size_t N>
+using StaticRChannel = Channel<TSStaticRingBuffer<T, N>>;
+
+// bounded by the bytes of buffered messages, eg.
+//     BLChannel<std::string> channel(
+//         1 << 20, [](std::string const& s) { return s.size(); });
+template <typename T>
+using BLChannel = Channel<TSBudgetedList<T>>;
+
+// bounded by bytes and count, eg. BRChannel<T> channel(bytes, sizer, 64)
+template <typename T>
+using BRChannel = Channel<TSBudgetedRingBuffer<T>>;
+
+// latest value per key, eg. channel.Add(symbol, price)
+template <typename K, typename V>
+using ConflatingChannel = Channel<TSConflating<K, V>>;
+
+// unbounded, spills to disk beyond a threshold, eg.
+//     SpillChannel<Event, EventCodec> channel("/var/spool/app", 100000)
+template <typename T, typename Codec = TrivialCodec<T>>
+using SpillChannel = Channel<TSSpilling<T, Codec>>;
+
+
+// Message received from a DurableChannel, Ack `seq` once it is
+// processed.
+template <typename T>
+struct Delivery {
+    uint64_t seq;
+    T value;
+
+    bool operator==(Delivery const& other) const {
+        return seq == other.seq;
+    }
+
+    bool operator!=(Delivery const& other) const {
+        return seq != other.seq;
+    }
+};
+
+// Channel persisting every message to a segmented log under `directory`
+// before Add returns. Writers append under the log lock, the first one
+// waiting for durability becomes the leader, sleeps for the group
+// commit `window` to let others append, then syncs everything written
+// so far with a single fdatasync. Messages are received in order once
+// they are durable.
+//
+// Consumers Ack sequence numbers in any order, the contiguous prefix of
+// acknowledged messages is checkpointed at most every
+// `checkpoint_interval` and the segments it covers are deleted. After a
+// restart every message past the checkpoint is received again, so
+// processing should be idempotent.
+template <typename T, typename Codec = TrivialCodec<T>>
+class DurableChannel {
+public:
+    using value_type = Delivery<T>;
+    using iterator = ChannelIterator<value_type, DurableChannel>;
+    using clock = std::chrono::steady_clock;
+
+    DurableChannel(std::string directory,
+                   std::chrono::microseconds window
+                   = std::chrono::microseconds(0),
+                   std::chrono::milliseconds checkpoint_interval
+                   = std::chrono::milliseconds(1000),
+                   size_t segment_size = 64 << 20,
+                   Codec codec = Codec())
+        : directory(std::move(directory)), window(window),
+          checkpoint_interval(checkpoint_interval),
+          segment_size(segment_size), codec(std::move(codec)),
+          m_runnable(true), failed(false), syncing(false), next_seq(1),
+          synced_seq(0), segment_bytes(0), acked(0), checkpointed(0),
+          last_checkpoint(clock::now()), num_syncs(0), num_replayed(0) {
+        platform::make_directory(this->directory);
+        recover();
+
+        std::unique_lock lock(log_mutex);
+        roll();
+    }
+
+    ~DurableChannel() {
+        Close();
+        Checkpoint();
+    }
+
+    DurableChannel(DurableChannel const&) = delete;
+    DurableChannel(DurableChannel&&) = delete;
+
+    DurableChannel& operator=(DurableChannel const&) = delete;
+    DurableChannel& operator=(DurableChannel&&) = delete;
+
+    // Append and sync, false if closed or the log can not be written.
+    bool Add(T const& value) {
+        size_t length = codec.size(value);
+        std::vector<unsigned char> record(header_size + length);
+        codec.encode(value, record.data() + header_size);
+
+        std::unique_lock lock(log_mutex);
+        while (true) {
+            if (!m_runnable || failed) {
+                return false;
+            }
+
+            bool rotate = !file.is_open()
+                          || (segment_bytes > 0
+                              && segment_bytes + record.size()
+                                     > segment_size);
+            if (!rotate) {
+                break;
+            }
+
+            // the leader syncs the current segment out of the lock
+            if (syncing) {
+                log_cond.wait(lock);
+            }
+            else if (!roll()) {
+                fail();
+                return false;
+            }
+        }
+
+        uint64_t seq = next_seq;
+        seal(record, seq, length);
+        if (!file.write(record.data(), record.size())) {
+            fail();
+            return false;
+        }
+
+        next_seq += 1;
+        segment_bytes += record.size();
+        segments.back().last = seq;
+        pending.push_back(value_type{ seq, value });
+
+        return commit(lock, seq);
+    }
+
+    std::optional<value_type> Get() {
+        return queue.pop_front();
+    }
+
+    std::optional<value_type> TryGet() {
+        return queue.try_pop();
+    }
+
+    // Acknowledge a processed message, it is not replayed once the
+    // checkpoint covers it.
+    void Ack(uint64_t seq) {
+        std::unique_lock lock(ack_mutex);
+        if (seq <= acked) {
+            return;
+        }
+
+        acks.insert(seq);
+        while (!acks.empty() && *acks.begin() == acked + 1) {
+            acked += 1;
+            acks.erase(acks.begin());
+        }
+
+        if (clock::now() - last_checkpoint >= checkpoint_interval) {
+            checkpoint();
+        }
+    }
+
+    // persist the acknowledged prefix now
+    void Checkpoint() {
+        std::unique_lock lock(ack_mutex);
+        checkpoint();
+    }
+
+    void Close() {
+        {
+            std::unique_lock lock(log_mutex);
+            m_runnable = false;
+        }
+        log_cond.notify_all();
+        queue.close();
+    }
+
+    bool Runnable() const {
+        return m_runnable;
+    }
+
+    bool Readable() {
+        return queue.readable();
+    }
+
+    // last sequence number covered by a checkpoint
+    uint64_t Checkpointed() {
+        std::unique_lock lock(ack_mutex);
+        return checkpointed;
+    }
+
+    // number of fdatasync calls, messages per sync is the group size
+    size_t Syncs() const {
+        return num_syncs.load(std::memory_order_relaxed);
+    }
+
+    // messages received again after a restart
+    size_t Replayed() const {
+        return num_replayed;
+    }
+
+    QueueStat Stat() const {
+        return queue.stat();
+    }
+
+    iterator begin() {
+        return iterator(*this, Get());
+    }
+
+    iterator end() {
+        return iterator(*this, std::nullopt);
+    }
+
+private:
+    struct Segment {
+        std::string path;
+        uint64_t first;
+        uint64_t last;
+    };
+
+    // length, checksum and sequence number precede the encoded message
+    static constexpr size_t header_size =
+        2 * sizeof(uint32_t) + sizeof(uint64_t);
+
+    static uint32_t checksum(unsigned char const* src, size_t size) {
+        uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < size; ++i) {
+            hash = (hash ^ src[i]) * 16777619u;
+        }
+        return hash;
+    }
+
+    static void seal(std::vector<unsigned char>& record,
+                     uint64_t seq,
+                     size_t length) {
+        unsigned char* dst = record.data();
+        std::memcpy(dst + 2 * sizeof(uint32_t), &seq, sizeof(seq));
+
+        auto size = static_cast<uint32_t>(length);
+        uint32_t sum = checksum(dst + 2 * sizeof(uint32_t),
+                                sizeof(seq) + length);
+        std::memcpy(dst, &size, sizeof(size));
+        std::memcpy(dst + sizeof(size), &sum, sizeof(sum));
+    }
+
+    std::string segment_path(uint64_t first) const {
+        std::string name = std::to_string(first);
+        return directory + "/wal-" + std::string(20 - name.size(), '0')
+               + name + ".log";
+    }
+
+    std::string checkpoint_path() const {
+        return directory + "/checkpoint";
+    }
+
+    // read the checkpoint and queue every message past it, a torn
+    // record ends its segment and a segment without a whole record is
+    // deleted
+    void recover() {
+        std::string content;
+        if (platform::read_file(checkpoint_path(), content)
+            && content.size() == sizeof(uint64_t)) {
+            std::memcpy(&checkpointed, content.data(), sizeof(uint64_t));
+            acked = checkpointed;
+        }
+        next_seq = acked + 1;
+
+        std::vector<uint64_t> firsts;
+        for (auto const& name : platform::list_directory(directory)) {
+            if (name.size() == 28 && name.compare(0, 4, "wal-") == 0
+                && name.compare(24, 4, ".log") == 0
+                && name.find_first_not_of("0123456789", 4) == 24) {
+                firsts.push_back(std::stoull(name.substr(4, 20)));
+            }
+        }
+        std::sort(firsts.begin(), firsts.end());
+
+        for (uint64_t first : firsts) {
+            Segment segment{ segment_path(first), first, first - 1 };
+            platform::read_file(segment.path, content);
+
+            auto src = reinterpret_cast<unsigned char const*>(content.data());
+            size_t pos = 0;
+            while (content.size() - pos >= header_size) {
+                uint32_t length = 0;
+                uint32_t sum = 0;
+                uint64_t seq = 0;
+                std::memcpy(&length, src + pos, sizeof(length));
+                std::memcpy(&sum, src + pos + sizeof(length), sizeof(sum));
+                std::memcpy(&seq, src + pos + 2 * sizeof(uint32_t),
+                            sizeof(seq));
+
+                if (content.size() - pos - header_size < length
+                    || checksum(src + pos + 2 * sizeof(uint32_t),
+                                sizeof(seq) + length)
+                           != sum) {
+                    break;
+                }
+
+                if (seq > acked) {
+                    queue.push_back(value_type{
+                        seq, codec.decode(src + pos + header_size, length) });
+                    num_replayed += 1;
+                }
+
+                segment.last = seq;
+                next_seq = std::max(next_seq, seq + 1);
+                pos += header_size + length;
+            }
+
+            if (pos == 0) {
+                platform::remove_file(segment.path);
+                continue;
+            }
+            segments.push_back(std::move(segment));
+        }
+
+        synced_seq = next_seq - 1;
+        drop_acked();
+    }
+
+    // seal the current segment and start a new one, under the log lock
+    bool roll() {
+        if (file.is_open()) {
+            if (!file.sync()) {
+                return false;
+            }
+            num_syncs.fetch_add(1, std::memory_order_relaxed);
+            synced_seq = next_seq - 1;
+            publish();
+            log_cond.notify_all();
+        }
+
+        // every record of a file by that name is torn, start it afresh
+        // so new records do not follow the torn bytes
+        std::string path = segment_path(next_seq);
+        if (!file.create(path) || !platform::sync_directory(path)) {
+            file.close();
+            return false;
+        }
+
+        segments.push_back(Segment{ path, next_seq, next_seq - 1 });
+        segment_bytes = 0;
+        return true;
+    }
+
+    // group commit, wait until `seq` is synced or sync as the leader
+    bool commit(std::unique_lock<std::mutex>& lock, uint64_t seq) {
+        while (synced_seq < seq) {
+            if (failed) {
+                return false;
+            }
+
+            if (syncing) {
+                log_cond.wait(lock);
+                continue;
+            }
+
+            syncing = true;
+            if (window.count() > 0) {
+                lock.unlock();
+                std::this_thread::sleep_for(window);
+                lock.lock();
+            }
+
+            uint64_t target = next_seq - 1;
+            lock.unlock();
+            bool synced = file.sync();
+            lock.lock();
+
+            syncing = false;
+            num_syncs.fetch_add(1, std::memory_order_relaxed);
+            if (synced) {
+                synced_seq = std::max(synced_seq, target);
+                publish();
+            }
+            else {
+                failed = true;
+            }
+            log_cond.notify_all();
+        }
+        return true;
+    }
+
+    // deliver synced messages in order, under the log lock
+    void publish() {
+        while (!pending.empty() && pending.front().seq <= synced_seq) {
+            queue.push_back(std::move(pending.front()));
+            pending.pop_front();
+        }
+    }
+
+    void fail() {
+        failed = true;
+        log_cond.notify_all();
+    }
+
+    // called under the ack lock
+    void checkpoint() {
+        last_checkpoint = clock::now();
+        if (acked == checkpointed
+            || !platform::replace_file(
+                checkpoint_path(), &acked, sizeof(acked))) {
+            return;
+        }
+
+        checkpointed = acked;
+        drop_acked();
+    }
+
+    // delete sealed segments covered by the checkpoint
+    void drop_acked() {
+        std::vector<std::string> drop;
+        {
+            std::unique_lock lock(log_mutex);
+            while (!segments.empty() && segments.front().last <= checkpointed
+                   && (segments.size() > 1 || !file.is_open())) {
+                drop.push_back(std::move(segments.front().path));
+                segments.pop_front();
+            }
+        }
+
+        for (auto const& path : drop) {
+            platform::remove_file(path);
+        }
+    }
+
+    std::string directory;
+    std::chrono::microseconds window;
+    std::chrono::milliseconds checkpoint_interval;
+    size_t segment_size;
+    Codec codec;
+
+    TSList<value_type> queue;
+
+    std::mutex log_mutex;
+    std::condition_variable log_cond;
+
+    bool m_runnable;
+    bool failed;
+    bool syncing;
+    uint64_t next_seq;
+    uint64_t synced_seq;
+    size_t segment_bytes;
+
+    platform::LogFile file;
+    std::deque<Segment> segments;
+    std::deque<value_type> pending;
+
+    std::mutex ack_mutex;
+    uint64_t acked;
+    uint64_t checkpointed;
+    std::set<uint64_t> acks;
+    clock::time_point last_checkpoint;
+
+    std::atomic<size_t> num_syncs;
+    size_t num_replayed;
+};
+
+
+// Lock-free log2 histogram of durations, bucket i counts samples
+// in (2^(i-1), 2^i] nanoseconds, bucket 0 those up to one. Bounds are
+// inclusive as the le of a prometheus bucket.
+class Histogram {
+public:
+    static constexpr size_t num_buckets = 64;
+
+    Histogram() : num_count(0), num_sum(0) {
+        for (auto& bucket : buckets) {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    Histogram(Histogram const& other) : Histogram() {
+        Merge(other);
+    }
+
+    Histogram& operator=(Histogram const& other) {
+        Reset();
+        Merge(other);
+        return *this;
+    }
+
+    template <typename Rep, typename Period>
+    void Record(std::chrono::duration<Rep, Period> const& dur) {
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(dur);
+        uint64_t value = ns.count() > 0 ? ns.count() : 0;
+
+        uint64_t below = value > 0 ? value - 1 : 0;
+        size_t idx = 0;
+        while (below >> idx) {
+            ++idx;
+        }
+
+        buckets[idx].fetch_add(1, std::memory_order_relaxed);
+        num_count.fetch_add(1, std::memory_order_relaxed);
+        num_sum.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    void Merge(Histogram const& other) {
+        for (size_t i = 0; i < num_buckets; ++i) {
+            buckets[i].fetch_add(other.Bucket(i), std::memory_order_relaxed);
+        }
+        num_count.fetch_add(other.Count(), std::memory_order_relaxed);
+        num_sum.fetch_add(other.num_sum.load(std::memory_order_relaxed),
+                          std::memory_order_relaxed);
+    }
+
+    void Reset() {
+        for (auto& bucket : buckets) {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+        num_count.store(0, std::memory_order_relaxed);
+        num_sum.store(0, std::memory_order_relaxed);
+    }
+
+    size_t Bucket(size_t idx) const {
+        return buckets[idx].load(std::memory_order_relaxed);
+    }
+
+    // inclusive upper bound of bucket `idx`
+    static std::chrono::nanoseconds UpperBound(size_t idx) {
+        if (idx >= num_buckets - 1) {
+            return std::chrono::nanoseconds::max();
+        }
+        return std::chrono::nanoseconds(1ll << idx);
+    }
+
+    size_t Count() const {
+        return num_count.load(std::memory_order_relaxed);
+    }
+
+    std::chrono::nanoseconds Sum() const {
+        return std::chrono::nanoseconds(
+            num_sum.load(std::memory_order_relaxed));
+    }
+
+    std::chrono::nanoseconds Mean() const {
+        auto count = static_cast<std::chrono::nanoseconds::rep>(Count());
+        return count > 0 ? Sum() / count : std::chrono::nanoseconds(0);
+    }
+
+    // upper bound of the bucket that holds the q-th quantile
+    std::chrono::nanoseconds Quantile(double q) const {
+        size_t count = Count();
+        size_t rank = static_cast<size_t>(q * count);
+        if (rank >= count && count > 0) {
+            rank = count - 1;
+        }
+
+        size_t acc = 0;
+        for (size_t i = 0; i < num_buckets; ++i) {
+            acc += Bucket(i);
+            if (acc > rank) {
+                return UpperBound(i);
+            }
+        }
+        return UpperBound(num_buckets - 1);
+    }
+
+private:
+    std::array<std::atomic<size_t>, num_buckets> buckets;
+    std::atomic<size_t> num_count;
+    std::atomic<uint64_t> num_sum;
+};
+
+
+struct WorkerSnapshot {
+    size_t id;
+    WorkerState state;
+    char const* label;
+    std::chrono::nanoseconds elapsed;
+};
+
+struct PoolSnapshot {
+    std::vector<WorkerSnapshot> workers;
+    size_t queue_depth;
+    size_t executed;
+    size_t parks;
+    size_t spurious_wakeups;
+};
+
+struct TaskStat {
+    Histogram queue_wait;
+    Histogram wall_time;
+    Histogram cpu_time;
+
+    void Merge(TaskStat const& other) {
+        queue_wait.Merge(other.queue_wait);
+        wall_time.Merge(other.wall_time);
+        cpu_time.Merge(other.cpu_time);
+    }
+};
+
+template <typename T,
+          template <typename> class ChannelType = RChannel>
+class ThreadPool {
+public:
+    ThreadPool() : ThreadPool(std::thread::hardware_concurrency()) {
+        // Do Nothing
+    }
+
+    template <typename... Args>
+    ThreadPool(size_t num_threads, Args&&... args)
+        : runnable(true), num_threads(num_threads), pool_id(++num_pools),
+          signal_id(0), accounting(false),
+          channel(std::forward<Args>(args)...),
+          workers(std::make_unique<WorkerStatus[]>(num_threads)),
+          accounts(std::make_unique<Account[]>(num_threads)),
+          threads(std::make_unique<std::thread[]>(num_threads)) {
+        for (size_t i = 0; i < num_threads; ++i) {
+            threads[i] = std::thread([this, i] { Run(i); });
+        }
+    }
+
+    ~ThreadPool() {
+        Stop();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool(ThreadPool&&) = delete;
+
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    ThreadPool& operator=(ThreadPool&&) = delete;
+
+    template <typename F>
+    std::future<T> Add(F&& task) {
+        return Add(nullptr, std::forward<F>(task));
+    }
+
+    // label should outlive the task, typically a string literal
+    template <typename F>
+    std::future<T> Add(char const* label, F&& task) {
+        std::packaged_task<T()> ptask(std::forward<F>(task));
+        std::future<T> fut = ptask.get_future();
+
+        WorkerStatus::clock::rep submitted = 0;
+        if (accounting.load(std::memory_order_relaxed)) {
+            submitted = WorkerStatus::clock::now().time_since_epoch().count();
+        }
+        channel.Add(Task{ std::move(ptask), label, submitted });
+        return fut;
+    }
+
+    // Run one queued task on the calling thread, false if none is queued.
+    // Threads waiting for pool tasks help with the queue instead, so
+    // waits nested inside tasks never leave the workers idle.
+    bool RunPending() {
+        auto given = channel.TryGet();
+        if (!given.has_value()) {
+            return false;
+        }
+
+        // accounted to the helping worker, the first for other threads
+        size_t idx = 0;
+        WorkerStatus* status = WorkerStatus::current();
+        if (status >= workers.get() && status < workers.get() + num_threads) {
+            idx = static_cast<size_t>(status - workers.get());
+        }
+        Execute(idx, given.value());
+        return true;
+    }
+
+    // Record queue wait, wall clock and thread cpu time of each task,
+    // aggregated per label. Queue wait growing while wall time stays
+    // flat means the pool is undersized, otherwise the tasks are slow.
+    void EnableAccounting(bool enable = true) {
+        accounting.store(enable, std::memory_order_relaxed);
+    }
+
+    std::map<std::string, TaskStat> Accounting() const {
+        std::map<std::string, TaskStat> merged;
+        for (size_t i = 0; i < num_threads; ++i) {
+            std::unique_lock lock(accounts[i].mutex);
+            for (auto const& [label, stat] : accounts[i].stats) {
+                merged[label != nullptr ? label : "(unnamed)"].Merge(*stat);
+            }
+        }
+        return merged;
+    }
+
+    size_t GetNumThreads() const {
+        return num_threads;
+    }
+
+    // tasks waiting for a worker
+    size_t Queued() const {
+        return channel.Stat().size;
+    }
+
+    PoolSnapshot Snapshot() const {
+        auto now = WorkerStatus::clock::now().time_since_epoch().count();
+        auto stat = channel.Stat();
+
+        PoolSnapshot snapshot{
+            {}, stat.size, 0, stat.pop_parks, stat.spurious_wakeups
+        };
+        snapshot.workers.reserve(num_threads);
+
+        for (size_t i = 0; i < num_threads; ++i) {
+            WorkerStatus const& status = workers[i];
+            WorkerState state = status.state.load(std::memory_order_acquire);
+
+            WorkerSnapshot worker{ i, state, nullptr, {} };
+            if (state != WorkerState::Idle) {
+                worker.label = status.label.load(std::memory_order_relaxed);
+                worker.elapsed = WorkerStatus::clock::duration(
+                    now - status.since.load(std::memory_order_relaxed));
+            }
+            snapshot.workers.push_back(worker);
+            snapshot.executed
+                += status.executed.load(std::memory_order_relaxed);
+        }
+        return snapshot;
+    }
+
+    void Dump(std::ostream& os) const {
+        using ms = std::chrono::milliseconds;
+        PoolSnapshot snapshot = Snapshot();
+
+        os << "pool " << pool_id << ": " << num_threads << " workers, "
+           << "queue depth " << snapshot.queue_depth << ", executed "
+           << snapshot.executed << ", parks " << snapshot.parks
+           << ", spurious wakeups " << snapshot.spurious_wakeups << '\n';
+
+        for (auto const& worker : snapshot.workers) {
+            os << "worker " << worker.id << " [" << to_string(worker.state);
+            if (worker.state != WorkerState::Idle) {
+                os << ", "
+                   << std::chrono::duration_cast<ms>(worker.elapsed).count()
+                   << "ms]: "
+                   << (worker.label != nullptr ? worker.label : "(unnamed)");
+            }
+            else {
+                os << ']';
+            }
+            os << '\n';
+        }
+        os.flush();
+    }
+
+    // Dump snapshot to stderr whenever the process receives `signo`,
+    // eg. `kill -USR1 <pid>` like goroutine dump of golang.
+    void DumpOnSignal(int signo = platform::dump_signal) {
+        if (signal_id == 0) {
+            signal_id = platform::SignalWatcher::instance().attach(
+                signo, [this] { Dump(std::cerr); });
+        }
+    }
+
+    void Stop() {
+        if (signal_id != 0) {
+            platform::SignalWatcher::instance().detach(signal_id);
+            signal_id = 0;
+        }
+
+        if (threads != nullptr) {
+            runnable = false;
+            channel.Close();
+
+            for (size_t i = 0; i < num_threads; ++i) {
+                if (threads[i].joinable()) {
+                    threads[i].join();
+                }
+            }
+            threads.reset();
+        }
+    }
+
+private:
+    struct Task {
+        std::packaged_task<T()> run;
+        char const* label = nullptr;
+        WorkerStatus::clock::rep submitted = 0;
+    };
+
+    struct Account {
+        std::mutex mutex;
+        std::unordered_map<char const*, std::unique_ptr<TaskStat>> stats;
+
+        TaskStat& operator[](char const* label) {
+            std::unique_lock lock(mutex);
+            auto& stat = stats[label];
+            if (stat == nullptr) {
+                stat = std::make_unique<TaskStat>();
+            }
+            return *stat;
+        }
+    };
+
+    void Execute(size_t idx, Task& task) {
+        using clock = WorkerStatus::clock;
+        if (!accounting.load(std::memory_order_relaxed)) {
+            task.run();
+            return;
+        }
+
+        clock::time_point start = clock::now();
+        std::chrono::nanoseconds cpu_start = platform::thread_cpu_time();
+
+        task.run();
+
+        std::chrono::nanoseconds cpu_end = platform::thread_cpu_time();
+        clock::time_point end = clock::now();
+
+        TaskStat& stat = accounts[idx][task.label];
+        if (task.submitted != 0) {
+            clock::time_point submitted{ clock::duration(task.submitted) };
+            stat.queue_wait.Record(start - submitted);
+        }
+        stat.wall_time.Record(end - start);
+        stat.cpu_time.Record(cpu_end - cpu_start);
+    }
+
+    void Run(size_t idx) {
+        WorkerStatus& status = workers[idx];
+        WorkerStatus::current() = &status;
+
+        std::string name =
+            "pool" + std::to_string(pool_id) + "-w" + std::to_string(idx);
+        platform::set_thread_name(name.c_str());
+        BlockingRegistry::Instance().Describe(name, true);
+
+        while (runnable) {
+            auto given = channel.Get();
+            if (!given.has_value()) {
+                break;
+            }
+
+            status.start(given->label);
+            Execute(idx, given.value());
+            status.finish();
+        }
+        WorkerStatus::current() = nullptr;
+    }
+
+    inline static std::atomic<size_t> num_pools = 0;
+
+    bool runnable;
+    size_t num_threads;
+    size_t pool_id;
+    size_t signal_id;
+    std::atomic<bool> accounting;
+
+    ChannelType<Task> channel;
+    std::unique_ptr<WorkerStatus[]> workers;
+    std::unique_ptr<Account[]> accounts;
+    std::unique_ptr<std::thread[]> threads;
+};
+
+template <typename T>
+using LThreadPool = ThreadPool<T, LChannel>;
+
+// Unfinished children of a TaskScope or TaskGraph, joined by a thread
+// which helps the pool meanwhile. With nothing queued the joiner yields
+// a few times, then parks until the last child is done, looking at the
+// queue every millisecond as a try_pop may miss a task. Children count
+// down without locking, the last one wakes the joiner under the lock,
+// which the joiner takes before returning, so the owner may be gone
+// once the last Done returns.
+class JoinCount {
+public:
+    JoinCount() : count(0) {
+        // Do Nothing
+    }
+
+    JoinCount(JoinCount const&) = delete;
+    JoinCount(JoinCount&&) = delete;
+
+    JoinCount& operator=(JoinCount const&) = delete;
+    JoinCount& operator=(JoinCount&&) = delete;
+
+    void Add(size_t num = 1) {
+        count.fetch_add(num, std::memory_order_relaxed);
+    }
+
+    void Done() {
+        size_t now = count.load(std::memory_order_relaxed);
+        while (now > 1
+               && !count.compare_exchange_weak(now, now - 1,
+                                               std::memory_order_release,
+                                               std::memory_order_relaxed)) {
+            // Do Nothing
+        }
+        if (now > 1) {
+            return;
+        }
+
+        // children may have added siblings meanwhile
+        std::unique_lock lock(mutex);
+        if (count.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            cond.notify_all();
+        }
+    }
+
+    template <typename Pool>
+    void Wait(Pool& pool, void const* object, char const* kind) {
+        size_t idle = 0;
+        while (count.load(std::memory_order_acquire) > 0) {
+            if (pool.RunPending()) {
+                idle = 0;
+            }
+            else if (++idle < 16) {
+                std::this_thread::yield();
+            }
+            else {
+                park(pool, object, kind);
+                idle = 0;
+            }
+        }
+
+        // the last Done may still hold the lock
+        std::unique_lock lock(mutex);
+    }
+
+private:
+    template <typename Pool>
+    void park(Pool& pool, void const* object, char const* kind) {
+        BlockingScope scope(object, kind);
+        std::unique_lock lock(mutex);
+        while (count.load(std::memory_order_acquire) > 0) {
+            if (cond.wait_for(lock, std::chrono::milliseconds(1))
+                    == std::cv_status::timeout
+                && pool.Queued() > 0) {
+                return;
+            }
+        }
+    }
+
+    std::atomic<size_t> count;
+    std::mutex mutex;
+    std::condition_variable cond;
+};
+
+
+enum class ChunkMode { Read, Map };
+
+// Piece of a file. Copies share the buffer or mapping it points into,
+// which stays valid while any copy is alive.
+struct FileChunk {
+    size_t index = 0;
+    uint64_t offset = 0;
+    std::shared_ptr<char const> data;
+    size_t size = 0;
+
+    std::string_view view() const {
+        return std::string_view(data.get(), size);
+    }
+};
+
+// Source stage reading a file in fixed size chunks, front to back. The
+// kernel is told the file is read sequentially and `depth` chunks ahead
+// of the reader are prefetched, so one producer keeps the device busy.
+//
+// In Read mode chunks are read into `depth` recycled buffers, and Next
+// blocks while every buffer is still referenced downstream. In Map mode
+// chunks point into a read only mapping of the whole file, and nothing
+// is copied or throttled. Map mode falls back to Read if mapping fails.
+class FileSource {
+public:
+    FileSource(std::string const& path,
+               size_t chunk_size = 1 << 20,
+               size_t depth = 8,
+               ChunkMode mode = ChunkMode::Read)
+        : state(std::make_shared<State>()),
+          chunk_size(std::max<size_t>(chunk_size, 1)),
+          depth(std::max<size_t>(depth, 1)), base(nullptr), offset(0),
+          index(0), prefetched(0), failed(false), num_stalls(0) {
+        if (!state->file.open(path)) {
+            failed = true;
+            return;
+        }
+
+        state->file.sequential();
+        if (mode == ChunkMode::Map) {
+            base = state->file.map();
+        }
+    }
+
+    FileSource(FileSource const&) = delete;
+    FileSource(FileSource&&) = delete;
+
+    FileSource& operator=(FileSource const&) = delete;
+    FileSource& operator=(FileSource&&) = delete;
+
+    // nullopt at the end of the file or on a read error
+    std::optional<FileChunk> Next() {
+        uint64_t size = state->file.size();
+        if (failed || offset >= size) {
+            return std::nullopt;
+        }
+
+        prefetch(size);
+        FileChunk chunk;
+        chunk.index = index;
+        chunk.offset = offset;
+        chunk.size = static_cast<size_t>(
+            std::min<uint64_t>(chunk_size, size - offset));
+
+        if (base != nullptr) {
+            // aliases the state, which owns the mapping
+            chunk.data = std::shared_ptr<char const>(state, base + offset);
+        }
+        else {
+            std::unique_ptr<char[]> buffer = acquire();
+            long res = state->file.read(buffer.get(), chunk.size, offset);
+            if (res <= 0) {
+                failed = res < 0;
+                release(std::move(buffer));
+                return std::nullopt;
+            }
+
+            // a file truncated meanwhile ends early
+            chunk.size = static_cast<size_t>(res);
+            chunk.data = std::shared_ptr<char const>(
+                buffer.release(), [state = state](char const* ptr) {
+                    std::unique_lock lock(state->mutex);
+                    state->free.emplace_back(const_cast<char*>(ptr));
+                    state->cond.notify_one();
+                });
+        }
+
+        offset += chunk.size;
+        ++index;
+        return chunk;
+    }
+
+    // Push every chunk into `out` and close it, false on a read error.
+    template <typename Channel>
+    bool Run(Channel& out) {
+        while (auto chunk = Next()) {
+            out.Add(std::move(chunk.value()));
+        }
+        out.Close();
+        return !failed;
+    }
+
+    // false if the file could not be opened or read
+    bool Ok() const {
+        return !failed;
+    }
+
+    uint64_t Size() const {
+        return state->file.size();
+    }
+
+    // waits for a buffer still held downstream, the consumers are slower
+    // than the device
+    size_t Stalls() const {
+        return num_stalls.load(std::memory_order_relaxed);
+    }
+
+    // buffers allocated in Read mode, at most `depth`
+    size_t Buffers() const {
+        std::unique_lock lock(state->mutex);
+        return state->allocated;
+    }
+
+    // buffers referenced by chunks downstream
+    size_t Held() const {
+        std::unique_lock lock(state->mutex);
+        return state->allocated - state->free.size();
+    }
+
+private:
+    // shared with the chunks, which may outlive the source
+    struct State {
+        platform::InputFile file;
+
+        std::mutex mutex;
+        std::condition_variable cond;
+        std::vector<std::unique_ptr<char[]>> free;
+        size_t allocated = 0;
+    };
+
+    void prefetch(uint64_t size) {
+        uint64_t ahead =
+            std::min<uint64_t>(size, offset + depth * chunk_size);
+        while (prefetched < ahead) {
+            state->file.prefetch(prefetched, chunk_size);
+            prefetched += chunk_size;
+        }
+    }
+
+    std::unique_ptr<char[]> acquire() {
+        std::unique_lock lock(state->mutex);
+        if (state->free.empty() && state->allocated >= depth) {
+            num_stalls.fetch_add(1, std::memory_order_relaxed);
+            state->cond.wait(lock, [this] { return !state->free.empty(); });
+        }
+
+        if (state->free.empty()) {
+            ++state->allocated;
+            return std::make_unique<char[]>(chunk_size);
+        }
+
+        std::unique_ptr<char[]> buffer = std::move(state->free.back());
+        state->free.pop_back();
+        return buffer;
+    }
+
+    void release(std::unique_ptr<char[]> buffer) {
+        std::unique_lock lock(state->mutex);
+        state->free.push_back(std::move(buffer));
+    }
+
+    std::shared_ptr<State> state;
+    size_t chunk_size;
+    size_t depth;
+    char const* base;
+
+    uint64_t offset;
+    size_t index;
+    uint64_t prefetched;
+    bool failed;
+    std::atomic<size_t> num_stalls;
+};
+
+// Lines ending in one chunk, without the newline. The views point into
+// the chunk, except the first which points into `joined` as its start
+// was carried over from the previous chunks.
+struct LineBatch {
+    size_t index = 0;
+    FileChunk chunk;
+    std::unique_ptr<std::string> joined;
+    std::vector<std::string_view> lines;
+};
+
+// Split the chunks of `in` into lines, chunks are scanned in parallel on
+// `pool` and batches reach `out` in file order. At most `depth` chunks
+// are scanned at once, and chunks are only held back while no other one
+// is ready, so a Read mode FileSource with fewer buffers than `depth`
+// bounds the parallelism instead of stalling. A last line without a
+// newline gets a batch of its own. Closes `out` once `in` is closed and
+// drained.
+template <typename In, typename Out>
+void SplitLines(In& in,
+                Out& out,
+                LThreadPool<void>& pool,
+                size_t depth = 8) {
+    struct Scan {
+        FileChunk chunk;
+        size_t first = std::string_view::npos;
+        size_t last = std::string_view::npos;
+        std::vector<std::string_view> lines;
+        std::future<void> done;
+
+        void run() {
+            std::string_view view = chunk.view();
+            char const* begin = view.data();
+            char const* end = begin + view.size();
+            char const* pos = begin;
+            while (pos < end) {
+                auto found = static_cast<char const*>(
+                    std::memchr(pos, '\n', static_cast<size_t>(end - pos)));
+                if (found == nullptr) {
+                    break;
+                }
+
+                size_t at = static_cast<size_t>(found - begin);
+                if (first == std::string_view::npos) {
+                    first = at;
+                }
+                else {
+                    lines.emplace_back(pos, static_cast<size_t>(found - pos));
+                }
+                last = at;
+                pos = found + 1;
+            }
+        }
+    };
+
+    auto carry = std::make_unique<std::string>();
+    size_t next_index = 0;
+    auto finish = [&](Scan& scan) {
+        std::string_view view = scan.chunk.view();
+        next_index = scan.chunk.index + 1;
+        if (scan.first == std::string_view::npos) {
+            carry->append(view);
+            return;
+        }
+
+        carry->append(view.substr(0, scan.first));
+        LineBatch batch;
+        batch.index = scan.chunk.index;
+        batch.joined = std::move(carry);
+        batch.lines.reserve(scan.lines.size() + 1);
+        batch.lines.emplace_back(*batch.joined);
+        batch.lines.insert(
+            batch.lines.end(), scan.lines.begin(), scan.lines.end());
+        batch.chunk = std::move(scan.chunk);
+
+        carry = std::make_unique<std::string>(view.substr(scan.last + 1));
+        out.Add(std::move(batch));
+    };
+
+    std::deque<std::unique_ptr<Scan>> scans;
+    while (true) {
+        // the source may wait for the buffer of a held chunk, block for
+        // the next chunk only once every scan is finished
+        auto chunk = scans.empty() ? in.Get() : in.TryGet();
+        if (!chunk.has_value()) {
+            if (scans.empty()) {
+                break;
+            }
+
+            scans.front()->done.get();
+            finish(*scans.front());
+            scans.pop_front();
+            continue;
+        }
+
+        auto scan = std::make_unique<Scan>();
+        scan->chunk = std::move(chunk.value());
+        Scan* raw = scan.get();
+        raw->done = pool.Add([raw] { raw->run(); });
+        scans.push_back(std::move(scan));
+
+        if (scans.size() >= std::max<size_t>(depth, 1)) {
+            scans.front()->done.get();
+            finish(*scans.front());
+            scans.pop_front();
+        }
+    }
+
+    if (!carry->empty()) {
+        LineBatch batch;
+        batch.index = next_index;
+        batch.joined = std::move(carry);
+        batch.lines.emplace_back(*batch.joined);
+        out.Add(std::move(batch));
+    }
+    out.Close();
+}
+
+
+// Lockable wrapper counting acquisitions, contention and time spent
+// waiting for the lock, eg. ThreadSafe<Cont, InstrumentedMutex>.
+template <typename Mutex = std::mutex>
+class InstrumentedMutex {
+public:
+    InstrumentedMutex() : num_acquire(0), num_contended(0) {
+        // Do Nothing
+    }
+
+    InstrumentedMutex(InstrumentedMutex const&) = delete;
+    InstrumentedMutex(InstrumentedMutex&&) = delete;
+
+    InstrumentedMutex& operator=(InstrumentedMutex const&) = delete;
+    InstrumentedMutex& operator=(InstrumentedMutex&&) = delete;
+
+    void lock() {
+        if (!mutex.try_lock()) {
+            auto start = std::chrono::steady_clock::now();
+            mutex.lock();
+            wait.Record(std::chrono::steady_clock::now() - start);
+
+            num_contended.fetch_add(1, std::memory_order_relaxed);
+        }
+        num_acquire.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    bool try_lock() {
+        if (mutex.try_lock()) {
+            num_acquire.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+        return false;
+    }
+
+    void unlock() {
+        mutex.unlock();
+    }
+
+    size_t Acquisitions() const {
+        return num_acquire.load(std::memory_order_relaxed);
+    }
+
+    size_t Contentions() const {
+        return num_contended.load(std::memory_order_relaxed);
+    }
+
+    Histogram const& WaitTime() const {
+        return wait;
+    }
+
+private:
+    Mutex mutex;
+
+    std::atomic<size_t> num_acquire;
+    std::atomic<size_t> num_contended;
+    Histogram wait;
+};
+
+
+// completion delivered to a channel, `result` is the syscall result or
+// -errno
+struct IoCompletion {
+    uint64_t tag;
+    long result;
+};
+
+// Asynchronous file I/O. Requests are queued on io_uring and handed to
+// the kernel in batches, a single reaper thread runs the completions, so
+// one thread may keep thousands of requests in flight. Without io_uring,
+// on older kernels, other systems or with zero entries, requests run as
+// blocking syscalls on a thread pool.
+//
+// Buffers and descriptors must stay valid until the request completes.
+// Callbacks run on the reaper or the pool and should not block.
+class IoService {
+public:
+    using Callback = std::function<void(long)>;
+
+    IoService(unsigned entries = 4096, size_t num_threads = 4)
+        : pool(num_threads), capacity(0), inflight(0), running(0),
+          unsubmitted(0), num_waiting(0), num_submitted(0), num_batches(0) {
+        if (ring.open(entries)) {
+            capacity = ring.capacity();
+            reaper = std::thread([this] { reap(); });
+        }
+    }
+
+    // waits for the requests in flight and their callbacks, which may
+    // chain further requests, before the reaper or the pool is joined
+    ~IoService() {
+        {
+            std::unique_lock lock(mutex);
+            ++num_waiting;
+            cond.wait(lock, [this] { return inflight == 0 && running == 0; });
+            --num_waiting;
+        }
+
+        if (ring.available()) {
+            platform::IoRequest request;
+            request.key = 0;
+            {
+                std::unique_lock lock(mutex);
+                ring.push(request);
+            }
+            ring.submit(1);
+            reaper.join();
+        }
+    }
+
+    IoService(IoService const&) = delete;
+    IoService(IoService&&) = delete;
+
+    IoService& operator=(IoService const&) = delete;
+    IoService& operator=(IoService&&) = delete;
+
+    void Read(int fd, void* buf, size_t len, uint64_t offset, Callback done) {
+        platform::IoRequest request;
+        request.op = platform::IoOp::Read;
+        request.fd = fd;
+        request.buf = buf;
+        request.len = len;
+        request.offset = offset;
+        submit(request, wrap(std::move(done)));
+    }
+
+    std::future<long> Read(int fd, void* buf, size_t len, uint64_t offset) {
+        auto promise = std::make_shared<std::promise<long>>();
+        Read(fd, buf, len, offset, fulfil(promise));
+        return promise->get_future();
+    }
+
+    void Write(int fd,
+               void const* buf,
+               size_t len,
+               uint64_t offset,
+               Callback done) {
+        platform::IoRequest request;
+        request.op = platform::IoOp::Write;
+        request.fd = fd;
+        request.buf = const_cast<void*>(buf);
+        request.len = len;
+        request.offset = offset;
+        submit(request, wrap(std::move(done)));
+    }
+
+    std::future<long> Write(int fd,
+                            void const* buf,
+                            size_t len,
+                            uint64_t offset) {
+        auto promise = std::make_shared<std::promise<long>>();
+        Write(fd, buf, len, offset, fulfil(promise));
+        return promise->get_future();
+    }
+
+    // the result is the new descriptor
+    void Open(std::string path, int flags, unsigned mode, Callback done) {
+        auto op = std::make_unique<Op>();
+        op->path = std::move(path);
+        op->done = [done = std::move(done)](Op&, long result) {
+            done(result);
+        };
+
+        platform::IoRequest request;
+        request.op = platform::IoOp::Open;
+        request.path = op->path.c_str();
+        request.flags = flags;
+        request.mode = mode;
+        submit(request, std::move(op));
+    }
+
+    std::future<long> Open(std::string path, int flags, unsigned mode = 0644) {
+        auto promise = std::make_shared<std::promise<long>>();
+        Open(std::move(path), flags, mode, fulfil(promise));
+        return promise->get_future();
+    }
+
+    void Stat(std::string path,
+              std::function<void(long, platform::FileStat const&)> done) {
+        auto op = std::make_unique<Op>();
+        op->path = std::move(path);
+        op->done = [done = std::move(done)](Op& op, long result) {
+            platform::FileStat stat{};
+            if (result >= 0) {
+                stat = platform::to_file_stat(op.stat);
+            }
+            done(result, stat);
+        };
+
+        platform::IoRequest request;
+        request.op = platform::IoOp::Stat;
+        request.path = op->path.c_str();
+        request.stat = &op->stat;
+        submit(request, std::move(op));
+    }
+
+    // nullopt if `path` does not exist
+    std::future<std::optional<platform::FileStat>> Stat(std::string path) {
+        using Result = std::optional<platform::FileStat>;
+        auto promise = std::make_shared<std::promise<Result>>();
+        Stat(std::move(path),
+             [promise](long result, platform::FileStat const& stat) {
+                 promise->set_value(result < 0 ? Result() : Result(stat));
+             });
+        return promise->get_future();
+    }
+
+    // io_uring has no getdents, directories are always listed on the pool
+    std::future<std::vector<std::string>> ListDir(std::string path) {
+        using Result = std::vector<std::string>;
+        auto promise = std::make_shared<std::promise<Result>>();
+        acquire();
+        pool.Add([this, promise, path = std::move(path)] {
+            auto names = platform::list_directory(path);
+            release();
+            promise->set_value(std::move(names));
+            settle();
+        });
+        return promise->get_future();
+    }
+
+    // false if requests run on the blocking pool
+    bool Uring() const {
+        return ring.available();
+    }
+
+    // requests not completed yet, completed ones no longer count by the
+    // time their callback runs
+    size_t InFlight() {
+        std::unique_lock lock(mutex);
+        return inflight;
+    }
+
+    // requests handed to the kernel and the enter calls doing so
+    size_t Submitted() const {
+        return num_submitted.load(std::memory_order_relaxed);
+    }
+
+    size_t Batches() const {
+        return num_batches.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Op {
+        std::function<void(Op&, long)> done;
+        platform::StatBuffer stat;
+        std::string path;
+    };
+
+    static std::unique_ptr<Op> wrap(Callback done) {
+        auto op = std::make_unique<Op>();
+        op->done = [done = std::move(done)](Op&, long result) {
+            done(result);
+        };
+        return op;
+    }
+
+    static Callback fulfil(std::shared_ptr<std::promise<long>> promise) {
+        return [promise](long result) { promise->set_value(result); };
+    }
+
+    // Queue the request, the submitter finding no unsubmitted requests
+    // flushes after releasing the lock, and takes every request queued
+    // meanwhile with it.
+    void submit(platform::IoRequest request, std::unique_ptr<Op> op) {
+        Op* raw = op.release();
+        request.key = reinterpret_cast<uint64_t>(raw);
+        if (!ring.available()) {
+            acquire();
+            pool.Add([this, raw, request] {
+                long result = platform::io_execute(request);
+                release();
+                finish(raw, result);
+            });
+            return;
+        }
+
+        {
+            std::unique_lock lock(mutex);
+            if (inflight >= capacity) {
+                ++num_waiting;
+                cond.wait(lock, [this] { return inflight < capacity; });
+                --num_waiting;
+            }
+
+            // in flight requests bound the queued ones, the push fits
+            ++inflight;
+            ring.push(request);
+            if (unsubmitted++ > 0) {
+                return;
+            }
+        }
+
+        // enters are serialized, the requests a failed one leaves are the
+        // oldest in the ring
+        std::unique_lock submitting(submit_mutex);
+        unsigned count = 0;
+        {
+            std::unique_lock lock(mutex);
+            count = unsubmitted;
+            unsubmitted = 0;
+        }
+        unsigned handed = ring.submit(count);
+        long error = -errno;
+        num_submitted.fetch_add(handed, std::memory_order_relaxed);
+        num_batches.fetch_add(1, std::memory_order_relaxed);
+        if (handed == count) {
+            return;
+        }
+
+        // the kernel never sees them, complete them with the error
+        std::vector<uint64_t> keys;
+        {
+            std::unique_lock lock(mutex);
+            keys = ring.drop(count - handed);
+        }
+        submitting.unlock();
+
+        for (uint64_t key : keys) {
+            pool.Add([this, key, error] {
+                release();
+                finish(reinterpret_cast<Op*>(key), error);
+            });
+        }
+    }
+
+    void acquire() {
+        std::unique_lock lock(mutex);
+        ++inflight;
+    }
+
+    // the request leaves InFlight, its callback is counted as running
+    // until finish
+    void release() {
+        std::unique_lock lock(mutex);
+        --inflight;
+        ++running;
+        if (num_waiting > 0) {
+            cond.notify_all();
+        }
+    }
+
+    void finish(Op* op, long result) {
+        op->done(*op, result);
+        delete op;
+        settle();
+    }
+
+    void settle() {
+        std::unique_lock lock(mutex);
+        --running;
+        if (num_waiting > 0) {
+            cond.notify_all();
+        }
+    }
+
+    void reap() {
+        platform::set_thread_name("io-reaper");
+        platform::IoEvent events[256];
+
+        while (true) {
+            size_t num = ring.reap(events, 256, true);
+            for (size_t i = 0; i < num; ++i) {
+                // the stop request is queued once nothing is in flight
+                if (events[i].key == 0) {
+                    return;
+                }
+
+                release();
+                finish(reinterpret_cast<Op*>(events[i].key), events[i].result);
+            }
+        }
+    }
+
+    LThreadPool<void> pool;
+    platform::IoRing ring;
+
+    std::mutex mutex;
+    std::mutex submit_mutex;
+    std::condition_variable cond;
+    size_t capacity;
+    size_t inflight;
+    size_t running;
+    unsigned unsubmitted;
+    size_t num_waiting;
+
+    std::atomic<size_t> num_submitted;
+    std::atomic<size_t> num_batches;
+    std::thread reaper;
+};
+
+// complete requests into a channel, eg.
+//     service.Read(fd, buf, len, 0, complete_to(channel, idx));
+template <typename Channel>
+IoService::Callback complete_to(Channel& channel, uint64_t tag) {
+    return [&channel, tag](long result) {
+        channel.Add(IoCompletion{ tag, result });
+    };
+}
+
+
+namespace LockFree {
+    template <typename T>
+    struct Node {
+        T data;
+        std::atomic<Node*> next;
+
+        Node() : data(), next(nullptr) {
+            // Do Nothing
+        }
+
+        template <typename... U>
+        Node(U&&... data) : data(std::forward<U>(data)...), next(nullptr) {
+            // Do Nothing
+        }
+    };
+
+    // Padded false packs the fields, only to measure the padding
+    template <typename T, bool Padded = true>
+    class List {
+    public:
+        List() : m_head(nullptr), m_tail(nullptr), m_runnable(true), m_size(0) {
+            // Do Nothing
+        }
+
+        ~List() {
+            m_runnable.store(false, std::memory_order_release);
+
+            Node<T>* node = m_head.load();
+            while (node != nullptr) {
+                Node<T>* next = node->next;
+                delete node;
+                node = next;
+            }
+        }
+
+        List(List const&) = delete;
+        List(List&&) = delete;
+
+        List& operator=(List const&) = delete;
+        List& operator=(List&&) = delete;
+
+        void push_back(T const& data) {
+            push_node(new Node<T>(data));
+        }
+
+        void push_back(T&& data) {
+            push_node(new Node<T>(std::move(data)));
+        }
+
+        template <typename... U>
+        void emplace_back(U&&... args) {
+            push_node(new Node<T>(std::forward<U>(args)...));
+        }
+
+        void push_node(Node<T>* node) {
+            bool run = false;
+            Node<T>* prev = nullptr;
+            do {
+                run = runnable();
+                prev = m_tail.load(std::memory_order_relaxed);
+            } while (
+                run
+                && !m_tail.compare_exchange_weak(prev,
+                                                 node,
+                                                 std::memory_order_relaxed,
+                                                 std::memory_order_relaxed));
+            if (run) {
+                if (prev != nullptr) {
+                    prev->next.store(node, std::memory_order_relaxed);
+                }
+                else {
+                    m_head.store(node, std::memory_order_relaxed);
+                }
+                ++m_size;
+            }
+        }
+
+        template <typename U = decltype(platform::prevent_deadlock)>
+        std::optional<T> pop_front(U const& prevent_deadlock
+                                   = platform::prevent_deadlock) {
+            bool run = false;
+            Node<T>* node = nullptr;
+            do {
+                std::this_thread::sleep_for(prevent_deadlock);
+
+                run = readable();
+                node = m_head.load(std::memory_order_relaxed);
+            } while (run
+                     && (!node
+                         || !m_head.compare_exchange_weak(
+                             node,
+                             node->next,
+                             std::memory_order_relaxed,
+                             std::memory_order_relaxed)));
+            if (run) {
+                if (node->next == nullptr) {
+                    m_tail.store(nullptr, std::memory_order_relaxed);
+                }
+                --m_size;
+                T res = std::move(node->data);
+
+                delete node;
+                return std::make_optional(std::move(res));
+            }
+            return std::nullopt;
+        }
+
+        std::optional<T> try_pop() {
+            Node<T>* node = m_head.load(std::memory_order_relaxed);
+            if (readable() && node
+                && m_head.compare_exchange_weak(node,
+                                                node->next,
+                                                std::memory_order_relaxed,
+                                                std::memory_order_relaxed)) {
+                if (node->next == nullptr) {
+                    m_tail.store(nullptr, std::memory_order_relaxed);
+                }
+                --m_size;
+                T res = std::move(node->data);
+
+                delete node;
+                return std::make_optional(std::move(res));
+            }
+            return std::nullopt;
+        }
+
+        size_t size() const {
+            return m_size.load(std::memory_order_relaxed);
+        }
+
+        Node<T>* head() {
+            return m_head.load(std::memory_order_relaxed);
+        }
+
+        Node<T>* tail() {
+            return m_tail.load(std::memory_order_relaxed);
+        }
+
+        bool runnable() const {
+            return m_runnable.load(std::memory_order_relaxed);
+        }
+
+        bool readable() const {
+            return runnable()
+                   || m_head.load(std::memory_order_relaxed) != nullptr;
+        }
+
+        void interrupt() {
+            m_runnable.store(false, std::memory_order_relaxed);
+        }
+
+        void resume() {
+            m_runnable.store(true, std::memory_order_relaxed);
+        }
+
+    private:
+        // consumers swing the head and producers the tail, keep them and
+        // the shared counter on separate cache lines
+        template <typename U>
+        static constexpr size_t line =
+            platform::line_align<std::atomic<U>, Padded>;
+
+        alignas(line<Node<T>*>) std::atomic<Node<T>*> m_head;
+        alignas(line<Node<T>*>) std::atomic<Node<T>*> m_tail;
+
+        alignas(line<bool>) std::atomic<bool> m_runnable;
+        alignas(line<size_t>) std::atomic<size_t> m_size;
+    };
+}  // namespace LockFree
+
+
+using ull = unsigned long long;
+
+class WaitGroup {
+public:
+    WaitGroup() : visit(0), waiters(0) {
+        // Do Nothing
+    }
+
+    WaitGroup(ull visit) : visit(visit), waiters(0) {
+        // Do Nothing
+    }
+
+    ull Add() {
+        BlockingRegistry::Instance().Progress();
+        return (visit += 1);
+    }
+
+    ull Done() {
+        BlockingRegistry::Instance().Progress();
+        return (visit -= 1);
+    }
+
+    void Wait() {
+        BlockingScope scope(this, "wait group");
+        waiters += 1;
+        while (visit > 0) {
+            std::this_thread::yield();
+        }
+        waiters -= 1;
+    }
+
+    ull Count() const {
+        return visit.load(std::memory_order_relaxed);
+    }
+
+    ull Waiters() const {
+        return waiters.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<ull> visit;
+    std::atomic<ull> waiters;
+};
+
+
+// Accumulates samples grouped by family and renders prometheus text
+// exposition format (version 0.0.4).
+class MetricWriter {
+public:
+    using Labels = std::vector<std::pair<std::string, std::string>>;
+
+    void Counter(std::string const& family,
+                 std::string const& help,
+                 Labels const& labels,
+                 double value) {
+        Sample(family, help, "counter", family, labels, value);
+    }
+
+    void Gauge(std::string const& family,
+               std::string const& help,
+               Labels const& labels,
+               double value) {
+        Sample(family, help, "gauge", family, labels, value);
+    }
+
+    // durations are exported in seconds
+    void Histogram(std::string const& family,
+                   std::string const& help,
+                   Labels const& labels,
+                   ::Histogram const& hist) {
+        size_t last = 0;
+        for (size_t i = 0; i < ::Histogram::num_buckets - 1; ++i) {
+            if (hist.Bucket(i) > 0) {
+                last = i;
+            }
+        }
+
+        size_t acc = 0;
+        for (size_t i = 0; i <= last; ++i) {
+            acc += hist.Bucket(i);
+
+            Labels bucket = labels;
+            bucket.emplace_back("le",
+                                Format(Seconds(::Histogram::UpperBound(i))));
+            Sample(family, help, "histogram", family + "_bucket", bucket, acc);
+        }
+
+        Labels inf = labels;
+        inf.emplace_back("le", "+Inf");
+        Sample(family,
+               help,
+               "histogram",
+               family + "_bucket",
+               inf,
+               hist.Count());
+        Sample(family,
+               help,
+               "histogram",
+               family + "_sum",
+               labels,
+               Seconds(hist.Sum()));
+        Sample(family,
+               help,
+               "histogram",
+               family + "_count",
+               labels,
+               hist.Count());
+    }
+
+    void Render(std::ostream& os) const {
+        for (auto const& [name, family] : families) {
+            os << "# HELP " << name << ' ' << family.help << '\n';
+            os << "# TYPE " << name << ' ' << family.type << '\n';
+            for (auto const& line : family.samples) {
+                os << line << '\n';
+            }
+        }
+    }
+
+private:
+    struct Family {
+        std::string help;
+        std::string type;
+        std::vector<std::string> samples;
+    };
+
+    static double Seconds(std::chrono::nanoseconds dur) {
+        return std::chrono::duration<double>(dur).count();
+    }
+
+    static std::string Format(double value) {
+        if (value > -1e15 && value < 1e15
+            && value == static_cast<double>(static_cast<long long>(value))) {
+            return std::to_string(static_cast<long long>(value));
+        }
+
+        std::ostringstream stream;
+        stream.precision(9);
+        stream << value;
+        return stream.str();
+    }
+
+    static std::string Escape(std::string const& value) {
+        std::string escaped;
+        for (char c : value) {
+            if (c == '\\' || c == '"') {
+                escaped += '\\';
+                escaped += c;
+            }
+            else if (c == '\n') {
+                escaped += "\\n";
+            }
+            else {
+                escaped += c;
+            }
+        }
+        return escaped;
+    }
+
+    void Sample(std::string const& family,
+                std::string const& help,
+                char const* type,
+                std::string const& name,
+                Labels const& labels,
+                double value) {
+        Family& target = families[family];
+        target.help = help;
+        target.type = type;
+
+        std::string line = name;
+        if (!labels.empty()) {
+            line += '{';
+            for (size_t i = 0; i < labels.size(); ++i) {
+                if (i > 0) {
+                    line += ',';
+                }
+                line += labels[i].first + "=\"" + Escape(labels[i].second)
+                        + '"';
+            }
+            line += '}';
+        }
+        target.samples.push_back(line + ' ' + Format(value));
+    }
+
+    std::map<std::string, Family> families;
+};
+
+template <typename Container>
+void collect_metric(MetricWriter& writer,
+                    std::string const& name,
+                    Channel<Container> const& channel) {
+    QueueStat stat = channel.Stat();
+    MetricWriter::Labels labels{ { "channel", name } };
+
+    writer.Gauge("concurrency_channel_depth",
+                 "Number of buffered messages.",
+                 labels,
+                 stat.size);
+    writer.Counter("concurrency_channel_sent_total",
+                   "Messages added to the channel.",
+                   labels,
+                   stat.pushed);
+    writer.Counter("concurrency_channel_received_total",
+                   "Messages taken from the channel.",
+                   labels,
+                   stat.popped);
+    writer.Counter("concurrency_channel_parks_total",
+                   "Waits on a full or empty channel.",
+                   { { "channel", name }, { "side", "send" } },
+                   stat.push_parks);
+    writer.Counter("concurrency_channel_parks_total",
+                   "Waits on a full or empty channel.",
+                   { { "channel", name }, { "side", "receive" } },
+                   stat.pop_parks);
+    writer.Counter("concurrency_channel_spurious_wakeups_total",
+                   "Wakeups which found the channel still full or empty.",
+                   labels,
+                   stat.spurious_wakeups);
+    writer.Counter("concurrency_channel_overflow_total",
+                   "Messages lost to the overflow policy of a full channel.",
+                   { { "channel", name }, { "reason", "dropped" } },
+                   stat.dropped);
+    writer.Counter("concurrency_channel_overflow_total",
+                   "Messages lost to the overflow policy of a full channel.",
+                   { { "channel", name }, { "reason", "evicted" } },
+                   stat.evicted);
+    writer.Counter("concurrency_channel_overflow_total",
+                   "Messages lost to the overflow policy of a full channel.",
+                   { { "channel", name }, { "reason", "rejected" } },
+                   stat.rejected);
+}
+
+template <typename T, template <typename> class ChannelType>
+void collect_metric(MetricWriter& writer,
+                    std::string const& name,
+                    ThreadPool<T, ChannelType> const& pool) {
+    PoolSnapshot snapshot = pool.Snapshot();
+    MetricWriter::Labels labels{ { "pool", name } };
+
+    std::map<WorkerState, size_t> states{ { WorkerState::Idle, 0 },
+                                          { WorkerState::Running, 0 },
+                                          { WorkerState::Blocked, 0 } };
+    for (auto const& worker : snapshot.workers) {
+        states[worker.state] += 1;
+    }
+    for (auto const& [state, count] : states) {
+        writer.Gauge("concurrency_pool_workers",
+                     "Workers by state.",
+                     { { "pool", name }, { "state", to_string(state) } },
+                     count);
+    }
+
+    writer.Gauge("concurrency_pool_queue_depth",
+                 "Tasks waiting for a worker.",
+                 labels,
+                 snapshot.queue_depth);
+    writer.Counter("concurrency_pool_tasks_executed_total",
+                   "Tasks run to completion.",
+                   labels,
+                   snapshot.executed);
+    writer.Counter("concurrency_pool_parks_total",
+                   "Waits of idle workers on the empty queue.",
+                   labels,
+                   snapshot.parks);
+    writer.Counter("concurrency_pool_spurious_wakeups_total",
+                   "Wakeups which found the queue still empty.",
+                   labels,
+                   snapshot.spurious_wakeups);
+
+    for (auto const& [label, stat] : pool.Accounting()) {
+        MetricWriter::Labels task{ { "pool", name }, { "task", label } };
+        writer.Histogram("concurrency_pool_task_queue_wait_seconds",
+                         "Time from submission to start.",
+                         task,
+                         stat.queue_wait);
+        writer.Histogram("concurrency_pool_task_wall_seconds",
+                         "Wall clock time of tasks.",
+                         task,
+                         stat.wall_time);
+        writer.Histogram("concurrency_pool_task_cpu_seconds",
+                         "Thread cpu time of tasks.",
+                         task,
+                         stat.cpu_time);
+    }
+}
+
+inline void collect_metric(MetricWriter& writer,
+                           std::string const& name,
+                           WaitGroup const& wg) {
+    MetricWriter::Labels labels{ { "wait_group", name } };
+    writer.Gauge("concurrency_wait_group_count",
+                 "Outstanding visits.",
+                 labels,
+                 wg.Count());
+    writer.Gauge("concurrency_wait_group_waiters",
+                 "Threads blocked in Wait.",
+                 labels,
+                 wg.Waiters());
+}
+
+template <typename Mutex>
+void collect_metric(MetricWriter& writer,
+                    std::string const& name,
+                    InstrumentedMutex<Mutex> const& mutex) {
+    MetricWriter::Labels labels{ { "mutex", name } };
+    writer.Counter("concurrency_mutex_acquisitions_total",
+                   "Successful lock acquisitions.",
+                   labels,
+                   mutex.Acquisitions());
+    writer.Counter("concurrency_mutex_contentions_total",
+                   "Acquisitions which had to wait.",
+                   labels,
+                   mutex.Contentions());
+    writer.Histogram("concurrency_mutex_wait_seconds",
+                     "Time spent waiting for a contended lock.",
+                     labels,
+                     mutex.WaitTime());
+}
+
+class MetricRegistry;
+
+// Registration of a metric source, unregistered on destruction.
+class MetricHandle {
+public:
+    MetricHandle() : registry(nullptr), id(0) {
+        // Do Nothing
+    }
+
+    MetricHandle(MetricRegistry* registry, size_t id)
+        : registry(registry), id(id) {
+        // Do Nothing
+    }
+
+    MetricHandle(MetricHandle&& other)
+        : registry(other.registry), id(other.id) {
+        other.registry = nullptr;
+    }
+
+    MetricHandle& operator=(MetricHandle&& other) {
+        if (this != &other) {
+            Reset();
+            registry = other.registry;
+            id = other.id;
+            other.registry = nullptr;
+        }
+        return *this;
+    }
+
+    MetricHandle(MetricHandle const&) = delete;
+    MetricHandle& operator=(MetricHandle const&) = delete;
+
+    ~MetricHandle() {
+        Reset();
+    }
+
+    inline void Reset();
+
+private:
+    MetricRegistry* registry;
+    size_t id;
+};
+
+// Collects registered channels, pools, wait groups and mutexes.
+// Rendering reads relaxed counters only and never takes channel locks.
+class MetricRegistry {
+public:
+    static MetricRegistry& Global() {
+        static MetricRegistry registry;
+        return registry;
+    }
+
+    MetricRegistry() : last_id(0) {
+        // Do Nothing
+    }
+
+    MetricRegistry(MetricRegistry const&) = delete;
+    MetricRegistry(MetricRegistry&&) = delete;
+
+    MetricRegistry& operator=(MetricRegistry const&) = delete;
+    MetricRegistry& operator=(MetricRegistry&&) = delete;
+
+    // `target` must outlive the returned handle
+    template <typename T>
+    [[nodiscard]] MetricHandle Register(std::string name, T const& target) {
+        return Register([name = std::move(name), &target](MetricWriter& w) {
+            collect_metric(w, name, target);
+        });
+    }
+
+    [[nodiscard]] MetricHandle Register(
+        std::function<void(MetricWriter&)> collector) {
+        std::unique_lock lock(mutex);
+        collectors.emplace(++last_id, std::move(collector));
+        return MetricHandle(this, last_id);
+    }
+
+    void Unregister(size_t id) {
+        std::unique_lock lock(mutex);
+        collectors.erase(id);
+    }
+
+    void Render(std::ostream& os) {
+        MetricWriter writer;
+        {
+            std::unique_lock lock(mutex);
+            for (auto const& [id, collector] : collectors) {
+                collector(writer);
+            }
+        }
+        writer.Render(os);
+    }
+
+    std::string Render() {
+        std::ostringstream stream;
+        Render(stream);
+        return stream.str();
+    }
+
+private:
+    std::mutex mutex;
+    size_t last_id;
+    std::map<size_t, std::function<void(MetricWriter&)>> collectors;
+};
+
+void MetricHandle::Reset() {
+    if (registry != nullptr) {
+        registry->Unregister(id);
+        registry = nullptr;
+    }
+}
+
+// Periodic background task stopped and joined on destruction.
+class MetricTicker {
+public:
+    template <typename Rep, typename Period, typename F>
+    MetricTicker(std::chrono::duration<Rep, Period> period, F&& tick)
+        : runnable(true) {
+        worker = std::thread(
+            [this, period, tick = std::forward<F>(tick)]() mutable {
+                std::unique_lock lock(mutex);
+                while (runnable) {
+                    lock.unlock();
+                    tick();
+                    lock.lock();
+                    cond.wait_for(lock, period, [this] { return !runnable; });
+                }
+            });
+    }
+
+    ~MetricTicker() {
+        {
+            std::unique_lock lock(mutex);
+            runnable = false;
+        }
+        cond.notify_all();
+        worker.join();
+    }
+
+    MetricTicker(MetricTicker const&) = delete;
+    MetricTicker(MetricTicker&&) = delete;
+
+    MetricTicker& operator=(MetricTicker const&) = delete;
+    MetricTicker& operator=(MetricTicker&&) = delete;
+
+private:
+    bool runnable;
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::thread worker;
+};
+
+// Rewrites `path` every period, through a temporary file and rename
+// so scrapers never read a partial exposition.
+class MetricFileExporter {
+public:
+    template <typename Rep, typename Period>
+    MetricFileExporter(MetricRegistry& registry,
+                       std::string path,
+                       std::chrono::duration<Rep, Period> period)
+        : registry(registry), path(std::move(path)),
+          ticker(period, [this] { Export(); }) {
+        // Do Nothing
+    }
+
+    bool Export() {
+        std::string tmp = path + ".tmp";
+        {
+            std::ofstream file(tmp, std::ios::trunc);
+            registry.Render(file);
+            if (!file) {
+                return false;
+            }
+        }
+        return platform::rename_file(tmp, path);
+    }
+
+private:
+    MetricRegistry& registry;
+    std::string path;
+    MetricTicker ticker;
+};
+
+// Serves `GET /metrics` on 127.0.0.1, port 0 picks an ephemeral port.
+// Unavailable where platform::has_socket is false.
+class MetricHttpExporter {
+public:
+    MetricHttpExporter(MetricRegistry& registry, uint16_t port = 0)
+        : registry(registry), runnable(true),
+          listener(platform::listen_local(port)) {
+        if (listener != platform::invalid_socket) {
+            worker = std::thread([this] { Serve(); });
+        }
+    }
+
+    ~MetricHttpExporter() {
+        runnable = false;
+        if (worker.joinable()) {
+            worker.join();
+        }
+        platform::close_socket(listener);
+    }
+
+    MetricHttpExporter(MetricHttpExporter const&) = delete;
+    MetricHttpExporter(MetricHttpExporter&&) = delete;
+
+    MetricHttpExporter& operator=(MetricHttpExporter const&) = delete;
+    MetricHttpExporter& operator=(MetricHttpExporter&&) = delete;
+
+    bool Listening() const {
+        return listener != platform::invalid_socket;
+    }
+
+    uint16_t Port() const {
+        return Listening() ? platform::local_port(listener) : 0;
+    }
+
+private:
+    void Serve() {
+        using namespace std::literals;
+        while (runnable) {
+            if (!platform::wait_readable(listener, 100ms)) {
+                continue;
+            }
+
+            platform::socket_t client = platform::accept_socket(listener);
+            if (client != platform::invalid_socket) {
+                Respond(client);
+                platform::close_socket(client);
+            }
+        }
+    }
+
+    void Respond(platform::socket_t client) {
+        using namespace std::literals;
+
+        std::string request;
+        char buf[1024];
+        while (request.find("\r\n\r\n") == std::string::npos
+               && request.size() < 8192
+               && platform::wait_readable(client, 1s)) {
+            long len = platform::recv_some(client, buf, sizeof(buf));
+            if (len <= 0) {
+                break;
+            }
+            request.append(buf, static_cast<size_t>(len));
+        }
+
+        std::string status = "200 OK";
+        std::string body;
+        if (request.rfind("GET /metrics ", 0) == 0
+            || request.rfind("GET / ", 0) == 0) {
+            body = registry.Render();
+        }
+        else {
+            status = "404 Not Found";
+        }
+
+        std::string response =
+            "HTTP/1.1 " + status
+            + "\r\nContent-Type: text/plain; version=0.0.4"
+            + "\r\nContent-Length: " + std::to_string(body.size())
+            + "\r\nConnection: close\r\n\r\n" + body;
+        platform::send_all(client, response.data(), response.size());
+    }
+
+    MetricRegistry& registry;
+    std::atomic<bool> runnable;
+    platform::socket_t listener;
+    std::thread worker;
+};
+
+
+// Source of connected sockets for a NetChannel, called again after every
+// failure. Returns platform::invalid_socket if no peer is reachable yet.
+using NetConnector = std::function<platform::socket_t()>;
+
+// dial `host:port` over tcp
+inline NetConnector net_dial(std::string host, uint16_t port) {
+    return [host = std::move(host), port] {
+        return platform::connect_tcp(host, port);
+    };
+}
+
+// dial a unix domain socket
+inline NetConnector net_dial_unix(std::string path) {
+    return [path = std::move(path)] { return platform::connect_unix(path); };
+}
+
+// accept the next peer on a listening socket owned by the caller
+inline NetConnector net_accept(platform::socket_t listener) {
+    return [listener] {
+        using namespace std::chrono_literals;
+        if (!platform::wait_readable(listener, 100ms)) {
+            return platform::invalid_socket;
+        }
+        return platform::accept_socket(listener);
+    };
+}
+
+// Channel between two hosts, each end Adds messages for its peer and
+// Gets messages from it. Messages are framed with a codec and sent by a
+// writer thread in batches of up to `max_batch` frames per writev.
+//
+// Flow control uses credits, a sender keeps at most `window` messages
+// which the remote consumer has not received with Get, further Adds
+// block. Acknowledgments carry the consumed sequence number, so after a
+// reconnect the unacknowledged messages are sent again and the peer
+// drops the ones it already has. Close sends an end of stream, the peer
+// receives every message before its range-for ends.
+template <typename T, typename Codec = TrivialCodec<T>>
+class NetChannel {
+public:
+    using value_type = T;
+    using iterator = ChannelIterator<T, NetChannel>;
+
+    NetChannel(NetConnector connector,
+               size_t window = 1024,
+               size_t max_batch = 64,
+               Codec codec = Codec())
+        : connector(std::move(connector)),
+          window(std::max<size_t>(window, 1)),
+          max_batch(std::clamp<size_t>(max_batch, 1, 62)),
+          codec(std::move(codec)), fd(platform::invalid_socket),
+          generation(0), broken(false), reading(false), stopping(false),
+          closed(false), fin_sent(false), next_seq(1), sent_seq(0),
+          peer_acked(0), received(0), consumed(0), ack_sent(0),
+          ack_due(false), num_connects(0), num_resent(0), num_batches(0),
+          num_credit_parks(0) {
+        writer = std::thread([this] { write_loop(); });
+        reader = std::thread([this] { read_loop(); });
+    }
+
+    // frames not written yet are flushed if connected, a peer which
+    // stopped reading blocks the destructor
+    ~NetChannel() {
+        Close();
+        {
+            std::unique_lock lock(mutex);
+            stopping = true;
+        }
+        cond.notify_all();
+
+        writer.join();
+        reader.join();
+        platform::close_socket(fd);
+    }
+
+    NetChannel(NetChannel const&) = delete;
+    NetChannel(NetChannel&&) = delete;
+
+    NetChannel& operator=(NetChannel const&) = delete;
+    NetChannel& operator=(NetChannel&&) = delete;
+
+    // Blocks while the peer holds `window` unconsumed messages, false
+    // once closed.
+    bool Add(T const& value) {
+        size_t length = codec.size(value);
+        std::vector<unsigned char> frame(header_size + length);
+        codec.encode(value, frame.data() + header_size);
+
+        std::unique_lock lock(mutex);
+        if (!closed && !has_credit()) {
+            BlockingScope scope(this, "send");
+            num_credit_parks.fetch_add(1, std::memory_order_relaxed);
+            cond.wait(lock, [&] { return closed || has_credit(); });
+        }
+
+        if (closed) {
+            return false;
+        }
+
+        uint64_t seq = next_seq++;
+        seal(frame.data(), Data, length, seq);
+        outbound.push_back(Frame{ seq, std::move(frame) });
+        cond.notify_all();
+        return true;
+    }
+
+    std::optional<T> Get() {
+        std::optional<T> value = inbound.pop_front();
+        if (value.has_value()) {
+            consume();
+        }
+        return value;
+    }
+
+    std::optional<T> TryGet() {
+        std::optional<T> value = inbound.try_pop();
+        if (value.has_value()) {
+            consume();
+        }
+        return value;
+    }
+
+    NetChannel& operator<<(T const& value) {
+        Add(value);
+        return *this;
+    }
+
+    NetChannel& operator>>(std::optional<T>& get) {
+        get = Get();
+        return *this;
+    }
+
+    NetChannel& operator>>(T& get) {
+        std::optional<T> res = Get();
+        if (res.has_value()) {
+            get = std::move(res.value());
+        }
+        return *this;
+    }
+
+    // no more Adds, the peer's Get ends after the pending messages
+    void Close() {
+        {
+            std::unique_lock lock(mutex);
+            closed = true;
+        }
+        cond.notify_all();
+        BlockingRegistry::Instance().Progress();
+    }
+
+    bool Runnable() {
+        std::unique_lock lock(mutex);
+        return !closed;
+    }
+
+    bool Readable() {
+        return inbound.readable();
+    }
+
+    bool Connected() {
+        std::unique_lock lock(mutex);
+        return fd != platform::invalid_socket && !broken;
+    }
+
+    // connections established, the first one included
+    size_t Connects() const {
+        return num_connects.load(std::memory_order_relaxed);
+    }
+
+    // messages written again after a reconnect
+    size_t Resent() const {
+        return num_resent.load(std::memory_order_relaxed);
+    }
+
+    // writev calls, frames per batch grow with the send rate
+    size_t Batches() const {
+        return num_batches.load(std::memory_order_relaxed);
+    }
+
+    // stat of received messages, push parks count Adds out of credit
+    QueueStat Stat() const {
+        QueueStat stat = inbound.stat();
+        stat.push_parks = num_credit_parks.load(std::memory_order_relaxed);
+        return stat;
+    }
+
+    iterator begin() {
+        return iterator(*this, Get());
+    }
+
+    iterator end() {
+        return iterator(*this, std::nullopt);
+    }
+
+private:
+    enum Kind : uint32_t { Data = 1, Ack = 2, Fin = 3 };
+
+    struct Frame {
+        uint64_t seq;
+        std::vector<unsigned char> bytes;
+    };
+
+    // kind, payload length and sequence number, acks and fins carry the
+    // consumed and the last sequence number
+    static constexpr size_t header_size =
+        2 * sizeof(uint32_t) + sizeof(uint64_t);
+
+    static constexpr size_t chunk_size = 64 << 10;
+
+    static void seal(unsigned char* dst,
+                     uint32_t kind,
+                     size_t length,
+                     uint64_t seq) {
+        auto size = static_cast<uint32_t>(length);
+        std::memcpy(dst, &kind, sizeof(kind));
+        std::memcpy(dst + sizeof(kind), &size, sizeof(size));
+        std::memcpy(dst + 2 * sizeof(uint32_t), &seq, sizeof(seq));
+    }
+
+    // called under the lock
+    bool has_credit() const {
+        return next_seq - 1 - peer_acked < window;
+    }
+
+    bool has_work() const {
+        bool connected = fd != platform::invalid_socket && !broken;
+        return ack_due
+               || (connected
+                   && (sent_seq + 1 < next_seq || (closed && !fin_sent)));
+    }
+
+    void break_connection() {
+        broken = true;
+        platform::shutdown_socket(fd);
+    }
+
+    // ack once a quarter of the window is consumed or nothing is left
+    void consume() {
+        {
+            std::unique_lock lock(mutex);
+            consumed += 1;
+            if (consumed - ack_sent < std::max<size_t>(window / 4, 1)
+                && inbound.stat().size > 0) {
+                return;
+            }
+            ack_due = true;
+        }
+        cond.notify_all();
+    }
+
+    void write_loop() {
+        platform::set_thread_name("net-writer");
+        auto backoff = std::chrono::milliseconds(10);
+
+        std::unique_lock lock(mutex);
+        while (true) {
+            if (fd == platform::invalid_socket) {
+                if (stopping) {
+                    break;
+                }
+
+                lock.unlock();
+                platform::socket_t sock = connector();
+                lock.lock();
+
+                if (sock == platform::invalid_socket) {
+                    cond.wait_for(lock, backoff);
+                    backoff = std::min(backoff * 2,
+                                       std::chrono::milliseconds(1000));
+                    continue;
+                }
+                connected(sock);
+                backoff = std::chrono::milliseconds(10);
+                continue;
+            }
+
+            if (broken) {
+                cond.wait(lock, [&] { return !reading; });
+                platform::close_socket(fd);
+                fd = platform::invalid_socket;
+                continue;
+            }
+
+            if (!has_work()) {
+                if (stopping) {
+                    break;
+                }
+                cond.wait(lock);
+                continue;
+            }
+
+            if (!flush(lock)) {
+                break_connection();
+            }
+            cond.notify_all();
+        }
+    }
+
+    // start over on a new connection, resend what the peer has not
+    // consumed and announce our own progress
+    void connected(platform::socket_t sock) {
+        fd = sock;
+        broken = false;
+        generation += 1;
+        num_connects.fetch_add(1, std::memory_order_relaxed);
+
+        if (sent_seq > peer_acked) {
+            num_resent.fetch_add(sent_seq - peer_acked,
+                                 std::memory_order_relaxed);
+        }
+        sent_seq = peer_acked;
+        fin_sent = false;
+        ack_due = true;
+        cond.notify_all();
+    }
+
+    // write one batch out of the lock, false if the connection failed
+    bool flush(std::unique_lock<std::mutex>& lock) {
+        while (!outbound.empty() && outbound.front().seq <= peer_acked) {
+            outbound.pop_front();
+        }
+
+        std::vector<platform::IoSlice> slices;
+        unsigned char control[2][header_size];
+
+        if (ack_due) {
+            seal(control[0], Ack, 0, consumed);
+            slices.push_back(platform::IoSlice{ control[0], header_size });
+            ack_sent = consumed;
+            ack_due = false;
+        }
+
+        uint64_t last = sent_seq;
+        for (auto& frame : outbound) {
+            if (slices.size() >= max_batch) {
+                break;
+            }
+            if (frame.seq > last) {
+                auto& bytes = frame.bytes;
+                slices.push_back(
+                    platform::IoSlice{ bytes.data(), bytes.size() });
+                last = frame.seq;
+            }
+        }
+
+        bool fin = closed && !fin_sent && last + 1 == next_seq;
+        if (fin) {
+            seal(control[1], Fin, 0, last);
+            slices.push_back(platform::IoSlice{ control[1], header_size });
+        }
+
+        platform::socket_t sock = fd;
+        lock.unlock();
+        bool ok = platform::send_all_vectored(sock, std::move(slices));
+        lock.lock();
+
+        if (!ok || broken) {
+            return false;
+        }
+        sent_seq = std::max(sent_seq, last);
+        fin_sent = fin_sent || fin;
+        num_batches.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    void read_loop() {
+        platform::set_thread_name("net-reader");
+        std::vector<unsigned char> buffer;
+        std::vector<unsigned char> chunk(chunk_size);
+        size_t current = 0;
+
+        std::unique_lock lock(mutex);
+        while (true) {
+            cond.wait(lock, [&] {
+                return stopping
+                       || (fd != platform::invalid_socket && !broken);
+            });
+            if (stopping) {
+                break;
+            }
+
+            // partial frames of a previous connection are discarded
+            if (current != generation) {
+                buffer.clear();
+                current = generation;
+            }
+
+            platform::socket_t sock = fd;
+            reading = true;
+            lock.unlock();
+
+            using namespace std::chrono_literals;
+            long num = 0;
+            bool ok = true;
+            if (platform::wait_readable(sock, 100ms)) {
+                num = platform::recv_some(sock, chunk.data(), chunk.size());
+                ok = num > 0;
+            }
+
+            lock.lock();
+            reading = false;
+            if (ok && num > 0) {
+                buffer.insert(buffer.end(), chunk.data(), chunk.data() + num);
+                ok = parse(buffer);
+            }
+            if (!ok && current == generation && !broken) {
+                break_connection();
+            }
+            cond.notify_all();
+        }
+    }
+
+    // consume complete frames from `buffer`, under the lock
+    bool parse(std::vector<unsigned char>& buffer) {
+        size_t pos = 0;
+        while (buffer.size() - pos >= header_size) {
+            uint32_t kind = 0;
+            uint32_t length = 0;
+            uint64_t seq = 0;
+            unsigned char const* src = buffer.data() + pos;
+            std::memcpy(&kind, src, sizeof(kind));
+            std::memcpy(&length, src + sizeof(kind), sizeof(length));
+            std::memcpy(&seq, src + 2 * sizeof(uint32_t), sizeof(seq));
+
+            if (buffer.size() - pos - header_size < length) {
+                break;
+            }
+
+            if (kind == Data) {
+                if (seq == received + 1) {
+                    inbound.push_back(codec.decode(src + header_size, length));
+                    received = seq;
+                }
+                else if (seq > received) {
+                    return false;
+                }
+            }
+            else if (kind == Ack) {
+                peer_acked = std::max(peer_acked, seq);
+            }
+            else if (kind == Fin) {
+                if (seq == received) {
+                    inbound.close();
+                }
+            }
+            else {
+                return false;
+            }
+            pos += header_size + length;
+        }
+
+        buffer.erase(buffer.begin(), buffer.begin() + pos);
+        return true;
+    }
+
+    NetConnector connector;
+    size_t window;
+    size_t max_batch;
+    Codec codec;
+
+    TSList<T> inbound;
+
+    std::mutex mutex;
+    std::condition_variable cond;
+
+    platform::socket_t fd;
+    size_t generation;
+    bool broken;
+    bool reading;
+    bool stopping;
+
+    bool closed;
+    bool fin_sent;
+    uint64_t next_seq;
+    uint64_t sent_seq;
+    uint64_t peer_acked;
+    std::deque<Frame> outbound;
+
+    uint64_t received;
+    uint64_t consumed;
+    uint64_t ack_sent;
+    bool ack_due;
+
+    std::atomic<size_t> num_connects;
+    std::atomic<size_t> num_resent;
+    std::atomic<size_t> num_batches;
+    std::atomic<size_t> num_credit_parks;
+
+    std::thread writer;
+    std::thread reader;
+};
+
+
+// Readiness of one descriptor, `ready` holds platform::poll_read and
+// poll_write bits set by the poller thread and taken by waiters.
+struct FdWatch {
+    int fd = -1;
+    uint64_t key = 0;
+    std::atomic<uint32_t> ready{ 0 };
+    std::atomic<uint32_t> waiters{ 0 };
+
+    // events the descriptor is armed for and words of selects parked
+    // on it, under the netpoller lock
+    uint32_t armed = 0;
+    std::vector<std::atomic<uint32_t>*> selectors;
+};
+
+// Poller thread delivering descriptor readiness to waiters, like the
+// netpoller of the go runtime. Descriptors are armed one shot when a
+// waiter finds them not ready, so an idle descriptor costs nothing and
+// a ready one is reported once per wait. Readiness is published as
+// bits of the watch, waiters check them without a syscall and park on
+// them with a futex.
+//
+// Forget a descriptor before closing it, its number may be reused.
+class Netpoller {
+public:
+    Netpoller() : running(true), next_key(1), num_events(0) {
+        poller.open();
+        if (wakeup.open()) {
+            poller.arm(wakeup.fd(), platform::poll_read, 0);
+        }
+        worker = std::thread([this] { loop(); });
+    }
+
+    ~Netpoller() {
+        running.store(false);
+        wakeup.signal();
+        worker.join();
+    }
+
+    Netpoller(Netpoller const&) = delete;
+    Netpoller(Netpoller&&) = delete;
+
+    Netpoller& operator=(Netpoller const&) = delete;
+    Netpoller& operator=(Netpoller&&) = delete;
+
+    static Netpoller& Global() {
+        // never destroyed, static watchers may leave after exit
+        static Netpoller* netpoller = new Netpoller();
+        return *netpoller;
+    }
+
+    // watch of `fd`, shared by every waiter of the descriptor
+    std::shared_ptr<FdWatch> Watch(int fd) {
+        std::unique_lock lock(mutex);
+        auto iter = by_fd.find(fd);
+        if (iter != by_fd.end()) {
+            return iter->second;
+        }
+
+        auto watch = std::make_shared<FdWatch>();
+        watch->fd = fd;
+        watch->key = next_key++;
+        by_fd.emplace(fd, watch);
+        by_key.emplace(watch->key, watch);
+        return watch;
+    }
+
+    void Forget(int fd) {
+        std::unique_lock lock(mutex);
+        auto iter = by_fd.find(fd);
+        if (iter == by_fd.end()) {
+            return;
+        }
+
+        poller.remove(fd);
+        by_key.erase(iter->second->key);
+        by_fd.erase(iter);
+    }
+
+    // Take ready `events`, or arm the descriptor for them and return
+    // false. Never blocks.
+    bool TryTake(FdWatch& watch, uint32_t events) {
+        if (watch.ready.fetch_and(~events, std::memory_order_acquire)
+            & events) {
+            return true;
+        }
+
+        arm(watch, events);
+        return false;
+    }
+
+    // Whether one of `events` is ready, without taking it, the
+    // descriptor is armed for them when not.
+    bool Ready(FdWatch& watch, uint32_t events) {
+        if (watch.ready.load(std::memory_order_acquire) & events) {
+            return true;
+        }
+
+        arm(watch, events);
+        return false;
+    }
+
+    // Block until one of `events` is ready, false on timeout.
+    bool Wait(FdWatch& watch,
+              uint32_t events,
+              std::chrono::milliseconds timeout = std::chrono::hours(24)) {
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        if (TryTake(watch, events)) {
+            return true;
+        }
+
+        BlockingScope scope(&watch, "fd", true);
+        while (true) {
+            watch.waiters.fetch_add(1);
+            uint32_t now = watch.ready.load();
+            auto left = std::chrono::duration_cast<std::chrono::microseconds>(
+                deadline - std::chrono::steady_clock::now());
+            if (!(now & events) && left.count() > 0) {
+                platform::futex_wait(watch.ready, now, false, left);
+            }
+            watch.waiters.fetch_sub(1);
+
+            if (TryTake(watch, events)) {
+                return true;
+            }
+            if (std::chrono::steady_clock::now() >= deadline) {
+                return false;
+            }
+        }
+    }
+
+    // Set `word` to one and wake it once one of `events` is ready, the
+    // descriptor is armed for them. False without attaching if one is
+    // ready already.
+    bool Attach(FdWatch& watch,
+                uint32_t events,
+                std::atomic<uint32_t>* word) {
+        if (Ready(watch, events)) {
+            return false;
+        }
+
+        std::unique_lock lock(mutex);
+        if (watch.ready.load() & events) {
+            return false;
+        }
+        watch.selectors.push_back(word);
+        return true;
+    }
+
+    void Detach(FdWatch& watch, std::atomic<uint32_t>* word) {
+        std::unique_lock lock(mutex);
+        auto& selectors = watch.selectors;
+        selectors.erase(std::remove(selectors.begin(), selectors.end(), word),
+                        selectors.end());
+    }
+
+    // descriptors currently watched
+    size_t Watched() {
+        std::unique_lock lock(mutex);
+        return by_fd.size();
+    }
+
+    // readiness events delivered so far
+    size_t Events() const {
+        return num_events.load(std::memory_order_relaxed);
+    }
+
+private:
+    void arm(FdWatch& watch, uint32_t events) {
+        std::unique_lock lock(mutex);
+        if ((watch.armed & events) == events) {
+            return;
+        }
+
+        watch.armed |= events;
+        poller.arm(watch.fd, watch.armed, watch.key);
+    }
+
+    void loop() {
+        platform::set_thread_name("netpoller");
+        platform::PollEvent events[256];
+
+        while (running.load(std::memory_order_relaxed)) {
+            size_t num =
+                poller.wait(events, 256, std::chrono::milliseconds(100));
+
+            std::unique_lock lock(mutex);
+            for (size_t i = 0; i < num; ++i) {
+                if (events[i].key == 0) {
+                    wakeup.drain();
+                    poller.arm(wakeup.fd(), platform::poll_read, 0);
+                    continue;
+                }
+
+                auto iter = by_key.find(events[i].key);
+                if (iter == by_key.end()) {
+                    continue;
+                }
+
+                // one shot, every event is disarmed
+                FdWatch& watch = *iter->second;
+                watch.armed = 0;
+                watch.ready.fetch_or(events[i].events);
+                if (watch.waiters.load() > 0) {
+                    platform::futex_wake(watch.ready);
+                }
+                for (auto* word : watch.selectors) {
+                    word->store(1, std::memory_order_release);
+                    platform::futex_wake(*word);
+                }
+            }
+            num_events.fetch_add(num, std::memory_order_relaxed);
+            if (num > 0) {
+                BlockingRegistry::Instance().Progress(false);
+            }
+        }
+    }
+
+    std::atomic<bool> running;
+
+    std::mutex mutex;
+    platform::Poller poller;
+    platform::EventFd wakeup;
+    uint64_t next_key;
+    std::unordered_map<int, std::shared_ptr<FdWatch>> by_fd;
+    std::unordered_map<uint64_t, std::shared_ptr<FdWatch>> by_key;
+
+    std::atomic<size_t> num_events;
+    std::thread worker;
+};
+
+// Channel like view of a descriptor for select, TryGet yields the
+// descriptor once it is ready for `events`.
+class FdSelectable {
+public:
+    FdSelectable(int fd,
+                 uint32_t events,
+                 Netpoller& netpoller = Netpoller::Global())
+        : netpoller(netpoller), watch(netpoller.Watch(fd)), events(events) {
+        // Do Nothing
+    }
+
+    // ready for `events`, arms the descriptor when not
+    bool Readable() {
+        return netpoller.Ready(*watch, events);
+    }
+
+    std::optional<int> TryGet() {
+        if (netpoller.TryTake(*watch, events)) {
+            return watch->fd;
+        }
+        return std::nullopt;
+    }
+
+private:
+    friend class SelectWait;
+
+    Netpoller& netpoller;
+    std::shared_ptr<FdWatch> watch;
+    uint32_t events;
+};
+
+// Blocking path of select, parks on a word of its own until one of
+// the cases may fire. Descriptor cases point their watch at the word,
+// channel cases are woken by the channel, so a wait costs no syscall
+// beyond the futex and wakes only for its own cases. Channels without
+// select support are checked again every millisecond.
+class SelectWait {
+public:
+    SelectWait() : word(0), ready(false), polling(false), external(false) {
+        // Do Nothing
+    }
+
+    SelectWait(SelectWait const&) = delete;
+    SelectWait(SelectWait&&) = delete;
+
+    SelectWait& operator=(SelectWait const&) = delete;
+    SelectWait& operator=(SelectWait&&) = delete;
+
+    template <typename C>
+    void Add(C& channel) {
+        if (ready) {
+            return;
+        }
+
+        if constexpr (std::is_same_v<C, FdSelectable>) {
+            external = true;
+            ready = !channel.netpoller.Attach(
+                *channel.watch, channel.events, &word);
+        }
+        else if constexpr (has_attach<C>::value) {
+            // closed and drained, never fires again
+            if (channel.Readable()) {
+                ready = !channel.Attach(&word);
+            }
+        }
+        else if (channel.Readable()) {
+            polling = true;
+        }
+    }
+
+    // every added case, after Park
+    template <typename C>
+    void Remove(C& channel) {
+        if constexpr (std::is_same_v<C, FdSelectable>) {
+            channel.netpoller.Detach(*channel.watch, &word);
+        }
+        else if constexpr (has_attach<C>::value) {
+            channel.Detach(&word);
+        }
+    }
+
+    void Park() {
+        if (ready) {
+            return;
+        }
+
+        BlockingScope scope(this, "select", external);
+        auto timeout = std::chrono::microseconds(polling ? 1000 : 0);
+        while (word.load(std::memory_order_acquire) == 0) {
+            platform::futex_wait(word, 0, false, timeout);
+            if (polling) {
+                break;
+            }
+        }
+    }
+
+private:
+    template <typename C, typename = void>
+    struct has_attach : std::false_type {};
+
+    template <typename C>
+    struct has_attach<C,
+                      std::void_t<decltype(std::declval<C&>().Attach(
+                          std::declval<std::atomic<uint32_t>*>()))>>
+        : std::true_type {};
+
+    std::atomic<uint32_t> word;
+    bool ready;
+    bool polling;
+    bool external;
+};
+
+// select case owning its descriptor view, as case_m refers to channels
+template <typename F>
+struct FdCase {
+    FdSelectable channel;
+    F action;
+};
+
+struct fd_case_m {
+    FdSelectable channel;
+
+    template <typename F>
+    FdCase<std::decay_t<F>> operator>>(F&& action) {
+        return FdCase<std::decay_t<F>>{ std::move(channel),
+                                        std::forward<F>(action) };
+    }
+};
+
+// eg. select(fd_readable_m(sock) >> [](int fd) { ... }, case_m(ch) >> ...)
+inline fd_case_m fd_readable_m(int fd) {
+    return fd_case_m{ FdSelectable(fd, platform::poll_read) };
+}
+
+inline fd_case_m fd_writable_m(int fd) {
+    return fd_case_m{ FdSelectable(fd, platform::poll_write) };
+}
+
+
+template <typename T, typename F>
+struct Selectable {
+    T& channel;
+    F action;
+
+    template <typename Fs>
+    Selectable(T& channel, Fs&& action)
+        : channel(channel), action(std::forward<Fs>(action)) {
+        // Do Nothing
+    }
+};
+
+struct DefaultSelectable {
+    bool Readable() const {
+        return true;
+    }
+
+    std::optional<void*> TryGet() const {
+        return { nullptr };
+    }
+
+    static DefaultSelectable channel;
+};
+DefaultSelectable DefaultSelectable::channel;
+
+template <typename T>
+struct case_m {
+    T& channel;
+
+    case_m(T& channel) : channel(channel) {
         // Do Nothing
     }
 
-    Channel(Channel const&) = delete;
-    Channel(Channel&&) = delete;
+    template <typename F>
+    Selectable<T, F> operator>>(F&& action) {
+        return Selectable<T, F>(channel, std::forward<F>(action));
+    }
+};
 
-    Channel& operator=(const Channel&) = delete;
-    Channel& operator=(Channel&&) = delete;
+inline case_m default_m(DefaultSelectable::channel);
 
-    template <typename... U>
-    void Add(U&&... args) {
-        buffer.emplace_back(std::forward<U>(args)...);
+template <typename A, typename V>
+auto select_invoke(A&& action, V&& value) {
+    if constexpr (std::is_invocable_v<A, V>) {
+        return action(value);
+    }
+    else if constexpr (std::is_invocable_v<A>) {
+        return action();
     }
+    return;
+}
 
-    template <typename U>
-    Channel& operator<<(U&& task) {
-        Add(std::forward<U>(task));
-        return *this;
+// a descriptor may become ready any time, a channel until it is closed
+// and drained
+template <typename C>
+bool select_open(C& channel) {
+    if constexpr (std::is_same_v<std::decay_t<C>, FdSelectable>) {
+        return true;
+    }
+    else {
+        return channel.Readable();
     }
+}
 
-    std::optional<value_type> Get() {
-        return buffer.pop_front();
+// Run the action of the first case with a message, in argument order.
+// Blocks until a case fires, parked while none is ready, and returns
+// without running one once every case is closed.
+template <typename... T>
+void select(T&&... matches) {
+    bool run = true;
+    auto try_action = [&](auto& match) {
+        if (run) {
+            auto opt = match.channel.TryGet();
+            if (opt.has_value()) {
+                run = false;
+                select_invoke(match.action, opt.value());
+            }
+        }
+    };
+
+    while (true) {
+        (try_action(matches), ...);
+        if (!run || !(select_open(matches.channel) || ...)) {
+            return;
+        }
+
+        // messages sent since the pass are found ready by the wait
+        SelectWait wait;
+        (wait.Add(matches.channel), ...);
+        wait.Park();
+        (wait.Remove(matches.channel), ...);
     }
+}
 
-    std::optional<value_type> TryGet() {
-        return buffer.try_pop();
+
+// Channel between processes, the ring lives in a named shared memory
+// object. One process creates it with a capacity, the peer opens it by
+// name, and both ends may Add and Get from any number of threads.
+//
+// Slots carry sequence numbers, so a send or receive is a single CAS
+// and no lock is ever held across processes. Blocked ends park on
+// process shared futex words and wake up periodically to check their
+// peer, a peer which exits without closing closes the channel, and
+// pending messages are still received. Slots the dead peer claimed but
+// never filled are skipped, see Reclaimed.
+template <typename T>
+class SharedChannel {
+public:
+    static_assert(std::is_trivially_copyable_v<T>,
+                  "SharedChannel requires trivially copyable messages");
+
+    using value_type = T;
+    using iterator = ChannelIterator<T, SharedChannel>;
+
+    // create `name` with room for `capacity` messages, rounded up to a
+    // power of two. A stale object left under the same name is replaced,
+    // the last end to go away removes the name.
+    SharedChannel(std::string name, size_t capacity)
+        : name(std::move(name)), role(0), header(nullptr), cells(nullptr),
+          num_pushing(0), num_reclaimed(0), num_push_park(0),
+          num_pop_park(0) {
+        size_t num_cells = 1;
+        while (num_cells < capacity) {
+            num_cells <<= 1;
+        }
+
+        platform::SharedMemory::unlink(this->name);
+        size_t size = offset() + num_cells * sizeof(Cell);
+        if (!memory.create(this->name, size)) {
+            return;
+        }
+
+        header = new (memory.data()) Header();
+        cells = reinterpret_cast<Cell*>(
+            static_cast<unsigned char*>(memory.data()) + offset());
+        for (size_t i = 0; i < num_cells; ++i) {
+            new (&cells[i]) Cell();
+            cells[i].seq.store(i, std::memory_order_relaxed);
+        }
+
+        header->mask = num_cells - 1;
+        header->pids[0].store(platform::process_id());
+        header->magic.store(magic, std::memory_order_release);
     }
 
-    Channel& operator>>(std::optional<value_type>& get) {
+    // open a channel created by the peer, closed if it does not exist
+    // or already has two ends
+    SharedChannel(std::string name)
+        : name(std::move(name)), role(1), header(nullptr), cells(nullptr),
+          num_pushing(0), num_reclaimed(0), num_push_park(0),
+          num_pop_park(0) {
+        if (!memory.open(this->name) || memory.size() < offset()) {
+            return;
+        }
+
+        auto candidate = static_cast<Header*>(memory.data());
+        if (candidate->magic.load(std::memory_order_acquire) != magic
+            || memory.size()
+                   < offset() + (candidate->mask + 1) * sizeof(Cell)) {
+            memory.close();
+            return;
+        }
+
+        // the slot of a dead opener may be taken over
+        long peer = candidate->pids[1].load();
+        long self = platform::process_id();
+        if ((peer != 0 && platform::process_alive(peer))
+            || !candidate->pids[1].compare_exchange_strong(peer, self)) {
+            memory.close();
+            return;
+        }
+
+        header = candidate;
+        cells = reinterpret_cast<Cell*>(
+            static_cast<unsigned char*>(memory.data()) + offset());
+    }
+
+    // the name is kept while the peer is alive, it may still open it
+    ~SharedChannel() {
+        if (header == nullptr) {
+            return;
+        }
+
+        Close();
+        header->pids[role].store(0);
+        long peer = header->pids[1 - role].load();
+        memory.close();
+        if (peer == 0 || !platform::process_alive(peer)) {
+            platform::SharedMemory::unlink(name);
+        }
+    }
+
+    SharedChannel(SharedChannel const&) = delete;
+    SharedChannel(SharedChannel&&) = delete;
+
+    SharedChannel& operator=(SharedChannel const&) = delete;
+    SharedChannel& operator=(SharedChannel&&) = delete;
+
+    // Blocks while full, false once closed.
+    bool Add(T const& value) {
+        if (header == nullptr) {
+            return false;
+        }
+
+        while (!closed()) {
+            uint32_t epoch = header->pops.load(std::memory_order_acquire);
+            if (try_push(value)) {
+                notify(header->pushes, header->readers);
+                return true;
+            }
+
+            park(header->pops, header->writers, epoch, num_push_park,
+                 [&] { return !full(); });
+        }
+        return false;
+    }
+
+    // Blocks while empty, nullopt once closed and drained.
+    std::optional<T> Get() {
+        if (header == nullptr) {
+            return std::nullopt;
+        }
+
+        while (true) {
+            uint32_t epoch = header->pushes.load(std::memory_order_acquire);
+            if (auto value = try_pop()) {
+                notify(header->pops, header->writers);
+                return value;
+            }
+
+            // messages sent before close are still received
+            if (closed()) {
+                if (reclaim()) {
+                    continue;
+                }
+                return std::nullopt;
+            }
+
+            park(header->pushes, header->readers, epoch, num_pop_park,
+                 [&] { return !empty(); });
+        }
+    }
+
+    std::optional<T> TryGet() {
+        if (header == nullptr) {
+            return std::nullopt;
+        }
+
+        auto value = try_pop();
+        if (value.has_value()) {
+            notify(header->pops, header->writers);
+        }
+        return value;
+    }
+
+    SharedChannel& operator<<(T const& value) {
+        Add(value);
+        return *this;
+    }
+
+    SharedChannel& operator>>(std::optional<T>& get) {
         get = Get();
         return *this;
     }
 
-    Channel& operator>>(value_type& get) {
-        std::optional<value_type> res = Get();
+    SharedChannel& operator>>(T& get) {
+        std::optional<T> res = Get();
         if (res.has_value()) {
-            get = std::move(res.value());
+            get = res.value();
         }
         return *this;
     }
 
+    // close both ends, blocked peers return
     void Close() {
-        buffer.close();
+        if (header == nullptr || header->closed.exchange(1) != 0) {
+            return;
+        }
+
+        header->pushes.fetch_add(1, std::memory_order_release);
+        header->pops.fetch_add(1, std::memory_order_release);
+        platform::futex_wake(header->pushes, true);
+        platform::futex_wake(header->pops, true);
     }
 
     bool Runnable() const {
-        return buffer.runnable();
+        return header != nullptr
+               && header->closed.load(std::memory_order_acquire) == 0;
     }
 
-    bool Readable() {
-        return buffer.readable();
+    bool Readable() const {
+        return header != nullptr && (!closed() || !empty());
+    }
+
+    // false if the shared memory object could not be created or opened
+    bool Attached() const {
+        return header != nullptr;
+    }
+
+    // slots skipped by this end as a dead peer claimed and never filled
+    // them, the messages it was sending there are lost
+    size_t Reclaimed() const {
+        return num_reclaimed.load(std::memory_order_relaxed);
+    }
+
+    // size, pushed and popped are shared by both ends, parks are local
+    QueueStat Stat() const {
+        uint64_t head = 0;
+        uint64_t tail = 0;
+        if (header != nullptr) {
+            head = header->head.load(std::memory_order_relaxed);
+            tail = header->tail.load(std::memory_order_relaxed);
+        }
+        return QueueStat{ static_cast<size_t>(tail - std::min(head, tail)),
+                          static_cast<size_t>(tail),
+                          static_cast<size_t>(head),
+                          num_push_park.load(std::memory_order_relaxed),
+                          num_pop_park.load(std::memory_order_relaxed),
+                          0,
+                          0,
+                          0,
+                          0 };
     }
 
     iterator begin() {
@@ -311,357 +8432,773 @@ public:
     }
 
 private:
-    Container buffer;
-};
-
-template <typename T>
-using LChannel = Channel<TSList<T>>;
-
-template <typename T>
-using RChannel = Channel<TSRingBuffer<T>>;
-
+    static constexpr uint32_t magic = 0x53484348;
+
+    // how often a parked end checks whether its peer is alive
+    static constexpr std::chrono::microseconds liveness{ 50'000 };
+
+    // placed at the start of the shared object, the futex words are
+    // bumped on every receive and send
+    struct Header {
+        std::atomic<uint32_t> magic{ 0 };
+        std::atomic<uint32_t> closed{ 0 };
+        uint64_t mask = 0;
+        std::atomic<long> pids[2] = { { 0 }, { 0 } };
+
+        alignas(platform::cache_line) std::atomic<uint64_t> head{ 0 };
+        std::atomic<uint32_t> pops{ 0 };
+        std::atomic<uint32_t> writers{ 0 };
+
+        alignas(platform::cache_line) std::atomic<uint64_t> tail{ 0 };
+        std::atomic<uint32_t> pushes{ 0 };
+        std::atomic<uint32_t> readers{ 0 };
+    };
 
-namespace LockFree {
-    template <typename T>
-    struct Node {
-        T data;
-        std::atomic<Node*> next;
+    struct Cell {
+        std::atomic<uint64_t> seq{ 0 };
+        std::atomic<uint32_t> skip{ 0 };
+        T value;
+    };
 
-        Node() : data(), next(nullptr) {
-            // Do Nothing
-        }
+    static constexpr size_t offset() {
+        return (sizeof(Header) + platform::cache_line - 1)
+               / platform::cache_line * platform::cache_line;
+    }
 
-        template <typename... U>
-        Node(U&&... data) : data(std::forward<U>(data)...), next(nullptr) {
-            // Do Nothing
-        }
-    };
+    // a push in flight is never reclaimed, see reclaim
+    bool try_push(T const& value) {
+        num_pushing.fetch_add(1);
+        bool pushed = header->closed.load() == 0 && push(value);
+        num_pushing.fetch_sub(1);
+        return pushed;
+    }
 
-    template <typename T>
-    class List {
-    public:
-        List() : m_head(nullptr), m_tail(nullptr), m_runnable(true), m_size(0) {
-            // Do Nothing
+    bool push(T const& value) {
+        uint64_t pos = header->tail.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells[pos & header->mask];
+            uint64_t seq = cell.seq.load(std::memory_order_acquire);
+            auto diff = static_cast<int64_t>(seq - pos);
+            if (diff == 0) {
+                if (header->tail.compare_exchange_weak(
+                        pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.value = value;
+                    cell.skip.store(0, std::memory_order_relaxed);
+                    cell.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0) {
+                return false;
+            }
+            else {
+                pos = header->tail.load(std::memory_order_relaxed);
+            }
         }
+    }
 
-        ~List() {
-            m_runnable.store(false, std::memory_order_release);
-
-            Node<T>* node = m_head.load();
-            while (node != nullptr) {
-                Node<T>* next = node->next;
-                delete node;
-                node = next;
+    std::optional<T> try_pop() {
+        uint64_t pos = header->head.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells[pos & header->mask];
+            uint64_t seq = cell.seq.load(std::memory_order_acquire);
+            auto diff = static_cast<int64_t>(seq - (pos + 1));
+            if (diff == 0) {
+                if (header->head.compare_exchange_weak(
+                        pos, pos + 1, std::memory_order_relaxed)) {
+                    T value = cell.value;
+                    bool skip = cell.skip.load(std::memory_order_relaxed);
+                    cell.seq.store(pos + header->mask + 1,
+                                   std::memory_order_release);
+                    if (!skip) {
+                        return value;
+                    }
+                    pos = header->head.load(std::memory_order_relaxed);
+                }
+            }
+            else if (diff < 0) {
+                return std::nullopt;
+            }
+            else {
+                pos = header->head.load(std::memory_order_relaxed);
             }
         }
+    }
 
-        List(List const&) = delete;
-        List(List&&) = delete;
+    bool empty() const {
+        uint64_t pos = header->head.load(std::memory_order_acquire);
+        return cells[pos & header->mask].seq.load(std::memory_order_acquire)
+               != pos + 1;
+    }
 
-        List& operator=(List const&) = delete;
-        List& operator=(List&&) = delete;
+    bool full() const {
+        uint64_t pos = header->tail.load(std::memory_order_acquire);
+        return cells[pos & header->mask].seq.load(std::memory_order_acquire)
+               != pos;
+    }
 
-        void push_back(T const& data) {
-            push_node(new Node<T>(data));
+    bool closed() const {
+        return header->closed.load(std::memory_order_acquire) != 0;
+    }
+
+    // bump the epoch, the syscall is skipped without waiters
+    static void notify(std::atomic<uint32_t>& word,
+                       std::atomic<uint32_t>& waiters) {
+        word.fetch_add(1, std::memory_order_release);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiters.load(std::memory_order_relaxed) > 0) {
+            platform::futex_wake(word, true);
         }
+    }
 
-        void push_back(T&& data) {
-            push_node(new Node<T>(std::move(data)));
+    // wait for the epoch to move, registered before the last check so a
+    // concurrent notify either sees the waiter or moves the epoch first
+    template <typename F>
+    void park(std::atomic<uint32_t>& word,
+              std::atomic<uint32_t>& waiters,
+              uint32_t epoch,
+              std::atomic<size_t>& parks,
+              F&& ready) {
+        waiters.fetch_add(1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!ready() && !closed()) {
+            parks.fetch_add(1, std::memory_order_relaxed);
+            platform::futex_wait(word, epoch, true, liveness);
+            if (word.load(std::memory_order_acquire) == epoch
+                && !peer_alive()) {
+                Close();
+            }
         }
+        waiters.fetch_sub(1);
+    }
 
-        template <typename... U>
-        void emplace_back(U&&... args) {
-            push_node(new Node<T>(std::forward<U>(args)...));
+    // Publish as skipped the slots between head and tail still claimed,
+    // they would hide every message behind them. Once closed by a dead
+    // peer and with no push of this process in flight, so each of them
+    // was claimed by the peer. False if there was none.
+    bool reclaim() {
+        if (peer_alive() || num_pushing.load() > 0) {
+            return false;
         }
 
-        void push_node(Node<T>* node) {
-            bool run = false;
-            Node<T>* prev = nullptr;
-            do {
-                run = runnable();
-                prev = m_tail.load(std::memory_order_relaxed);
-            } while (
-                run
-                && !m_tail.compare_exchange_weak(prev,
-                                                 node,
-                                                 std::memory_order_relaxed,
-                                                 std::memory_order_relaxed));
-            if (run) {
-                if (prev != nullptr) {
-                    prev->next.store(node, std::memory_order_relaxed);
-                }
-                else {
-                    m_head.store(node, std::memory_order_relaxed);
-                }
-                ++m_size;
+        uint64_t head = header->head.load(std::memory_order_acquire);
+        uint64_t tail = header->tail.load(std::memory_order_acquire);
+        size_t num = 0;
+        for (uint64_t pos = head; pos < tail; ++pos) {
+            Cell& cell = cells[pos & header->mask];
+            uint64_t seq = pos;
+            if (cell.seq.load(std::memory_order_acquire) != seq) {
+                continue;
+            }
+
+            cell.skip.store(1, std::memory_order_relaxed);
+            if (cell.seq.compare_exchange_strong(
+                    seq, pos + 1, std::memory_order_release)) {
+                num += 1;
             }
         }
+        num_reclaimed.fetch_add(num, std::memory_order_relaxed);
+        return num > 0;
+    }
 
-        template <typename U = decltype(platform::prevent_deadlock)>
-        std::optional<T> pop_front(U const& prevent_deadlock
-                                   = platform::prevent_deadlock) {
-            bool run = false;
-            Node<T>* node = nullptr;
-            do {
-                std::this_thread::sleep_for(prevent_deadlock);
+    bool peer_alive() const {
+        long peer = header->pids[1 - role].load();
+        return peer == 0 || platform::process_alive(peer);
+    }
 
-                run = readable();
-                node = m_head.load(std::memory_order_relaxed);
-            } while (run
-                     && (!node
-                         || !m_head.compare_exchange_weak(
-                             node,
-                             node->next,
-                             std::memory_order_relaxed,
-                             std::memory_order_relaxed)));
-            if (run) {
-                if (node->next == nullptr) {
-                    m_tail.store(nullptr, std::memory_order_relaxed);
-                }
-                --m_size;
-                T res = std::move(node->data);
+    std::string name;
+    int role;
+
+    platform::SharedMemory memory;
+    Header* header;
+    Cell* cells;
+
+    std::atomic<size_t> num_pushing;
+    std::atomic<size_t> num_reclaimed;
+    std::atomic<size_t> num_push_park;
+    std::atomic<size_t> num_pop_park;
+};
+
+
+// longest chain of the last run, weighted by the node durations
+struct CriticalPath {
+    std::vector<size_t> nodes;
+    std::chrono::nanoseconds length;
+};
+
+// Reusable DAG of tasks run on a ThreadPool<void>. Every node counts its
+// unfinished predecessors, the predecessor finishing last schedules it,
+// so no thread ever blocks on an edge. A finished node runs one ready
+// successor itself and queues the others on the pool.
+//
+// A node that throws skips the nodes not started yet, Run rethrows the
+// exception once the graph is drained. The graph must not be modified or
+// run again while it runs.
+//
+//     TaskGraph graph;
+//     auto load = graph.Add([&] { ... }, "load");
+//     auto parse = graph.Add([&] { ... }, "parse");
+//     graph.Precede(load, parse);
+//     graph.Run(pool);
+class TaskGraph {
+public:
+    TaskGraph()
+        : checked(true), acyclic(true), failed(false), num_runs(0) {
+        // Do Nothing
+    }
 
-                delete node;
-                return std::make_optional(std::move(res));
-            }
-            return std::nullopt;
+    TaskGraph(TaskGraph const&) = delete;
+    TaskGraph(TaskGraph&&) = delete;
+
+    TaskGraph& operator=(TaskGraph const&) = delete;
+    TaskGraph& operator=(TaskGraph&&) = delete;
+
+    // label should outlive the graph, typically a string literal
+    size_t Add(std::function<void()> task, char const* label = nullptr) {
+        nodes.emplace_back(std::move(task), label);
+        return nodes.size() - 1;
+    }
+
+    // `after` starts once `before` has finished
+    void Precede(size_t before, size_t after) {
+        nodes[before].successors.push_back(after);
+        nodes[after].num_deps += 1;
+        checked = false;
+    }
+
+    // Run every node and wait for them, helping the pool meanwhile. False
+    // without running anything if the graph has a cycle.
+    template <typename Pool>
+    bool Run(Pool& pool) {
+        if (!Acyclic()) {
+            return false;
+        }
+        if (nodes.empty()) {
+            return true;
         }
 
-        std::optional<T> try_pop() {
-            Node<T>* node = m_head.load(std::memory_order_relaxed);
-            if (readable() && node
-                && m_head.compare_exchange_weak(node,
-                                                node->next,
-                                                std::memory_order_relaxed,
-                                                std::memory_order_relaxed)) {
-                if (node->next == nullptr) {
-                    m_tail.store(nullptr, std::memory_order_relaxed);
-                }
-                --m_size;
-                T res = std::move(node->data);
+        auto start = clock::now();
+        pending.Add(nodes.size());
+        failed.store(false, std::memory_order_relaxed);
+        for (auto& node : nodes) {
+            node.remaining.store(node.num_deps, std::memory_order_relaxed);
+        }
 
-                delete node;
-                return std::make_optional(std::move(res));
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            if (nodes[i].num_deps == 0) {
+                pool.Add(nodes[i].label,
+                         [this, &pool, i] { execute(pool, i); });
             }
-            return std::nullopt;
         }
 
-        size_t size() const {
-            return m_size.load(std::memory_order_relaxed);
-        }
+        pending.Wait(pool, this, "task graph");
+        elapsed = clock::now() - start;
+        num_runs += 1;
 
-        Node<T>* head() {
-            return m_head.load(std::memory_order_relaxed);
+        std::exception_ptr error;
+        {
+            std::unique_lock lock(mutex);
+            error = std::exchange(first, nullptr);
         }
+        if (error != nullptr) {
+            std::rethrow_exception(error);
+        }
+        return true;
+    }
 
-        Node<T>* tail() {
-            return m_tail.load(std::memory_order_relaxed);
+    // false if the edges form a cycle
+    bool Acyclic() {
+        if (!checked) {
+            acyclic = order().size() == nodes.size();
+            checked = true;
         }
+        return acyclic;
+    }
 
-        bool runnable() const {
-            return m_runnable.load(std::memory_order_relaxed);
+    size_t Size() const {
+        return nodes.size();
+    }
+
+    char const* Label(size_t node) const {
+        return nodes[node].label;
+    }
+
+    // of the last run, zero for skipped nodes
+    std::chrono::nanoseconds Duration(size_t node) const {
+        return nodes[node].duration;
+    }
+
+    // wall clock time of the last run
+    std::chrono::nanoseconds Elapsed() const {
+        return elapsed;
+    }
+
+    // Sum of the node durations of the last run, Work over the critical
+    // path length bounds the speedup any number of workers may give.
+    std::chrono::nanoseconds Work() const {
+        std::chrono::nanoseconds work(0);
+        for (auto const& node : nodes) {
+            work += node.duration;
         }
+        return work;
+    }
 
-        bool readable() const {
-            return runnable()
-                   || m_head.load(std::memory_order_relaxed) != nullptr;
+    CriticalPath Critical() {
+        CriticalPath path{ {}, std::chrono::nanoseconds(0) };
+        if (!Acyclic() || nodes.empty()) {
+            return path;
         }
 
-        void interrupt() {
-            m_runnable.store(false, std::memory_order_relaxed);
+        // longest finish of each node along its chain of predecessors
+        std::vector<std::chrono::nanoseconds> finish(nodes.size());
+        std::vector<size_t> prev(nodes.size(), nodes.size());
+        for (size_t i : order()) {
+            finish[i] += nodes[i].duration;
+            for (size_t next : nodes[i].successors) {
+                if (prev[next] == nodes.size() || finish[i] > finish[next]) {
+                    finish[next] = finish[i];
+                    prev[next] = i;
+                }
+            }
         }
 
-        void resume() {
-            m_runnable.store(true, std::memory_order_relaxed);
+        size_t last = static_cast<size_t>(
+            std::max_element(finish.begin(), finish.end()) - finish.begin());
+        path.length = finish[last];
+        for (size_t i = last; i != nodes.size(); i = prev[i]) {
+            path.nodes.push_back(i);
         }
+        std::reverse(path.nodes.begin(), path.nodes.end());
+        return path;
+    }
 
-    private:
-        std::atomic<Node<T>*> m_head;
-        std::atomic<Node<T>*> m_tail;
+    size_t Runs() const {
+        return num_runs;
+    }
 
-        std::atomic<bool> m_runnable;
-        std::atomic<size_t> m_size;
+private:
+    using clock = std::chrono::steady_clock;
+
+    struct Node {
+        Node(std::function<void()> task, char const* label)
+            : task(std::move(task)), label(label), num_deps(0),
+              remaining(0), duration(0) {
+            // Do Nothing
+        }
+
+        std::function<void()> task;
+        char const* label;
+        std::vector<size_t> successors;
+        size_t num_deps;
+        std::atomic<size_t> remaining;
+        std::chrono::nanoseconds duration;
     };
-}  // namespace LockFree
 
+    template <typename Pool>
+    void execute(Pool& pool, size_t idx) {
+        while (true) {
+            Node& node = nodes[idx];
+            node.duration = std::chrono::nanoseconds(0);
+            if (!failed.load(std::memory_order_relaxed)) {
+                auto start = clock::now();
+                try {
+                    node.task();
+                }
+                catch (...) {
+                    fail(std::current_exception());
+                }
+                node.duration = clock::now() - start;
+            }
 
-template <typename T, typename F>
-struct Selectable {
-    T& channel;
-    F action;
+            // skipped nodes release their successors all the same
+            size_t next = nodes.size();
+            for (size_t succ : node.successors) {
+                if (nodes[succ].remaining.fetch_sub(
+                        1, std::memory_order_acq_rel)
+                    != 1) {
+                    continue;
+                }
 
-    template <typename Fs>
-    Selectable(T& channel, Fs&& action)
-        : channel(channel), action(std::forward<Fs>(action)) {
-        // Do Nothing
+                if (next == nodes.size()) {
+                    next = succ;
+                }
+                else {
+                    pool.Add(nodes[succ].label,
+                             [this, &pool, succ] { execute(pool, succ); });
+                }
+            }
+
+            // the graph may be gone as soon as the count drops to zero,
+            // which a ready successor holds off, nothing of it is read
+            // after the last decrement
+            bool done = next == nodes.size();
+            pending.Done();
+            if (done) {
+                return;
+            }
+            idx = next;
+        }
     }
-};
 
-struct DefaultSelectable {
-    bool Readable() const {
-        return true;
+    void fail(std::exception_ptr error) {
+        std::unique_lock lock(mutex);
+        if (first == nullptr) {
+            first = std::move(error);
+        }
+        failed.store(true, std::memory_order_relaxed);
     }
 
-    std::optional<void*> TryGet() const {
-        return { nullptr };
+    // topological order, shorter than the graph if it has a cycle
+    std::vector<size_t> order() const {
+        std::vector<size_t> deps(nodes.size());
+        std::vector<size_t> sorted;
+        sorted.reserve(nodes.size());
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            deps[i] = nodes[i].num_deps;
+            if (deps[i] == 0) {
+                sorted.push_back(i);
+            }
+        }
+
+        for (size_t pos = 0; pos < sorted.size(); ++pos) {
+            for (size_t next : nodes[sorted[pos]].successors) {
+                if (--deps[next] == 0) {
+                    sorted.push_back(next);
+                }
+            }
+        }
+        return sorted;
     }
 
-    static DefaultSelectable channel;
+    std::deque<Node> nodes;
+    bool checked;
+    bool acyclic;
+
+    JoinCount pending;
+    std::atomic<bool> failed;
+    std::mutex mutex;
+    std::exception_ptr first;
+
+    std::chrono::nanoseconds elapsed{ 0 };
+    size_t num_runs;
 };
-DefaultSelectable DefaultSelectable::channel;
 
-template <typename T>
-struct case_m {
-    T& channel;
 
-    case_m(T& channel) : channel(channel) {
+// Structured fan out over a ThreadPool<void>, children never outlive the
+// scope. The first child to throw cancels the scope, children still
+// queued are then skipped, and the exception is rethrown by Join or by
+// the destructor. Running children may poll Cancelled to stop early.
+//
+// Joining runs queued pool tasks on the joining thread, so scopes nested
+// inside children keep every worker busy instead of parking them.
+//
+//     TaskScope scope(pool);
+//     for (auto const& part : parts) {
+//         scope.Spawn([&] { process(part); });
+//     }
+//     scope.Join();
+template <typename Pool>
+class TaskScope {
+public:
+    TaskScope(Pool& pool)
+        : pool(pool), cancelled(false), num_skipped(0),
+          uncaught(std::uncaught_exceptions()) {
         // Do Nothing
     }
 
+    // joins, rethrows unless the scope is left by an exception
+    ~TaskScope() noexcept(false) {
+        wait();
+        if (std::uncaught_exceptions() == uncaught) {
+            rethrow();
+        }
+    }
+
+    TaskScope(TaskScope const&) = delete;
+    TaskScope(TaskScope&&) = delete;
+
+    TaskScope& operator=(TaskScope const&) = delete;
+    TaskScope& operator=(TaskScope&&) = delete;
+
+    // children may spawn siblings into the scope
     template <typename F>
-    Selectable<T, F> operator>>(F&& action) {
-        return Selectable<T, F>(channel, std::forward<F>(action));
+    void Spawn(F&& task) {
+        Spawn(nullptr, std::forward<F>(task));
     }
-};
 
-inline case_m default_m(DefaultSelectable::channel);
+    template <typename F>
+    void Spawn(char const* label, F&& task) {
+        if (Cancelled()) {
+            num_skipped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
 
-template <typename A, typename V>
-auto select_invoke(A&& action, V&& value) {
-    if constexpr (std::is_invocable_v<A, V>) {
-        return action(value);
+        pending.Add();
+        pool.Add(label, [this, task = std::forward<F>(task)]() mutable {
+            run(task);
+        });
     }
-    else if constexpr (std::is_invocable_v<A>) {
-        return action();
+
+    // wait for every child, rethrow the first exception
+    void Join() {
+        wait();
+        rethrow();
     }
-    return;
-}
 
-template <typename... T>
-void select(T&&... matches) {
-    auto readable = [](auto&... selectable) {
-        return (selectable.channel.Readable() || ...);
-    };
+    // skip children not started yet
+    void Cancel() {
+        cancelled.store(true, std::memory_order_release);
+    }
 
-    bool run = true;
-    auto try_action = [&](auto& match) {
-        if (run) {
-            auto opt = match.channel.TryGet();
-            if (opt.has_value()) {
-                run = false;
-                select_invoke(match.action, opt.value());
+    bool Cancelled() const {
+        return cancelled.load(std::memory_order_acquire);
+    }
+
+    // children spawned or queued after the scope was cancelled
+    size_t Skipped() const {
+        return num_skipped.load(std::memory_order_relaxed);
+    }
+
+private:
+    template <typename F>
+    void run(F& task) {
+        if (Cancelled()) {
+            num_skipped.fetch_add(1, std::memory_order_relaxed);
+        }
+        else {
+            try {
+                task();
+            }
+            catch (...) {
+                fail(std::current_exception());
             }
         }
-    };
 
-    while (!readable(matches...))
-        ;
-    (try_action(matches), ...);
-}
+        BlockingRegistry::Instance().Progress();
+        // the scope may be gone as soon as the count drops
+        pending.Done();
+    }
 
+    void fail(std::exception_ptr error) {
+        {
+            std::unique_lock lock(mutex);
+            if (first == nullptr) {
+                first = std::move(error);
+            }
+        }
+        Cancel();
+    }
 
-template <typename T,
-          template <typename> class ChannelType = RChannel>
-class ThreadPool {
-public:
-    ThreadPool() : ThreadPool(std::thread::hardware_concurrency()) {
-        // Do Nothing
+    void wait() {
+        pending.Wait(pool, this, "task scope");
     }
 
-    template <typename... Args>
-    ThreadPool(size_t num_threads, Args&&... args)
-        : runnable(true), num_threads(num_threads),
-          channel(std::forward<Args>(args)...),
-          threads(std::make_unique<std::thread[]>(num_threads)) {
-        for (size_t i = 0; i < num_threads; ++i) {
-            threads[i] = std::thread([this] {
-                while (runnable) {
-                    auto given = channel.Get();
-                    if (!given.has_value()) {
-                        break;
-                    }
-                    given.value()();
-                }
-            });
+    void rethrow() {
+        std::exception_ptr error;
+        {
+            std::unique_lock lock(mutex);
+            error = std::exchange(first, nullptr);
+        }
+        if (error != nullptr) {
+            std::rethrow_exception(error);
         }
     }
 
-    ~ThreadPool() {
-        Stop();
-    }
+    Pool& pool;
+    JoinCount pending;
+    std::atomic<bool> cancelled;
+    std::atomic<size_t> num_skipped;
+    int uncaught;
 
-    ThreadPool(const ThreadPool&) = delete;
-    ThreadPool(ThreadPool&&) = delete;
+    std::mutex mutex;
+    std::exception_ptr first;
+};
 
-    ThreadPool& operator=(const ThreadPool&) = delete;
-    ThreadPool& operator=(ThreadPool&&) = delete;
 
-    template <typename F>
-    std::future<T> Add(F&& task) {
-        std::packaged_task<T()> ptask(std::forward<F>(task));
-        std::future<T> fut = ptask.get_future();
-        channel.Add(std::move(ptask));
-        return fut;
+// Opt-in deadlock detector, like "all goroutines are asleep" of golang.
+// While alive it tracks threads blocked on channels and wait groups,
+// and reports the wait graph once every tracked thread has been blocked
+// without any channel or wait group progress for `threshold`.
+// At least one thread must wait outside an idle pool worker loop, so
+// an idle pool alone is not a deadlock. Threads which never touch a
+// tracked primitive are invisible, so keep the threshold generous. The
+// graph is printed to stderr, pass Abort to end the process as well.
+class Watchdog {
+public:
+    using Reporter = std::function<void(std::string const&)>;
+
+    static void Print(std::string const& graph) {
+        std::cerr << graph << std::flush;
     }
 
-    size_t GetNumThreads() const {
-        return num_threads;
+    static void Abort(std::string const& graph) {
+        Print(graph);
+        std::abort();
     }
 
-    void Stop() {
-        if (threads != nullptr) {
-            runnable = false;
-            channel.Close();
+    template <typename Rep, typename Period>
+    Watchdog(std::chrono::duration<Rep, Period> threshold,
+             Reporter reporter = Print)
+        : threshold(std::chrono::duration_cast<clock::duration>(threshold)),
+          reporter(std::move(reporter)), runnable(true), stalled(false),
+          reported(false), stall_epoch(0) {
+        BlockingRegistry::Instance().Enable(true);
+
+        auto period = this->threshold / 4;
+        if (period < std::chrono::milliseconds(1)) {
+            period = std::chrono::milliseconds(1);
+        }
 
-            for (size_t i = 0; i < num_threads; ++i) {
-                if (threads[i].joinable()) {
-                    threads[i].join();
+        monitor = std::thread([this, period] {
+            std::unique_lock lock(mutex);
+            while (runnable) {
+                cond.wait_for(lock, period, [this] { return !runnable; });
+                if (!runnable) {
+                    break;
+                }
+
+                lock.unlock();
+                if (auto graph = Check()) {
+                    this->reporter(graph.value());
                 }
+                lock.lock();
             }
-            threads.reset();
-        }
+        });
     }
 
-private:
-    bool runnable;
-    size_t num_threads;
-
-    ChannelType<std::packaged_task<T()>> channel;
-    std::unique_ptr<std::thread[]> threads;
-};
+    ~Watchdog() {
+        {
+            std::unique_lock lock(mutex);
+            runnable = false;
+        }
+        cond.notify_all();
+        monitor.join();
 
-template <typename T>
-using LThreadPool = ThreadPool<T, LChannel>;
+        BlockingRegistry::Instance().Enable(false);
+    }
 
+    Watchdog(Watchdog const&) = delete;
+    Watchdog(Watchdog&&) = delete;
 
-using ull = unsigned long long;
+    Watchdog& operator=(Watchdog const&) = delete;
+    Watchdog& operator=(Watchdog&&) = delete;
 
-class WaitGroup {
-public:
-    WaitGroup() : visit(0) {
-        // Do Nothing
+    // label an object in the wait graph, eg. Name(&channel, "jobs")
+    static void Name(void const* object, std::string name) {
+        BlockingRegistry::Instance().Name(object, std::move(name));
     }
 
-    WaitGroup(ull visit) : visit(visit) {
-        // Do Nothing
+    static void Unname(void const* object) {
+        BlockingRegistry::Instance().Unname(object);
     }
 
-    ull Add() {
-        return (visit += 1);
-    }
+    // wait graph if the process has been stuck longer than threshold,
+    // reported once per stall
+    std::optional<std::string> Check() {
+        BlockingRegistry& registry = BlockingRegistry::Instance();
+        size_t epoch = registry.Epoch();
+
+        std::vector<Waiter> waiters;
+        bool all_blocked = true;
+        bool any_waiting = false;
+
+        registry.ForEach([&](ThreadRecord const& record) {
+            void const* object =
+                record.object.load(std::memory_order_acquire);
+            if (object == nullptr) {
+                all_blocked = false;
+                return;
+            }
 
-    ull Done() {
-        return (visit -= 1);
-    }
+            bool idle = record.idle.load(std::memory_order_relaxed);
+            any_waiting = any_waiting || !idle;
+            waiters.push_back(
+                Waiter{ object,
+                        record.kind.load(std::memory_order_relaxed),
+                        record.name,
+                        idle,
+                        record.since.load(std::memory_order_relaxed) });
+        });
 
-    void Wait() {
-        while (visit > 0) {
-            std::this_thread::yield();
+        auto now = clock::now();
+        if (!all_blocked || !any_waiting || epoch != registry.Epoch()) {
+            stalled = false;
+            reported = false;
+            return std::nullopt;
+        }
+
+        if (!stalled || epoch != stall_epoch) {
+            stalled = true;
+            reported = false;
+            stall_epoch = epoch;
+            stall_start = now;
+            return std::nullopt;
         }
+
+        if (reported || now - stall_start < threshold) {
+            return std::nullopt;
+        }
+        reported = true;
+        return Graph(waiters, now);
     }
 
 private:
-    std::atomic<ull> visit;
+    using clock = std::chrono::steady_clock;
+
+    struct Waiter {
+        void const* object;
+        char const* kind;
+        std::string thread;
+        bool idle;
+        clock::rep since;
+    };
+
+    static std::string Graph(std::vector<Waiter> const& waiters,
+                             clock::time_point now) {
+        using ms = std::chrono::milliseconds;
+
+        std::map<void const*, std::vector<Waiter const*>> graph;
+        for (auto const& waiter : waiters) {
+            graph[waiter.object].push_back(&waiter);
+        }
+
+        std::ostringstream stream;
+        stream << "all threads are asleep - deadlock!\n";
+        for (auto const& [object, edges] : graph) {
+            stream << '\n' << object;
+
+            std::string name = BlockingRegistry::Instance().NameOf(object);
+            if (!name.empty()) {
+                stream << " (" << name << ')';
+            }
+            stream << '\n';
+
+            for (auto const* waiter : edges) {
+                auto blocked =
+                    now - clock::time_point(clock::duration(waiter->since));
+                stream << "    " << waiter->thread << " [" << waiter->kind
+                       << ", "
+                       << std::chrono::duration_cast<ms>(blocked).count()
+                       << "ms" << (waiter->idle ? ", idle worker" : "")
+                       << "]\n";
+            }
+        }
+        return stream.str();
+    }
+
+    clock::duration threshold;
+    Reporter reporter;
+
+    bool runnable;
+    std::mutex mutex;
+    std::condition_variable cond;
+
+    bool stalled;
+    bool reported;
+    size_t stall_epoch;
+    clock::time_point stall_start;
+
+    std::thread monitor;
 };
 
 
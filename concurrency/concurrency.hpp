@@ -2,13 +2,45 @@
 #define CONCURRENCY_HPP
 
 #include "impl/platform/constant.hpp"
+#include "impl/platform/event_fd.hpp"
+#include "impl/platform/futex.hpp"
+#include "impl/platform/input_file.hpp"
+#include "impl/platform/io_ring.hpp"
+#include "impl/platform/log_file.hpp"
+#include "impl/platform/mapped_file.hpp"
+#include "impl/platform/poller.hpp"
+#include "impl/platform/shared_memory.hpp"
+#include "impl/platform/signal.hpp"
+#include "impl/platform/socket.hpp"
+#include "impl/platform/thread.hpp"
+#include "impl/blocking.hpp"
+#include "impl/codec.hpp"
+#include "impl/memory_governor.hpp"
 #include "impl/container/ring_buffer.hpp"
+#include "impl/container/budgeted.hpp"
+#include "impl/container/conflating.hpp"
+#include "impl/container/spilling.hpp"
+#include "impl/container/byte_ring.hpp"
 #include "impl/container/thread_safe.hpp"
 #include "impl/lockfree/list.hpp"
 #include "impl/channel_iter.hpp"
 #include "impl/channel.hpp"
+#include "impl/byte_channel.hpp"
+#include "impl/durable_channel.hpp"
+#include "impl/shared_channel.hpp"
+#include "impl/net_channel.hpp"
 #include "impl/select.hpp"
+#include "impl/netpoller.hpp"
+#include "impl/io_service.hpp"
+#include "impl/file_source.hpp"
 #include "impl/thread_pool.hpp"
+#include "impl/task_scope.hpp"
+#include "impl/task_graph.hpp"
 #include "impl/wait_group.hpp"
+#include "impl/barrier.hpp"
+#include "impl/histogram.hpp"
+#include "impl/instrumented_mutex.hpp"
+#include "impl/metrics.hpp"
+#include "impl/watchdog.hpp"
 
 #endif
\ No newline at end of file
@@ -0,0 +1,285 @@
+#ifndef BARRIER_HPP
+#define BARRIER_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <utility>
+
+#include "blocking.hpp"
+#include "platform/futex.hpp"
+#include "platform/thread.hpp"
+
+// Phase word shared by Barrier and Phaser. Waiters remember the phase
+// they arrived in and wait for the word to move past it, the generalized
+// form of sense reversal, so the same word serves every phase. They spin
+// first, a short phase ends without a syscall, then park on a futex.
+class PhaseWord {
+public:
+    // on a single core the other parties only run when the waiter yields
+    PhaseWord(uint32_t phase, size_t spins)
+        : word(phase), waiters(0), spins(spins),
+          yield_every(std::thread::hardware_concurrency() > 1 ? 64 : 1) {
+        // Do Nothing
+    }
+
+    uint32_t Load() const {
+        return word.load(std::memory_order_acquire);
+    }
+
+    // block until a phase later than `phase` is published
+    void Await(uint32_t phase) {
+        for (size_t i = 0; i < spins; ++i) {
+            if (passed(word.load(std::memory_order_acquire), phase)) {
+                return;
+            }
+            if ((i + 1) % yield_every == 0) {
+                std::this_thread::yield();
+            }
+            else {
+                platform::cpu_relax();
+            }
+        }
+
+        BlockingScope scope(this, "barrier");
+        waiters.fetch_add(1);
+        for (uint32_t now = word.load(); !passed(now, phase);
+             now = word.load()) {
+            platform::futex_wait(word, now);
+        }
+        waiters.fetch_sub(1);
+    }
+
+    // release the waiters of every earlier phase
+    void Publish(uint32_t phase) {
+        word.store(phase);
+        BlockingRegistry::Instance().Progress();
+        if (waiters.load() > 0) {
+            platform::futex_wake(word);
+        }
+    }
+
+private:
+    // wraps around like the phase
+    static bool passed(uint32_t now, uint32_t phase) {
+        return static_cast<int32_t>(now - phase) > 0;
+    }
+
+    std::atomic<uint32_t> word;
+    std::atomic<uint32_t> waiters;
+    size_t spins;
+    size_t yield_every;
+};
+
+// Reusable barrier for a fixed number of parties. The last to arrive
+// runs the completion, then releases the others into the next phase.
+//
+//     Barrier barrier(num_workers, [&] { swap(current, next); });
+//     for (int step = 0; step < num_steps; ++step) {
+//         relax(current, next, part);
+//         barrier.ArriveAndWait();
+//     }
+class Barrier {
+public:
+    Barrier(size_t parties,
+            std::function<void()> completion = nullptr,
+            size_t spins = 4096)
+        : parties(parties), remaining(parties), phase(0, spins),
+          completion(std::move(completion)) {
+        // Do Nothing
+    }
+
+    Barrier(Barrier const&) = delete;
+    Barrier(Barrier&&) = delete;
+
+    Barrier& operator=(Barrier const&) = delete;
+    Barrier& operator=(Barrier&&) = delete;
+
+    // true for the party which ran the completion
+    bool ArriveAndWait() {
+        uint32_t current = phase.Load();
+        if (remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            if (completion) {
+                completion();
+            }
+
+            // reset before the release, early arrivals of the next
+            // phase count down from the full number
+            remaining.store(parties, std::memory_order_relaxed);
+            phase.Publish(current + 1);
+            return true;
+        }
+
+        phase.Await(current);
+        return false;
+    }
+
+    // phases completed so far
+    uint32_t Phase() const {
+        return phase.Load();
+    }
+
+    size_t Parties() const {
+        return parties;
+    }
+
+private:
+    size_t const parties;
+    std::atomic<size_t> remaining;
+    PhaseWord phase;
+    std::function<void()> completion;
+};
+
+// Barrier whose parties register and deregister at any time, like the
+// Phaser of java. Registered parties, unarrived parties and the phase
+// share one atomic word, so an arrival never races a registration. While
+// the last arrival runs the completion, registrations and arrivals for
+// the next phase wait for it.
+//
+// At most 32767 parties may be registered at once.
+class Phaser {
+public:
+    // completion receives the phase it completes
+    Phaser(size_t parties = 0,
+           std::function<void(uint32_t)> completion = nullptr,
+           size_t spins = 4096)
+        : state(pack(0, parties, parties)), epoch(0, spins),
+          completion(std::move(completion)) {
+        // Do Nothing
+    }
+
+    Phaser(Phaser const&) = delete;
+    Phaser(Phaser&&) = delete;
+
+    Phaser& operator=(Phaser const&) = delete;
+    Phaser& operator=(Phaser&&) = delete;
+
+    // Add `count` parties to the current phase, which they must arrive
+    // at, returns that phase.
+    uint32_t Register(size_t count = 1) {
+        uint64_t current = state.load(std::memory_order_acquire);
+        while (true) {
+            if (current & advancing) {
+                epoch.Await(phase_of(current));
+                current = state.load(std::memory_order_acquire);
+                continue;
+            }
+
+            uint64_t next = current + count * (one_party + 1);
+            if (state.compare_exchange_weak(
+                    current, next, std::memory_order_acq_rel)) {
+                return phase_of(current);
+            }
+        }
+    }
+
+    // arrive without waiting, returns the phase arrived at
+    uint32_t Arrive() {
+        return arrive(false);
+    }
+
+    // arrive and leave, later phases no longer wait for the party
+    uint32_t ArriveAndDeregister() {
+        return arrive(true);
+    }
+
+    // arrive and wait for the other parties, returns the phase arrived at
+    uint32_t ArriveAndAwait() {
+        uint32_t phase = arrive(false);
+        AwaitAdvance(phase);
+        return phase;
+    }
+
+    // wait until `phase` is completed, immediately for past phases
+    void AwaitAdvance(uint32_t phase) {
+        epoch.Await(phase);
+    }
+
+    uint32_t Phase() const {
+        return phase_of(state.load(std::memory_order_acquire));
+    }
+
+    size_t Registered() const {
+        return parties_of(state.load(std::memory_order_acquire));
+    }
+
+    size_t Unarrived() const {
+        return unarrived_of(state.load(std::memory_order_acquire));
+    }
+
+private:
+    // phase in the high half, then the advancing bit, 15 bits of
+    // registered and 16 bits of unarrived parties
+    static constexpr uint64_t advancing = uint64_t(1) << 31;
+    static constexpr uint64_t one_party = uint64_t(1) << 16;
+
+    static constexpr uint64_t pack(uint32_t phase,
+                                   size_t parties,
+                                   size_t unarrived) {
+        return (uint64_t(phase) << 32) | (uint64_t(parties) << 16)
+               | uint64_t(unarrived);
+    }
+
+    static constexpr uint32_t phase_of(uint64_t state) {
+        return static_cast<uint32_t>(state >> 32);
+    }
+
+    static constexpr size_t parties_of(uint64_t state) {
+        return static_cast<size_t>((state >> 16) & 0x7fff);
+    }
+
+    static constexpr size_t unarrived_of(uint64_t state) {
+        return static_cast<size_t>(state & 0xffff);
+    }
+
+    uint32_t arrive(bool deregister) {
+        uint64_t current = state.load(std::memory_order_acquire);
+        while (true) {
+            uint32_t phase = phase_of(current);
+            if (current & advancing) {
+                epoch.Await(phase);
+                current = state.load(std::memory_order_acquire);
+                continue;
+            }
+
+            // no party is registered
+            size_t unarrived = unarrived_of(current);
+            if (unarrived == 0) {
+                return phase;
+            }
+
+            size_t parties = parties_of(current) - (deregister ? 1 : 0);
+            uint64_t next = current - 1 - (deregister ? one_party : 0);
+            if (unarrived == 1) {
+                next = pack(phase, parties, 0) | advancing;
+            }
+            if (!state.compare_exchange_weak(
+                    current, next, std::memory_order_acq_rel)) {
+                continue;
+            }
+
+            if (unarrived == 1) {
+                advance(phase, parties);
+            }
+            return phase;
+        }
+    }
+
+    // the state is frozen by the advancing bit meanwhile
+    void advance(uint32_t phase, size_t parties) {
+        if (completion) {
+            completion(phase);
+        }
+        state.store(pack(phase + 1, parties, parties),
+                    std::memory_order_release);
+        epoch.Publish(phase + 1);
+    }
+
+    std::atomic<uint64_t> state;
+    PhaseWord epoch;
+    std::function<void(uint32_t)> completion;
+};
+
+#endif
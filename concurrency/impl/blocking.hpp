@@ -0,0 +1,237 @@
+#ifndef BLOCKING_HPP
+#define BLOCKING_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <list>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+enum class WorkerState { Idle, Running, Blocked };
+
+inline char const* to_string(WorkerState state) {
+    switch (state) {
+    case WorkerState::Idle:
+        return "idle";
+    case WorkerState::Running:
+        return "running";
+    case WorkerState::Blocked:
+        return "blocked";
+    }
+    return "unknown";
+}
+
+struct WorkerStatus {
+    using clock = std::chrono::steady_clock;
+
+    std::atomic<WorkerState> state;
+    std::atomic<char const*> label;
+    std::atomic<clock::rep> since;
+    std::atomic<size_t> executed;
+
+    WorkerStatus()
+        : state(WorkerState::Idle), label(nullptr), since(0), executed(0) {
+        // Do Nothing
+    }
+
+    void start(char const* task_label) {
+        label.store(task_label, std::memory_order_relaxed);
+        since.store(clock::now().time_since_epoch().count(),
+                    std::memory_order_relaxed);
+        state.store(WorkerState::Running, std::memory_order_release);
+    }
+
+    void finish() {
+        state.store(WorkerState::Idle, std::memory_order_release);
+        label.store(nullptr, std::memory_order_relaxed);
+        executed.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    static WorkerStatus*& current() {
+        thread_local WorkerStatus* status = nullptr;
+        return status;
+    }
+};
+
+struct ThreadRecord {
+    using clock = std::chrono::steady_clock;
+
+    std::string name;
+    bool worker = false;
+
+    std::atomic<void const*> object{ nullptr };
+    std::atomic<char const*> kind{ nullptr };
+    std::atomic<bool> idle{ false };
+    std::atomic<clock::rep> since{ 0 };
+};
+
+// Threads blocked on channels and wait groups, kept for the deadlock
+// watchdog. Pool workers always register, other threads register the
+// first time they use or block on a channel or wait group while
+// tracking is enabled, and count as running until they block.
+class BlockingRegistry {
+public:
+    static BlockingRegistry& Instance() {
+        // never destroyed, thread_local records may detach after exit
+        static BlockingRegistry* registry = new BlockingRegistry();
+        return *registry;
+    }
+
+    bool Enabled() const {
+        return enabled.load(std::memory_order_relaxed);
+    }
+
+    void Enable(bool enable) {
+        enabled.store(enable, std::memory_order_relaxed);
+    }
+
+    // Called on every operation which may wake a blocked thread, which
+    // registers the caller unless it is no `participant`, like the
+    // netpoller thread.
+    void Progress(bool participant = true) {
+        if (Enabled()) {
+            if (participant) {
+                Current();
+            }
+            epoch.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    size_t Epoch() const {
+        return epoch.load(std::memory_order_relaxed);
+    }
+
+    ThreadRecord& Current() {
+        thread_local Handle handle(*this);
+        return *handle.record;
+    }
+
+    void Describe(std::string name, bool worker) {
+        ThreadRecord& record = Current();
+
+        std::unique_lock lock(mutex);
+        record.name = std::move(name);
+        record.worker = worker;
+    }
+
+    void Name(void const* object, std::string name) {
+        std::unique_lock lock(mutex);
+        names[object] = std::move(name);
+    }
+
+    void Unname(void const* object) {
+        std::unique_lock lock(mutex);
+        names.erase(object);
+    }
+
+    template <typename F>
+    void ForEach(F&& func) {
+        std::unique_lock lock(mutex);
+        for (auto& record : records) {
+            func(record);
+        }
+    }
+
+    std::string NameOf(void const* object) {
+        std::unique_lock lock(mutex);
+        auto iter = names.find(object);
+        return iter != names.end() ? iter->second : std::string();
+    }
+
+private:
+    struct Handle {
+        BlockingRegistry& registry;
+        ThreadRecord* record;
+
+        Handle(BlockingRegistry& registry) : registry(registry) {
+            std::unique_lock lock(registry.mutex);
+            record = &registry.records.emplace_back();
+
+            std::ostringstream stream;
+            stream << "thread " << std::this_thread::get_id();
+            record->name = stream.str();
+        }
+
+        ~Handle() {
+            std::unique_lock lock(registry.mutex);
+            registry.records.remove_if(
+                [&](ThreadRecord const& elem) { return &elem == record; });
+        }
+    };
+
+    BlockingRegistry() : enabled(false), epoch(0) {
+        // Do Nothing
+    }
+
+    std::atomic<bool> enabled;
+    std::atomic<size_t> epoch;
+
+    std::mutex mutex;
+    std::list<ThreadRecord> records;
+    std::unordered_map<void const*, std::string> names;
+};
+
+// Marks the running pool worker of the current thread as blocked
+// while a channel or wait group parks it, and records the wait for
+// the deadlock watchdog. An `external` wait, on descriptors woken from
+// outside the process, is no deadlock, like netpoll waits of golang,
+// and the thread counts as running for the watchdog.
+class BlockingScope {
+public:
+    BlockingScope(void const* object, char const* kind, bool external = false)
+        : status(WorkerStatus::current()), record(nullptr) {
+        bool idle = false;
+        if (status != nullptr
+            && status->state.load(std::memory_order_relaxed)
+                   == WorkerState::Running) {
+            status->state.store(WorkerState::Blocked,
+                                std::memory_order_relaxed);
+            idle = false;
+        }
+        else {
+            idle = status != nullptr;
+            status = nullptr;
+        }
+
+        BlockingRegistry& registry = BlockingRegistry::Instance();
+        if (registry.Enabled() && external) {
+            registry.Current();
+        }
+        else if (registry.Enabled()) {
+            record = &registry.Current();
+            record->kind.store(kind, std::memory_order_relaxed);
+            record->idle.store(idle, std::memory_order_relaxed);
+            record->since.store(
+                ThreadRecord::clock::now().time_since_epoch().count(),
+                std::memory_order_relaxed);
+            record->object.store(object, std::memory_order_release);
+        }
+    }
+
+    ~BlockingScope() {
+        if (status != nullptr) {
+            status->state.store(WorkerState::Running,
+                                std::memory_order_relaxed);
+        }
+        if (record != nullptr) {
+            record->object.store(nullptr, std::memory_order_release);
+            BlockingRegistry::Instance().Progress();
+        }
+    }
+
+    BlockingScope(BlockingScope const&) = delete;
+    BlockingScope(BlockingScope&&) = delete;
+
+    BlockingScope& operator=(BlockingScope const&) = delete;
+    BlockingScope& operator=(BlockingScope&&) = delete;
+
+private:
+    WorkerStatus* status;
+    ThreadRecord* record;
+};
+
+#endif
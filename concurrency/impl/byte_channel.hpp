@@ -0,0 +1,312 @@
+#ifndef BYTE_CHANNEL_HPP
+#define BYTE_CHANNEL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <optional>
+
+#include "blocking.hpp"
+#include "container/byte_ring.hpp"
+#include "container/thread_safe.hpp"
+#include "platform/constant.hpp"
+
+class ByteChannel;
+
+// Producer side reservation of a record, write `size()` bytes into
+// `data()` then Commit. A claim dropped without Commit is skipped.
+class ByteClaim {
+public:
+    ByteClaim(ByteChannel& channel, std::optional<uint64_t> pos)
+        : channel(channel), pos(pos) {
+        // Do Nothing
+    }
+
+    inline ~ByteClaim();
+
+    ByteClaim(ByteClaim const&) = delete;
+    ByteClaim(ByteClaim&&) = delete;
+
+    ByteClaim& operator=(ByteClaim const&) = delete;
+    ByteClaim& operator=(ByteClaim&&) = delete;
+
+    // false once the channel is closed, or if the record never fits
+    explicit operator bool() const {
+        return pos.has_value();
+    }
+
+    inline unsigned char* data();
+    inline size_t size();
+    inline void Commit();
+
+private:
+    ByteChannel& channel;
+    std::optional<uint64_t> pos;
+};
+
+// Consumer side of a record, read in place and released on Release or
+// destruction.
+class ByteRecord {
+public:
+    ByteRecord(ByteChannel& channel, std::optional<uint64_t> pos)
+        : channel(channel), pos(pos) {
+        // Do Nothing
+    }
+
+    inline ~ByteRecord();
+
+    ByteRecord(ByteRecord const&) = delete;
+    ByteRecord(ByteRecord&&) = delete;
+
+    ByteRecord& operator=(ByteRecord const&) = delete;
+    ByteRecord& operator=(ByteRecord&&) = delete;
+
+    // false once the channel is closed and drained
+    explicit operator bool() const {
+        return pos.has_value();
+    }
+
+    inline unsigned char const* data();
+    inline size_t size();
+    inline void Release();
+
+private:
+    ByteChannel& channel;
+    std::optional<uint64_t> pos;
+};
+
+// Channel of variable size byte records, bounded in bytes. Records are
+// written and read in place, so a send costs one copy into the ring at
+// most and no allocation.
+class ByteChannel {
+public:
+    ByteChannel(size_t capacity)
+        : m_runnable(true), ring(capacity), m_used(0), num_push(0),
+          num_pop(0), num_push_park(0), num_pop_park(0), num_spurious(0) {
+        // Do Nothing
+    }
+
+    ~ByteChannel() {
+        Close();
+    }
+
+    ByteChannel(ByteChannel const&) = delete;
+    ByteChannel(ByteChannel&&) = delete;
+
+    ByteChannel& operator=(ByteChannel const&) = delete;
+    ByteChannel& operator=(ByteChannel&&) = delete;
+
+    // Reserve `size` bytes, blocks until they fit.
+    ByteClaim Claim(size_t size) {
+        std::unique_lock lock(mutex);
+        if (size > ring.max_length()) {
+            return ByteClaim(*this, std::nullopt);
+        }
+
+        wait(lock, num_push_park, "send", [&] {
+            return !m_runnable || ring.fits(size);
+        });
+
+        if (!m_runnable) {
+            return ByteClaim(*this, std::nullopt);
+        }
+        return ByteClaim(*this, ring.claim(size));
+    }
+
+    // Copy a record into the ring, false if closed or too large.
+    bool Add(void const* src, size_t size) {
+        ByteClaim claim = Claim(size);
+        if (!claim) {
+            return false;
+        }
+
+        std::memcpy(claim.data(), src, size);
+        claim.Commit();
+        return true;
+    }
+
+    // Borrow the front record, blocks until one is available.
+    ByteRecord Get() {
+        std::unique_lock lock(mutex);
+        wait(lock, num_pop_park, "receive", [&] {
+            return !m_runnable || ring.size() > 0;
+        });
+
+        if (ring.size() == 0) {
+            return ByteRecord(*this, std::nullopt);
+        }
+
+        uint64_t pos = ring.borrow();
+        popped();
+        return ByteRecord(*this, pos);
+    }
+
+    ByteRecord TryGet() {
+        std::unique_lock lock(mutex, std::try_to_lock);
+        if (lock.owns_lock() && ring.size() > 0) {
+            uint64_t pos = ring.borrow();
+            popped();
+            return ByteRecord(*this, pos);
+        }
+        return ByteRecord(*this, std::nullopt);
+    }
+
+    void Close() {
+        {
+            std::unique_lock lock(mutex);
+            m_runnable = false;
+        }
+        cond.notify_all();
+        BlockingRegistry::Instance().Progress();
+    }
+
+    bool Runnable() const {
+        return m_runnable;
+    }
+
+    bool Readable() {
+        std::unique_lock lock(mutex);
+        return m_runnable || ring.size() > 0;
+    }
+
+    // largest record accepted by Claim
+    size_t MaxRecord() const {
+        return ring.max_length();
+    }
+
+    // size is the number of buffered bytes, records and padding
+    QueueStat Stat() const {
+        return QueueStat{ m_used.load(std::memory_order_relaxed),
+                          num_push.load(std::memory_order_relaxed),
+                          num_pop.load(std::memory_order_relaxed),
+                          num_push_park.load(std::memory_order_relaxed),
+                          num_pop_park.load(std::memory_order_relaxed),
+                          num_spurious.load(std::memory_order_relaxed),
+                          0,
+                          0,
+                          0 };
+    }
+
+private:
+    friend class ByteClaim;
+    friend class ByteRecord;
+
+    void commit(uint64_t pos) {
+        {
+            std::unique_lock lock(mutex);
+            ring.commit(pos);
+            pushed();
+        }
+        cond.notify_all();
+    }
+
+    void abandon(uint64_t pos) {
+        {
+            std::unique_lock lock(mutex);
+            ring.abandon(pos);
+            m_used.store(ring.used(), std::memory_order_relaxed);
+        }
+        cond.notify_all();
+    }
+
+    void release(uint64_t pos) {
+        {
+            std::unique_lock lock(mutex);
+            ring.release(pos);
+            m_used.store(ring.used(), std::memory_order_relaxed);
+        }
+        cond.notify_all();
+        BlockingRegistry::Instance().Progress();
+    }
+
+    // counters are written under the lock and read lock-free by Stat
+    void pushed() {
+        BlockingRegistry::Instance().Progress();
+        m_used.store(ring.used(), std::memory_order_relaxed);
+        num_push.store(num_push.load(std::memory_order_relaxed) + 1,
+                       std::memory_order_relaxed);
+    }
+
+    void popped() {
+        BlockingRegistry::Instance().Progress();
+        num_pop.store(num_pop.load(std::memory_order_relaxed) + 1,
+                      std::memory_order_relaxed);
+    }
+
+    template <typename F>
+    void wait(std::unique_lock<std::mutex>& lock,
+              std::atomic<size_t>& parks,
+              char const* kind,
+              F&& pred) {
+        if (pred()) {
+            return;
+        }
+
+        BlockingScope scope(this, kind);
+        parks.fetch_add(1, std::memory_order_relaxed);
+
+        cond.wait(lock);
+        while (!pred()) {
+            num_spurious.fetch_add(1, std::memory_order_relaxed);
+            cond.wait(lock);
+        }
+    }
+
+    alignas(platform::cache_line) std::mutex mutex;
+    std::condition_variable cond;
+
+    bool m_runnable;
+    ByteRing ring;
+
+    alignas(platform::cache_line) std::atomic<size_t> m_used;
+    std::atomic<size_t> num_push;
+    std::atomic<size_t> num_pop;
+    std::atomic<size_t> num_push_park;
+    std::atomic<size_t> num_pop_park;
+    std::atomic<size_t> num_spurious;
+};
+
+ByteClaim::~ByteClaim() {
+    if (pos.has_value()) {
+        channel.abandon(pos.value());
+    }
+}
+
+unsigned char* ByteClaim::data() {
+    return channel.ring.data(pos.value());
+}
+
+size_t ByteClaim::size() {
+    return channel.ring.length(pos.value());
+}
+
+void ByteClaim::Commit() {
+    if (pos.has_value()) {
+        channel.commit(pos.value());
+        pos.reset();
+    }
+}
+
+ByteRecord::~ByteRecord() {
+    Release();
+}
+
+unsigned char const* ByteRecord::data() {
+    return channel.ring.data(pos.value());
+}
+
+size_t ByteRecord::size() {
+    return channel.ring.length(pos.value());
+}
+
+void ByteRecord::Release() {
+    if (pos.has_value()) {
+        channel.release(pos.value());
+        pos.reset();
+    }
+}
+
+#endif
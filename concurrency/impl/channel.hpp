@@ -1,6 +1,8 @@
 #ifndef CHANNEL_HPP
 #define CHANNEL_HPP
 
+#include <atomic>
+#include <cstdint>
 #include <optional>
 
 #include "channel_iter.hpp"
@@ -23,9 +25,10 @@ public:
     Channel& operator=(const Channel&) = delete;
     Channel& operator=(Channel&&) = delete;
 
+    // SendStatus of ThreadSafe containers, see Overflow
     template <typename... U>
-    void Add(U&&... args) {
-        buffer.emplace_back(std::forward<U>(args)...);
+    auto Add(U&&... args) {
+        return buffer.emplace_back(std::forward<U>(args)...);
     }
 
     template <typename U>
@@ -34,6 +37,32 @@ public:
         return *this;
     }
 
+    // Batch transfer, trivially copyable messages are copied with memcpy
+    // when the container supports it.
+    size_t AddBulk(value_type const* src, size_t count) {
+        return buffer.push_bulk(src, count);
+    }
+
+    size_t GetBulk(value_type* dst, size_t count) {
+        return buffer.pop_bulk(dst, count);
+    }
+
+    // Zero-copy transfer for containers with slot reservation, eg.
+    //     if (auto slot = channel.Claim()) {
+    //         slot.emplace(args...);
+    //         slot.Commit();
+    //     }
+    //     if (auto slot = channel.Borrow()) {
+    //         use(*slot);
+    //     }
+    ClaimedSlot<Container> Claim() {
+        return ClaimedSlot<Container>(buffer, buffer.claim());
+    }
+
+    BorrowedSlot<Container> Borrow() {
+        return BorrowedSlot<Container>(buffer, buffer.borrow());
+    }
+
     std::optional<value_type> Get() {
         return buffer.pop_front();
     }
@@ -67,6 +96,37 @@ public:
         return buffer.readable();
     }
 
+    // Pollable descriptor for event loops, readable once the channel
+    // goes from empty to non empty or is closed. Drain with TryGet,
+    // then ClearReady.
+    int ReadyFd() {
+        return buffer.ready_fd();
+    }
+
+    void ClearReady() {
+        buffer.clear_ready();
+    }
+
+    // wake `word` for a select parked on this and other channels, false
+    // if a message is readable or the channel is closed already
+    bool Attach(std::atomic<uint32_t>* word) {
+        return buffer.attach(word);
+    }
+
+    void Detach(std::atomic<uint32_t>* word) {
+        buffer.detach(word);
+    }
+
+    // charge buffered bytes to a process wide memory budget, false if
+    // the channel is already governed
+    bool Govern(MemoryGovernor& governor = MemoryGovernor::Global()) {
+        return buffer.govern(governor);
+    }
+
+    auto Stat() const {
+        return buffer.stat();
+    }
+
     iterator begin() {
         return iterator(*this, Get());
     }
@@ -85,4 +145,27 @@ using LChannel = Channel<TSList<T>>;
 template <typename T>
 using RChannel = Channel<TSRingBuffer<T>>;
 
+// capacity known at compile time, no heap allocation
+template <typename T, size_t N>
+using StaticRChannel = Channel<TSStaticRingBuffer<T, N>>;
+
+// bounded by the bytes of buffered messages, eg.
+//     BLChannel<std::string> channel(
+//         1 << 20, [](std::string const& s) { return s.size(); });
+template <typename T>
+using BLChannel = Channel<TSBudgetedList<T>>;
+
+// bounded by bytes and count, eg. BRChannel<T> channel(bytes, sizer, 64)
+template <typename T>
+using BRChannel = Channel<TSBudgetedRingBuffer<T>>;
+
+// latest value per key, eg. channel.Add(symbol, price)
+template <typename K, typename V>
+using ConflatingChannel = Channel<TSConflating<K, V>>;
+
+// unbounded, spills to disk beyond a threshold, eg.
+//     SpillChannel<Event, EventCodec> channel("/var/spool/app", 100000)
+template <typename T, typename Codec = TrivialCodec<T>>
+using SpillChannel = Channel<TSSpilling<T, Codec>>;
+
 #endif
\ No newline at end of file
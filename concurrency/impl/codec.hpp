@@ -0,0 +1,30 @@
+#ifndef CODEC_HPP
+#define CODEC_HPP
+
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+
+// Codec of trivially copyable messages, a codec serializes messages to
+// bytes for channels backed by files or sockets and reads them back.
+template <typename T>
+struct TrivialCodec {
+    static_assert(std::is_trivially_copyable_v<T>,
+                  "TrivialCodec requires trivially copyable messages");
+
+    size_t size(T const&) const {
+        return sizeof(T);
+    }
+
+    void encode(T const& value, unsigned char* dst) const {
+        std::memcpy(dst, &value, sizeof(T));
+    }
+
+    T decode(unsigned char const* src, size_t) const {
+        T value;
+        std::memcpy(&value, src, sizeof(T));
+        return value;
+    }
+};
+
+#endif
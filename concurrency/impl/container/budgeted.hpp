@@ -0,0 +1,92 @@
+#ifndef CONTAINER_BUDGETED_HPP
+#define CONTAINER_BUDGETED_HPP
+
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <utility>
+
+// Bounds a container by the bytes of its elements, measured by a user
+// supplied size function. The container is full once the budget is
+// reached, so the last accepted element may overshoot it, and a single
+// element larger than the whole budget still passes an empty channel.
+template <typename Cont>
+class Budgeted {
+public:
+    using value_type = typename Cont::value_type;
+    using Sizer = std::function<size_t(value_type const&)>;
+
+    template <typename... Args>
+    Budgeted(size_t budget, Sizer sizer, Args&&... args)
+        : budget(budget), num_bytes(0), sizer(std::move(sizer)),
+          buffer(std::forward<Args>(args)...), front_measured(false),
+          front_bytes(0) {
+        // Do Nothing
+    }
+
+    template <typename... U>
+    void emplace_back(U&&... args) {
+        push_back(value_type(std::forward<U>(args)...));
+    }
+
+    void push_back(value_type const& value) {
+        num_bytes += sizer(value);
+        buffer.push_back(value);
+    }
+
+    void push_back(value_type&& value) {
+        num_bytes += sizer(value);
+        buffer.push_back(std::move(value));
+    }
+
+    void pop_front() {
+        measure_front();
+        num_bytes -= front_bytes;
+        front_measured = false;
+        buffer.pop_front();
+    }
+
+    // measured here, callers move the front out before pop_front
+    value_type& front() {
+        measure_front();
+        return buffer.front();
+    }
+
+    size_t size() const {
+        return buffer.size();
+    }
+
+    size_t max_size() const {
+        return buffer.max_size();
+    }
+
+    bool full() const {
+        return num_bytes >= budget || buffer.size() >= buffer.max_size();
+    }
+
+    size_t bytes() const {
+        return num_bytes;
+    }
+
+    size_t max_bytes() const {
+        return budget;
+    }
+
+private:
+    void measure_front() {
+        if (!front_measured) {
+            front_bytes = sizer(buffer.front());
+            front_measured = true;
+        }
+    }
+
+    size_t budget;
+    size_t num_bytes;
+    Sizer sizer;
+    Cont buffer;
+
+    bool front_measured;
+    size_t front_bytes;
+};
+
+#endif
@@ -0,0 +1,196 @@
+#ifndef CONTAINER_BYTE_RING_HPP
+#define CONTAINER_BYTE_RING_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "ring_buffer.hpp"
+
+// Length prefixed variable size records stored contiguously, capacity
+// is bounded in bytes. A record which does not fit before the end of
+// the storage is preceded by an abandoned padding record and starts
+// again at offset zero. Records and their payloads are 8 byte aligned.
+//
+// Like BasicRingBuffer, records are claimed, constructed in place and
+// committed, then borrowed, read in place and released. Cursors are
+// monotonic byte positions, storage offsets are positions masked by
+// the power of two storage size.
+class ByteRing {
+public:
+    struct Header {
+        uint32_t length;
+        SlotState state;
+    };
+
+    static constexpr size_t header_size = sizeof(Header);
+    static_assert(header_size == 8, "record header must be 8 bytes");
+
+    ByteRing(size_t capacity)
+        : capacity(capacity), mask(next_power_of_two(align(capacity)) - 1),
+          headers(new Header[(mask + 1) / header_size]) {
+        // Do Nothing
+    }
+
+    ByteRing(ByteRing const&) = delete;
+    ByteRing(ByteRing&&) = delete;
+
+    ByteRing& operator=(ByteRing const&) = delete;
+    ByteRing& operator=(ByteRing&&) = delete;
+
+    static constexpr size_t align(size_t size) {
+        return (size + header_size - 1) & ~(header_size - 1);
+    }
+
+    // bytes a record of `length` payload bytes occupies
+    static constexpr size_t record_size(size_t length) {
+        return header_size + align(length);
+    }
+
+    // largest payload which fits into an empty ring
+    size_t max_length() const {
+        size_t bound = capacity & ~(header_size - 1);
+        return bound > header_size ? bound - header_size : 0;
+    }
+
+    // whether a record of `length` payload bytes can be claimed now
+    bool fits(size_t length) const {
+        size_t need = record_size(length);
+        if (pos_claim == pos_head) {
+            return need <= capacity;
+        }
+
+        size_t contiguous = (mask + 1) - (pos_claim & mask);
+        size_t padding = contiguous < need ? contiguous : 0;
+        return used() + padding + need <= capacity;
+    }
+
+    // Reserve a record, requires fits(length), returns its position.
+    uint64_t claim(size_t length) {
+        size_t need = record_size(length);
+        size_t contiguous = (mask + 1) - (pos_claim & mask);
+        if (contiguous < need) {
+            if (pos_claim == pos_head) {
+                // nothing in flight, jump to the start of the storage
+                pos_claim += contiguous;
+                pos_tail = pos_borrow = pos_head = pos_claim;
+            }
+            else {
+                *header(pos_claim) = Header{
+                    static_cast<uint32_t>(contiguous - header_size),
+                    SlotState::Abandoned
+                };
+                pos_claim += contiguous;
+            }
+        }
+
+        uint64_t pos = pos_claim;
+        *header(pos) =
+            Header{ static_cast<uint32_t>(length), SlotState::Claimed };
+        pos_claim += need;
+        return pos;
+    }
+
+    void commit(uint64_t pos) {
+        header(pos)->state = SlotState::Committed;
+        publish();
+    }
+
+    void abandon(uint64_t pos) {
+        header(pos)->state = SlotState::Abandoned;
+        publish();
+    }
+
+    // Take the front record, requires size() > 0.
+    uint64_t borrow() {
+        uint64_t pos = pos_borrow;
+        header(pos)->state = SlotState::Borrowed;
+
+        num_records -= 1;
+        pos_borrow += record_size(header(pos)->length);
+        skip_abandoned();
+        return pos;
+    }
+
+    void release(uint64_t pos) {
+        header(pos)->state = SlotState::Free;
+        reclaim();
+    }
+
+    // record memory stays put, owners access it without synchronization
+    unsigned char* data(uint64_t pos) {
+        return reinterpret_cast<unsigned char*>(header(pos) + 1);
+    }
+
+    size_t length(uint64_t pos) {
+        return header(pos)->length;
+    }
+
+    // readable records
+    size_t size() const {
+        return num_records;
+    }
+
+    // bytes held by readable, claimed and borrowed records and padding
+    size_t used() const {
+        return static_cast<size_t>(pos_claim - pos_head);
+    }
+
+    size_t max_size() const {
+        return capacity;
+    }
+
+private:
+    Header* header(uint64_t pos) {
+        return headers.get() + (pos & mask) / header_size;
+    }
+
+    void publish() {
+        while (pos_tail < pos_claim) {
+            Header* head = header(pos_tail);
+            if (head->state == SlotState::Claimed) {
+                break;
+            }
+
+            num_records += head->state == SlotState::Committed ? 1 : 0;
+            pos_tail += record_size(head->length);
+        }
+        skip_abandoned();
+    }
+
+    void skip_abandoned() {
+        while (pos_borrow < pos_tail) {
+            Header* head = header(pos_borrow);
+            if (head->state != SlotState::Abandoned) {
+                break;
+            }
+
+            head->state = SlotState::Free;
+            pos_borrow += record_size(head->length);
+        }
+        reclaim();
+    }
+
+    void reclaim() {
+        while (pos_head < pos_borrow) {
+            Header* head = header(pos_head);
+            if (head->state != SlotState::Free) {
+                break;
+            }
+            pos_head += record_size(head->length);
+        }
+    }
+
+    size_t capacity;
+    size_t mask;
+    std::unique_ptr<Header[]> headers;
+
+    size_t num_records = 0;
+
+    uint64_t pos_head = 0;
+    uint64_t pos_borrow = 0;
+    uint64_t pos_tail = 0;
+    uint64_t pos_claim = 0;
+};
+
+#endif
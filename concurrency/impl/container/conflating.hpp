@@ -0,0 +1,106 @@
+#ifndef CONTAINER_CONFLATING_HPP
+#define CONTAINER_CONFLATING_HPP
+
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <unordered_map>
+#include <utility>
+
+// Keeps only the latest value per key. A send to a pending key
+// overwrites its value in place, keys are popped in the order they
+// first became pending. Size is the number of pending keys, a full
+// buffer still takes values of pending keys.
+template <typename K, typename V, typename Hash = std::hash<K>>
+class Conflating {
+public:
+    using value_type = std::pair<K, V>;
+    using entry_type = std::pair<K const, V>;
+
+    Conflating() : Conflating(std::numeric_limits<size_t>::max()) {
+        // Do Nothing
+    }
+
+    Conflating(size_t max_keys) : max_keys(max_keys), num_conflated(0) {
+        // Do Nothing
+    }
+
+    template <typename... U>
+    void emplace_back(U&&... args) {
+        push_back(value_type(std::forward<U>(args)...));
+    }
+
+    void push_back(value_type const& value) {
+        push_back(value_type(value));
+    }
+
+    void push_back(value_type&& value) {
+        auto [iter, inserted] =
+            values.try_emplace(std::move(value.first), std::move(value.second));
+        if (inserted) {
+            order.push_back(&*iter);
+        }
+        else {
+            iter->second = std::move(value.second);
+            num_conflated += 1;
+        }
+    }
+
+    void pop_front() {
+        values.erase(order.front()->first);
+        order.pop_front();
+    }
+
+    // key stays intact when the entry is moved out, so pop_front still
+    // finds it
+    entry_type& front() {
+        return *order.front();
+    }
+
+    size_t push_bulk(value_type const* src, size_t count) {
+        size_t num = 0;
+        for (; num < count && (size() < max_size() || pending(src[num]));
+             ++num) {
+            push_back(src[num]);
+        }
+        return num;
+    }
+
+    // drains up to `count` pending keys in one batch
+    size_t pop_bulk(value_type* dst, size_t count) {
+        size_t num = 0;
+        for (; num < count && !order.empty(); ++num) {
+            dst[num] = std::move(front());
+            pop_front();
+        }
+        return num;
+    }
+
+    // whether the key of `value` is pending, its value is replaced
+    bool pending(value_type const& value) const {
+        return values.find(value.first) != values.end();
+    }
+
+    size_t size() const {
+        return order.size();
+    }
+
+    size_t max_size() const {
+        return max_keys;
+    }
+
+    // values overwritten before being popped
+    size_t conflated() const {
+        return num_conflated;
+    }
+
+private:
+    size_t max_keys;
+    size_t num_conflated;
+
+    std::unordered_map<K, V, Hash> values;
+    std::deque<entry_type*> order;
+};
+
+#endif
@@ -1,68 +1,361 @@
 #ifndef CONTAINER_RING_BUFFER_HPP
 #define CONTAINER_RING_BUFFER_HPP
 
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
 #include <memory>
+#include <new>
 #include <type_traits>
 
-template <typename T, typename = void>  // for stl compatiblity
-class RingBuffer {
-public:
-    using value_type = T;
+constexpr size_t next_power_of_two(size_t size) {
+    size_t power = 1;
+    while (power < size) {
+        power <<= 1;
+    }
+    return power;
+}
 
-    static_assert(std::is_default_constructible_v<T>,
-                  "RingBuffer base type must be default constructible");
+template <typename T>
+struct RingSlot {
+    alignas(T) unsigned char data[sizeof(T)];
+};
 
-    RingBuffer() : RingBuffer(1) {
+// Producers claim a slot then commit or abandon it, consumers borrow
+// a committed slot then release it.
+enum class SlotState : unsigned char {
+    Free,
+    Claimed,
+    Committed,
+    Abandoned,
+    Borrowed
+};
+
+// Heap allocated slots, capacity given at runtime.
+template <typename T>
+class HeapSlots {
+public:
+    HeapSlots() : HeapSlots(1) {
         // Do Nothing
     }
 
-    RingBuffer(size_t size_buffer)
-        : size_buffer(size_buffer), buffer(std::make_unique<T[]>(size_buffer)) {
+    HeapSlots(size_t capacity)
+        : capacity(capacity), mask(next_power_of_two(capacity) - 1),
+          slots(new RingSlot<T>[mask + 1]),
+          states(new SlotState[mask + 1]()) {
         // Do Nothing
     }
 
-    RingBuffer(RingBuffer const&) = delete;
-    RingBuffer(RingBuffer&&) = delete;
+    RingSlot<T>& operator[](size_t idx) {
+        return slots[idx];
+    }
+
+    RingSlot<T> const& operator[](size_t idx) const {
+        return slots[idx];
+    }
+
+    SlotState& state(size_t idx) {
+        return states[idx];
+    }
+
+    size_t max_size() const {
+        return capacity;
+    }
+
+    size_t capacity;
+    size_t mask;
+
+private:
+    std::unique_ptr<RingSlot<T>[]> slots;
+    std::unique_ptr<SlotState[]> states;
+};
+
+// Inline slots, capacity and mask are compile-time constants.
+template <typename T, size_t N>
+class InlineSlots {
+public:
+    static_assert(N > 0, "InlineSlots capacity must be positive");
+
+    static constexpr size_t capacity = N;
+    static constexpr size_t mask = next_power_of_two(N) - 1;
+
+    RingSlot<T>& operator[](size_t idx) {
+        return slots[idx];
+    }
+
+    RingSlot<T> const& operator[](size_t idx) const {
+        return slots[idx];
+    }
+
+    SlotState& state(size_t idx) {
+        return states[idx];
+    }
+
+    constexpr size_t max_size() const {
+        return N;
+    }
+
+private:
+    RingSlot<T> slots[mask + 1];
+    SlotState states[mask + 1] = {};
+};
+
+// Slots are raw storage, elements are constructed in place by
+// emplace_back and destroyed by pop_front. Storage is rounded up to
+// a power of two so indices wrap with a mask, while max_size keeps
+// the requested capacity.
+//
+// For zero-copy transfer a slot may also be claimed, constructed in
+// place without holding any lock and committed, or borrowed, read in
+// place and released. Slots are published in claim order and freed in
+// borrow order, so the cursors advance over a slot only once every
+// earlier slot has been committed or released:
+//
+//     head ... borrow ... tail ... claim
+//     [borrowed][ readable ][ claimed ][ free ]
+template <typename T, typename Slots>
+class BasicRingBuffer {
+public:
+    using value_type = T;
+
+    template <typename... Args>
+    BasicRingBuffer(Args&&... args) : slots(std::forward<Args>(args)...) {
+        // Do Nothing
+    }
+
+    ~BasicRingBuffer() {
+        if constexpr (!std::is_trivially_destructible_v<T>) {
+            for (size_t i = 0, idx = ptr_head; i < num_used;
+                 ++i, idx = (idx + 1) & slots.mask) {
+                if (slots.state(idx) == SlotState::Committed) {
+                    at(idx)->~T();
+                }
+            }
+        }
+    }
+
+    BasicRingBuffer(BasicRingBuffer const&) = delete;
+    BasicRingBuffer(BasicRingBuffer&&) = delete;
 
-    RingBuffer& operator=(RingBuffer const&) = delete;
-    RingBuffer& operator=(RingBuffer&&) = delete;
+    BasicRingBuffer& operator=(BasicRingBuffer const&) = delete;
+    BasicRingBuffer& operator=(BasicRingBuffer&&) = delete;
 
     template <typename... U>
     void emplace_back(U&&... args) {
-        buffer[ptr_tail] = T(std::forward<U>(args)...);
+        size_t idx = claim();
+        try {
+            new (storage(idx)) T(std::forward<U>(args)...);
+        }
+        catch (...) {
+            // still the latest claim, take it back
+            slots.state(idx) = SlotState::Free;
+            num_used -= 1;
+            num_pending -= 1;
+            ptr_claim = idx;
+            throw;
+        }
+        commit(idx);
+    }
+
+    void push_back(T const& value) {
+        emplace_back(value);
+    }
 
-        num_data += 1;
-        ptr_tail = (ptr_tail + 1) % size_buffer;
+    void push_back(T&& value) {
+        emplace_back(std::move(value));
     }
 
     void pop_front() {
+        release(borrow());
+    }
+
+    // Copy up to `count` elements while space remains, returns the number
+    // copied. Trivially copyable elements are copied with memcpy in at most
+    // two contiguous segments.
+    size_t push_bulk(T const* src, size_t count) {
+        count = std::min(count, max_size() - num_used);
+        if constexpr (std::is_trivially_copyable_v<T>) {
+            size_t first = std::min(count, (slots.mask + 1) - ptr_claim);
+            std::memcpy(slots[ptr_claim].data, src, first * sizeof(T));
+            std::memcpy(
+                slots[0].data, src + first, (count - first) * sizeof(T));
+
+            mark(ptr_claim, count, SlotState::Committed);
+            num_used += count;
+            num_pending += count;
+            ptr_claim = (ptr_claim + count) & slots.mask;
+            publish();
+        }
+        else {
+            for (size_t i = 0; i < count; ++i) {
+                emplace_back(src[i]);
+            }
+        }
+        return count;
+    }
+
+    // Move up to `count` elements into `dst`, returns the number moved.
+    size_t pop_bulk(T* dst, size_t count) {
+        count = std::min(count, num_data);
+        if constexpr (std::is_trivially_copyable_v<T>) {
+            // abandoned slots break the readable run into pieces
+            if (num_ready == num_data) {
+                size_t first = std::min(count, (slots.mask + 1) - ptr_borrow);
+                std::memcpy(dst, slots[ptr_borrow].data, first * sizeof(T));
+                std::memcpy(
+                    dst + first, slots[0].data, (count - first) * sizeof(T));
+
+                mark(ptr_borrow, count, SlotState::Free);
+                num_data -= count;
+                num_ready -= count;
+                ptr_borrow = (ptr_borrow + count) & slots.mask;
+                reclaim();
+                return count;
+            }
+        }
+
+        for (size_t i = 0; i < count; ++i) {
+            dst[i] = std::move(front());
+            pop_front();
+        }
+        return count;
+    }
+
+    // Reserve the next slot for construction in place, requires !full().
+    size_t claim() {
+        size_t idx = ptr_claim;
+        slots.state(idx) = SlotState::Claimed;
+
+        num_used += 1;
+        num_pending += 1;
+        ptr_claim = (ptr_claim + 1) & slots.mask;
+        return idx;
+    }
+
+    // Publish a claimed slot holding a constructed element.
+    void commit(size_t idx) {
+        slots.state(idx) = SlotState::Committed;
+        publish();
+    }
+
+    // Give a claimed slot back without an element, consumers skip it.
+    void abandon(size_t idx) {
+        slots.state(idx) = SlotState::Abandoned;
+        publish();
+    }
+
+    // Take the front element for reading in place, requires size() > 0.
+    size_t borrow() {
+        size_t idx = ptr_borrow;
+        slots.state(idx) = SlotState::Borrowed;
+
         num_data -= 1;
-        ptr_head = (ptr_head + 1) % size_buffer;
+        num_ready -= 1;
+        ptr_borrow = (ptr_borrow + 1) & slots.mask;
+        skip_abandoned();
+        return idx;
+    }
+
+    // Destroy a borrowed element and free its slot.
+    void release(size_t idx) {
+        at(idx)->~T();
+        slots.state(idx) = SlotState::Free;
+        reclaim();
+    }
+
+    // Slot memory stays put, claimed and borrowed slots may be accessed
+    // without synchronization by their owner.
+    void* storage(size_t idx) {
+        return slots[idx].data;
+    }
+
+    T* at(size_t idx) {
+        return std::launder(reinterpret_cast<T*>(slots[idx].data));
     }
 
     T& front() {
-        return buffer[ptr_head];
+        return *at(ptr_borrow);
     }
 
     T const& front() const {
-        return buffer[ptr_head];
+        return *std::launder(
+            reinterpret_cast<T const*>(slots[ptr_borrow].data));
     }
 
+    // readable elements
     size_t size() const {
         return num_data;
     }
 
+    // every slot is readable, claimed or borrowed
+    bool full() const {
+        return num_used >= max_size();
+    }
+
     size_t max_size() const {
-        return size_buffer;
+        return slots.max_size();
     }
 
 private:
-    size_t size_buffer;
-    std::unique_ptr<T[]> buffer;
+    void mark(size_t idx, size_t count, SlotState state) {
+        size_t first = std::min(count, (slots.mask + 1) - idx);
+        std::fill_n(&slots.state(idx), first, state);
+        std::fill_n(&slots.state(0), count - first, state);
+    }
+
+    // advance tail over the committed or abandoned prefix of claims
+    void publish() {
+        while (num_pending > 0) {
+            SlotState state = slots.state(ptr_tail);
+            if (state == SlotState::Claimed) {
+                break;
+            }
+
+            num_data += state == SlotState::Committed ? 1 : 0;
+            num_ready += 1;
+            num_pending -= 1;
+            ptr_tail = (ptr_tail + 1) & slots.mask;
+        }
+        skip_abandoned();
+    }
+
+    // keep an element at the borrow cursor whenever one is readable
+    void skip_abandoned() {
+        while (num_ready > 0
+               && slots.state(ptr_borrow) == SlotState::Abandoned) {
+            slots.state(ptr_borrow) = SlotState::Free;
+
+            num_ready -= 1;
+            ptr_borrow = (ptr_borrow + 1) & slots.mask;
+        }
+        reclaim();
+    }
+
+    // advance head over the released prefix of borrows
+    void reclaim() {
+        while (num_used > 0 && slots.state(ptr_head) == SlotState::Free) {
+            num_used -= 1;
+            ptr_head = (ptr_head + 1) & slots.mask;
+        }
+    }
+
+    Slots slots;
+
+    size_t num_data = 0;     // committed in [borrow, tail)
+    size_t num_ready = 0;    // [borrow, tail), with abandoned slots
+    size_t num_pending = 0;  // [tail, claim)
+    size_t num_used = 0;     // [head, claim)
 
-    size_t num_data = 0;
     size_t ptr_head = 0;
+    size_t ptr_borrow = 0;
     size_t ptr_tail = 0;
+    size_t ptr_claim = 0;
 };
 
-#endif
\ No newline at end of file
+template <typename T, typename = void>  // for stl compatiblity
+using RingBuffer = BasicRingBuffer<T, HeapSlots<T>>;
+
+template <typename T, size_t N>
+using StaticRingBuffer = BasicRingBuffer<T, InlineSlots<T, N>>;
+
+#endif
@@ -0,0 +1,233 @@
+#ifndef CONTAINER_SPILLING_HPP
+#define CONTAINER_SPILLING_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <list>
+#include <string>
+#include <utility>
+
+#include "../codec.hpp"
+#include "../platform/mapped_file.hpp"
+
+// unique across channels and processes sharing `directory`
+inline std::string spill_path(std::string const& directory) {
+    static std::atomic<size_t> num_files{ 0 };
+    return directory + "/spill-" + std::to_string(platform::process_id())
+           + '-' + std::to_string(num_files.fetch_add(1)) + ".seg";
+}
+
+// Unbounded container which keeps at most `threshold` messages in
+// memory. Beyond that, messages are encoded into memory mapped segment
+// files under `directory` and decoded back in order as consumers catch
+// up. Only the segments being written and read stay mapped, and drained
+// segments are deleted. If a segment can not be created, spilled
+// messages are read back and the container keeps growing in memory, so
+// no message is lost.
+//
+// Spilling and reading back happen under the channel lock, they only
+// slow down a channel which is already falling behind.
+template <typename T, typename Codec = TrivialCodec<T>>
+class Spilling {
+public:
+    using value_type = T;
+
+    Spilling(std::string directory,
+             size_t threshold,
+             Codec codec = Codec(),
+             size_t segment_size = 64 << 20)
+        : directory(std::move(directory)),
+          threshold(std::max<size_t>(threshold, 1)),
+          segment_size(segment_size), codec(std::move(codec)),
+          num_spilled(0), num_segments(0) {
+        // Do Nothing
+    }
+
+    ~Spilling() {
+        for (auto& segment : segments) {
+            segment.file.close();
+            platform::remove_file(segment.path);
+        }
+    }
+
+    Spilling(Spilling const&) = delete;
+    Spilling(Spilling&&) = delete;
+
+    Spilling& operator=(Spilling const&) = delete;
+    Spilling& operator=(Spilling&&) = delete;
+
+    template <typename... U>
+    void emplace_back(U&&... args) {
+        if (num_spilled == 0 && memory.size() < threshold) {
+            memory.emplace_back(std::forward<U>(args)...);
+        }
+        else {
+            push_back(T(std::forward<U>(args)...));
+        }
+    }
+
+    void push_back(T const& value) {
+        if ((num_spilled == 0 && memory.size() < threshold) || !spill(value)) {
+            memory.push_back(value);
+        }
+    }
+
+    void push_back(T&& value) {
+        if ((num_spilled == 0 && memory.size() < threshold) || !spill(value)) {
+            memory.push_back(std::move(value));
+        }
+    }
+
+    void pop_front() {
+        memory.pop_front();
+        refill();
+    }
+
+    T& front() {
+        return memory.front();
+    }
+
+    T const& front() const {
+        return memory.front();
+    }
+
+    size_t size() const {
+        return memory.size() + num_spilled;
+    }
+
+    size_t max_size() const {
+        return memory.max_size();
+    }
+
+    // in memory, as charged to a MemoryGovernor, spilled messages cost
+    // none
+    size_t bytes() const {
+        return memory.size() * sizeof(T);
+    }
+
+    // messages on disk
+    size_t spilled() const {
+        return num_spilled;
+    }
+
+    // segment files created so far
+    size_t segments_created() const {
+        return num_segments;
+    }
+
+private:
+    struct Segment {
+        std::string path;
+        platform::MappedFile file;
+
+        size_t written = 0;
+        size_t read = 0;
+        size_t count = 0;
+        size_t consumed = 0;
+    };
+
+    static constexpr size_t prefix = sizeof(uint32_t);
+
+    // append to the last segment, false if no segment could be created
+    bool spill(T const& value) {
+        size_t length = codec.size(value);
+        size_t need = prefix + length;
+
+        if (segments.empty() || !segments.back().file.mapped()
+            || segments.back().written + need
+                   > segments.back().file.size()) {
+            if (!segments.empty()) {
+                segments.back().file.close();
+            }
+
+            Segment& segment = segments.emplace_back();
+            segment.path = spill_path(directory);
+            if (!segment.file.create(segment.path,
+                                     std::max(segment_size, need))) {
+                platform::remove_file(segment.path);
+                segments.pop_back();
+
+                unspill();
+                return false;
+            }
+            num_segments += 1;
+        }
+
+        Segment& segment = segments.back();
+        unsigned char* dst = segment.file.data() + segment.written;
+
+        auto header = static_cast<uint32_t>(length);
+        std::memcpy(dst, &header, prefix);
+        codec.encode(value, dst + prefix);
+
+        segment.written += need;
+        segment.count += 1;
+        num_spilled += 1;
+        return true;
+    }
+
+    // read back spilled messages while memory is below the threshold
+    void refill() {
+        while (memory.size() < threshold && read_one()) {
+            // Do Nothing
+        }
+    }
+
+    // read back every spilled message
+    void unspill() {
+        while (read_one()) {
+            // Do Nothing
+        }
+    }
+
+    bool read_one() {
+        if (num_spilled == 0) {
+            return false;
+        }
+
+        Segment& segment = segments.front();
+        if (!segment.file.mapped() && !segment.file.open(segment.path)) {
+            // segment vanished from the disk, nothing left to read back
+            num_spilled -= segment.count - segment.consumed;
+            drop_front();
+            return num_spilled > 0;
+        }
+
+        unsigned char const* src = segment.file.data() + segment.read;
+        uint32_t length = 0;
+        std::memcpy(&length, src, prefix);
+        memory.push_back(codec.decode(src + prefix, length));
+
+        segment.read += prefix + length;
+        segment.consumed += 1;
+        num_spilled -= 1;
+
+        if (segment.consumed == segment.count) {
+            drop_front();
+        }
+        return true;
+    }
+
+    void drop_front() {
+        segments.front().file.close();
+        platform::remove_file(segments.front().path);
+        segments.pop_front();
+    }
+
+    std::string directory;
+    size_t threshold;
+    size_t segment_size;
+    Codec codec;
+
+    std::list<T> memory;
+    std::deque<Segment> segments;
+
+    size_t num_spilled;
+    size_t num_segments;
+};
+
+#endif
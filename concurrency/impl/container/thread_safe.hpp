@@ -1,27 +1,78 @@
 #ifndef CONTAINER_THREAD_SAFE_HPP
 #define CONTAINER_THREAD_SAFE_HPP
 
+#include <algorithm>
+#include <atomic>
 #include <condition_variable>
+#include <cstddef>
+#include <cstdint>
 #include <list>
 #include <memory>
 #include <mutex>
+#include <new>
 #include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
+#include "../blocking.hpp"
+#include "../memory_governor.hpp"
+#include "../platform/constant.hpp"
+#include "../platform/event_fd.hpp"
+#include "../platform/futex.hpp"
+#include "budgeted.hpp"
+#include "conflating.hpp"
 #include "ring_buffer.hpp"
+#include "spilling.hpp"
 
-template <typename Cont, typename Mutex = std::mutex>
+struct QueueStat {
+    size_t size;
+    size_t pushed;
+    size_t popped;
+    size_t push_parks;
+    size_t pop_parks;
+    size_t spurious_wakeups;
+    size_t dropped;
+    size_t evicted;
+    size_t rejected;
+};
+
+// What a full channel does with a new message, Block waits for space,
+// DropNewest discards the message, DropOldest evicts buffered messages
+// and Fail refuses the message.
+enum class Overflow { Block, DropNewest, DropOldest, Fail };
+
+// Sent or Evicted when the message is buffered.
+enum class SendStatus { Sent, Evicted, Dropped, Full, Closed };
+
+// Padded false packs the fields, only to measure the padding.
+template <typename Cont, typename Mutex = std::mutex, bool Padded = true>
 class ThreadSafe {
 public:
     using value_type = typename Cont::value_type;
 
     template <typename... Args>
     ThreadSafe(Args&&... args)
-        : m_runnable(true), buffer(std::forward<Args>(args)...) {
+        : ThreadSafe(Overflow::Block, std::forward<Args>(args)...) {
+        // Do Nothing
+    }
+
+    // eg. ThreadSafe<RingBuffer<T>>(Overflow::DropOldest, 1024)
+    template <typename... Args>
+    ThreadSafe(Overflow overflow, Args&&... args)
+        : overflow(overflow), m_runnable(true),
+          buffer(std::forward<Args>(args)...), account(nullptr), charged(0),
+          m_size(0), num_push(0), num_pop(0), num_push_park(0),
+          num_pop_park(0), num_spurious(0), num_dropped(0), num_evicted(0),
+          num_rejected(0) {
         // Do Nothing
     }
 
     ~ThreadSafe() {
         close();
+        if (auto* current = account.load(std::memory_order_acquire)) {
+            current->governor->Leave(current);
+        }
     }
 
     ThreadSafe(ThreadSafe const&) = delete;
@@ -31,45 +82,84 @@ public:
     ThreadSafe& operator=(ThreadSafe&&) = delete;
 
     template <typename... U>
-    void emplace_back(U&&... args) {
-        std::unique_lock lock(mutex);
-        cond.wait(lock, [&] {
-            return !m_runnable || buffer.size() < buffer.max_size();
-        });
-
-        if (m_runnable) {
-            buffer.emplace_back(std::forward<U>(args)...);
+    SendStatus emplace_back(U&&... args) {
+        if constexpr (has_pending<Cont>::value) {
+            // the key decides whether the value needs space
+            value_type value(std::forward<U>(args)...);
+            return send(&value, std::move(value));
         }
-        cond.notify_all();
+        else {
+            return send(nullptr, std::forward<U>(args)...);
+        }
+    }
+
+    SendStatus push_back(value_type const& value) {
+        return emplace_back(value);
     }
 
-    void push_back(value_type const& value) {
+    SendStatus push_back(value_type&& value) {
+        return emplace_back(std::move(value));
+    }
+
+    // Pushes all `count` elements unless the channel closes or the
+    // overflow policy drops or rejects the rest, returns the number pushed.
+    size_t push_bulk(value_type const* src, size_t count) {
+        size_t done = 0;
+        admit();
         std::unique_lock lock(mutex);
-        cond.wait(lock, [&] {
-            return !m_runnable || buffer.size() < buffer.max_size();
-        });
+        while (done < count) {
+            if (!accepted(make_space(lock, count - done, src + done))) {
+                break;
+            }
 
-        if (m_runnable) {
-            buffer.push_back(value);
+            size_t before = buffer.size();
+            size_t num = 0;
+            if constexpr (has_bulk<Cont>::value) {
+                num = buffer.push_bulk(src + done, count - done);
+            }
+            else {
+                for (; done + num < count && has_space(); ++num) {
+                    buffer.push_back(src[done + num]);
+                }
+            }
+            done += num;
+            pushed(before, num);
+            cond.notify_all();
         }
-        cond.notify_all();
+        return done;
     }
 
-    void push_back(value_type&& value) {
+    // Blocks until at least one element is available, then moves up to
+    // `count` elements, returns zero once closed and drained.
+    size_t pop_bulk(value_type* dst, size_t count) {
         std::unique_lock lock(mutex);
-        cond.wait(lock, [&] {
-            return !m_runnable || buffer.size() < buffer.max_size();
+        wait(lock, num_pop_park, "receive", [&] {
+            return !m_runnable || buffer.size() > 0;
         });
 
-        if (m_runnable) {
-            buffer.push_back(std::move(value));
+        size_t num = 0;
+        if constexpr (has_bulk<Cont>::value) {
+            num = buffer.pop_bulk(dst, count);
         }
-        cond.notify_all();
+        else {
+            for (; num < count && buffer.size() > 0; ++num) {
+                dst[num] = std::move(buffer.front());
+                buffer.pop_front();
+            }
+        }
+
+        if (num > 0) {
+            popped(num);
+            cond.notify_all();
+        }
+        return num;
     }
 
     std::optional<value_type> pop_front() {
         std::unique_lock lock(mutex);
-        cond.wait(lock, [&] { return !m_runnable || buffer.size() > 0; });
+        wait(lock, num_pop_park, "receive", [&] {
+            return !m_runnable || buffer.size() > 0;
+        });
 
         if (!m_runnable && buffer.size() == 0) {
             return std::nullopt;
@@ -77,6 +167,7 @@ public:
 
         value_type given = std::move(buffer.front());
         buffer.pop_front();
+        popped();
 
         cond.notify_all();
         return std::make_optional(std::move(given));
@@ -87,6 +178,7 @@ public:
         if (lock.owns_lock() && buffer.size() > 0) {
             value_type given = std::move(buffer.front());
             buffer.pop_front();
+            popped();
 
             cond.notify_all();
             return std::make_optional(std::move(given));
@@ -94,9 +186,141 @@ public:
         return std::nullopt;
     }
 
+    // Reserve a slot for construction in place, blocks until space is
+    // available, returns nullopt once closed or refused by the overflow
+    // policy.
+    std::optional<size_t> claim() {
+        admit();
+        std::unique_lock lock(mutex);
+        if (!accepted(make_space(lock, 1))) {
+            return std::nullopt;
+        }
+        return buffer.claim();
+    }
+
+    void commit(size_t idx) {
+        std::unique_lock lock(mutex);
+        size_t before = buffer.size();
+        buffer.commit(idx);
+        pushed(before);
+
+        cond.notify_all();
+    }
+
+    // may publish slots committed after `idx`
+    void abandon(size_t idx) {
+        std::unique_lock lock(mutex);
+        size_t before = buffer.size();
+        buffer.abandon(idx);
+        pushed(before, 0);
+
+        cond.notify_all();
+    }
+
+    // Take the front element for reading in place, blocks until one is
+    // available, returns nullopt once closed and drained.
+    std::optional<size_t> borrow() {
+        std::unique_lock lock(mutex);
+        wait(lock, num_pop_park, "receive", [&] {
+            return !m_runnable || buffer.size() > 0;
+        });
+
+        if (buffer.size() == 0) {
+            return std::nullopt;
+        }
+
+        size_t idx = buffer.borrow();
+        popped();
+        return idx;
+    }
+
+    void release(size_t idx) {
+        std::unique_lock lock(mutex);
+        buffer.release(idx);
+
+        cond.notify_all();
+    }
+
+    // claimed and borrowed slots are accessed without the lock
+    void* storage(size_t idx) {
+        return buffer.storage(idx);
+    }
+
+    value_type* at(size_t idx) {
+        return buffer.at(idx);
+    }
+
     void close() {
         m_runnable = false;
         cond.notify_all();
+        {
+            std::unique_lock lock(mutex);
+            if (readiness.is_open()) {
+                readiness.signal();
+            }
+            wake_selectors();
+        }
+        if (auto* current = account.load(std::memory_order_acquire)) {
+            current->closed.store(true, std::memory_order_relaxed);
+            current->governor->Wake();
+        }
+        BlockingRegistry::Instance().Progress();
+    }
+
+    // Charge buffered bytes to `governor`, producers are throttled by it
+    // before taking the lock. Bytes are reported by the container, or
+    // estimated by the element size. Safe while producers run, false if
+    // already governed, producers may be parked on the first account.
+    bool govern(MemoryGovernor& governor) {
+        std::unique_lock lock(mutex);
+        if (account.load(std::memory_order_relaxed) != nullptr) {
+            return false;
+        }
+
+        account.store(governor.Join(), std::memory_order_release);
+        charged = 0;
+        charge();
+        return true;
+    }
+
+    // Descriptor readable once the container goes from empty to non
+    // empty or is closed, -1 if unsupported. Created on first use.
+    int ready_fd() {
+        std::unique_lock lock(mutex);
+        if (!readiness.is_open() && readiness.open()
+            && (buffer.size() > 0 || !m_runnable)) {
+            readiness.signal();
+        }
+        return readiness.fd();
+    }
+
+    // Set `word` to one and wake it once the container goes from empty
+    // to non empty or is closed, for a select parked on several
+    // channels. False without attaching if a message is readable or the
+    // container is closed already.
+    bool attach(std::atomic<uint32_t>* word) {
+        std::unique_lock lock(mutex);
+        if (buffer.size() > 0 || !m_runnable) {
+            return false;
+        }
+        selectors.push_back(word);
+        return true;
+    }
+
+    void detach(std::atomic<uint32_t>* word) {
+        std::unique_lock lock(mutex);
+        selectors.erase(std::remove(selectors.begin(), selectors.end(), word),
+                        selectors.end());
+    }
+
+    // called after draining with try_pop, the fd stays readable if
+    // messages are left, eg. when try_pop lost the lock
+    void clear_ready() {
+        std::unique_lock lock(mutex);
+        readiness.drain();
+        if (buffer.size() > 0 || !m_runnable) {
+            readiness.signal();
+        }
     }
 
     bool runnable() const {
@@ -108,12 +332,365 @@ public:
         return m_runnable || buffer.size() > 0;
     }
 
+    QueueStat stat() const {
+        return QueueStat{ m_size.load(std::memory_order_relaxed),
+                          num_push.load(std::memory_order_relaxed),
+                          num_pop.load(std::memory_order_relaxed),
+                          num_push_park.load(std::memory_order_relaxed),
+                          num_pop_park.load(std::memory_order_relaxed),
+                          num_spurious.load(std::memory_order_relaxed),
+                          num_dropped.load(std::memory_order_relaxed),
+                          num_evicted.load(std::memory_order_relaxed),
+                          num_rejected.load(std::memory_order_relaxed) };
+    }
+
 private:
+    using cond_type = std::conditional_t<std::is_same_v<Mutex, std::mutex>,
+                                         std::condition_variable,
+                                         std::condition_variable_any>;
+
+    template <typename C, typename = void>
+    struct has_bulk : std::false_type {};
+
+    template <typename C>
+    struct has_bulk<C,
+                    std::void_t<decltype(std::declval<C&>().pop_bulk(
+                        std::declval<value_type*>(), size_t()))>>
+        : std::true_type {};
+
+    template <typename C, typename = void>
+    struct has_pending : std::false_type {};
+
+    template <typename C>
+    struct has_pending<C,
+                       std::void_t<decltype(std::declval<C const&>().pending(
+                           std::declval<value_type const&>()))>>
+        : std::true_type {};
+
+    template <typename C, typename = void>
+    struct has_full : std::false_type {};
+
+    template <typename C>
+    struct has_full<C, std::void_t<decltype(std::declval<C const&>().full())>>
+        : std::true_type {};
+
+    // an `incoming` value replacing a pending one always fits
+    bool has_space(value_type const* incoming = nullptr) const {
+        if constexpr (has_pending<Cont>::value) {
+            if (incoming != nullptr && buffer.pending(*incoming)) {
+                return true;
+            }
+        }
+        else {
+            (void)incoming;
+        }
+
+        if constexpr (has_full<Cont>::value) {
+            return !buffer.full();
+        }
+        else {
+            return buffer.size() < buffer.max_size();
+        }
+    }
+
+    template <typename C, typename = void>
+    struct has_bytes : std::false_type {};
+
+    template <typename C>
+    struct has_bytes<C,
+                     std::void_t<decltype(std::declval<C const&>().bytes())>>
+        : std::true_type {};
+
+    template <typename... U>
+    SendStatus send(value_type const* incoming, U&&... args) {
+        admit();
+        std::unique_lock lock(mutex);
+        SendStatus status = make_space(lock, 1, incoming);
+
+        if (accepted(status)) {
+            size_t before = buffer.size();
+            buffer.emplace_back(std::forward<U>(args)...);
+            pushed(before);
+        }
+        cond.notify_all();
+        return status;
+    }
+
+    // Applies the overflow policy until there is space for `incoming`,
+    // or one element if unknown, `pending` elements are counted when
+    // dropped or rejected.
+    SendStatus make_space(std::unique_lock<Mutex>& lock,
+                          size_t pending,
+                          value_type const* incoming = nullptr) {
+        if (overflow == Overflow::Block) {
+            wait(lock, num_push_park, "send", [&] {
+                return !m_runnable || has_space(incoming);
+            });
+        }
+
+        if (!m_runnable) {
+            return SendStatus::Closed;
+        }
+        if (has_space(incoming)) {
+            return SendStatus::Sent;
+        }
+
+        if (overflow == Overflow::DropNewest) {
+            bump(num_dropped, pending);
+            return SendStatus::Dropped;
+        }
+        if (overflow == Overflow::Fail) {
+            bump(num_rejected, pending);
+            return SendStatus::Full;
+        }
+
+        size_t num = 0;
+        for (; !has_space(incoming) && buffer.size() > 0; ++num) {
+            buffer.pop_front();
+        }
+        bump(num_evicted, num);
+
+        // claimed and borrowed slots can not be evicted
+        wait(lock, num_push_park, "send", [&] {
+            return !m_runnable || has_space(incoming);
+        });
+        if (!m_runnable) {
+            return SendStatus::Closed;
+        }
+        return num > 0 ? SendStatus::Evicted : SendStatus::Sent;
+    }
+
+    static bool accepted(SendStatus status) {
+        return status == SendStatus::Sent || status == SendStatus::Evicted;
+    }
+
+    static void bump(std::atomic<size_t>& counter, size_t num) {
+        counter.store(counter.load(std::memory_order_relaxed) + num,
+                      std::memory_order_relaxed);
+    }
+
+    void admit() {
+        if (auto* current = account.load(std::memory_order_acquire)) {
+            current->governor->Admit(*current);
+        }
+    }
+
+    void charge() {
+        auto* current = account.load(std::memory_order_relaxed);
+        if (current == nullptr) {
+            return;
+        }
+
+        size_t bytes = 0;
+        if constexpr (has_bytes<Cont>::value) {
+            bytes = buffer.bytes();
+        }
+        else {
+            bytes = buffer.size() * sizeof(value_type);
+        }
+
+        current->governor->Charge(*current,
+                                  static_cast<std::ptrdiff_t>(bytes)
+                                      - static_cast<std::ptrdiff_t>(charged));
+        charged = bytes;
+    }
+
+    // counters are written under the lock and read lock-free by metrics
+    void pushed(size_t before, size_t num = 1) {
+        // Signal the transition only, later sends find the fd readable.
+        // Commits out of claim order make several messages readable at
+        // once, or none.
+        if (before == 0 && buffer.size() > 0) {
+            if (readiness.is_open()) {
+                readiness.signal();
+            }
+            wake_selectors();
+        }
+        charge();
+        BlockingRegistry::Instance().Progress();
+        m_size.store(buffer.size(), std::memory_order_relaxed);
+        bump(num_push, num);
+    }
+
+    void wake_selectors() {
+        for (auto* word : selectors) {
+            word->store(1, std::memory_order_release);
+            platform::futex_wake(*word);
+        }
+    }
+
+    void popped(size_t num = 1) {
+        charge();
+        BlockingRegistry::Instance().Progress();
+        m_size.store(buffer.size(), std::memory_order_relaxed);
+        bump(num_pop, num);
+    }
+
+    template <typename F>
+    void wait(std::unique_lock<Mutex>& lock,
+              std::atomic<size_t>& parks,
+              char const* kind,
+              F&& pred) {
+        if (pred()) {
+            return;
+        }
+
+        BlockingScope scope(this, kind);
+        parks.fetch_add(1, std::memory_order_relaxed);
+
+        cond.wait(lock);
+        while (!pred()) {
+            num_spurious.fetch_add(1, std::memory_order_relaxed);
+            cond.wait(lock);
+        }
+    }
+
+    // Every field but the counters is guarded by the mutex, producers
+    // and consumers already serialize on it. Align the guarded state so
+    // it does not share a line with neighbouring objects, and keep the
+    // counters read by metrics on their own line.
+    alignas(platform::line_align<Mutex, Padded>) Mutex mutex;
+    cond_type cond;
+
+    Overflow overflow;
     bool m_runnable;
     Cont buffer;
 
-    Mutex mutex;
-    std::condition_variable cond;
+    // set once under the lock, read without it by producers
+    std::atomic<MemoryGovernor::Account*> account;
+    size_t charged;
+
+    platform::EventFd readiness;
+    std::vector<std::atomic<uint32_t>*> selectors;
+
+    alignas(platform::line_align<std::atomic<size_t>, Padded>)
+        std::atomic<size_t> m_size;
+    std::atomic<size_t> num_push;
+    std::atomic<size_t> num_pop;
+    std::atomic<size_t> num_push_park;
+    std::atomic<size_t> num_pop_park;
+    std::atomic<size_t> num_spurious;
+    std::atomic<size_t> num_dropped;
+    std::atomic<size_t> num_evicted;
+    std::atomic<size_t> num_rejected;
+};
+
+// Producer side of a zero-copy transfer. Construct the message in
+// place with emplace, or access a default initialized one through * and
+// ->, then Commit. A slot dropped without Commit is skipped.
+template <typename Queue>
+class ClaimedSlot {
+public:
+    using value_type = typename Queue::value_type;
+
+    ClaimedSlot(Queue& queue, std::optional<size_t> idx)
+        : queue(queue), idx(idx), constructed(false) {
+        // Do Nothing
+    }
+
+    ~ClaimedSlot() {
+        if (idx.has_value()) {
+            if (constructed) {
+                queue.at(idx.value())->~value_type();
+            }
+            queue.abandon(idx.value());
+        }
+    }
+
+    ClaimedSlot(ClaimedSlot const&) = delete;
+    ClaimedSlot(ClaimedSlot&&) = delete;
+
+    ClaimedSlot& operator=(ClaimedSlot const&) = delete;
+    ClaimedSlot& operator=(ClaimedSlot&&) = delete;
+
+    // false once the channel is closed
+    explicit operator bool() const {
+        return idx.has_value();
+    }
+
+    template <typename... U>
+    value_type& emplace(U&&... args) {
+        if (constructed) {
+            queue.at(idx.value())->~value_type();
+            constructed = false;
+        }
+
+        new (queue.storage(idx.value()))
+            value_type(std::forward<U>(args)...);
+        constructed = true;
+        return *queue.at(idx.value());
+    }
+
+    value_type& operator*() {
+        if (!constructed) {
+            new (queue.storage(idx.value())) value_type;
+            constructed = true;
+        }
+        return *queue.at(idx.value());
+    }
+
+    value_type* operator->() {
+        return &**this;
+    }
+
+    void Commit() {
+        if (idx.has_value() && constructed) {
+            queue.commit(idx.value());
+            idx.reset();
+        }
+    }
+
+private:
+    Queue& queue;
+    std::optional<size_t> idx;
+    bool constructed;
+};
+
+// Consumer side of a zero-copy transfer, the message is read in place
+// and destroyed on Release or destruction.
+template <typename Queue>
+class BorrowedSlot {
+public:
+    using value_type = typename Queue::value_type;
+
+    BorrowedSlot(Queue& queue, std::optional<size_t> idx)
+        : queue(queue), idx(idx) {
+        // Do Nothing
+    }
+
+    ~BorrowedSlot() {
+        Release();
+    }
+
+    BorrowedSlot(BorrowedSlot const&) = delete;
+    BorrowedSlot(BorrowedSlot&&) = delete;
+
+    BorrowedSlot& operator=(BorrowedSlot const&) = delete;
+    BorrowedSlot& operator=(BorrowedSlot&&) = delete;
+
+    // false once the channel is closed and drained
+    explicit operator bool() const {
+        return idx.has_value();
+    }
+
+    value_type& operator*() {
+        return *queue.at(idx.value());
+    }
+
+    value_type* operator->() {
+        return queue.at(idx.value());
+    }
+
+    void Release() {
+        if (idx.has_value()) {
+            queue.release(idx.value());
+            idx.reset();
+        }
+    }
+
+private:
+    Queue& queue;
+    std::optional<size_t> idx;
 };
 
 template <typename T>
@@ -122,4 +699,19 @@ using TSList = ThreadSafe<std::list<T>>;
 template <typename T>
 using TSRingBuffer = ThreadSafe<RingBuffer<T>>;
 
+template <typename T, size_t N>
+using TSStaticRingBuffer = ThreadSafe<StaticRingBuffer<T, N>>;
+
+template <typename T>
+using TSBudgetedList = ThreadSafe<Budgeted<std::list<T>>>;
+
+template <typename T>
+using TSBudgetedRingBuffer = ThreadSafe<Budgeted<RingBuffer<T>>>;
+
+template <typename K, typename V>
+using TSConflating = ThreadSafe<Conflating<K, V>>;
+
+template <typename T, typename Codec = TrivialCodec<T>>
+using TSSpilling = ThreadSafe<Spilling<T, Codec>>;
+
 #endif
\ No newline at end of file
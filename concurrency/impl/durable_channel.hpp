@@ -0,0 +1,460 @@
+#ifndef DURABLE_CHANNEL_HPP
+#define DURABLE_CHANNEL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "channel_iter.hpp"
+#include "codec.hpp"
+#include "container/thread_safe.hpp"
+#include "platform/log_file.hpp"
+#include "platform/mapped_file.hpp"
+
+// Message received from a DurableChannel, Ack `seq` once it is
+// processed.
+template <typename T>
+struct Delivery {
+    uint64_t seq;
+    T value;
+
+    bool operator==(Delivery const& other) const {
+        return seq == other.seq;
+    }
+
+    bool operator!=(Delivery const& other) const {
+        return seq != other.seq;
+    }
+};
+
+// Channel persisting every message to a segmented log under `directory`
+// before Add returns. Writers append under the log lock, the first one
+// waiting for durability becomes the leader, sleeps for the group
+// commit `window` to let others append, then syncs everything written
+// so far with a single fdatasync. Messages are received in order once
+// they are durable.
+//
+// Consumers Ack sequence numbers in any order, the contiguous prefix of
+// acknowledged messages is checkpointed at most every
+// `checkpoint_interval` and the segments it covers are deleted. After a
+// restart every message past the checkpoint is received again, so
+// processing should be idempotent.
+template <typename T, typename Codec = TrivialCodec<T>>
+class DurableChannel {
+public:
+    using value_type = Delivery<T>;
+    using iterator = ChannelIterator<value_type, DurableChannel>;
+    using clock = std::chrono::steady_clock;
+
+    DurableChannel(std::string directory,
+                   std::chrono::microseconds window
+                   = std::chrono::microseconds(0),
+                   std::chrono::milliseconds checkpoint_interval
+                   = std::chrono::milliseconds(1000),
+                   size_t segment_size = 64 << 20,
+                   Codec codec = Codec())
+        : directory(std::move(directory)), window(window),
+          checkpoint_interval(checkpoint_interval),
+          segment_size(segment_size), codec(std::move(codec)),
+          m_runnable(true), failed(false), syncing(false), next_seq(1),
+          synced_seq(0), segment_bytes(0), acked(0), checkpointed(0),
+          last_checkpoint(clock::now()), num_syncs(0), num_replayed(0) {
+        platform::make_directory(this->directory);
+        recover();
+
+        std::unique_lock lock(log_mutex);
+        roll();
+    }
+
+    ~DurableChannel() {
+        Close();
+        Checkpoint();
+    }
+
+    DurableChannel(DurableChannel const&) = delete;
+    DurableChannel(DurableChannel&&) = delete;
+
+    DurableChannel& operator=(DurableChannel const&) = delete;
+    DurableChannel& operator=(DurableChannel&&) = delete;
+
+    // Append and sync, false if closed or the log can not be written.
+    bool Add(T const& value) {
+        size_t length = codec.size(value);
+        std::vector<unsigned char> record(header_size + length);
+        codec.encode(value, record.data() + header_size);
+
+        std::unique_lock lock(log_mutex);
+        while (true) {
+            if (!m_runnable || failed) {
+                return false;
+            }
+
+            bool rotate = !file.is_open()
+                          || (segment_bytes > 0
+                              && segment_bytes + record.size()
+                                     > segment_size);
+            if (!rotate) {
+                break;
+            }
+
+            // the leader syncs the current segment out of the lock
+            if (syncing) {
+                log_cond.wait(lock);
+            }
+            else if (!roll()) {
+                fail();
+                return false;
+            }
+        }
+
+        uint64_t seq = next_seq;
+        seal(record, seq, length);
+        if (!file.write(record.data(), record.size())) {
+            fail();
+            return false;
+        }
+
+        next_seq += 1;
+        segment_bytes += record.size();
+        segments.back().last = seq;
+        pending.push_back(value_type{ seq, value });
+
+        return commit(lock, seq);
+    }
+
+    std::optional<value_type> Get() {
+        return queue.pop_front();
+    }
+
+    std::optional<value_type> TryGet() {
+        return queue.try_pop();
+    }
+
+    // Acknowledge a processed message, it is not replayed once the
+    // checkpoint covers it.
+    void Ack(uint64_t seq) {
+        std::unique_lock lock(ack_mutex);
+        if (seq <= acked) {
+            return;
+        }
+
+        acks.insert(seq);
+        while (!acks.empty() && *acks.begin() == acked + 1) {
+            acked += 1;
+            acks.erase(acks.begin());
+        }
+
+        if (clock::now() - last_checkpoint >= checkpoint_interval) {
+            checkpoint();
+        }
+    }
+
+    // persist the acknowledged prefix now
+    void Checkpoint() {
+        std::unique_lock lock(ack_mutex);
+        checkpoint();
+    }
+
+    void Close() {
+        {
+            std::unique_lock lock(log_mutex);
+            m_runnable = false;
+        }
+        log_cond.notify_all();
+        queue.close();
+    }
+
+    bool Runnable() const {
+        return m_runnable;
+    }
+
+    bool Readable() {
+        return queue.readable();
+    }
+
+    // last sequence number covered by a checkpoint
+    uint64_t Checkpointed() {
+        std::unique_lock lock(ack_mutex);
+        return checkpointed;
+    }
+
+    // number of fdatasync calls, messages per sync is the group size
+    size_t Syncs() const {
+        return num_syncs.load(std::memory_order_relaxed);
+    }
+
+    // messages received again after a restart
+    size_t Replayed() const {
+        return num_replayed;
+    }
+
+    QueueStat Stat() const {
+        return queue.stat();
+    }
+
+    iterator begin() {
+        return iterator(*this, Get());
+    }
+
+    iterator end() {
+        return iterator(*this, std::nullopt);
+    }
+
+private:
+    struct Segment {
+        std::string path;
+        uint64_t first;
+        uint64_t last;
+    };
+
+    // length, checksum and sequence number precede the encoded message
+    static constexpr size_t header_size =
+        2 * sizeof(uint32_t) + sizeof(uint64_t);
+
+    static uint32_t checksum(unsigned char const* src, size_t size) {
+        uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < size; ++i) {
+            hash = (hash ^ src[i]) * 16777619u;
+        }
+        return hash;
+    }
+
+    static void seal(std::vector<unsigned char>& record,
+                     uint64_t seq,
+                     size_t length) {
+        unsigned char* dst = record.data();
+        std::memcpy(dst + 2 * sizeof(uint32_t), &seq, sizeof(seq));
+
+        auto size = static_cast<uint32_t>(length);
+        uint32_t sum = checksum(dst + 2 * sizeof(uint32_t),
+                                sizeof(seq) + length);
+        std::memcpy(dst, &size, sizeof(size));
+        std::memcpy(dst + sizeof(size), &sum, sizeof(sum));
+    }
+
+    std::string segment_path(uint64_t first) const {
+        std::string name = std::to_string(first);
+        return directory + "/wal-" + std::string(20 - name.size(), '0')
+               + name + ".log";
+    }
+
+    std::string checkpoint_path() const {
+        return directory + "/checkpoint";
+    }
+
+    // read the checkpoint and queue every message past it, a torn
+    // record ends its segment and a segment without a whole record is
+    // deleted
+    void recover() {
+        std::string content;
+        if (platform::read_file(checkpoint_path(), content)
+            && content.size() == sizeof(uint64_t)) {
+            std::memcpy(&checkpointed, content.data(), sizeof(uint64_t));
+            acked = checkpointed;
+        }
+        next_seq = acked + 1;
+
+        std::vector<uint64_t> firsts;
+        for (auto const& name : platform::list_directory(directory)) {
+            if (name.size() == 28 && name.compare(0, 4, "wal-") == 0
+                && name.compare(24, 4, ".log") == 0
+                && name.find_first_not_of("0123456789", 4) == 24) {
+                firsts.push_back(std::stoull(name.substr(4, 20)));
+            }
+        }
+        std::sort(firsts.begin(), firsts.end());
+
+        for (uint64_t first : firsts) {
+            Segment segment{ segment_path(first), first, first - 1 };
+            platform::read_file(segment.path, content);
+
+            auto src = reinterpret_cast<unsigned char const*>(content.data());
+            size_t pos = 0;
+            while (content.size() - pos >= header_size) {
+                uint32_t length = 0;
+                uint32_t sum = 0;
+                uint64_t seq = 0;
+                std::memcpy(&length, src + pos, sizeof(length));
+                std::memcpy(&sum, src + pos + sizeof(length), sizeof(sum));
+                std::memcpy(&seq, src + pos + 2 * sizeof(uint32_t),
+                            sizeof(seq));
+
+                if (content.size() - pos - header_size < length
+                    || checksum(src + pos + 2 * sizeof(uint32_t),
+                                sizeof(seq) + length)
+                           != sum) {
+                    break;
+                }
+
+                if (seq > acked) {
+                    queue.push_back(value_type{
+                        seq, codec.decode(src + pos + header_size, length) });
+                    num_replayed += 1;
+                }
+
+                segment.last = seq;
+                next_seq = std::max(next_seq, seq + 1);
+                pos += header_size + length;
+            }
+
+            if (pos == 0) {
+                platform::remove_file(segment.path);
+                continue;
+            }
+            segments.push_back(std::move(segment));
+        }
+
+        synced_seq = next_seq - 1;
+        drop_acked();
+    }
+
+    // seal the current segment and start a new one, under the log lock
+    bool roll() {
+        if (file.is_open()) {
+            if (!file.sync()) {
+                return false;
+            }
+            num_syncs.fetch_add(1, std::memory_order_relaxed);
+            synced_seq = next_seq - 1;
+            publish();
+            log_cond.notify_all();
+        }
+
+        // every record of a file by that name is torn, start it afresh
+        // so new records do not follow the torn bytes
+        std::string path = segment_path(next_seq);
+        if (!file.create(path) || !platform::sync_directory(path)) {
+            file.close();
+            return false;
+        }
+
+        segments.push_back(Segment{ path, next_seq, next_seq - 1 });
+        segment_bytes = 0;
+        return true;
+    }
+
+    // group commit, wait until `seq` is synced or sync as the leader
+    bool commit(std::unique_lock<std::mutex>& lock, uint64_t seq) {
+        while (synced_seq < seq) {
+            if (failed) {
+                return false;
+            }
+
+            if (syncing) {
+                log_cond.wait(lock);
+                continue;
+            }
+
+            syncing = true;
+            if (window.count() > 0) {
+                lock.unlock();
+                std::this_thread::sleep_for(window);
+                lock.lock();
+            }
+
+            uint64_t target = next_seq - 1;
+            lock.unlock();
+            bool synced = file.sync();
+            lock.lock();
+
+            syncing = false;
+            num_syncs.fetch_add(1, std::memory_order_relaxed);
+            if (synced) {
+                synced_seq = std::max(synced_seq, target);
+                publish();
+            }
+            else {
+                failed = true;
+            }
+            log_cond.notify_all();
+        }
+        return true;
+    }
+
+    // deliver synced messages in order, under the log lock
+    void publish() {
+        while (!pending.empty() && pending.front().seq <= synced_seq) {
+            queue.push_back(std::move(pending.front()));
+            pending.pop_front();
+        }
+    }
+
+    void fail() {
+        failed = true;
+        log_cond.notify_all();
+    }
+
+    // called under the ack lock
+    void checkpoint() {
+        last_checkpoint = clock::now();
+        if (acked == checkpointed
+            || !platform::replace_file(
+                checkpoint_path(), &acked, sizeof(acked))) {
+            return;
+        }
+
+        checkpointed = acked;
+        drop_acked();
+    }
+
+    // delete sealed segments covered by the checkpoint
+    void drop_acked() {
+        std::vector<std::string> drop;
+        {
+            std::unique_lock lock(log_mutex);
+            while (!segments.empty() && segments.front().last <= checkpointed
+                   && (segments.size() > 1 || !file.is_open())) {
+                drop.push_back(std::move(segments.front().path));
+                segments.pop_front();
+            }
+        }
+
+        for (auto const& path : drop) {
+            platform::remove_file(path);
+        }
+    }
+
+    std::string directory;
+    std::chrono::microseconds window;
+    std::chrono::milliseconds checkpoint_interval;
+    size_t segment_size;
+    Codec codec;
+
+    TSList<value_type> queue;
+
+    std::mutex log_mutex;
+    std::condition_variable log_cond;
+
+    bool m_runnable;
+    bool failed;
+    bool syncing;
+    uint64_t next_seq;
+    uint64_t synced_seq;
+    size_t segment_bytes;
+
+    platform::LogFile file;
+    std::deque<Segment> segments;
+    std::deque<value_type> pending;
+
+    std::mutex ack_mutex;
+    uint64_t acked;
+    uint64_t checkpointed;
+    std::set<uint64_t> acks;
+    clock::time_point last_checkpoint;
+
+    std::atomic<size_t> num_syncs;
+    size_t num_replayed;
+};
+
+#endif
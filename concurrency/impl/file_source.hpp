@@ -0,0 +1,323 @@
+#ifndef FILE_SOURCE_HPP
+#define FILE_SOURCE_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "platform/input_file.hpp"
+#include "thread_pool.hpp"
+
+enum class ChunkMode { Read, Map };
+
+// Piece of a file. Copies share the buffer or mapping it points into,
+// which stays valid while any copy is alive.
+struct FileChunk {
+    size_t index = 0;
+    uint64_t offset = 0;
+    std::shared_ptr<char const> data;
+    size_t size = 0;
+
+    std::string_view view() const {
+        return std::string_view(data.get(), size);
+    }
+};
+
+// Source stage reading a file in fixed size chunks, front to back. The
+// kernel is told the file is read sequentially and `depth` chunks ahead
+// of the reader are prefetched, so one producer keeps the device busy.
+//
+// In Read mode chunks are read into `depth` recycled buffers, and Next
+// blocks while every buffer is still referenced downstream. In Map mode
+// chunks point into a read only mapping of the whole file, and nothing
+// is copied or throttled. Map mode falls back to Read if mapping fails.
+class FileSource {
+public:
+    FileSource(std::string const& path,
+               size_t chunk_size = 1 << 20,
+               size_t depth = 8,
+               ChunkMode mode = ChunkMode::Read)
+        : state(std::make_shared<State>()),
+          chunk_size(std::max<size_t>(chunk_size, 1)),
+          depth(std::max<size_t>(depth, 1)), base(nullptr), offset(0),
+          index(0), prefetched(0), failed(false), num_stalls(0) {
+        if (!state->file.open(path)) {
+            failed = true;
+            return;
+        }
+
+        state->file.sequential();
+        if (mode == ChunkMode::Map) {
+            base = state->file.map();
+        }
+    }
+
+    FileSource(FileSource const&) = delete;
+    FileSource(FileSource&&) = delete;
+
+    FileSource& operator=(FileSource const&) = delete;
+    FileSource& operator=(FileSource&&) = delete;
+
+    // nullopt at the end of the file or on a read error
+    std::optional<FileChunk> Next() {
+        uint64_t size = state->file.size();
+        if (failed || offset >= size) {
+            return std::nullopt;
+        }
+
+        prefetch(size);
+        FileChunk chunk;
+        chunk.index = index;
+        chunk.offset = offset;
+        chunk.size = static_cast<size_t>(
+            std::min<uint64_t>(chunk_size, size - offset));
+
+        if (base != nullptr) {
+            // aliases the state, which owns the mapping
+            chunk.data = std::shared_ptr<char const>(state, base + offset);
+        }
+        else {
+            std::unique_ptr<char[]> buffer = acquire();
+            long res = state->file.read(buffer.get(), chunk.size, offset);
+            if (res <= 0) {
+                failed = res < 0;
+                release(std::move(buffer));
+                return std::nullopt;
+            }
+
+            // a file truncated meanwhile ends early
+            chunk.size = static_cast<size_t>(res);
+            chunk.data = std::shared_ptr<char const>(
+                buffer.release(), [state = state](char const* ptr) {
+                    std::unique_lock lock(state->mutex);
+                    state->free.emplace_back(const_cast<char*>(ptr));
+                    state->cond.notify_one();
+                });
+        }
+
+        offset += chunk.size;
+        ++index;
+        return chunk;
+    }
+
+    // Push every chunk into `out` and close it, false on a read error.
+    template <typename Channel>
+    bool Run(Channel& out) {
+        while (auto chunk = Next()) {
+            out.Add(std::move(chunk.value()));
+        }
+        out.Close();
+        return !failed;
+    }
+
+    // false if the file could not be opened or read
+    bool Ok() const {
+        return !failed;
+    }
+
+    uint64_t Size() const {
+        return state->file.size();
+    }
+
+    // waits for a buffer still held downstream, the consumers are slower
+    // than the device
+    size_t Stalls() const {
+        return num_stalls.load(std::memory_order_relaxed);
+    }
+
+    // buffers allocated in Read mode, at most `depth`
+    size_t Buffers() const {
+        std::unique_lock lock(state->mutex);
+        return state->allocated;
+    }
+
+    // buffers referenced by chunks downstream
+    size_t Held() const {
+        std::unique_lock lock(state->mutex);
+        return state->allocated - state->free.size();
+    }
+
+private:
+    // shared with the chunks, which may outlive the source
+    struct State {
+        platform::InputFile file;
+
+        std::mutex mutex;
+        std::condition_variable cond;
+        std::vector<std::unique_ptr<char[]>> free;
+        size_t allocated = 0;
+    };
+
+    void prefetch(uint64_t size) {
+        uint64_t ahead =
+            std::min<uint64_t>(size, offset + depth * chunk_size);
+        while (prefetched < ahead) {
+            state->file.prefetch(prefetched, chunk_size);
+            prefetched += chunk_size;
+        }
+    }
+
+    std::unique_ptr<char[]> acquire() {
+        std::unique_lock lock(state->mutex);
+        if (state->free.empty() && state->allocated >= depth) {
+            num_stalls.fetch_add(1, std::memory_order_relaxed);
+            state->cond.wait(lock, [this] { return !state->free.empty(); });
+        }
+
+        if (state->free.empty()) {
+            ++state->allocated;
+            return std::make_unique<char[]>(chunk_size);
+        }
+
+        std::unique_ptr<char[]> buffer = std::move(state->free.back());
+        state->free.pop_back();
+        return buffer;
+    }
+
+    void release(std::unique_ptr<char[]> buffer) {
+        std::unique_lock lock(state->mutex);
+        state->free.push_back(std::move(buffer));
+    }
+
+    std::shared_ptr<State> state;
+    size_t chunk_size;
+    size_t depth;
+    char const* base;
+
+    uint64_t offset;
+    size_t index;
+    uint64_t prefetched;
+    bool failed;
+    std::atomic<size_t> num_stalls;
+};
+
+// Lines ending in one chunk, without the newline. The views point into
+// the chunk, except the first which points into `joined` as its start
+// was carried over from the previous chunks.
+struct LineBatch {
+    size_t index = 0;
+    FileChunk chunk;
+    std::unique_ptr<std::string> joined;
+    std::vector<std::string_view> lines;
+};
+
+// Split the chunks of `in` into lines, chunks are scanned in parallel on
+// `pool` and batches reach `out` in file order. At most `depth` chunks
+// are scanned at once, and chunks are only held back while no other one
+// is ready, so a Read mode FileSource with fewer buffers than `depth`
+// bounds the parallelism instead of stalling. A last line without a
+// newline gets a batch of its own. Closes `out` once `in` is closed and
+// drained.
+template <typename In, typename Out>
+void SplitLines(In& in,
+                Out& out,
+                LThreadPool<void>& pool,
+                size_t depth = 8) {
+    struct Scan {
+        FileChunk chunk;
+        size_t first = std::string_view::npos;
+        size_t last = std::string_view::npos;
+        std::vector<std::string_view> lines;
+        std::future<void> done;
+
+        void run() {
+            std::string_view view = chunk.view();
+            char const* begin = view.data();
+            char const* end = begin + view.size();
+            char const* pos = begin;
+            while (pos < end) {
+                auto found = static_cast<char const*>(
+                    std::memchr(pos, '\n', static_cast<size_t>(end - pos)));
+                if (found == nullptr) {
+                    break;
+                }
+
+                size_t at = static_cast<size_t>(found - begin);
+                if (first == std::string_view::npos) {
+                    first = at;
+                }
+                else {
+                    lines.emplace_back(pos, static_cast<size_t>(found - pos));
+                }
+                last = at;
+                pos = found + 1;
+            }
+        }
+    };
+
+    auto carry = std::make_unique<std::string>();
+    size_t next_index = 0;
+    auto finish = [&](Scan& scan) {
+        std::string_view view = scan.chunk.view();
+        next_index = scan.chunk.index + 1;
+        if (scan.first == std::string_view::npos) {
+            carry->append(view);
+            return;
+        }
+
+        carry->append(view.substr(0, scan.first));
+        LineBatch batch;
+        batch.index = scan.chunk.index;
+        batch.joined = std::move(carry);
+        batch.lines.reserve(scan.lines.size() + 1);
+        batch.lines.emplace_back(*batch.joined);
+        batch.lines.insert(
+            batch.lines.end(), scan.lines.begin(), scan.lines.end());
+        batch.chunk = std::move(scan.chunk);
+
+        carry = std::make_unique<std::string>(view.substr(scan.last + 1));
+        out.Add(std::move(batch));
+    };
+
+    std::deque<std::unique_ptr<Scan>> scans;
+    while (true) {
+        // the source may wait for the buffer of a held chunk, block for
+        // the next chunk only once every scan is finished
+        auto chunk = scans.empty() ? in.Get() : in.TryGet();
+        if (!chunk.has_value()) {
+            if (scans.empty()) {
+                break;
+            }
+
+            scans.front()->done.get();
+            finish(*scans.front());
+            scans.pop_front();
+            continue;
+        }
+
+        auto scan = std::make_unique<Scan>();
+        scan->chunk = std::move(chunk.value());
+        Scan* raw = scan.get();
+        raw->done = pool.Add([raw] { raw->run(); });
+        scans.push_back(std::move(scan));
+
+        if (scans.size() >= std::max<size_t>(depth, 1)) {
+            scans.front()->done.get();
+            finish(*scans.front());
+            scans.pop_front();
+        }
+    }
+
+    if (!carry->empty()) {
+        LineBatch batch;
+        batch.index = next_index;
+        batch.joined = std::move(carry);
+        batch.lines.emplace_back(*batch.joined);
+        out.Add(std::move(batch));
+    }
+    out.Close();
+}
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef HISTOGRAM_HPP
+#define HISTOGRAM_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// Lock-free log2 histogram of durations, bucket i counts samples
+// in (2^(i-1), 2^i] nanoseconds, bucket 0 those up to one. Bounds are
+// inclusive as the le of a prometheus bucket.
+class Histogram {
+public:
+    static constexpr size_t num_buckets = 64;
+
+    Histogram() : num_count(0), num_sum(0) {
+        for (auto& bucket : buckets) {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    Histogram(Histogram const& other) : Histogram() {
+        Merge(other);
+    }
+
+    Histogram& operator=(Histogram const& other) {
+        Reset();
+        Merge(other);
+        return *this;
+    }
+
+    template <typename Rep, typename Period>
+    void Record(std::chrono::duration<Rep, Period> const& dur) {
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(dur);
+        uint64_t value = ns.count() > 0 ? ns.count() : 0;
+
+        uint64_t below = value > 0 ? value - 1 : 0;
+        size_t idx = 0;
+        while (below >> idx) {
+            ++idx;
+        }
+
+        buckets[idx].fetch_add(1, std::memory_order_relaxed);
+        num_count.fetch_add(1, std::memory_order_relaxed);
+        num_sum.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    void Merge(Histogram const& other) {
+        for (size_t i = 0; i < num_buckets; ++i) {
+            buckets[i].fetch_add(other.Bucket(i), std::memory_order_relaxed);
+        }
+        num_count.fetch_add(other.Count(), std::memory_order_relaxed);
+        num_sum.fetch_add(other.num_sum.load(std::memory_order_relaxed),
+                          std::memory_order_relaxed);
+    }
+
+    void Reset() {
+        for (auto& bucket : buckets) {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+        num_count.store(0, std::memory_order_relaxed);
+        num_sum.store(0, std::memory_order_relaxed);
+    }
+
+    size_t Bucket(size_t idx) const {
+        return buckets[idx].load(std::memory_order_relaxed);
+    }
+
+    // inclusive upper bound of bucket `idx`
+    static std::chrono::nanoseconds UpperBound(size_t idx) {
+        if (idx >= num_buckets - 1) {
+            return std::chrono::nanoseconds::max();
+        }
+        return std::chrono::nanoseconds(1ll << idx);
+    }
+
+    size_t Count() const {
+        return num_count.load(std::memory_order_relaxed);
+    }
+
+    std::chrono::nanoseconds Sum() const {
+        return std::chrono::nanoseconds(
+            num_sum.load(std::memory_order_relaxed));
+    }
+
+    std::chrono::nanoseconds Mean() const {
+        auto count = static_cast<std::chrono::nanoseconds::rep>(Count());
+        return count > 0 ? Sum() / count : std::chrono::nanoseconds(0);
+    }
+
+    // upper bound of the bucket that holds the q-th quantile
+    std::chrono::nanoseconds Quantile(double q) const {
+        size_t count = Count();
+        size_t rank = static_cast<size_t>(q * count);
+        if (rank >= count && count > 0) {
+            rank = count - 1;
+        }
+
+        size_t acc = 0;
+        for (size_t i = 0; i < num_buckets; ++i) {
+            acc += Bucket(i);
+            if (acc > rank) {
+                return UpperBound(i);
+            }
+        }
+        return UpperBound(num_buckets - 1);
+    }
+
+private:
+    std::array<std::atomic<size_t>, num_buckets> buckets;
+    std::atomic<size_t> num_count;
+    std::atomic<uint64_t> num_sum;
+};
+
+#endif
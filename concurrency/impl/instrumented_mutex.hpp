@@ -0,0 +1,68 @@
+#ifndef INSTRUMENTED_MUTEX_HPP
+#define INSTRUMENTED_MUTEX_HPP
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+
+#include "histogram.hpp"
+
+// Lockable wrapper counting acquisitions, contention and time spent
+// waiting for the lock, eg. ThreadSafe<Cont, InstrumentedMutex>.
+template <typename Mutex = std::mutex>
+class InstrumentedMutex {
+public:
+    InstrumentedMutex() : num_acquire(0), num_contended(0) {
+        // Do Nothing
+    }
+
+    InstrumentedMutex(InstrumentedMutex const&) = delete;
+    InstrumentedMutex(InstrumentedMutex&&) = delete;
+
+    InstrumentedMutex& operator=(InstrumentedMutex const&) = delete;
+    InstrumentedMutex& operator=(InstrumentedMutex&&) = delete;
+
+    void lock() {
+        if (!mutex.try_lock()) {
+            auto start = std::chrono::steady_clock::now();
+            mutex.lock();
+            wait.Record(std::chrono::steady_clock::now() - start);
+
+            num_contended.fetch_add(1, std::memory_order_relaxed);
+        }
+        num_acquire.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    bool try_lock() {
+        if (mutex.try_lock()) {
+            num_acquire.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+        return false;
+    }
+
+    void unlock() {
+        mutex.unlock();
+    }
+
+    size_t Acquisitions() const {
+        return num_acquire.load(std::memory_order_relaxed);
+    }
+
+    size_t Contentions() const {
+        return num_contended.load(std::memory_order_relaxed);
+    }
+
+    Histogram const& WaitTime() const {
+        return wait;
+    }
+
+private:
+    Mutex mutex;
+
+    std::atomic<size_t> num_acquire;
+    std::atomic<size_t> num_contended;
+    Histogram wait;
+};
+
+#endif
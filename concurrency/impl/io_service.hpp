@@ -0,0 +1,364 @@
+#ifndef IO_SERVICE_HPP
+#define IO_SERVICE_HPP
+
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "platform/io_ring.hpp"
+#include "platform/log_file.hpp"
+#include "platform/thread.hpp"
+#include "thread_pool.hpp"
+
+// completion delivered to a channel, `result` is the syscall result or
+// -errno
+struct IoCompletion {
+    uint64_t tag;
+    long result;
+};
+
+// Asynchronous file I/O. Requests are queued on io_uring and handed to
+// the kernel in batches, a single reaper thread runs the completions, so
+// one thread may keep thousands of requests in flight. Without io_uring,
+// on older kernels, other systems or with zero entries, requests run as
+// blocking syscalls on a thread pool.
+//
+// Buffers and descriptors must stay valid until the request completes.
+// Callbacks run on the reaper or the pool and should not block.
+class IoService {
+public:
+    using Callback = std::function<void(long)>;
+
+    IoService(unsigned entries = 4096, size_t num_threads = 4)
+        : pool(num_threads), capacity(0), inflight(0), running(0),
+          unsubmitted(0), num_waiting(0), num_submitted(0), num_batches(0) {
+        if (ring.open(entries)) {
+            capacity = ring.capacity();
+            reaper = std::thread([this] { reap(); });
+        }
+    }
+
+    // waits for the requests in flight and their callbacks, which may
+    // chain further requests, before the reaper or the pool is joined
+    ~IoService() {
+        {
+            std::unique_lock lock(mutex);
+            ++num_waiting;
+            cond.wait(lock, [this] { return inflight == 0 && running == 0; });
+            --num_waiting;
+        }
+
+        if (ring.available()) {
+            platform::IoRequest request;
+            request.key = 0;
+            {
+                std::unique_lock lock(mutex);
+                ring.push(request);
+            }
+            ring.submit(1);
+            reaper.join();
+        }
+    }
+
+    IoService(IoService const&) = delete;
+    IoService(IoService&&) = delete;
+
+    IoService& operator=(IoService const&) = delete;
+    IoService& operator=(IoService&&) = delete;
+
+    void Read(int fd, void* buf, size_t len, uint64_t offset, Callback done) {
+        platform::IoRequest request;
+        request.op = platform::IoOp::Read;
+        request.fd = fd;
+        request.buf = buf;
+        request.len = len;
+        request.offset = offset;
+        submit(request, wrap(std::move(done)));
+    }
+
+    std::future<long> Read(int fd, void* buf, size_t len, uint64_t offset) {
+        auto promise = std::make_shared<std::promise<long>>();
+        Read(fd, buf, len, offset, fulfil(promise));
+        return promise->get_future();
+    }
+
+    void Write(int fd,
+               void const* buf,
+               size_t len,
+               uint64_t offset,
+               Callback done) {
+        platform::IoRequest request;
+        request.op = platform::IoOp::Write;
+        request.fd = fd;
+        request.buf = const_cast<void*>(buf);
+        request.len = len;
+        request.offset = offset;
+        submit(request, wrap(std::move(done)));
+    }
+
+    std::future<long> Write(int fd,
+                            void const* buf,
+                            size_t len,
+                            uint64_t offset) {
+        auto promise = std::make_shared<std::promise<long>>();
+        Write(fd, buf, len, offset, fulfil(promise));
+        return promise->get_future();
+    }
+
+    // the result is the new descriptor
+    void Open(std::string path, int flags, unsigned mode, Callback done) {
+        auto op = std::make_unique<Op>();
+        op->path = std::move(path);
+        op->done = [done = std::move(done)](Op&, long result) {
+            done(result);
+        };
+
+        platform::IoRequest request;
+        request.op = platform::IoOp::Open;
+        request.path = op->path.c_str();
+        request.flags = flags;
+        request.mode = mode;
+        submit(request, std::move(op));
+    }
+
+    std::future<long> Open(std::string path, int flags, unsigned mode = 0644) {
+        auto promise = std::make_shared<std::promise<long>>();
+        Open(std::move(path), flags, mode, fulfil(promise));
+        return promise->get_future();
+    }
+
+    void Stat(std::string path,
+              std::function<void(long, platform::FileStat const&)> done) {
+        auto op = std::make_unique<Op>();
+        op->path = std::move(path);
+        op->done = [done = std::move(done)](Op& op, long result) {
+            platform::FileStat stat{};
+            if (result >= 0) {
+                stat = platform::to_file_stat(op.stat);
+            }
+            done(result, stat);
+        };
+
+        platform::IoRequest request;
+        request.op = platform::IoOp::Stat;
+        request.path = op->path.c_str();
+        request.stat = &op->stat;
+        submit(request, std::move(op));
+    }
+
+    // nullopt if `path` does not exist
+    std::future<std::optional<platform::FileStat>> Stat(std::string path) {
+        using Result = std::optional<platform::FileStat>;
+        auto promise = std::make_shared<std::promise<Result>>();
+        Stat(std::move(path),
+             [promise](long result, platform::FileStat const& stat) {
+                 promise->set_value(result < 0 ? Result() : Result(stat));
+             });
+        return promise->get_future();
+    }
+
+    // io_uring has no getdents, directories are always listed on the pool
+    std::future<std::vector<std::string>> ListDir(std::string path) {
+        using Result = std::vector<std::string>;
+        auto promise = std::make_shared<std::promise<Result>>();
+        acquire();
+        pool.Add([this, promise, path = std::move(path)] {
+            auto names = platform::list_directory(path);
+            release();
+            promise->set_value(std::move(names));
+            settle();
+        });
+        return promise->get_future();
+    }
+
+    // false if requests run on the blocking pool
+    bool Uring() const {
+        return ring.available();
+    }
+
+    // requests not completed yet, completed ones no longer count by the
+    // time their callback runs
+    size_t InFlight() {
+        std::unique_lock lock(mutex);
+        return inflight;
+    }
+
+    // requests handed to the kernel and the enter calls doing so
+    size_t Submitted() const {
+        return num_submitted.load(std::memory_order_relaxed);
+    }
+
+    size_t Batches() const {
+        return num_batches.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Op {
+        std::function<void(Op&, long)> done;
+        platform::StatBuffer stat;
+        std::string path;
+    };
+
+    static std::unique_ptr<Op> wrap(Callback done) {
+        auto op = std::make_unique<Op>();
+        op->done = [done = std::move(done)](Op&, long result) {
+            done(result);
+        };
+        return op;
+    }
+
+    static Callback fulfil(std::shared_ptr<std::promise<long>> promise) {
+        return [promise](long result) { promise->set_value(result); };
+    }
+
+    // Queue the request, the submitter finding no unsubmitted requests
+    // flushes after releasing the lock, and takes every request queued
+    // meanwhile with it.
+    void submit(platform::IoRequest request, std::unique_ptr<Op> op) {
+        Op* raw = op.release();
+        request.key = reinterpret_cast<uint64_t>(raw);
+        if (!ring.available()) {
+            acquire();
+            pool.Add([this, raw, request] {
+                long result = platform::io_execute(request);
+                release();
+                finish(raw, result);
+            });
+            return;
+        }
+
+        {
+            std::unique_lock lock(mutex);
+            if (inflight >= capacity) {
+                ++num_waiting;
+                cond.wait(lock, [this] { return inflight < capacity; });
+                --num_waiting;
+            }
+
+            // in flight requests bound the queued ones, the push fits
+            ++inflight;
+            ring.push(request);
+            if (unsubmitted++ > 0) {
+                return;
+            }
+        }
+
+        // enters are serialized, the requests a failed one leaves are the
+        // oldest in the ring
+        std::unique_lock submitting(submit_mutex);
+        unsigned count = 0;
+        {
+            std::unique_lock lock(mutex);
+            count = unsubmitted;
+            unsubmitted = 0;
+        }
+        unsigned handed = ring.submit(count);
+        long error = -errno;
+        num_submitted.fetch_add(handed, std::memory_order_relaxed);
+        num_batches.fetch_add(1, std::memory_order_relaxed);
+        if (handed == count) {
+            return;
+        }
+
+        // the kernel never sees them, complete them with the error
+        std::vector<uint64_t> keys;
+        {
+            std::unique_lock lock(mutex);
+            keys = ring.drop(count - handed);
+        }
+        submitting.unlock();
+
+        for (uint64_t key : keys) {
+            pool.Add([this, key, error] {
+                release();
+                finish(reinterpret_cast<Op*>(key), error);
+            });
+        }
+    }
+
+    void acquire() {
+        std::unique_lock lock(mutex);
+        ++inflight;
+    }
+
+    // the request leaves InFlight, its callback is counted as running
+    // until finish
+    void release() {
+        std::unique_lock lock(mutex);
+        --inflight;
+        ++running;
+        if (num_waiting > 0) {
+            cond.notify_all();
+        }
+    }
+
+    void finish(Op* op, long result) {
+        op->done(*op, result);
+        delete op;
+        settle();
+    }
+
+    void settle() {
+        std::unique_lock lock(mutex);
+        --running;
+        if (num_waiting > 0) {
+            cond.notify_all();
+        }
+    }
+
+    void reap() {
+        platform::set_thread_name("io-reaper");
+        platform::IoEvent events[256];
+
+        while (true) {
+            size_t num = ring.reap(events, 256, true);
+            for (size_t i = 0; i < num; ++i) {
+                // the stop request is queued once nothing is in flight
+                if (events[i].key == 0) {
+                    return;
+                }
+
+                release();
+                finish(reinterpret_cast<Op*>(events[i].key), events[i].result);
+            }
+        }
+    }
+
+    LThreadPool<void> pool;
+    platform::IoRing ring;
+
+    std::mutex mutex;
+    std::mutex submit_mutex;
+    std::condition_variable cond;
+    size_t capacity;
+    size_t inflight;
+    size_t running;
+    unsigned unsubmitted;
+    size_t num_waiting;
+
+    std::atomic<size_t> num_submitted;
+    std::atomic<size_t> num_batches;
+    std::thread reaper;
+};
+
+// complete requests into a channel, eg.
+//     service.Read(fd, buf, len, 0, complete_to(channel, idx));
+template <typename Channel>
+IoService::Callback complete_to(Channel& channel, uint64_t tag) {
+    return [&channel, tag](long result) {
+        channel.Add(IoCompletion{ tag, result });
+    };
+}
+
+#endif
@@ -25,7 +25,8 @@ namespace LockFree {
         }
     };
 
-    template <typename T>
+    // Padded false packs the fields, only to measure the padding
+    template <typename T, bool Padded = true>
     class List {
     public:
         List() : m_head(nullptr), m_tail(nullptr), m_runnable(true), m_size(0) {
@@ -164,11 +165,17 @@ namespace LockFree {
         }
 
     private:
-        std::atomic<Node<T>*> m_head;
-        std::atomic<Node<T>*> m_tail;
+        // consumers swing the head and producers the tail, keep them and
+        // the shared counter on separate cache lines
+        template <typename U>
+        static constexpr size_t line =
+            platform::line_align<std::atomic<U>, Padded>;
+
+        alignas(line<Node<T>*>) std::atomic<Node<T>*> m_head;
+        alignas(line<Node<T>*>) std::atomic<Node<T>*> m_tail;
 
-        std::atomic<bool> m_runnable;
-        std::atomic<size_t> m_size;
+        alignas(line<bool>) std::atomic<bool> m_runnable;
+        alignas(line<size_t>) std::atomic<size_t> m_size;
     };
 }  // namespace LockFree
 
@@ -0,0 +1,182 @@
+#ifndef MEMORY_GOVERNOR_HPP
+#define MEMORY_GOVERNOR_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <limits>
+#include <list>
+#include <mutex>
+
+#include "blocking.hpp"
+
+// Process wide budget of bytes buffered by governed channels. Once the
+// total crosses the high water mark, producers of channels holding at
+// least their fair share, low water mark / number of channels, are
+// parked until the total falls to the low water mark. The largest
+// channels are throttled first, while the smaller ones keep flowing
+// and together stay under the low water mark.
+//
+// Producers are parked before they take the channel lock, and channels
+// charge the governor under their own lock, so the governor never
+// waits on a channel.
+class MemoryGovernor {
+public:
+    struct Account {
+        MemoryGovernor* governor{ nullptr };
+        std::atomic<size_t> bytes{ 0 };
+        std::atomic<bool> closed{ false };
+    };
+
+    MemoryGovernor()
+        : MemoryGovernor(std::numeric_limits<size_t>::max(),
+                         std::numeric_limits<size_t>::max()) {
+        // Do Nothing
+    }
+
+    MemoryGovernor(size_t high, size_t low)
+        : high(high), low(std::min(low, high)), total(0), throttling(false),
+          num_accounts(0), num_parks(0) {
+        // Do Nothing
+    }
+
+    MemoryGovernor(MemoryGovernor const&) = delete;
+    MemoryGovernor(MemoryGovernor&&) = delete;
+
+    MemoryGovernor& operator=(MemoryGovernor const&) = delete;
+    MemoryGovernor& operator=(MemoryGovernor&&) = delete;
+
+    // unlimited until SetLimits
+    static MemoryGovernor& Global() {
+        // never destroyed, static channels may leave after exit
+        static MemoryGovernor* governor = new MemoryGovernor();
+        return *governor;
+    }
+
+    void SetLimits(size_t high, size_t low) {
+        {
+            std::unique_lock lock(mutex);
+            this->high.store(high, std::memory_order_relaxed);
+            this->low = std::min(low, high);
+            update();
+        }
+        cond.notify_all();
+    }
+
+    Account* Join() {
+        std::unique_lock lock(mutex);
+        num_accounts.fetch_add(1, std::memory_order_relaxed);
+        Account& account = accounts.emplace_back();
+        account.governor = this;
+        return &account;
+    }
+
+    void Leave(Account* account) {
+        auto bytes = static_cast<std::ptrdiff_t>(account->bytes.load());
+        Charge(*account, -bytes);
+        {
+            std::unique_lock lock(mutex);
+            num_accounts.fetch_sub(1, std::memory_order_relaxed);
+            accounts.remove_if(
+                [&](Account const& elem) { return &elem == account; });
+            update();
+        }
+        cond.notify_all();
+    }
+
+    // called by channels under their lock whenever buffered bytes change
+    void Charge(Account& account, std::ptrdiff_t delta) {
+        if (delta == 0) {
+            return;
+        }
+
+        auto diff = static_cast<size_t>(delta);
+        account.bytes.fetch_add(diff, std::memory_order_relaxed);
+        size_t now = total.fetch_add(diff, std::memory_order_relaxed) + diff;
+
+        if (throttling.load(std::memory_order_relaxed)) {
+            if (delta < 0) {
+                {
+                    std::unique_lock lock(mutex);
+                    update();
+                }
+                cond.notify_all();
+            }
+        }
+        else if (now > high.load(std::memory_order_relaxed)) {
+            std::unique_lock lock(mutex);
+            update();
+        }
+    }
+
+    // called by producers before they take the channel lock
+    void Admit(Account& account) {
+        if (!throttling.load(std::memory_order_relaxed)) {
+            return;
+        }
+
+        std::unique_lock lock(mutex);
+        if (!throttled(account)) {
+            return;
+        }
+
+        BlockingScope scope(this, "memory");
+        num_parks.fetch_add(1, std::memory_order_relaxed);
+        cond.wait(lock, [&] { return !throttled(account); });
+    }
+
+    // wake producers of a closed channel
+    void Wake() {
+        {
+            std::unique_lock lock(mutex);
+        }
+        cond.notify_all();
+    }
+
+    size_t Bytes() const {
+        return total.load(std::memory_order_relaxed);
+    }
+
+    bool Throttling() const {
+        return throttling.load(std::memory_order_relaxed);
+    }
+
+    size_t Parks() const {
+        return num_parks.load(std::memory_order_relaxed);
+    }
+
+private:
+    // hysteresis between the water marks, called under the mutex
+    void update() {
+        size_t now = total.load(std::memory_order_relaxed);
+        if (now > high.load(std::memory_order_relaxed)) {
+            throttling.store(true, std::memory_order_relaxed);
+        }
+        else if (now <= low) {
+            throttling.store(false, std::memory_order_relaxed);
+        }
+        BlockingRegistry::Instance().Progress();
+    }
+
+    bool throttled(Account const& account) const {
+        size_t share = low / std::max<size_t>(num_accounts.load(), 1);
+        return throttling.load(std::memory_order_relaxed)
+               && !account.closed.load(std::memory_order_relaxed)
+               && account.bytes.load(std::memory_order_relaxed) >= share;
+    }
+
+    std::atomic<size_t> high;
+    size_t low;
+
+    std::atomic<size_t> total;
+    std::atomic<bool> throttling;
+    std::atomic<size_t> num_accounts;
+    std::atomic<size_t> num_parks;
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::list<Account> accounts;
+};
+
+#endif
@@ -0,0 +1,570 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "channel.hpp"
+#include "histogram.hpp"
+#include "instrumented_mutex.hpp"
+#include "platform/log_file.hpp"
+#include "platform/socket.hpp"
+#include "thread_pool.hpp"
+#include "wait_group.hpp"
+
+// Accumulates samples grouped by family and renders prometheus text
+// exposition format (version 0.0.4).
+class MetricWriter {
+public:
+    using Labels = std::vector<std::pair<std::string, std::string>>;
+
+    void Counter(std::string const& family,
+                 std::string const& help,
+                 Labels const& labels,
+                 double value) {
+        Sample(family, help, "counter", family, labels, value);
+    }
+
+    void Gauge(std::string const& family,
+               std::string const& help,
+               Labels const& labels,
+               double value) {
+        Sample(family, help, "gauge", family, labels, value);
+    }
+
+    // durations are exported in seconds
+    void Histogram(std::string const& family,
+                   std::string const& help,
+                   Labels const& labels,
+                   ::Histogram const& hist) {
+        size_t last = 0;
+        for (size_t i = 0; i < ::Histogram::num_buckets - 1; ++i) {
+            if (hist.Bucket(i) > 0) {
+                last = i;
+            }
+        }
+
+        size_t acc = 0;
+        for (size_t i = 0; i <= last; ++i) {
+            acc += hist.Bucket(i);
+
+            Labels bucket = labels;
+            bucket.emplace_back("le",
+                                Format(Seconds(::Histogram::UpperBound(i))));
+            Sample(family, help, "histogram", family + "_bucket", bucket, acc);
+        }
+
+        Labels inf = labels;
+        inf.emplace_back("le", "+Inf");
+        Sample(family,
+               help,
+               "histogram",
+               family + "_bucket",
+               inf,
+               hist.Count());
+        Sample(family,
+               help,
+               "histogram",
+               family + "_sum",
+               labels,
+               Seconds(hist.Sum()));
+        Sample(family,
+               help,
+               "histogram",
+               family + "_count",
+               labels,
+               hist.Count());
+    }
+
+    void Render(std::ostream& os) const {
+        for (auto const& [name, family] : families) {
+            os << "# HELP " << name << ' ' << family.help << '\n';
+            os << "# TYPE " << name << ' ' << family.type << '\n';
+            for (auto const& line : family.samples) {
+                os << line << '\n';
+            }
+        }
+    }
+
+private:
+    struct Family {
+        std::string help;
+        std::string type;
+        std::vector<std::string> samples;
+    };
+
+    static double Seconds(std::chrono::nanoseconds dur) {
+        return std::chrono::duration<double>(dur).count();
+    }
+
+    static std::string Format(double value) {
+        if (value > -1e15 && value < 1e15
+            && value == static_cast<double>(static_cast<long long>(value))) {
+            return std::to_string(static_cast<long long>(value));
+        }
+
+        std::ostringstream stream;
+        stream.precision(9);
+        stream << value;
+        return stream.str();
+    }
+
+    static std::string Escape(std::string const& value) {
+        std::string escaped;
+        for (char c : value) {
+            if (c == '\\' || c == '"') {
+                escaped += '\\';
+                escaped += c;
+            }
+            else if (c == '\n') {
+                escaped += "\\n";
+            }
+            else {
+                escaped += c;
+            }
+        }
+        return escaped;
+    }
+
+    void Sample(std::string const& family,
+                std::string const& help,
+                char const* type,
+                std::string const& name,
+                Labels const& labels,
+                double value) {
+        Family& target = families[family];
+        target.help = help;
+        target.type = type;
+
+        std::string line = name;
+        if (!labels.empty()) {
+            line += '{';
+            for (size_t i = 0; i < labels.size(); ++i) {
+                if (i > 0) {
+                    line += ',';
+                }
+                line += labels[i].first + "=\"" + Escape(labels[i].second)
+                        + '"';
+            }
+            line += '}';
+        }
+        target.samples.push_back(line + ' ' + Format(value));
+    }
+
+    std::map<std::string, Family> families;
+};
+
+template <typename Container>
+void collect_metric(MetricWriter& writer,
+                    std::string const& name,
+                    Channel<Container> const& channel) {
+    QueueStat stat = channel.Stat();
+    MetricWriter::Labels labels{ { "channel", name } };
+
+    writer.Gauge("concurrency_channel_depth",
+                 "Number of buffered messages.",
+                 labels,
+                 stat.size);
+    writer.Counter("concurrency_channel_sent_total",
+                   "Messages added to the channel.",
+                   labels,
+                   stat.pushed);
+    writer.Counter("concurrency_channel_received_total",
+                   "Messages taken from the channel.",
+                   labels,
+                   stat.popped);
+    writer.Counter("concurrency_channel_parks_total",
+                   "Waits on a full or empty channel.",
+                   { { "channel", name }, { "side", "send" } },
+                   stat.push_parks);
+    writer.Counter("concurrency_channel_parks_total",
+                   "Waits on a full or empty channel.",
+                   { { "channel", name }, { "side", "receive" } },
+                   stat.pop_parks);
+    writer.Counter("concurrency_channel_spurious_wakeups_total",
+                   "Wakeups which found the channel still full or empty.",
+                   labels,
+                   stat.spurious_wakeups);
+    writer.Counter("concurrency_channel_overflow_total",
+                   "Messages lost to the overflow policy of a full channel.",
+                   { { "channel", name }, { "reason", "dropped" } },
+                   stat.dropped);
+    writer.Counter("concurrency_channel_overflow_total",
+                   "Messages lost to the overflow policy of a full channel.",
+                   { { "channel", name }, { "reason", "evicted" } },
+                   stat.evicted);
+    writer.Counter("concurrency_channel_overflow_total",
+                   "Messages lost to the overflow policy of a full channel.",
+                   { { "channel", name }, { "reason", "rejected" } },
+                   stat.rejected);
+}
+
+template <typename T, template <typename> class ChannelType>
+void collect_metric(MetricWriter& writer,
+                    std::string const& name,
+                    ThreadPool<T, ChannelType> const& pool) {
+    PoolSnapshot snapshot = pool.Snapshot();
+    MetricWriter::Labels labels{ { "pool", name } };
+
+    std::map<WorkerState, size_t> states{ { WorkerState::Idle, 0 },
+                                          { WorkerState::Running, 0 },
+                                          { WorkerState::Blocked, 0 } };
+    for (auto const& worker : snapshot.workers) {
+        states[worker.state] += 1;
+    }
+    for (auto const& [state, count] : states) {
+        writer.Gauge("concurrency_pool_workers",
+                     "Workers by state.",
+                     { { "pool", name }, { "state", to_string(state) } },
+                     count);
+    }
+
+    writer.Gauge("concurrency_pool_queue_depth",
+                 "Tasks waiting for a worker.",
+                 labels,
+                 snapshot.queue_depth);
+    writer.Counter("concurrency_pool_tasks_executed_total",
+                   "Tasks run to completion.",
+                   labels,
+                   snapshot.executed);
+    writer.Counter("concurrency_pool_parks_total",
+                   "Waits of idle workers on the empty queue.",
+                   labels,
+                   snapshot.parks);
+    writer.Counter("concurrency_pool_spurious_wakeups_total",
+                   "Wakeups which found the queue still empty.",
+                   labels,
+                   snapshot.spurious_wakeups);
+
+    for (auto const& [label, stat] : pool.Accounting()) {
+        MetricWriter::Labels task{ { "pool", name }, { "task", label } };
+        writer.Histogram("concurrency_pool_task_queue_wait_seconds",
+                         "Time from submission to start.",
+                         task,
+                         stat.queue_wait);
+        writer.Histogram("concurrency_pool_task_wall_seconds",
+                         "Wall clock time of tasks.",
+                         task,
+                         stat.wall_time);
+        writer.Histogram("concurrency_pool_task_cpu_seconds",
+                         "Thread cpu time of tasks.",
+                         task,
+                         stat.cpu_time);
+    }
+}
+
+inline void collect_metric(MetricWriter& writer,
+                           std::string const& name,
+                           WaitGroup const& wg) {
+    MetricWriter::Labels labels{ { "wait_group", name } };
+    writer.Gauge("concurrency_wait_group_count",
+                 "Outstanding visits.",
+                 labels,
+                 wg.Count());
+    writer.Gauge("concurrency_wait_group_waiters",
+                 "Threads blocked in Wait.",
+                 labels,
+                 wg.Waiters());
+}
+
+template <typename Mutex>
+void collect_metric(MetricWriter& writer,
+                    std::string const& name,
+                    InstrumentedMutex<Mutex> const& mutex) {
+    MetricWriter::Labels labels{ { "mutex", name } };
+    writer.Counter("concurrency_mutex_acquisitions_total",
+                   "Successful lock acquisitions.",
+                   labels,
+                   mutex.Acquisitions());
+    writer.Counter("concurrency_mutex_contentions_total",
+                   "Acquisitions which had to wait.",
+                   labels,
+                   mutex.Contentions());
+    writer.Histogram("concurrency_mutex_wait_seconds",
+                     "Time spent waiting for a contended lock.",
+                     labels,
+                     mutex.WaitTime());
+}
+
+class MetricRegistry;
+
+// Registration of a metric source, unregistered on destruction.
+class MetricHandle {
+public:
+    MetricHandle() : registry(nullptr), id(0) {
+        // Do Nothing
+    }
+
+    MetricHandle(MetricRegistry* registry, size_t id)
+        : registry(registry), id(id) {
+        // Do Nothing
+    }
+
+    MetricHandle(MetricHandle&& other)
+        : registry(other.registry), id(other.id) {
+        other.registry = nullptr;
+    }
+
+    MetricHandle& operator=(MetricHandle&& other) {
+        if (this != &other) {
+            Reset();
+            registry = other.registry;
+            id = other.id;
+            other.registry = nullptr;
+        }
+        return *this;
+    }
+
+    MetricHandle(MetricHandle const&) = delete;
+    MetricHandle& operator=(MetricHandle const&) = delete;
+
+    ~MetricHandle() {
+        Reset();
+    }
+
+    inline void Reset();
+
+private:
+    MetricRegistry* registry;
+    size_t id;
+};
+
+// Collects registered channels, pools, wait groups and mutexes.
+// Rendering reads relaxed counters only and never takes channel locks.
+class MetricRegistry {
+public:
+    static MetricRegistry& Global() {
+        static MetricRegistry registry;
+        return registry;
+    }
+
+    MetricRegistry() : last_id(0) {
+        // Do Nothing
+    }
+
+    MetricRegistry(MetricRegistry const&) = delete;
+    MetricRegistry(MetricRegistry&&) = delete;
+
+    MetricRegistry& operator=(MetricRegistry const&) = delete;
+    MetricRegistry& operator=(MetricRegistry&&) = delete;
+
+    // `target` must outlive the returned handle
+    template <typename T>
+    [[nodiscard]] MetricHandle Register(std::string name, T const& target) {
+        return Register([name = std::move(name), &target](MetricWriter& w) {
+            collect_metric(w, name, target);
+        });
+    }
+
+    [[nodiscard]] MetricHandle Register(
+        std::function<void(MetricWriter&)> collector) {
+        std::unique_lock lock(mutex);
+        collectors.emplace(++last_id, std::move(collector));
+        return MetricHandle(this, last_id);
+    }
+
+    void Unregister(size_t id) {
+        std::unique_lock lock(mutex);
+        collectors.erase(id);
+    }
+
+    void Render(std::ostream& os) {
+        MetricWriter writer;
+        {
+            std::unique_lock lock(mutex);
+            for (auto const& [id, collector] : collectors) {
+                collector(writer);
+            }
+        }
+        writer.Render(os);
+    }
+
+    std::string Render() {
+        std::ostringstream stream;
+        Render(stream);
+        return stream.str();
+    }
+
+private:
+    std::mutex mutex;
+    size_t last_id;
+    std::map<size_t, std::function<void(MetricWriter&)>> collectors;
+};
+
+void MetricHandle::Reset() {
+    if (registry != nullptr) {
+        registry->Unregister(id);
+        registry = nullptr;
+    }
+}
+
+// Periodic background task stopped and joined on destruction.
+class MetricTicker {
+public:
+    template <typename Rep, typename Period, typename F>
+    MetricTicker(std::chrono::duration<Rep, Period> period, F&& tick)
+        : runnable(true) {
+        worker = std::thread(
+            [this, period, tick = std::forward<F>(tick)]() mutable {
+                std::unique_lock lock(mutex);
+                while (runnable) {
+                    lock.unlock();
+                    tick();
+                    lock.lock();
+                    cond.wait_for(lock, period, [this] { return !runnable; });
+                }
+            });
+    }
+
+    ~MetricTicker() {
+        {
+            std::unique_lock lock(mutex);
+            runnable = false;
+        }
+        cond.notify_all();
+        worker.join();
+    }
+
+    MetricTicker(MetricTicker const&) = delete;
+    MetricTicker(MetricTicker&&) = delete;
+
+    MetricTicker& operator=(MetricTicker const&) = delete;
+    MetricTicker& operator=(MetricTicker&&) = delete;
+
+private:
+    bool runnable;
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::thread worker;
+};
+
+// Rewrites `path` every period, through a temporary file and rename
+// so scrapers never read a partial exposition.
+class MetricFileExporter {
+public:
+    template <typename Rep, typename Period>
+    MetricFileExporter(MetricRegistry& registry,
+                       std::string path,
+                       std::chrono::duration<Rep, Period> period)
+        : registry(registry), path(std::move(path)),
+          ticker(period, [this] { Export(); }) {
+        // Do Nothing
+    }
+
+    bool Export() {
+        std::string tmp = path + ".tmp";
+        {
+            std::ofstream file(tmp, std::ios::trunc);
+            registry.Render(file);
+            if (!file) {
+                return false;
+            }
+        }
+        return platform::rename_file(tmp, path);
+    }
+
+private:
+    MetricRegistry& registry;
+    std::string path;
+    MetricTicker ticker;
+};
+
+// Serves `GET /metrics` on 127.0.0.1, port 0 picks an ephemeral port.
+// Unavailable where platform::has_socket is false.
+class MetricHttpExporter {
+public:
+    MetricHttpExporter(MetricRegistry& registry, uint16_t port = 0)
+        : registry(registry), runnable(true),
+          listener(platform::listen_local(port)) {
+        if (listener != platform::invalid_socket) {
+            worker = std::thread([this] { Serve(); });
+        }
+    }
+
+    ~MetricHttpExporter() {
+        runnable = false;
+        if (worker.joinable()) {
+            worker.join();
+        }
+        platform::close_socket(listener);
+    }
+
+    MetricHttpExporter(MetricHttpExporter const&) = delete;
+    MetricHttpExporter(MetricHttpExporter&&) = delete;
+
+    MetricHttpExporter& operator=(MetricHttpExporter const&) = delete;
+    MetricHttpExporter& operator=(MetricHttpExporter&&) = delete;
+
+    bool Listening() const {
+        return listener != platform::invalid_socket;
+    }
+
+    uint16_t Port() const {
+        return Listening() ? platform::local_port(listener) : 0;
+    }
+
+private:
+    void Serve() {
+        using namespace std::literals;
+        while (runnable) {
+            if (!platform::wait_readable(listener, 100ms)) {
+                continue;
+            }
+
+            platform::socket_t client = platform::accept_socket(listener);
+            if (client != platform::invalid_socket) {
+                Respond(client);
+                platform::close_socket(client);
+            }
+        }
+    }
+
+    void Respond(platform::socket_t client) {
+        using namespace std::literals;
+
+        std::string request;
+        char buf[1024];
+        while (request.find("\r\n\r\n") == std::string::npos
+               && request.size() < 8192
+               && platform::wait_readable(client, 1s)) {
+            long len = platform::recv_some(client, buf, sizeof(buf));
+            if (len <= 0) {
+                break;
+            }
+            request.append(buf, static_cast<size_t>(len));
+        }
+
+        std::string status = "200 OK";
+        std::string body;
+        if (request.rfind("GET /metrics ", 0) == 0
+            || request.rfind("GET / ", 0) == 0) {
+            body = registry.Render();
+        }
+        else {
+            status = "404 Not Found";
+        }
+
+        std::string response =
+            "HTTP/1.1 " + status
+            + "\r\nContent-Type: text/plain; version=0.0.4"
+            + "\r\nContent-Length: " + std::to_string(body.size())
+            + "\r\nConnection: close\r\n\r\n" + body;
+        platform::send_all(client, response.data(), response.size());
+    }
+
+    MetricRegistry& registry;
+    std::atomic<bool> runnable;
+    platform::socket_t listener;
+    std::thread worker;
+};
+
+#endif
@@ -0,0 +1,518 @@
+#ifndef NET_CHANNEL_HPP
+#define NET_CHANNEL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "blocking.hpp"
+#include "channel_iter.hpp"
+#include "codec.hpp"
+#include "container/thread_safe.hpp"
+#include "platform/socket.hpp"
+#include "platform/thread.hpp"
+
+// Source of connected sockets for a NetChannel, called again after every
+// failure. Returns platform::invalid_socket if no peer is reachable yet.
+using NetConnector = std::function<platform::socket_t()>;
+
+// dial `host:port` over tcp
+inline NetConnector net_dial(std::string host, uint16_t port) {
+    return [host = std::move(host), port] {
+        return platform::connect_tcp(host, port);
+    };
+}
+
+// dial a unix domain socket
+inline NetConnector net_dial_unix(std::string path) {
+    return [path = std::move(path)] { return platform::connect_unix(path); };
+}
+
+// accept the next peer on a listening socket owned by the caller
+inline NetConnector net_accept(platform::socket_t listener) {
+    return [listener] {
+        using namespace std::chrono_literals;
+        if (!platform::wait_readable(listener, 100ms)) {
+            return platform::invalid_socket;
+        }
+        return platform::accept_socket(listener);
+    };
+}
+
+// Channel between two hosts, each end Adds messages for its peer and
+// Gets messages from it. Messages are framed with a codec and sent by a
+// writer thread in batches of up to `max_batch` frames per writev.
+//
+// Flow control uses credits, a sender keeps at most `window` messages
+// which the remote consumer has not received with Get, further Adds
+// block. Acknowledgments carry the consumed sequence number, so after a
+// reconnect the unacknowledged messages are sent again and the peer
+// drops the ones it already has. Close sends an end of stream, the peer
+// receives every message before its range-for ends.
+template <typename T, typename Codec = TrivialCodec<T>>
+class NetChannel {
+public:
+    using value_type = T;
+    using iterator = ChannelIterator<T, NetChannel>;
+
+    NetChannel(NetConnector connector,
+               size_t window = 1024,
+               size_t max_batch = 64,
+               Codec codec = Codec())
+        : connector(std::move(connector)),
+          window(std::max<size_t>(window, 1)),
+          max_batch(std::clamp<size_t>(max_batch, 1, 62)),
+          codec(std::move(codec)), fd(platform::invalid_socket),
+          generation(0), broken(false), reading(false), stopping(false),
+          closed(false), fin_sent(false), next_seq(1), sent_seq(0),
+          peer_acked(0), received(0), consumed(0), ack_sent(0),
+          ack_due(false), num_connects(0), num_resent(0), num_batches(0),
+          num_credit_parks(0) {
+        writer = std::thread([this] { write_loop(); });
+        reader = std::thread([this] { read_loop(); });
+    }
+
+    // frames not written yet are flushed if connected, a peer which
+    // stopped reading blocks the destructor
+    ~NetChannel() {
+        Close();
+        {
+            std::unique_lock lock(mutex);
+            stopping = true;
+        }
+        cond.notify_all();
+
+        writer.join();
+        reader.join();
+        platform::close_socket(fd);
+    }
+
+    NetChannel(NetChannel const&) = delete;
+    NetChannel(NetChannel&&) = delete;
+
+    NetChannel& operator=(NetChannel const&) = delete;
+    NetChannel& operator=(NetChannel&&) = delete;
+
+    // Blocks while the peer holds `window` unconsumed messages, false
+    // once closed.
+    bool Add(T const& value) {
+        size_t length = codec.size(value);
+        std::vector<unsigned char> frame(header_size + length);
+        codec.encode(value, frame.data() + header_size);
+
+        std::unique_lock lock(mutex);
+        if (!closed && !has_credit()) {
+            BlockingScope scope(this, "send");
+            num_credit_parks.fetch_add(1, std::memory_order_relaxed);
+            cond.wait(lock, [&] { return closed || has_credit(); });
+        }
+
+        if (closed) {
+            return false;
+        }
+
+        uint64_t seq = next_seq++;
+        seal(frame.data(), Data, length, seq);
+        outbound.push_back(Frame{ seq, std::move(frame) });
+        cond.notify_all();
+        return true;
+    }
+
+    std::optional<T> Get() {
+        std::optional<T> value = inbound.pop_front();
+        if (value.has_value()) {
+            consume();
+        }
+        return value;
+    }
+
+    std::optional<T> TryGet() {
+        std::optional<T> value = inbound.try_pop();
+        if (value.has_value()) {
+            consume();
+        }
+        return value;
+    }
+
+    NetChannel& operator<<(T const& value) {
+        Add(value);
+        return *this;
+    }
+
+    NetChannel& operator>>(std::optional<T>& get) {
+        get = Get();
+        return *this;
+    }
+
+    NetChannel& operator>>(T& get) {
+        std::optional<T> res = Get();
+        if (res.has_value()) {
+            get = std::move(res.value());
+        }
+        return *this;
+    }
+
+    // no more Adds, the peer's Get ends after the pending messages
+    void Close() {
+        {
+            std::unique_lock lock(mutex);
+            closed = true;
+        }
+        cond.notify_all();
+        BlockingRegistry::Instance().Progress();
+    }
+
+    bool Runnable() {
+        std::unique_lock lock(mutex);
+        return !closed;
+    }
+
+    bool Readable() {
+        return inbound.readable();
+    }
+
+    bool Connected() {
+        std::unique_lock lock(mutex);
+        return fd != platform::invalid_socket && !broken;
+    }
+
+    // connections established, the first one included
+    size_t Connects() const {
+        return num_connects.load(std::memory_order_relaxed);
+    }
+
+    // messages written again after a reconnect
+    size_t Resent() const {
+        return num_resent.load(std::memory_order_relaxed);
+    }
+
+    // writev calls, frames per batch grow with the send rate
+    size_t Batches() const {
+        return num_batches.load(std::memory_order_relaxed);
+    }
+
+    // stat of received messages, push parks count Adds out of credit
+    QueueStat Stat() const {
+        QueueStat stat = inbound.stat();
+        stat.push_parks = num_credit_parks.load(std::memory_order_relaxed);
+        return stat;
+    }
+
+    iterator begin() {
+        return iterator(*this, Get());
+    }
+
+    iterator end() {
+        return iterator(*this, std::nullopt);
+    }
+
+private:
+    enum Kind : uint32_t { Data = 1, Ack = 2, Fin = 3 };
+
+    struct Frame {
+        uint64_t seq;
+        std::vector<unsigned char> bytes;
+    };
+
+    // kind, payload length and sequence number, acks and fins carry the
+    // consumed and the last sequence number
+    static constexpr size_t header_size =
+        2 * sizeof(uint32_t) + sizeof(uint64_t);
+
+    static constexpr size_t chunk_size = 64 << 10;
+
+    static void seal(unsigned char* dst,
+                     uint32_t kind,
+                     size_t length,
+                     uint64_t seq) {
+        auto size = static_cast<uint32_t>(length);
+        std::memcpy(dst, &kind, sizeof(kind));
+        std::memcpy(dst + sizeof(kind), &size, sizeof(size));
+        std::memcpy(dst + 2 * sizeof(uint32_t), &seq, sizeof(seq));
+    }
+
+    // called under the lock
+    bool has_credit() const {
+        return next_seq - 1 - peer_acked < window;
+    }
+
+    bool has_work() const {
+        bool connected = fd != platform::invalid_socket && !broken;
+        return ack_due
+               || (connected
+                   && (sent_seq + 1 < next_seq || (closed && !fin_sent)));
+    }
+
+    void break_connection() {
+        broken = true;
+        platform::shutdown_socket(fd);
+    }
+
+    // ack once a quarter of the window is consumed or nothing is left
+    void consume() {
+        {
+            std::unique_lock lock(mutex);
+            consumed += 1;
+            if (consumed - ack_sent < std::max<size_t>(window / 4, 1)
+                && inbound.stat().size > 0) {
+                return;
+            }
+            ack_due = true;
+        }
+        cond.notify_all();
+    }
+
+    void write_loop() {
+        platform::set_thread_name("net-writer");
+        auto backoff = std::chrono::milliseconds(10);
+
+        std::unique_lock lock(mutex);
+        while (true) {
+            if (fd == platform::invalid_socket) {
+                if (stopping) {
+                    break;
+                }
+
+                lock.unlock();
+                platform::socket_t sock = connector();
+                lock.lock();
+
+                if (sock == platform::invalid_socket) {
+                    cond.wait_for(lock, backoff);
+                    backoff = std::min(backoff * 2,
+                                       std::chrono::milliseconds(1000));
+                    continue;
+                }
+                connected(sock);
+                backoff = std::chrono::milliseconds(10);
+                continue;
+            }
+
+            if (broken) {
+                cond.wait(lock, [&] { return !reading; });
+                platform::close_socket(fd);
+                fd = platform::invalid_socket;
+                continue;
+            }
+
+            if (!has_work()) {
+                if (stopping) {
+                    break;
+                }
+                cond.wait(lock);
+                continue;
+            }
+
+            if (!flush(lock)) {
+                break_connection();
+            }
+            cond.notify_all();
+        }
+    }
+
+    // start over on a new connection, resend what the peer has not
+    // consumed and announce our own progress
+    void connected(platform::socket_t sock) {
+        fd = sock;
+        broken = false;
+        generation += 1;
+        num_connects.fetch_add(1, std::memory_order_relaxed);
+
+        if (sent_seq > peer_acked) {
+            num_resent.fetch_add(sent_seq - peer_acked,
+                                 std::memory_order_relaxed);
+        }
+        sent_seq = peer_acked;
+        fin_sent = false;
+        ack_due = true;
+        cond.notify_all();
+    }
+
+    // write one batch out of the lock, false if the connection failed
+    bool flush(std::unique_lock<std::mutex>& lock) {
+        while (!outbound.empty() && outbound.front().seq <= peer_acked) {
+            outbound.pop_front();
+        }
+
+        std::vector<platform::IoSlice> slices;
+        unsigned char control[2][header_size];
+
+        if (ack_due) {
+            seal(control[0], Ack, 0, consumed);
+            slices.push_back(platform::IoSlice{ control[0], header_size });
+            ack_sent = consumed;
+            ack_due = false;
+        }
+
+        uint64_t last = sent_seq;
+        for (auto& frame : outbound) {
+            if (slices.size() >= max_batch) {
+                break;
+            }
+            if (frame.seq > last) {
+                auto& bytes = frame.bytes;
+                slices.push_back(
+                    platform::IoSlice{ bytes.data(), bytes.size() });
+                last = frame.seq;
+            }
+        }
+
+        bool fin = closed && !fin_sent && last + 1 == next_seq;
+        if (fin) {
+            seal(control[1], Fin, 0, last);
+            slices.push_back(platform::IoSlice{ control[1], header_size });
+        }
+
+        platform::socket_t sock = fd;
+        lock.unlock();
+        bool ok = platform::send_all_vectored(sock, std::move(slices));
+        lock.lock();
+
+        if (!ok || broken) {
+            return false;
+        }
+        sent_seq = std::max(sent_seq, last);
+        fin_sent = fin_sent || fin;
+        num_batches.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    void read_loop() {
+        platform::set_thread_name("net-reader");
+        std::vector<unsigned char> buffer;
+        std::vector<unsigned char> chunk(chunk_size);
+        size_t current = 0;
+
+        std::unique_lock lock(mutex);
+        while (true) {
+            cond.wait(lock, [&] {
+                return stopping
+                       || (fd != platform::invalid_socket && !broken);
+            });
+            if (stopping) {
+                break;
+            }
+
+            // partial frames of a previous connection are discarded
+            if (current != generation) {
+                buffer.clear();
+                current = generation;
+            }
+
+            platform::socket_t sock = fd;
+            reading = true;
+            lock.unlock();
+
+            using namespace std::chrono_literals;
+            long num = 0;
+            bool ok = true;
+            if (platform::wait_readable(sock, 100ms)) {
+                num = platform::recv_some(sock, chunk.data(), chunk.size());
+                ok = num > 0;
+            }
+
+            lock.lock();
+            reading = false;
+            if (ok && num > 0) {
+                buffer.insert(buffer.end(), chunk.data(), chunk.data() + num);
+                ok = parse(buffer);
+            }
+            if (!ok && current == generation && !broken) {
+                break_connection();
+            }
+            cond.notify_all();
+        }
+    }
+
+    // consume complete frames from `buffer`, under the lock
+    bool parse(std::vector<unsigned char>& buffer) {
+        size_t pos = 0;
+        while (buffer.size() - pos >= header_size) {
+            uint32_t kind = 0;
+            uint32_t length = 0;
+            uint64_t seq = 0;
+            unsigned char const* src = buffer.data() + pos;
+            std::memcpy(&kind, src, sizeof(kind));
+            std::memcpy(&length, src + sizeof(kind), sizeof(length));
+            std::memcpy(&seq, src + 2 * sizeof(uint32_t), sizeof(seq));
+
+            if (buffer.size() - pos - header_size < length) {
+                break;
+            }
+
+            if (kind == Data) {
+                if (seq == received + 1) {
+                    inbound.push_back(codec.decode(src + header_size, length));
+                    received = seq;
+                }
+                else if (seq > received) {
+                    return false;
+                }
+            }
+            else if (kind == Ack) {
+                peer_acked = std::max(peer_acked, seq);
+            }
+            else if (kind == Fin) {
+                if (seq == received) {
+                    inbound.close();
+                }
+            }
+            else {
+                return false;
+            }
+            pos += header_size + length;
+        }
+
+        buffer.erase(buffer.begin(), buffer.begin() + pos);
+        return true;
+    }
+
+    NetConnector connector;
+    size_t window;
+    size_t max_batch;
+    Codec codec;
+
+    TSList<T> inbound;
+
+    std::mutex mutex;
+    std::condition_variable cond;
+
+    platform::socket_t fd;
+    size_t generation;
+    bool broken;
+    bool reading;
+    bool stopping;
+
+    bool closed;
+    bool fin_sent;
+    uint64_t next_seq;
+    uint64_t sent_seq;
+    uint64_t peer_acked;
+    std::deque<Frame> outbound;
+
+    uint64_t received;
+    uint64_t consumed;
+    uint64_t ack_sent;
+    bool ack_due;
+
+    std::atomic<size_t> num_connects;
+    std::atomic<size_t> num_resent;
+    std::atomic<size_t> num_batches;
+    std::atomic<size_t> num_credit_parks;
+
+    std::thread writer;
+    std::thread reader;
+};
+
+#endif
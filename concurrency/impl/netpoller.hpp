@@ -0,0 +1,392 @@
+#ifndef NETPOLLER_HPP
+#define NETPOLLER_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "blocking.hpp"
+#include "platform/event_fd.hpp"
+#include "platform/futex.hpp"
+#include "platform/poller.hpp"
+#include "platform/thread.hpp"
+
+// Readiness of one descriptor, `ready` holds platform::poll_read and
+// poll_write bits set by the poller thread and taken by waiters.
+struct FdWatch {
+    int fd = -1;
+    uint64_t key = 0;
+    std::atomic<uint32_t> ready{ 0 };
+    std::atomic<uint32_t> waiters{ 0 };
+
+    // events the descriptor is armed for and words of selects parked
+    // on it, under the netpoller lock
+    uint32_t armed = 0;
+    std::vector<std::atomic<uint32_t>*> selectors;
+};
+
+// Poller thread delivering descriptor readiness to waiters, like the
+// netpoller of the go runtime. Descriptors are armed one shot when a
+// waiter finds them not ready, so an idle descriptor costs nothing and
+// a ready one is reported once per wait. Readiness is published as
+// bits of the watch, waiters check them without a syscall and park on
+// them with a futex.
+//
+// Forget a descriptor before closing it, its number may be reused.
+class Netpoller {
+public:
+    Netpoller() : running(true), next_key(1), num_events(0) {
+        poller.open();
+        if (wakeup.open()) {
+            poller.arm(wakeup.fd(), platform::poll_read, 0);
+        }
+        worker = std::thread([this] { loop(); });
+    }
+
+    ~Netpoller() {
+        running.store(false);
+        wakeup.signal();
+        worker.join();
+    }
+
+    Netpoller(Netpoller const&) = delete;
+    Netpoller(Netpoller&&) = delete;
+
+    Netpoller& operator=(Netpoller const&) = delete;
+    Netpoller& operator=(Netpoller&&) = delete;
+
+    static Netpoller& Global() {
+        // never destroyed, static watchers may leave after exit
+        static Netpoller* netpoller = new Netpoller();
+        return *netpoller;
+    }
+
+    // watch of `fd`, shared by every waiter of the descriptor
+    std::shared_ptr<FdWatch> Watch(int fd) {
+        std::unique_lock lock(mutex);
+        auto iter = by_fd.find(fd);
+        if (iter != by_fd.end()) {
+            return iter->second;
+        }
+
+        auto watch = std::make_shared<FdWatch>();
+        watch->fd = fd;
+        watch->key = next_key++;
+        by_fd.emplace(fd, watch);
+        by_key.emplace(watch->key, watch);
+        return watch;
+    }
+
+    void Forget(int fd) {
+        std::unique_lock lock(mutex);
+        auto iter = by_fd.find(fd);
+        if (iter == by_fd.end()) {
+            return;
+        }
+
+        poller.remove(fd);
+        by_key.erase(iter->second->key);
+        by_fd.erase(iter);
+    }
+
+    // Take ready `events`, or arm the descriptor for them and return
+    // false. Never blocks.
+    bool TryTake(FdWatch& watch, uint32_t events) {
+        if (watch.ready.fetch_and(~events, std::memory_order_acquire)
+            & events) {
+            return true;
+        }
+
+        arm(watch, events);
+        return false;
+    }
+
+    // Whether one of `events` is ready, without taking it, the
+    // descriptor is armed for them when not.
+    bool Ready(FdWatch& watch, uint32_t events) {
+        if (watch.ready.load(std::memory_order_acquire) & events) {
+            return true;
+        }
+
+        arm(watch, events);
+        return false;
+    }
+
+    // Block until one of `events` is ready, false on timeout.
+    bool Wait(FdWatch& watch,
+              uint32_t events,
+              std::chrono::milliseconds timeout = std::chrono::hours(24)) {
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        if (TryTake(watch, events)) {
+            return true;
+        }
+
+        BlockingScope scope(&watch, "fd", true);
+        while (true) {
+            watch.waiters.fetch_add(1);
+            uint32_t now = watch.ready.load();
+            auto left = std::chrono::duration_cast<std::chrono::microseconds>(
+                deadline - std::chrono::steady_clock::now());
+            if (!(now & events) && left.count() > 0) {
+                platform::futex_wait(watch.ready, now, false, left);
+            }
+            watch.waiters.fetch_sub(1);
+
+            if (TryTake(watch, events)) {
+                return true;
+            }
+            if (std::chrono::steady_clock::now() >= deadline) {
+                return false;
+            }
+        }
+    }
+
+    // Set `word` to one and wake it once one of `events` is ready, the
+    // descriptor is armed for them. False without attaching if one is
+    // ready already.
+    bool Attach(FdWatch& watch,
+                uint32_t events,
+                std::atomic<uint32_t>* word) {
+        if (Ready(watch, events)) {
+            return false;
+        }
+
+        std::unique_lock lock(mutex);
+        if (watch.ready.load() & events) {
+            return false;
+        }
+        watch.selectors.push_back(word);
+        return true;
+    }
+
+    void Detach(FdWatch& watch, std::atomic<uint32_t>* word) {
+        std::unique_lock lock(mutex);
+        auto& selectors = watch.selectors;
+        selectors.erase(std::remove(selectors.begin(), selectors.end(), word),
+                        selectors.end());
+    }
+
+    // descriptors currently watched
+    size_t Watched() {
+        std::unique_lock lock(mutex);
+        return by_fd.size();
+    }
+
+    // readiness events delivered so far
+    size_t Events() const {
+        return num_events.load(std::memory_order_relaxed);
+    }
+
+private:
+    void arm(FdWatch& watch, uint32_t events) {
+        std::unique_lock lock(mutex);
+        if ((watch.armed & events) == events) {
+            return;
+        }
+
+        watch.armed |= events;
+        poller.arm(watch.fd, watch.armed, watch.key);
+    }
+
+    void loop() {
+        platform::set_thread_name("netpoller");
+        platform::PollEvent events[256];
+
+        while (running.load(std::memory_order_relaxed)) {
+            size_t num =
+                poller.wait(events, 256, std::chrono::milliseconds(100));
+
+            std::unique_lock lock(mutex);
+            for (size_t i = 0; i < num; ++i) {
+                if (events[i].key == 0) {
+                    wakeup.drain();
+                    poller.arm(wakeup.fd(), platform::poll_read, 0);
+                    continue;
+                }
+
+                auto iter = by_key.find(events[i].key);
+                if (iter == by_key.end()) {
+                    continue;
+                }
+
+                // one shot, every event is disarmed
+                FdWatch& watch = *iter->second;
+                watch.armed = 0;
+                watch.ready.fetch_or(events[i].events);
+                if (watch.waiters.load() > 0) {
+                    platform::futex_wake(watch.ready);
+                }
+                for (auto* word : watch.selectors) {
+                    word->store(1, std::memory_order_release);
+                    platform::futex_wake(*word);
+                }
+            }
+            num_events.fetch_add(num, std::memory_order_relaxed);
+            if (num > 0) {
+                BlockingRegistry::Instance().Progress(false);
+            }
+        }
+    }
+
+    std::atomic<bool> running;
+
+    std::mutex mutex;
+    platform::Poller poller;
+    platform::EventFd wakeup;
+    uint64_t next_key;
+    std::unordered_map<int, std::shared_ptr<FdWatch>> by_fd;
+    std::unordered_map<uint64_t, std::shared_ptr<FdWatch>> by_key;
+
+    std::atomic<size_t> num_events;
+    std::thread worker;
+};
+
+// Channel like view of a descriptor for select, TryGet yields the
+// descriptor once it is ready for `events`.
+class FdSelectable {
+public:
+    FdSelectable(int fd,
+                 uint32_t events,
+                 Netpoller& netpoller = Netpoller::Global())
+        : netpoller(netpoller), watch(netpoller.Watch(fd)), events(events) {
+        // Do Nothing
+    }
+
+    // ready for `events`, arms the descriptor when not
+    bool Readable() {
+        return netpoller.Ready(*watch, events);
+    }
+
+    std::optional<int> TryGet() {
+        if (netpoller.TryTake(*watch, events)) {
+            return watch->fd;
+        }
+        return std::nullopt;
+    }
+
+private:
+    friend class SelectWait;
+
+    Netpoller& netpoller;
+    std::shared_ptr<FdWatch> watch;
+    uint32_t events;
+};
+
+// Blocking path of select, parks on a word of its own until one of
+// the cases may fire. Descriptor cases point their watch at the word,
+// channel cases are woken by the channel, so a wait costs no syscall
+// beyond the futex and wakes only for its own cases. Channels without
+// select support are checked again every millisecond.
+class SelectWait {
+public:
+    SelectWait() : word(0), ready(false), polling(false), external(false) {
+        // Do Nothing
+    }
+
+    SelectWait(SelectWait const&) = delete;
+    SelectWait(SelectWait&&) = delete;
+
+    SelectWait& operator=(SelectWait const&) = delete;
+    SelectWait& operator=(SelectWait&&) = delete;
+
+    template <typename C>
+    void Add(C& channel) {
+        if (ready) {
+            return;
+        }
+
+        if constexpr (std::is_same_v<C, FdSelectable>) {
+            external = true;
+            ready = !channel.netpoller.Attach(
+                *channel.watch, channel.events, &word);
+        }
+        else if constexpr (has_attach<C>::value) {
+            // closed and drained, never fires again
+            if (channel.Readable()) {
+                ready = !channel.Attach(&word);
+            }
+        }
+        else if (channel.Readable()) {
+            polling = true;
+        }
+    }
+
+    // every added case, after Park
+    template <typename C>
+    void Remove(C& channel) {
+        if constexpr (std::is_same_v<C, FdSelectable>) {
+            channel.netpoller.Detach(*channel.watch, &word);
+        }
+        else if constexpr (has_attach<C>::value) {
+            channel.Detach(&word);
+        }
+    }
+
+    void Park() {
+        if (ready) {
+            return;
+        }
+
+        BlockingScope scope(this, "select", external);
+        auto timeout = std::chrono::microseconds(polling ? 1000 : 0);
+        while (word.load(std::memory_order_acquire) == 0) {
+            platform::futex_wait(word, 0, false, timeout);
+            if (polling) {
+                break;
+            }
+        }
+    }
+
+private:
+    template <typename C, typename = void>
+    struct has_attach : std::false_type {};
+
+    template <typename C>
+    struct has_attach<C,
+                      std::void_t<decltype(std::declval<C&>().Attach(
+                          std::declval<std::atomic<uint32_t>*>()))>>
+        : std::true_type {};
+
+    std::atomic<uint32_t> word;
+    bool ready;
+    bool polling;
+    bool external;
+};
+
+// select case owning its descriptor view, as case_m refers to channels
+template <typename F>
+struct FdCase {
+    FdSelectable channel;
+    F action;
+};
+
+struct fd_case_m {
+    FdSelectable channel;
+
+    template <typename F>
+    FdCase<std::decay_t<F>> operator>>(F&& action) {
+        return FdCase<std::decay_t<F>>{ std::move(channel),
+                                        std::forward<F>(action) };
+    }
+};
+
+// eg. select(fd_readable_m(sock) >> [](int fd) { ... }, case_m(ch) >> ...)
+inline fd_case_m fd_readable_m(int fd) {
+    return fd_case_m{ FdSelectable(fd, platform::poll_read) };
+}
+
+inline fd_case_m fd_writable_m(int fd) {
+    return fd_case_m{ FdSelectable(fd, platform::poll_write) };
+}
+
+#endif
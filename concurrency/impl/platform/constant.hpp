@@ -3,6 +3,8 @@
 
 // merge:include
 #include <chrono>
+#include <cstddef>
+#include <new>
 // merge:end
 
 namespace platform {
@@ -13,6 +15,20 @@ namespace platform {
     // constexpr auto prevent_deadlock = 150us;  // for personal mac
     constexpr auto prevent_deadlock = 500us;  // for azure-pipeline mac
 #endif
+
+    // gcc warns the standard constant is not abi stable across -mtune
+#if defined(__cpp_lib_hardware_interference_size) && !defined(__GNUC__)
+    constexpr size_t cache_line = std::hardware_destructive_interference_size;
+#elif defined(__APPLE__) && defined(__aarch64__)
+    constexpr size_t cache_line = 128;
+#else
+    constexpr size_t cache_line = 64;
+#endif
+
+    // alignment of a member starting its own cache line, or its natural
+    // alignment for the unpadded layout
+    template <typename T, bool Padded>
+    constexpr size_t line_align = Padded ? cache_line : alignof(T);
 }  // namespace platform
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,129 @@
+#ifndef PLATFORM_EVENT_FD_HPP
+#define PLATFORM_EVENT_FD_HPP
+
+// merge:np_include
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#endif
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+// merge:end
+
+// merge:include
+#include <cstdint>
+// merge:end
+
+namespace platform {
+    // Pollable descriptor which stays readable once signalled until it
+    // is drained. Nonblocking eventfd on linux, a self pipe on other
+    // posix systems, unsupported on windows where open fails.
+    class EventFd {
+    public:
+        EventFd() : read_end(-1), write_end(-1) {
+            // Do Nothing
+        }
+
+        ~EventFd() {
+            close();
+        }
+
+        EventFd(EventFd const&) = delete;
+        EventFd(EventFd&&) = delete;
+
+        EventFd& operator=(EventFd const&) = delete;
+        EventFd& operator=(EventFd&&) = delete;
+
+#if defined(__linux__)
+        bool open() {
+            close();
+            read_end = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            write_end = read_end;
+            return read_end >= 0;
+        }
+
+        void signal() {
+            uint64_t one = 1;
+            ssize_t res = ::write(write_end, &one, sizeof(one));
+            (void)res;
+        }
+
+        void drain() {
+            uint64_t count = 0;
+            ssize_t res = ::read(read_end, &count, sizeof(count));
+            (void)res;
+        }
+#elif !defined(_WIN32)
+        bool open() {
+            close();
+            int fds[2];
+            if (::pipe(fds) != 0) {
+                return false;
+            }
+
+            for (int fd : fds) {
+                ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+                ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+            }
+            read_end = fds[0];
+            write_end = fds[1];
+            return true;
+        }
+
+        // a full pipe is readable already
+        void signal() {
+            char one = 1;
+            ssize_t res = ::write(write_end, &one, 1);
+            (void)res;
+        }
+
+        void drain() {
+            char buf[64];
+            while (::read(read_end, buf, sizeof(buf)) > 0) {
+                // Do Nothing
+            }
+        }
+#else
+        bool open() {
+            return false;
+        }
+
+        void signal() {
+            // Do Nothing
+        }
+
+        void drain() {
+            // Do Nothing
+        }
+#endif
+
+        void close() {
+#ifndef _WIN32
+            if (write_end >= 0 && write_end != read_end) {
+                ::close(write_end);
+            }
+            if (read_end >= 0) {
+                ::close(read_end);
+            }
+#endif
+            read_end = -1;
+            write_end = -1;
+        }
+
+        bool is_open() const {
+            return read_end >= 0;
+        }
+
+        // descriptor to poll for readability
+        int fd() const {
+            return read_end;
+        }
+
+    private:
+        int read_end;
+        int write_end;
+    };
+}  // namespace platform
+
+#endif
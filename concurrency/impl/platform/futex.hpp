@@ -0,0 +1,69 @@
+#ifndef PLATFORM_FUTEX_HPP
+#define PLATFORM_FUTEX_HPP
+
+// merge:np_include
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+// merge:end
+
+// merge:include
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <thread>
+// merge:end
+
+namespace platform {
+    // Park while `word` holds `expected`, at most `timeout` unless it is
+    // zero. Returns spuriously, callers recheck their condition. Words
+    // in memory shared between processes need `shared`. Without futex,
+    // waiters sleep briefly and wake calls do nothing.
+    inline void futex_wait(std::atomic<uint32_t>& word,
+                           uint32_t expected,
+                           bool shared = false,
+                           std::chrono::microseconds timeout
+                           = std::chrono::microseconds(0)) {
+#if defined(__linux__)
+        timespec ts;
+        timespec* pts = nullptr;
+        if (timeout.count() > 0) {
+            ts.tv_sec = static_cast<time_t>(timeout.count() / 1'000'000);
+            ts.tv_nsec = static_cast<long>(timeout.count() % 1'000'000) * 1000;
+            pts = &ts;
+        }
+
+        int op = shared ? FUTEX_WAIT : FUTEX_WAIT_PRIVATE;
+        ::syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), op,
+                  expected, pts, nullptr, 0);
+#else
+        (void)shared;
+        if (word.load(std::memory_order_acquire) == expected) {
+            auto nap = std::chrono::microseconds(50);
+            std::this_thread::sleep_for(
+                timeout.count() > 0 && timeout < nap ? timeout : nap);
+        }
+#endif
+    }
+
+    // wake up to `count` waiters of `word`
+    inline void futex_wake(std::atomic<uint32_t>& word,
+                           bool shared = false,
+                           int count = INT_MAX) {
+#if defined(__linux__)
+        int op = shared ? FUTEX_WAKE : FUTEX_WAKE_PRIVATE;
+        ::syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), op, count,
+                  nullptr, nullptr, 0);
+#else
+        (void)word;
+        (void)shared;
+        (void)count;
+#endif
+    }
+}  // namespace platform
+
+#endif
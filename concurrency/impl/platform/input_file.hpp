@@ -0,0 +1,159 @@
+#ifndef PLATFORM_INPUT_FILE_HPP
+#define PLATFORM_INPUT_FILE_HPP
+
+// merge:np_include
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+// merge:end
+
+// merge:include
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+// merge:end
+
+namespace platform {
+    // File read front to back, either with positional reads or through
+    // a read only mapping, with hints for the kernel readahead. Every
+    // call fails on windows.
+    class InputFile {
+    public:
+        InputFile() : fd(-1), length(0), ptr(nullptr) {
+            // Do Nothing
+        }
+
+        ~InputFile() {
+            close();
+        }
+
+        InputFile(InputFile const&) = delete;
+        InputFile(InputFile&&) = delete;
+
+        InputFile& operator=(InputFile const&) = delete;
+        InputFile& operator=(InputFile&&) = delete;
+
+#ifndef _WIN32
+        bool open(std::string const& path) {
+            close();
+            fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+            struct stat st;
+            if (fd < 0 || ::fstat(fd, &st) != 0) {
+                close();
+                return false;
+            }
+            length = static_cast<uint64_t>(st.st_size);
+            return true;
+        }
+
+        void close() {
+            if (ptr != nullptr) {
+                ::munmap(ptr, length);
+            }
+            if (fd >= 0) {
+                ::close(fd);
+            }
+            fd = -1;
+            ptr = nullptr;
+            length = 0;
+        }
+
+        // the whole file will be read once, front to back
+        void sequential() {
+#if defined(POSIX_FADV_SEQUENTIAL)
+            ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+        }
+
+        // start reading `len` bytes at `offset` into the page cache
+        void prefetch(uint64_t offset, size_t len) {
+#if defined(__linux__)
+            ::readahead(fd, static_cast<off64_t>(offset), len);
+#elif defined(POSIX_FADV_WILLNEED)
+            ::posix_fadvise(fd, static_cast<off_t>(offset),
+                            static_cast<off_t>(len), POSIX_FADV_WILLNEED);
+#endif
+        }
+
+        // read up to `len` bytes at `offset`, short only at the end of
+        // the file, -1 on error
+        long read(void* buf, size_t len, uint64_t offset) {
+            size_t done = 0;
+            while (done < len) {
+                ssize_t res =
+                    ::pread(fd, static_cast<char*>(buf) + done, len - done,
+                            static_cast<off_t>(offset + done));
+                if (res < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (res < 0) {
+                    return -1;
+                }
+                if (res == 0) {
+                    break;
+                }
+                done += static_cast<size_t>(res);
+            }
+            return static_cast<long>(done);
+        }
+
+        // map the whole file read only, nullptr on failure or if empty
+        char const* map() {
+            if (ptr == nullptr && fd >= 0 && length > 0) {
+                void* addr = ::mmap(
+                    nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (addr == MAP_FAILED) {
+                    return nullptr;
+                }
+                ::madvise(addr, length, MADV_SEQUENTIAL);
+                ptr = addr;
+            }
+            return static_cast<char const*>(ptr);
+        }
+#else
+        bool open(std::string const&) {
+            return false;
+        }
+
+        void close() {
+            // Do Nothing
+        }
+
+        void sequential() {
+            // Do Nothing
+        }
+
+        void prefetch(uint64_t, size_t) {
+            // Do Nothing
+        }
+
+        long read(void*, size_t, uint64_t) {
+            return -1;
+        }
+
+        char const* map() {
+            return nullptr;
+        }
+#endif
+
+        bool is_open() const {
+            return fd >= 0;
+        }
+
+        uint64_t size() const {
+            return length;
+        }
+
+    private:
+        int fd;
+        uint64_t length;
+        void* ptr;
+    };
+}  // namespace platform
+
+#endif
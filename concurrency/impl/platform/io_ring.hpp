@@ -0,0 +1,433 @@
+#ifndef PLATFORM_IO_RING_HPP
+#define PLATFORM_IO_RING_HPP
+
+// merge:np_include
+#if defined(__linux__)
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <linux/stat.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#elif !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+// merge:end
+
+// merge:include
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+// merge:end
+
+namespace platform {
+    enum class IoOp : unsigned char { Nop, Read, Write, Open, Stat };
+
+    // statx result on linux, struct stat elsewhere
+    struct StatBuffer {
+        alignas(8) unsigned char raw[256];
+        bool is_statx;
+    };
+
+    struct FileStat {
+        uint64_t size;
+        uint32_t mode;
+        int64_t mtime_sec;
+        uint32_t mtime_nsec;
+    };
+
+    // Positional read and write, open relative to the working directory
+    // with `flags` and `mode`, stat of `path` into `stat`. `key` comes
+    // back with the completion.
+    struct IoRequest {
+        IoOp op = IoOp::Nop;
+        int fd = -1;
+        void* buf = nullptr;
+        size_t len = 0;
+        uint64_t offset = 0;
+        char const* path = nullptr;
+        int flags = 0;
+        unsigned mode = 0;
+        StatBuffer* stat = nullptr;
+        uint64_t key = 0;
+    };
+
+    struct IoEvent {
+        uint64_t key;
+        long result;
+    };
+
+    inline FileStat to_file_stat(StatBuffer const& buffer) {
+        FileStat stat{};
+#if defined(__linux__)
+        if (buffer.is_statx) {
+            struct statx stx;
+            std::memcpy(&stx, buffer.raw, sizeof(stx));
+            stat.size = stx.stx_size;
+            stat.mode = stx.stx_mode;
+            stat.mtime_sec = stx.stx_mtime.tv_sec;
+            stat.mtime_nsec = stx.stx_mtime.tv_nsec;
+            return stat;
+        }
+#endif
+#ifndef _WIN32
+        struct stat st;
+        std::memcpy(&st, buffer.raw, sizeof(st));
+        stat.size = static_cast<uint64_t>(st.st_size);
+        stat.mode = static_cast<uint32_t>(st.st_mode);
+        stat.mtime_sec = static_cast<int64_t>(st.st_mtime);
+#endif
+        return stat;
+    }
+
+    // run a request with blocking syscalls, -errno on failure
+    inline long io_execute(IoRequest const& request) {
+#ifndef _WIN32
+        long res = 0;
+        switch (request.op) {
+        case IoOp::Nop:
+            return 0;
+        case IoOp::Read:
+            res = ::pread(request.fd, request.buf, request.len,
+                          static_cast<off_t>(request.offset));
+            break;
+        case IoOp::Write:
+            res = ::pwrite(request.fd, request.buf, request.len,
+                           static_cast<off_t>(request.offset));
+            break;
+        case IoOp::Open:
+            res = ::open(request.path, request.flags, request.mode);
+            break;
+        case IoOp::Stat: {
+            static_assert(sizeof(struct stat) <= sizeof(StatBuffer::raw));
+            struct stat st;
+            res = ::stat(request.path, &st);
+            std::memcpy(request.stat->raw, &st, sizeof(st));
+            request.stat->is_statx = false;
+            break;
+        }
+        }
+        return res < 0 ? -errno : res;
+#else
+        (void)request;
+        return -38;
+#endif
+    }
+
+    // Submission and completion rings of io_uring set up with raw
+    // syscalls, unavailable before linux 5.6 and on other systems where
+    // open fails, as it does when the kernel lacks one of the opcodes.
+    // Pushes need external serialization, completions are reaped by a
+    // single thread.
+    class IoRing {
+    public:
+        IoRing() : ring_fd(-1) {
+            // Do Nothing
+        }
+
+        ~IoRing() {
+            close();
+        }
+
+        IoRing(IoRing const&) = delete;
+        IoRing(IoRing&&) = delete;
+
+        IoRing& operator=(IoRing const&) = delete;
+        IoRing& operator=(IoRing&&) = delete;
+
+#if defined(__linux__)
+        bool open(unsigned entries) {
+            close();
+            if (entries == 0) {
+                return false;
+            }
+
+            io_uring_params params;
+            std::memset(&params, 0, sizeof(params));
+            ring_fd = static_cast<int>(
+                ::syscall(__NR_io_uring_setup, entries, &params));
+            if (ring_fd < 0) {
+                ring_fd = -1;
+                return false;
+            }
+
+            if (!probe()) {
+                close();
+                return false;
+            }
+
+            sq_size = params.sq_off.array
+                      + params.sq_entries * sizeof(unsigned);
+            cq_size = params.cq_off.cqes
+                      + params.cq_entries * sizeof(io_uring_cqe);
+            bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+            if (single) {
+                sq_size = cq_size = sq_size > cq_size ? sq_size : cq_size;
+            }
+
+            sq_ptr = map(sq_size, IORING_OFF_SQ_RING);
+            cq_ptr = single ? sq_ptr : map(cq_size, IORING_OFF_CQ_RING);
+            sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+            sqes = static_cast<io_uring_sqe*>(
+                map(sqes_size, IORING_OFF_SQES));
+            if (sq_ptr == nullptr || cq_ptr == nullptr || sqes == nullptr) {
+                close();
+                return false;
+            }
+
+            auto sq = static_cast<unsigned char*>(sq_ptr);
+            sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+            sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+            sq_mask =
+                *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+            sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+            auto cq = static_cast<unsigned char*>(cq_ptr);
+            cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+            cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+            cq_mask =
+                *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+            cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+            sq_entries = params.sq_entries;
+            cq_entries = params.cq_entries;
+            return true;
+        }
+
+        void close() {
+            if (sqes != nullptr) {
+                ::munmap(sqes, sqes_size);
+            }
+            if (cq_ptr != nullptr && cq_ptr != sq_ptr) {
+                ::munmap(cq_ptr, cq_size);
+            }
+            if (sq_ptr != nullptr) {
+                ::munmap(sq_ptr, sq_size);
+            }
+            if (ring_fd >= 0) {
+                ::close(ring_fd);
+            }
+            ring_fd = -1;
+            sq_ptr = cq_ptr = nullptr;
+            sqes = nullptr;
+        }
+
+        // false while the submission ring is full
+        bool push(IoRequest const& request) {
+            unsigned tail = *sq_tail;
+            if (tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE)
+                >= sq_entries) {
+                return false;
+            }
+
+            unsigned idx = tail & sq_mask;
+            io_uring_sqe& sqe = sqes[idx];
+            std::memset(&sqe, 0, sizeof(sqe));
+            sqe.user_data = request.key;
+
+            switch (request.op) {
+            case IoOp::Nop:
+                sqe.opcode = IORING_OP_NOP;
+                break;
+            case IoOp::Read:
+            case IoOp::Write:
+                sqe.opcode = request.op == IoOp::Read ? IORING_OP_READ
+                                                      : IORING_OP_WRITE;
+                sqe.fd = request.fd;
+                sqe.addr = reinterpret_cast<uint64_t>(request.buf);
+                // a transfer stops short at the cap of pread and pwrite
+                sqe.len = static_cast<uint32_t>(
+                    request.len < max_transfer ? request.len : max_transfer);
+                sqe.off = request.offset;
+                break;
+            case IoOp::Open:
+                sqe.opcode = IORING_OP_OPENAT;
+                sqe.fd = AT_FDCWD;
+                sqe.addr = reinterpret_cast<uint64_t>(request.path);
+                sqe.len = request.mode;
+                sqe.open_flags = static_cast<uint32_t>(request.flags);
+                break;
+            case IoOp::Stat:
+                sqe.opcode = IORING_OP_STATX;
+                sqe.fd = AT_FDCWD;
+                sqe.addr = reinterpret_cast<uint64_t>(request.path);
+                sqe.len = STATX_BASIC_STATS;
+                sqe.off = reinterpret_cast<uint64_t>(request.stat->raw);
+                request.stat->is_statx = true;
+                break;
+            }
+
+            sq_array[idx] = idx;
+            __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+            return true;
+        }
+
+        // hand `count` pushed requests to the kernel, the number handed,
+        // fewer with errno set if io_uring_enter failed
+        unsigned submit(unsigned count) {
+            unsigned handed = 0;
+            while (handed < count) {
+                long res = ::syscall(__NR_io_uring_enter, ring_fd,
+                                     count - handed, 0, 0, nullptr, 0);
+                if (res < 0 && errno != EINTR && errno != EAGAIN) {
+                    break;
+                }
+                handed += res > 0 ? static_cast<unsigned>(res) : 0;
+            }
+            return handed;
+        }
+
+        // Take back the `num` oldest requests the kernel has not consumed,
+        // after a failed submit, and return their keys. Later requests
+        // move up, pushes and submits must be stopped meanwhile.
+        std::vector<uint64_t> drop(unsigned num) {
+            unsigned head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+            unsigned tail = *sq_tail;
+            num = num < tail - head ? num : tail - head;
+
+            std::vector<uint64_t> keys;
+            keys.reserve(num);
+            for (unsigned pos = head; pos != head + num; ++pos) {
+                keys.push_back(sqes[sq_array[pos & sq_mask]].user_data);
+            }
+            for (unsigned pos = head + num; pos != tail; ++pos) {
+                unsigned idx = (pos - num) & sq_mask;
+                sqes[idx] = sqes[sq_array[pos & sq_mask]];
+                sq_array[idx] = idx;
+            }
+
+            __atomic_store_n(sq_tail, tail - num, __ATOMIC_RELEASE);
+            return keys;
+        }
+
+        // reap up to `max` completions, waiting for one if `block`
+        size_t reap(IoEvent* out, size_t max, bool block) {
+            unsigned head = *cq_head;
+            if (block && head == __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+                ::syscall(__NR_io_uring_enter, ring_fd, 0, 1,
+                          IORING_ENTER_GETEVENTS, nullptr, 0);
+            }
+
+            size_t num = 0;
+            unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+            while (head != tail && num < max) {
+                io_uring_cqe const& cqe = cqes[head & cq_mask];
+                out[num++] = IoEvent{ cqe.user_data, cqe.res };
+                head += 1;
+            }
+            __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+            return num;
+        }
+
+        bool available() const {
+            return ring_fd >= 0;
+        }
+
+        // requests in flight that neither fill the submission ring nor
+        // overflow the completion ring
+        size_t capacity() const {
+            return sq_entries < cq_entries ? sq_entries : cq_entries;
+        }
+#else
+        bool open(unsigned) {
+            return false;
+        }
+
+        void close() {
+            // Do Nothing
+        }
+
+        bool push(IoRequest const&) {
+            return false;
+        }
+
+        unsigned submit(unsigned) {
+            return 0;
+        }
+
+        std::vector<uint64_t> drop(unsigned) {
+            return {};
+        }
+
+        size_t reap(IoEvent*, size_t, bool) {
+            return 0;
+        }
+
+        bool available() const {
+            return false;
+        }
+
+        size_t capacity() const {
+            return 0;
+        }
+#endif
+
+    private:
+#if defined(__linux__)
+        // MAX_RW_COUNT of linux, sqe lengths are 32 bits
+        static constexpr size_t max_transfer = 0x7ffff000;
+
+        // Kernels 5.1 to 5.5 set up rings without the read, write, openat
+        // or statx opcodes, and fail each request with -EINVAL. Probing
+        // came with 5.6, so it fails on those.
+        bool probe() {
+            constexpr unsigned num_ops = 256;
+            alignas(io_uring_probe) unsigned char
+                raw[sizeof(io_uring_probe)
+                    + num_ops * sizeof(io_uring_probe_op)];
+            std::memset(raw, 0, sizeof(raw));
+
+            auto probe = reinterpret_cast<io_uring_probe*>(raw);
+            if (::syscall(__NR_io_uring_register, ring_fd,
+                          IORING_REGISTER_PROBE, probe, num_ops)
+                < 0) {
+                return false;
+            }
+
+            unsigned const ops[] = { IORING_OP_READ, IORING_OP_WRITE,
+                                     IORING_OP_OPENAT, IORING_OP_STATX };
+            for (unsigned op : ops) {
+                if (op > probe->last_op
+                    || (probe->ops[op].flags & IO_URING_OP_SUPPORTED) == 0) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        void* map(size_t size, uint64_t offset) {
+            void* addr = ::mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                                MAP_SHARED | MAP_POPULATE, ring_fd,
+                                static_cast<off_t>(offset));
+            return addr == MAP_FAILED ? nullptr : addr;
+        }
+
+        void* sq_ptr = nullptr;
+        void* cq_ptr = nullptr;
+        io_uring_sqe* sqes = nullptr;
+        size_t sq_size = 0;
+        size_t cq_size = 0;
+        size_t sqes_size = 0;
+
+        unsigned* sq_head = nullptr;
+        unsigned* sq_tail = nullptr;
+        unsigned* sq_array = nullptr;
+        unsigned sq_mask = 0;
+        unsigned sq_entries = 0;
+
+        unsigned* cq_head = nullptr;
+        unsigned* cq_tail = nullptr;
+        io_uring_cqe* cqes = nullptr;
+        unsigned cq_mask = 0;
+        unsigned cq_entries = 0;
+#endif
+        int ring_fd;
+    };
+}  // namespace platform
+
+#endif
@@ -0,0 +1,233 @@
+#ifndef PLATFORM_LOG_FILE_HPP
+#define PLATFORM_LOG_FILE_HPP
+
+// merge:np_include
+#ifndef _WIN32
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+// merge:end
+
+// merge:include
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <vector>
+// merge:end
+
+namespace platform {
+    // Append only file with explicit data sync, unsupported on windows
+    // where every call fails.
+    class LogFile {
+    public:
+        LogFile() : fd(-1) {
+            // Do Nothing
+        }
+
+        ~LogFile() {
+            close();
+        }
+
+        LogFile(LogFile const&) = delete;
+        LogFile(LogFile&&) = delete;
+
+        LogFile& operator=(LogFile const&) = delete;
+        LogFile& operator=(LogFile&&) = delete;
+
+#ifndef _WIN32
+        // create `path` or append to its end
+        bool open(std::string const& path) {
+            close();
+            fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0600);
+            return fd >= 0;
+        }
+
+        // create `path` or discard its content
+        bool create(std::string const& path) {
+            close();
+            fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+            return fd >= 0;
+        }
+
+        bool write(void const* src, size_t size) {
+            auto ptr = static_cast<char const*>(src);
+            while (size > 0) {
+                ssize_t num = ::write(fd, ptr, size);
+                if (num < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (num <= 0) {
+                    return false;
+                }
+                ptr += num;
+                size -= static_cast<size_t>(num);
+            }
+            return true;
+        }
+
+        // flush written data to the device, metadata only if required
+        // to read it back
+        bool sync() {
+#ifdef __linux__
+            return ::fdatasync(fd) == 0;
+#else
+            return ::fsync(fd) == 0;
+#endif
+        }
+
+        void close() {
+            if (fd >= 0) {
+                ::close(fd);
+            }
+            fd = -1;
+        }
+#else
+        bool open(std::string const&) {
+            return false;
+        }
+
+        bool create(std::string const&) {
+            return false;
+        }
+
+        bool write(void const*, size_t) {
+            return false;
+        }
+
+        bool sync() {
+            return false;
+        }
+
+        void close() {
+            // Do Nothing
+        }
+#endif
+
+        bool is_open() const {
+            return fd >= 0;
+        }
+
+    private:
+        int fd;
+    };
+
+    // whole content of `path`, false if it can not be read
+    inline bool read_file(std::string const& path, std::string& out) {
+        std::FILE* file = std::fopen(path.c_str(), "rb");
+        if (file == nullptr) {
+            return false;
+        }
+
+        out.clear();
+        char buf[1 << 16];
+        size_t num = 0;
+        while ((num = std::fread(buf, 1, sizeof(buf), file)) > 0) {
+            out.append(buf, num);
+        }
+
+        bool ok = std::ferror(file) == 0;
+        std::fclose(file);
+        return ok;
+    }
+
+    // make creation and renames of entries in the directory of `path`
+    // durable
+    inline bool sync_directory(std::string const& path) {
+#ifndef _WIN32
+        size_t slash = path.rfind('/');
+        std::string dir = slash == std::string::npos
+                              ? std::string(".")
+                              : path.substr(0, std::max<size_t>(slash, 1));
+
+        int fd = ::open(dir.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+
+        bool ok = ::fsync(fd) == 0;
+        ::close(fd);
+        return ok;
+#else
+        (void)path;
+        return false;
+#endif
+    }
+
+    // move `from` over `to`, atomically where the platform allows it
+    inline bool rename_file(std::string const& from, std::string const& to) {
+#ifdef _WIN32
+        // rename does not replace an existing file there
+        std::remove(to.c_str());
+#endif
+        return std::rename(from.c_str(), to.c_str()) == 0;
+    }
+
+    // replace `path` atomically with synced content, readers see either
+    // the old or the new file after a crash
+    inline bool replace_file(std::string const& path,
+                             void const* src,
+                             size_t size) {
+#ifndef _WIN32
+        std::string tmp = path + ".tmp";
+        {
+            int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+            if (fd < 0) {
+                return false;
+            }
+
+            bool ok = ::write(fd, src, size) == static_cast<ssize_t>(size)
+                      && ::fsync(fd) == 0;
+            ::close(fd);
+            if (!ok) {
+                ::unlink(tmp.c_str());
+                return false;
+            }
+        }
+        return ::rename(tmp.c_str(), path.c_str()) == 0
+               && sync_directory(path);
+#else
+        (void)path;
+        (void)src;
+        (void)size;
+        return false;
+#endif
+    }
+
+    // create `path` if it does not exist yet
+    inline bool make_directory(std::string const& path) {
+#ifndef _WIN32
+        return ::mkdir(path.c_str(), 0700) == 0 || errno == EEXIST;
+#else
+        (void)path;
+        return false;
+#endif
+    }
+
+    // names of the entries in `path`, empty if it can not be listed
+    inline std::vector<std::string> list_directory(std::string const& path) {
+        std::vector<std::string> names;
+#ifndef _WIN32
+        DIR* dir = ::opendir(path.c_str());
+        if (dir == nullptr) {
+            return names;
+        }
+
+        while (dirent* entry = ::readdir(dir)) {
+            std::string name = entry->d_name;
+            if (name != "." && name != "..") {
+                names.push_back(std::move(name));
+            }
+        }
+        ::closedir(dir);
+#else
+        (void)path;
+#endif
+        return names;
+    }
+}  // namespace platform
+
+#endif
@@ -0,0 +1,167 @@
+#ifndef PLATFORM_MAPPED_FILE_HPP
+#define PLATFORM_MAPPED_FILE_HPP
+
+// merge:np_include
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+// merge:end
+
+// merge:include
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <string>
+// merge:end
+
+namespace platform {
+    // Shared read-write mapping of a whole file, unsupported on windows
+    // where every call fails.
+    class MappedFile {
+    public:
+        MappedFile() : fd(-1), ptr(nullptr), length(0) {
+            // Do Nothing
+        }
+
+        ~MappedFile() {
+            close();
+        }
+
+        MappedFile(MappedFile const&) = delete;
+        MappedFile(MappedFile&&) = delete;
+
+        MappedFile& operator=(MappedFile const&) = delete;
+        MappedFile& operator=(MappedFile&&) = delete;
+
+#ifndef _WIN32
+        // Create or truncate `path` to `size` bytes and map it. The blocks
+        // are allocated up front, a full disk fails here instead of
+        // raising SIGBUS on a write through the mapping.
+        bool create(std::string const& path, size_t size) {
+            close();
+            fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+            if (fd < 0) {
+                return false;
+            }
+            if (!allocate(size)) {
+                close();
+                return false;
+            }
+            return map(size);
+        }
+
+        // map an existing file
+        bool open(std::string const& path) {
+            close();
+            fd = ::open(path.c_str(), O_RDWR);
+
+            struct stat st;
+            if (fd < 0 || ::fstat(fd, &st) != 0) {
+                close();
+                return false;
+            }
+            return map(static_cast<size_t>(st.st_size));
+        }
+
+        void close() {
+            if (ptr != nullptr) {
+                ::munmap(ptr, length);
+            }
+            if (fd >= 0) {
+                ::close(fd);
+            }
+            fd = -1;
+            ptr = nullptr;
+            length = 0;
+        }
+#else
+        bool create(std::string const&, size_t) {
+            return false;
+        }
+
+        bool open(std::string const&) {
+            return false;
+        }
+
+        void close() {
+            // Do Nothing
+        }
+#endif
+
+        bool mapped() const {
+            return ptr != nullptr;
+        }
+
+        unsigned char* data() {
+            return static_cast<unsigned char*>(ptr);
+        }
+
+        size_t size() const {
+            return length;
+        }
+
+    private:
+#ifndef _WIN32
+        bool allocate(size_t size) {
+#ifndef __APPLE__
+            return ::posix_fallocate(fd, 0, static_cast<off_t>(size)) == 0;
+#else
+            // no posix_fallocate, write the zeros out
+            char zeros[1 << 12] = {};
+            for (size_t done = 0; done < size;) {
+                size_t num = std::min(sizeof(zeros), size - done);
+                ssize_t res =
+                    ::pwrite(fd, zeros, num, static_cast<off_t>(done));
+                if (res < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (res <= 0) {
+                    return false;
+                }
+                done += static_cast<size_t>(res);
+            }
+            return true;
+#endif
+        }
+
+        bool map(size_t size) {
+            void* addr = ::mmap(
+                nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (addr == MAP_FAILED) {
+                close();
+                return false;
+            }
+
+            ptr = addr;
+            length = size;
+            return true;
+        }
+#endif
+
+        int fd;
+        void* ptr;
+        size_t length;
+    };
+
+    inline bool remove_file(std::string const& path) {
+#ifndef _WIN32
+        return ::unlink(path.c_str()) == 0;
+#else
+        return std::remove(path.c_str()) == 0;
+#endif
+    }
+
+    inline long process_id() {
+#ifndef _WIN32
+        return static_cast<long>(::getpid());
+#else
+        return 0;
+#endif
+    }
+}  // namespace platform
+
+#endif
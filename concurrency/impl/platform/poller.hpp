@@ -0,0 +1,234 @@
+#ifndef PLATFORM_POLLER_HPP
+#define PLATFORM_POLLER_HPP
+
+// merge:np_include
+#if defined(__linux__)
+#include <sys/epoll.h>
+#include <unistd.h>
+#elif !defined(_WIN32)
+#include <poll.h>
+#endif
+// merge:end
+
+// merge:include
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+// merge:end
+
+namespace platform {
+    constexpr uint32_t poll_read = 1;
+    constexpr uint32_t poll_write = 2;
+
+    struct PollEvent {
+        uint64_t key;
+        uint32_t events;
+    };
+
+    // One shot readiness of file descriptors, an armed descriptor is
+    // reported once and disarmed until armed again. Level triggered, so
+    // arming a descriptor which is still ready reports it right away.
+    // epoll on linux, poll on other posix systems where arming waits for
+    // the next wakeup of at most 10ms, unsupported on windows.
+    class Poller {
+    public:
+        Poller() : epfd(-1) {
+            // Do Nothing
+        }
+
+        ~Poller() {
+            close();
+        }
+
+        Poller(Poller const&) = delete;
+        Poller(Poller&&) = delete;
+
+        Poller& operator=(Poller const&) = delete;
+        Poller& operator=(Poller&&) = delete;
+
+#if defined(__linux__)
+        bool open() {
+            close();
+            epfd = ::epoll_create1(EPOLL_CLOEXEC);
+            return epfd >= 0;
+        }
+
+        void close() {
+            if (epfd >= 0) {
+                ::close(epfd);
+            }
+            epfd = -1;
+        }
+
+        // registers `fd` on first use
+        bool arm(int fd, uint32_t events, uint64_t key) {
+            epoll_event ev{};
+            ev.events = EPOLLONESHOT | EPOLLRDHUP;
+            if (events & poll_read) {
+                ev.events |= EPOLLIN;
+            }
+            if (events & poll_write) {
+                ev.events |= EPOLLOUT;
+            }
+            ev.data.u64 = key;
+
+            if (::epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev) == 0) {
+                return true;
+            }
+            return errno == ENOENT
+                   && ::epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) == 0;
+        }
+
+        void remove(int fd) {
+            epoll_event ev{};
+            ::epoll_ctl(epfd, EPOLL_CTL_DEL, fd, &ev);
+        }
+
+        // errors and hangups are reported as both read and write
+        size_t wait(PollEvent* out,
+                    size_t max,
+                    std::chrono::milliseconds timeout) {
+            epoll_event evs[256];
+            auto cap = static_cast<int>(std::min<size_t>(max, 256));
+            int num = ::epoll_wait(
+                epfd, evs, cap, static_cast<int>(timeout.count()));
+            for (int i = 0; i < num; ++i) {
+                uint32_t events = 0;
+                if (evs[i].events & (EPOLLIN | EPOLLRDHUP)) {
+                    events |= poll_read;
+                }
+                if (evs[i].events & EPOLLOUT) {
+                    events |= poll_write;
+                }
+                if (evs[i].events & (EPOLLERR | EPOLLHUP)) {
+                    events |= poll_read | poll_write;
+                }
+                out[i] = PollEvent{ evs[i].data.u64, events };
+            }
+            return num > 0 ? static_cast<size_t>(num) : 0;
+        }
+#elif !defined(_WIN32)
+        bool open() {
+            epfd = 0;
+            return true;
+        }
+
+        void close() {
+            std::unique_lock lock(mutex);
+            armed.clear();
+            epfd = -1;
+        }
+
+        bool arm(int fd, uint32_t events, uint64_t key) {
+            std::unique_lock lock(mutex);
+            for (auto& entry : armed) {
+                if (entry.fd == fd) {
+                    entry.events |= events;
+                    entry.key = key;
+                    return true;
+                }
+            }
+            armed.push_back(Entry{ fd, events, key });
+            return true;
+        }
+
+        void remove(int fd) {
+            std::unique_lock lock(mutex);
+            armed.erase(std::remove_if(armed.begin(), armed.end(),
+                                       [&](Entry const& entry) {
+                                           return entry.fd == fd;
+                                       }),
+                        armed.end());
+        }
+
+        size_t wait(PollEvent* out,
+                    size_t max,
+                    std::chrono::milliseconds timeout) {
+            std::vector<pollfd> fds;
+            {
+                std::unique_lock lock(mutex);
+                for (auto const& entry : armed) {
+                    short events = 0;
+                    events |= (entry.events & poll_read) ? POLLIN : 0;
+                    events |= (entry.events & poll_write) ? POLLOUT : 0;
+                    fds.push_back(pollfd{ entry.fd, events, 0 });
+                }
+            }
+
+            auto nap = std::min<long long>(timeout.count(), 10);
+            if (::poll(fds.data(), fds.size(), static_cast<int>(nap)) <= 0) {
+                return 0;
+            }
+
+            std::unique_lock lock(mutex);
+            size_t num = 0;
+            for (auto const& pfd : fds) {
+                if (pfd.revents == 0 || num == max) {
+                    continue;
+                }
+
+                uint32_t events = 0;
+                if (pfd.revents & POLLIN) {
+                    events |= poll_read;
+                }
+                if (pfd.revents & POLLOUT) {
+                    events |= poll_write;
+                }
+                if (pfd.revents & (POLLERR | POLLHUP | POLLNVAL)) {
+                    events |= poll_read | poll_write;
+                }
+
+                for (auto iter = armed.begin(); iter != armed.end(); ++iter) {
+                    if (iter->fd == pfd.fd) {
+                        out[num++] = PollEvent{ iter->key, events };
+                        armed.erase(iter);
+                        break;
+                    }
+                }
+            }
+            return num;
+        }
+#else
+        bool open() {
+            return false;
+        }
+
+        void close() {
+            // Do Nothing
+        }
+
+        bool arm(int, uint32_t, uint64_t) {
+            return false;
+        }
+
+        void remove(int) {
+            // Do Nothing
+        }
+
+        size_t wait(PollEvent*, size_t, std::chrono::milliseconds timeout) {
+            std::this_thread::sleep_for(timeout);
+            return 0;
+        }
+#endif
+
+    private:
+#if !defined(__linux__) && !defined(_WIN32)
+        struct Entry {
+            int fd;
+            uint32_t events;
+            uint64_t key;
+        };
+
+        std::mutex mutex;
+        std::vector<Entry> armed;
+#endif
+        int epfd;
+    };
+}  // namespace platform
+
+#endif
@@ -0,0 +1,176 @@
+#ifndef PLATFORM_SHARED_MEMORY_HPP
+#define PLATFORM_SHARED_MEMORY_HPP
+
+// merge:np_include
+#ifndef _WIN32
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+// merge:end
+
+// merge:include
+#include <cerrno>
+#include <cstddef>
+#include <string>
+// merge:end
+
+namespace platform {
+    // Named shared memory object mapped read-write, visible to every
+    // process opening the same name. Unsupported on windows where every
+    // call fails.
+    class SharedMemory {
+    public:
+        SharedMemory() : ptr(nullptr), length(0) {
+            // Do Nothing
+        }
+
+        ~SharedMemory() {
+            close();
+        }
+
+        SharedMemory(SharedMemory const&) = delete;
+        SharedMemory(SharedMemory&&) = delete;
+
+        SharedMemory& operator=(SharedMemory const&) = delete;
+        SharedMemory& operator=(SharedMemory&&) = delete;
+
+#ifndef _WIN32
+        // create a zero filled object, fails if `name` already exists
+        bool create(std::string const& name, size_t size) {
+            close();
+            int fd = ::shm_open(path(name).c_str(),
+                                O_RDWR | O_CREAT | O_EXCL, 0600);
+            if (fd < 0) {
+                return false;
+            }
+
+            bool ok = ::ftruncate(fd, static_cast<off_t>(size)) == 0
+                      && map(fd, size);
+            ::close(fd);
+            if (!ok) {
+                unlink(name);
+            }
+            return ok;
+        }
+
+        bool open(std::string const& name) {
+            close();
+            int fd = ::shm_open(path(name).c_str(), O_RDWR, 0600);
+            if (fd < 0) {
+                return false;
+            }
+
+            struct stat st;
+            bool ok = ::fstat(fd, &st) == 0 && st.st_size > 0
+                      && map(fd, static_cast<size_t>(st.st_size));
+            ::close(fd);
+            return ok;
+        }
+
+        void close() {
+            if (ptr != nullptr) {
+                ::munmap(ptr, length);
+            }
+            ptr = nullptr;
+            length = 0;
+        }
+
+        // remove the name, mappings stay valid until closed
+        static bool unlink(std::string const& name) {
+            return ::shm_unlink(path(name).c_str()) == 0;
+        }
+#else
+        bool create(std::string const&, size_t) {
+            return false;
+        }
+
+        bool open(std::string const&) {
+            return false;
+        }
+
+        void close() {
+            // Do Nothing
+        }
+
+        static bool unlink(std::string const&) {
+            return false;
+        }
+#endif
+
+        bool mapped() const {
+            return ptr != nullptr;
+        }
+
+        void* data() {
+            return ptr;
+        }
+
+        size_t size() const {
+            return length;
+        }
+
+    private:
+#ifndef _WIN32
+        static std::string path(std::string const& name) {
+            return name.empty() || name[0] != '/' ? '/' + name : name;
+        }
+
+        bool map(int fd, size_t size) {
+            void* addr = ::mmap(
+                nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (addr == MAP_FAILED) {
+                return false;
+            }
+
+            ptr = addr;
+            length = size;
+            return true;
+        }
+#endif
+
+        void* ptr;
+        size_t length;
+    };
+
+    // False once process `pid` has exited, even before its parent reaps
+    // it, always true on windows. A pidfd polls readable on exit, kill
+    // would still find the zombie.
+    inline bool process_alive(long pid) {
+#ifndef _WIN32
+        auto id = static_cast<pid_t>(pid);
+#ifdef SYS_pidfd_open
+        int fd = static_cast<int>(::syscall(SYS_pidfd_open, id, 0));
+        if (fd >= 0) {
+            pollfd watch{ fd, POLLIN, 0 };
+            bool exited = ::poll(&watch, 1, 0) > 0;
+            ::close(fd);
+            return !exited;
+        }
+        if (errno == ESRCH) {
+            return false;
+        }
+#endif
+        // without pidfds, an exited child of ours is seen without
+        // reaping it
+        siginfo_t info{};
+        if (::waitid(P_PID, static_cast<id_t>(id), &info,
+                     WEXITED | WNOHANG | WNOWAIT)
+                == 0
+            && info.si_pid == id) {
+            return false;
+        }
+        return ::kill(id, 0) == 0 || errno == EPERM;
+#else
+        (void)pid;
+        return true;
+#endif
+    }
+}  // namespace platform
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef PLATFORM_SIGNAL_HPP
+#define PLATFORM_SIGNAL_HPP
+
+// merge:include
+#include <atomic>
+#include <csignal>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+// merge:end
+
+namespace platform {
+    using namespace std::literals;
+#if defined(SIGUSR1)
+    constexpr int dump_signal = SIGUSR1;
+#elif defined(SIGBREAK)
+    constexpr int dump_signal = SIGBREAK;
+#else
+    constexpr int dump_signal = SIGINT;
+#endif
+
+    // Signal handlers may only touch lock-free atomics, so callbacks run on
+    // a watcher thread which polls the pending signal mask.
+    class SignalWatcher {
+    public:
+        static SignalWatcher& instance() {
+            // never destroyed, static objects may detach after exit
+            static SignalWatcher* watcher = new SignalWatcher();
+            return *watcher;
+        }
+
+        size_t attach(int signo, std::function<void()> callback) {
+            std::unique_lock lock(mutex);
+            std::signal(signo, handler);
+
+            callbacks.emplace(++last_id, std::make_pair(signo, callback));
+            return last_id;
+        }
+
+        void detach(size_t id) {
+            std::unique_lock lock(mutex);
+            callbacks.erase(id);
+        }
+
+    private:
+        SignalWatcher() : last_id(0), watcher([this] { run(); }) {
+            watcher.detach();
+        }
+
+        static void handler(int signo) {
+            pending.fetch_or(1ull << (signo & 63));
+        }
+
+        void run() {
+            while (true) {
+                std::this_thread::sleep_for(100ms);
+
+                unsigned long long mask = pending.exchange(0);
+                if (mask == 0) {
+                    continue;
+                }
+
+                std::unique_lock lock(mutex);
+                for (auto const& [id, callback] : callbacks) {
+                    if (mask & (1ull << (callback.first & 63))) {
+                        callback.second();
+                    }
+                }
+            }
+        }
+
+        inline static std::atomic<unsigned long long> pending = 0;
+
+        std::mutex mutex;
+        size_t last_id;
+        std::map<size_t, std::pair<int, std::function<void()>>> callbacks;
+
+        std::thread watcher;
+    };
+}  // namespace platform
+
+#endif
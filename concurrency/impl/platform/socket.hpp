@@ -0,0 +1,331 @@
+#ifndef PLATFORM_SOCKET_HPP
+#define PLATFORM_SOCKET_HPP
+
+// merge:np_include
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+// merge:end
+
+// merge:include
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+// merge:end
+
+namespace platform {
+    // Thin wrapper over bsd sockets, sockets are unsupported on windows
+    // and every call fails with `invalid_socket` or -1.
+    using socket_t = int;
+    constexpr socket_t invalid_socket = -1;
+
+    // one buffer of a vectored send
+    struct IoSlice {
+        void const* data;
+        size_t size;
+    };
+
+#ifndef _WIN32
+    constexpr bool has_socket = true;
+
+#ifdef MSG_NOSIGNAL
+    constexpr int send_flags = MSG_NOSIGNAL;
+#else
+    constexpr int send_flags = 0;
+#endif
+
+    inline void no_sigpipe(socket_t fd) {
+#ifdef SO_NOSIGPIPE
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#else
+        (void)fd;
+#endif
+    }
+
+    inline void close_socket(socket_t fd) {
+        if (fd != invalid_socket) {
+            ::close(fd);
+        }
+    }
+
+    // wakes up a peer blocked on `fd` without releasing the descriptor
+    inline void shutdown_socket(socket_t fd) {
+        if (fd != invalid_socket) {
+            ::shutdown(fd, SHUT_RDWR);
+        }
+    }
+
+    inline socket_t listen_inet(uint16_t port, uint32_t host, int backlog) {
+        socket_t fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        if (fd == invalid_socket) {
+            return invalid_socket;
+        }
+
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(host);
+
+        if (::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0
+            || ::listen(fd, backlog) != 0) {
+            close_socket(fd);
+            return invalid_socket;
+        }
+        return fd;
+    }
+
+    // listen on loopback, port 0 picks an ephemeral port
+    inline socket_t listen_local(uint16_t port, int backlog = 16) {
+        return listen_inet(port, INADDR_LOOPBACK, backlog);
+    }
+
+    // listen on every interface
+    inline socket_t listen_tcp(uint16_t port, int backlog = 16) {
+        return listen_inet(port, INADDR_ANY, backlog);
+    }
+
+    // connect to `host`, a name or an address, with nagle disabled
+    inline socket_t connect_tcp(std::string const& host, uint16_t port) {
+        addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+
+        addrinfo* res = nullptr;
+        std::string service = std::to_string(port);
+        if (::getaddrinfo(host.c_str(), service.c_str(), &hints, &res) != 0) {
+            return invalid_socket;
+        }
+
+        socket_t fd = invalid_socket;
+        for (addrinfo* ai = res; ai != nullptr; ai = ai->ai_next) {
+            fd = ::socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+            if (fd == invalid_socket) {
+                continue;
+            }
+            if (::connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+                break;
+            }
+            close_socket(fd);
+            fd = invalid_socket;
+        }
+        ::freeaddrinfo(res);
+
+        if (fd != invalid_socket) {
+            int on = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+            no_sigpipe(fd);
+        }
+        return fd;
+    }
+
+    inline bool unix_address(std::string const& path, sockaddr_un& addr) {
+        addr = sockaddr_un{};
+        addr.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(addr.sun_path)) {
+            return false;
+        }
+        std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+        return true;
+    }
+
+    // listen on a unix domain socket, a stale `path` is replaced
+    inline socket_t listen_unix(std::string const& path, int backlog = 16) {
+        sockaddr_un addr;
+        socket_t fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd == invalid_socket || !unix_address(path, addr)) {
+            close_socket(fd);
+            return invalid_socket;
+        }
+
+        ::unlink(path.c_str());
+        if (::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0
+            || ::listen(fd, backlog) != 0) {
+            close_socket(fd);
+            return invalid_socket;
+        }
+        return fd;
+    }
+
+    inline socket_t connect_unix(std::string const& path) {
+        sockaddr_un addr;
+        socket_t fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd == invalid_socket || !unix_address(path, addr)
+            || ::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr))
+                   != 0) {
+            close_socket(fd);
+            return invalid_socket;
+        }
+
+        no_sigpipe(fd);
+        return fd;
+    }
+
+    // connected pair of unix domain sockets
+    inline bool socket_pair(socket_t (&fds)[2]) {
+        if (::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+            return false;
+        }
+        no_sigpipe(fds[0]);
+        no_sigpipe(fds[1]);
+        return true;
+    }
+
+    inline uint16_t local_port(socket_t fd) {
+        sockaddr_in addr{};
+        socklen_t len = sizeof(addr);
+        if (::getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &len) != 0) {
+            return 0;
+        }
+        return ntohs(addr.sin_port);
+    }
+
+    inline socket_t accept_socket(socket_t fd) {
+        socket_t client = ::accept(fd, nullptr, nullptr);
+        if (client != invalid_socket) {
+            no_sigpipe(client);
+        }
+        return client;
+    }
+
+    inline bool wait_readable(socket_t fd, std::chrono::milliseconds timeout) {
+        pollfd pfd{ fd, POLLIN, 0 };
+        return ::poll(&pfd, 1, static_cast<int>(timeout.count())) > 0;
+    }
+
+    inline long send_some(socket_t fd, void const* data, size_t size) {
+        return ::send(fd, data, size, send_flags);
+    }
+
+    inline long recv_some(socket_t fd, void* data, size_t size) {
+        return ::recv(fd, data, size, 0);
+    }
+
+    // gather `count` slices into one sendmsg, like writev without
+    // SIGPIPE
+    inline long send_vectored(socket_t fd, IoSlice const* slices,
+                              size_t count) {
+        iovec iov[64];
+        size_t num = count < 64 ? count : 64;
+        for (size_t i = 0; i < num; ++i) {
+            iov[i].iov_base = const_cast<void*>(slices[i].data);
+            iov[i].iov_len = slices[i].size;
+        }
+
+        msghdr msg{};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = num;
+        return ::sendmsg(fd, &msg, send_flags);
+    }
+#else
+    constexpr bool has_socket = false;
+
+    inline void close_socket(socket_t) {
+        // Do Nothing
+    }
+
+    inline socket_t listen_local(uint16_t, int = 16) {
+        return invalid_socket;
+    }
+
+    inline uint16_t local_port(socket_t) {
+        return 0;
+    }
+
+    inline socket_t accept_socket(socket_t) {
+        return invalid_socket;
+    }
+
+    inline bool wait_readable(socket_t, std::chrono::milliseconds) {
+        return false;
+    }
+
+    inline long send_some(socket_t, void const*, size_t) {
+        return -1;
+    }
+
+    inline long recv_some(socket_t, void*, size_t) {
+        return -1;
+    }
+
+    inline void shutdown_socket(socket_t) {
+        // Do Nothing
+    }
+
+    inline socket_t listen_tcp(uint16_t, int = 16) {
+        return invalid_socket;
+    }
+
+    inline socket_t connect_tcp(std::string const&, uint16_t) {
+        return invalid_socket;
+    }
+
+    inline socket_t listen_unix(std::string const&, int = 16) {
+        return invalid_socket;
+    }
+
+    inline socket_t connect_unix(std::string const&) {
+        return invalid_socket;
+    }
+
+    inline bool socket_pair(socket_t (&)[2]) {
+        return false;
+    }
+
+    inline long send_vectored(socket_t, IoSlice const*, size_t) {
+        return -1;
+    }
+#endif
+
+    inline bool send_all(socket_t fd, void const* data, size_t size) {
+        auto ptr = static_cast<char const*>(data);
+        while (size > 0) {
+            long sent = send_some(fd, ptr, size);
+            if (sent <= 0) {
+                return false;
+            }
+            ptr += sent;
+            size -= static_cast<size_t>(sent);
+        }
+        return true;
+    }
+
+    // send every slice, advancing past partial writes
+    inline bool send_all_vectored(socket_t fd, std::vector<IoSlice> slices) {
+        size_t first = 0;
+        while (first < slices.size()) {
+            long sent =
+                send_vectored(fd, &slices[first], slices.size() - first);
+            if (sent <= 0) {
+                return false;
+            }
+
+            auto left = static_cast<size_t>(sent);
+            while (first < slices.size() && left >= slices[first].size) {
+                left -= slices[first].size;
+                first += 1;
+            }
+            if (left > 0) {
+                auto data = static_cast<char const*>(slices[first].data);
+                slices[first].data = data + left;
+                slices[first].size -= left;
+            }
+        }
+        return true;
+    }
+}  // namespace platform
+
+#endif
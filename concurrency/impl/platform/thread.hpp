@@ -0,0 +1,54 @@
+#ifndef PLATFORM_THREAD_HPP
+#define PLATFORM_THREAD_HPP
+
+// merge:np_include
+#if defined(__linux__) || defined(__APPLE__)
+#include <pthread.h>
+#include <time.h>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+// merge:end
+
+// merge:include
+#include <chrono>
+// merge:end
+
+namespace platform {
+    // linux limits thread names to 15 characters, longer names are ignored
+    inline void set_thread_name(char const* name) {
+#if defined(__linux__)
+        pthread_setname_np(pthread_self(), name);
+#elif defined(__APPLE__)
+        pthread_setname_np(name);
+#else
+        (void)name;
+#endif
+    }
+
+    // cpu time consumed by the calling thread, zero if unsupported
+    inline std::chrono::nanoseconds thread_cpu_time() {
+#if defined(CLOCK_THREAD_CPUTIME_ID)
+        timespec ts;
+        if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0) {
+            return std::chrono::seconds(ts.tv_sec)
+                   + std::chrono::nanoseconds(ts.tv_nsec);
+        }
+#endif
+        return std::chrono::nanoseconds(0);
+    }
+
+    // spin loop hint, yields the core to a sibling hyperthread
+    inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__)
+        asm volatile("yield");
+#elif defined(_M_X64) || defined(_M_IX86)
+        _mm_pause();
+#endif
+    }
+}  // namespace platform
+
+#endif
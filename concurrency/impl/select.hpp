@@ -2,6 +2,7 @@
 #define SELECT_HPP
 
 #include "channel.hpp"
+#include "netpoller.hpp"
 
 template <typename T, typename F>
 struct Selectable {
@@ -55,12 +56,23 @@ auto select_invoke(A&& action, V&& value) {
     return;
 }
 
+// a descriptor may become ready any time, a channel until it is closed
+// and drained
+template <typename C>
+bool select_open(C& channel) {
+    if constexpr (std::is_same_v<std::decay_t<C>, FdSelectable>) {
+        return true;
+    }
+    else {
+        return channel.Readable();
+    }
+}
+
+// Run the action of the first case with a message, in argument order.
+// Blocks until a case fires, parked while none is ready, and returns
+// without running one once every case is closed.
 template <typename... T>
 void select(T&&... matches) {
-    auto readable = [](auto&... selectable) {
-        return (selectable.channel.Readable() || ...);
-    };
-
     bool run = true;
     auto try_action = [&](auto& match) {
         if (run) {
@@ -72,9 +84,18 @@ void select(T&&... matches) {
         }
     };
 
-    while (!readable(matches...))
-        ;
-    (try_action(matches), ...);
+    while (true) {
+        (try_action(matches), ...);
+        if (!run || !(select_open(matches.channel) || ...)) {
+            return;
+        }
+
+        // messages sent since the pass are found ready by the wait
+        SelectWait wait;
+        (wait.Add(matches.channel), ...);
+        wait.Park();
+        (wait.Remove(matches.channel), ...);
+    }
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,446 @@
+#ifndef SHARED_CHANNEL_HPP
+#define SHARED_CHANNEL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <optional>
+#include <string>
+#include <type_traits>
+
+#include "channel_iter.hpp"
+#include "container/thread_safe.hpp"
+#include "platform/constant.hpp"
+#include "platform/futex.hpp"
+#include "platform/mapped_file.hpp"
+#include "platform/shared_memory.hpp"
+
+// Channel between processes, the ring lives in a named shared memory
+// object. One process creates it with a capacity, the peer opens it by
+// name, and both ends may Add and Get from any number of threads.
+//
+// Slots carry sequence numbers, so a send or receive is a single CAS
+// and no lock is ever held across processes. Blocked ends park on
+// process shared futex words and wake up periodically to check their
+// peer, a peer which exits without closing closes the channel, and
+// pending messages are still received. Slots the dead peer claimed but
+// never filled are skipped, see Reclaimed.
+template <typename T>
+class SharedChannel {
+public:
+    static_assert(std::is_trivially_copyable_v<T>,
+                  "SharedChannel requires trivially copyable messages");
+
+    using value_type = T;
+    using iterator = ChannelIterator<T, SharedChannel>;
+
+    // create `name` with room for `capacity` messages, rounded up to a
+    // power of two. A stale object left under the same name is replaced,
+    // the last end to go away removes the name.
+    SharedChannel(std::string name, size_t capacity)
+        : name(std::move(name)), role(0), header(nullptr), cells(nullptr),
+          num_pushing(0), num_reclaimed(0), num_push_park(0),
+          num_pop_park(0) {
+        size_t num_cells = 1;
+        while (num_cells < capacity) {
+            num_cells <<= 1;
+        }
+
+        platform::SharedMemory::unlink(this->name);
+        size_t size = offset() + num_cells * sizeof(Cell);
+        if (!memory.create(this->name, size)) {
+            return;
+        }
+
+        header = new (memory.data()) Header();
+        cells = reinterpret_cast<Cell*>(
+            static_cast<unsigned char*>(memory.data()) + offset());
+        for (size_t i = 0; i < num_cells; ++i) {
+            new (&cells[i]) Cell();
+            cells[i].seq.store(i, std::memory_order_relaxed);
+        }
+
+        header->mask = num_cells - 1;
+        header->pids[0].store(platform::process_id());
+        header->magic.store(magic, std::memory_order_release);
+    }
+
+    // open a channel created by the peer, closed if it does not exist
+    // or already has two ends
+    SharedChannel(std::string name)
+        : name(std::move(name)), role(1), header(nullptr), cells(nullptr),
+          num_pushing(0), num_reclaimed(0), num_push_park(0),
+          num_pop_park(0) {
+        if (!memory.open(this->name) || memory.size() < offset()) {
+            return;
+        }
+
+        auto candidate = static_cast<Header*>(memory.data());
+        if (candidate->magic.load(std::memory_order_acquire) != magic
+            || memory.size()
+                   < offset() + (candidate->mask + 1) * sizeof(Cell)) {
+            memory.close();
+            return;
+        }
+
+        // the slot of a dead opener may be taken over
+        long peer = candidate->pids[1].load();
+        long self = platform::process_id();
+        if ((peer != 0 && platform::process_alive(peer))
+            || !candidate->pids[1].compare_exchange_strong(peer, self)) {
+            memory.close();
+            return;
+        }
+
+        header = candidate;
+        cells = reinterpret_cast<Cell*>(
+            static_cast<unsigned char*>(memory.data()) + offset());
+    }
+
+    // the name is kept while the peer is alive, it may still open it
+    ~SharedChannel() {
+        if (header == nullptr) {
+            return;
+        }
+
+        Close();
+        header->pids[role].store(0);
+        long peer = header->pids[1 - role].load();
+        memory.close();
+        if (peer == 0 || !platform::process_alive(peer)) {
+            platform::SharedMemory::unlink(name);
+        }
+    }
+
+    SharedChannel(SharedChannel const&) = delete;
+    SharedChannel(SharedChannel&&) = delete;
+
+    SharedChannel& operator=(SharedChannel const&) = delete;
+    SharedChannel& operator=(SharedChannel&&) = delete;
+
+    // Blocks while full, false once closed.
+    bool Add(T const& value) {
+        if (header == nullptr) {
+            return false;
+        }
+
+        while (!closed()) {
+            uint32_t epoch = header->pops.load(std::memory_order_acquire);
+            if (try_push(value)) {
+                notify(header->pushes, header->readers);
+                return true;
+            }
+
+            park(header->pops, header->writers, epoch, num_push_park,
+                 [&] { return !full(); });
+        }
+        return false;
+    }
+
+    // Blocks while empty, nullopt once closed and drained.
+    std::optional<T> Get() {
+        if (header == nullptr) {
+            return std::nullopt;
+        }
+
+        while (true) {
+            uint32_t epoch = header->pushes.load(std::memory_order_acquire);
+            if (auto value = try_pop()) {
+                notify(header->pops, header->writers);
+                return value;
+            }
+
+            // messages sent before close are still received
+            if (closed()) {
+                if (reclaim()) {
+                    continue;
+                }
+                return std::nullopt;
+            }
+
+            park(header->pushes, header->readers, epoch, num_pop_park,
+                 [&] { return !empty(); });
+        }
+    }
+
+    std::optional<T> TryGet() {
+        if (header == nullptr) {
+            return std::nullopt;
+        }
+
+        auto value = try_pop();
+        if (value.has_value()) {
+            notify(header->pops, header->writers);
+        }
+        return value;
+    }
+
+    SharedChannel& operator<<(T const& value) {
+        Add(value);
+        return *this;
+    }
+
+    SharedChannel& operator>>(std::optional<T>& get) {
+        get = Get();
+        return *this;
+    }
+
+    SharedChannel& operator>>(T& get) {
+        std::optional<T> res = Get();
+        if (res.has_value()) {
+            get = res.value();
+        }
+        return *this;
+    }
+
+    // close both ends, blocked peers return
+    void Close() {
+        if (header == nullptr || header->closed.exchange(1) != 0) {
+            return;
+        }
+
+        header->pushes.fetch_add(1, std::memory_order_release);
+        header->pops.fetch_add(1, std::memory_order_release);
+        platform::futex_wake(header->pushes, true);
+        platform::futex_wake(header->pops, true);
+    }
+
+    bool Runnable() const {
+        return header != nullptr
+               && header->closed.load(std::memory_order_acquire) == 0;
+    }
+
+    bool Readable() const {
+        return header != nullptr && (!closed() || !empty());
+    }
+
+    // false if the shared memory object could not be created or opened
+    bool Attached() const {
+        return header != nullptr;
+    }
+
+    // slots skipped by this end as a dead peer claimed and never filled
+    // them, the messages it was sending there are lost
+    size_t Reclaimed() const {
+        return num_reclaimed.load(std::memory_order_relaxed);
+    }
+
+    // size, pushed and popped are shared by both ends, parks are local
+    QueueStat Stat() const {
+        uint64_t head = 0;
+        uint64_t tail = 0;
+        if (header != nullptr) {
+            head = header->head.load(std::memory_order_relaxed);
+            tail = header->tail.load(std::memory_order_relaxed);
+        }
+        return QueueStat{ static_cast<size_t>(tail - std::min(head, tail)),
+                          static_cast<size_t>(tail),
+                          static_cast<size_t>(head),
+                          num_push_park.load(std::memory_order_relaxed),
+                          num_pop_park.load(std::memory_order_relaxed),
+                          0,
+                          0,
+                          0,
+                          0 };
+    }
+
+    iterator begin() {
+        return iterator(*this, Get());
+    }
+
+    iterator end() {
+        return iterator(*this, std::nullopt);
+    }
+
+private:
+    static constexpr uint32_t magic = 0x53484348;
+
+    // how often a parked end checks whether its peer is alive
+    static constexpr std::chrono::microseconds liveness{ 50'000 };
+
+    // placed at the start of the shared object, the futex words are
+    // bumped on every receive and send
+    struct Header {
+        std::atomic<uint32_t> magic{ 0 };
+        std::atomic<uint32_t> closed{ 0 };
+        uint64_t mask = 0;
+        std::atomic<long> pids[2] = { { 0 }, { 0 } };
+
+        alignas(platform::cache_line) std::atomic<uint64_t> head{ 0 };
+        std::atomic<uint32_t> pops{ 0 };
+        std::atomic<uint32_t> writers{ 0 };
+
+        alignas(platform::cache_line) std::atomic<uint64_t> tail{ 0 };
+        std::atomic<uint32_t> pushes{ 0 };
+        std::atomic<uint32_t> readers{ 0 };
+    };
+
+    struct Cell {
+        std::atomic<uint64_t> seq{ 0 };
+        std::atomic<uint32_t> skip{ 0 };
+        T value;
+    };
+
+    static constexpr size_t offset() {
+        return (sizeof(Header) + platform::cache_line - 1)
+               / platform::cache_line * platform::cache_line;
+    }
+
+    // a push in flight is never reclaimed, see reclaim
+    bool try_push(T const& value) {
+        num_pushing.fetch_add(1);
+        bool pushed = header->closed.load() == 0 && push(value);
+        num_pushing.fetch_sub(1);
+        return pushed;
+    }
+
+    bool push(T const& value) {
+        uint64_t pos = header->tail.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells[pos & header->mask];
+            uint64_t seq = cell.seq.load(std::memory_order_acquire);
+            auto diff = static_cast<int64_t>(seq - pos);
+            if (diff == 0) {
+                if (header->tail.compare_exchange_weak(
+                        pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.value = value;
+                    cell.skip.store(0, std::memory_order_relaxed);
+                    cell.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0) {
+                return false;
+            }
+            else {
+                pos = header->tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    std::optional<T> try_pop() {
+        uint64_t pos = header->head.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells[pos & header->mask];
+            uint64_t seq = cell.seq.load(std::memory_order_acquire);
+            auto diff = static_cast<int64_t>(seq - (pos + 1));
+            if (diff == 0) {
+                if (header->head.compare_exchange_weak(
+                        pos, pos + 1, std::memory_order_relaxed)) {
+                    T value = cell.value;
+                    bool skip = cell.skip.load(std::memory_order_relaxed);
+                    cell.seq.store(pos + header->mask + 1,
+                                   std::memory_order_release);
+                    if (!skip) {
+                        return value;
+                    }
+                    pos = header->head.load(std::memory_order_relaxed);
+                }
+            }
+            else if (diff < 0) {
+                return std::nullopt;
+            }
+            else {
+                pos = header->head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool empty() const {
+        uint64_t pos = header->head.load(std::memory_order_acquire);
+        return cells[pos & header->mask].seq.load(std::memory_order_acquire)
+               != pos + 1;
+    }
+
+    bool full() const {
+        uint64_t pos = header->tail.load(std::memory_order_acquire);
+        return cells[pos & header->mask].seq.load(std::memory_order_acquire)
+               != pos;
+    }
+
+    bool closed() const {
+        return header->closed.load(std::memory_order_acquire) != 0;
+    }
+
+    // bump the epoch, the syscall is skipped without waiters
+    static void notify(std::atomic<uint32_t>& word,
+                       std::atomic<uint32_t>& waiters) {
+        word.fetch_add(1, std::memory_order_release);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiters.load(std::memory_order_relaxed) > 0) {
+            platform::futex_wake(word, true);
+        }
+    }
+
+    // wait for the epoch to move, registered before the last check so a
+    // concurrent notify either sees the waiter or moves the epoch first
+    template <typename F>
+    void park(std::atomic<uint32_t>& word,
+              std::atomic<uint32_t>& waiters,
+              uint32_t epoch,
+              std::atomic<size_t>& parks,
+              F&& ready) {
+        waiters.fetch_add(1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!ready() && !closed()) {
+            parks.fetch_add(1, std::memory_order_relaxed);
+            platform::futex_wait(word, epoch, true, liveness);
+            if (word.load(std::memory_order_acquire) == epoch
+                && !peer_alive()) {
+                Close();
+            }
+        }
+        waiters.fetch_sub(1);
+    }
+
+    // Publish as skipped the slots between head and tail still claimed,
+    // they would hide every message behind them. Once closed by a dead
+    // peer and with no push of this process in flight, so each of them
+    // was claimed by the peer. False if there was none.
+    bool reclaim() {
+        if (peer_alive() || num_pushing.load() > 0) {
+            return false;
+        }
+
+        uint64_t head = header->head.load(std::memory_order_acquire);
+        uint64_t tail = header->tail.load(std::memory_order_acquire);
+        size_t num = 0;
+        for (uint64_t pos = head; pos < tail; ++pos) {
+            Cell& cell = cells[pos & header->mask];
+            uint64_t seq = pos;
+            if (cell.seq.load(std::memory_order_acquire) != seq) {
+                continue;
+            }
+
+            cell.skip.store(1, std::memory_order_relaxed);
+            if (cell.seq.compare_exchange_strong(
+                    seq, pos + 1, std::memory_order_release)) {
+                num += 1;
+            }
+        }
+        num_reclaimed.fetch_add(num, std::memory_order_relaxed);
+        return num > 0;
+    }
+
+    bool peer_alive() const {
+        long peer = header->pids[1 - role].load();
+        return peer == 0 || platform::process_alive(peer);
+    }
+
+    std::string name;
+    int role;
+
+    platform::SharedMemory memory;
+    Header* header;
+    Cell* cells;
+
+    std::atomic<size_t> num_pushing;
+    std::atomic<size_t> num_reclaimed;
+    std::atomic<size_t> num_push_park;
+    std::atomic<size_t> num_pop_park;
+};
+
+#endif
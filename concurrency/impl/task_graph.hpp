@@ -0,0 +1,281 @@
+#ifndef TASK_GRAPH_HPP
+#define TASK_GRAPH_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "blocking.hpp"
+#include "thread_pool.hpp"
+
+// longest chain of the last run, weighted by the node durations
+struct CriticalPath {
+    std::vector<size_t> nodes;
+    std::chrono::nanoseconds length;
+};
+
+// Reusable DAG of tasks run on a ThreadPool<void>. Every node counts its
+// unfinished predecessors, the predecessor finishing last schedules it,
+// so no thread ever blocks on an edge. A finished node runs one ready
+// successor itself and queues the others on the pool.
+//
+// A node that throws skips the nodes not started yet, Run rethrows the
+// exception once the graph is drained. The graph must not be modified or
+// run again while it runs.
+//
+//     TaskGraph graph;
+//     auto load = graph.Add([&] { ... }, "load");
+//     auto parse = graph.Add([&] { ... }, "parse");
+//     graph.Precede(load, parse);
+//     graph.Run(pool);
+class TaskGraph {
+public:
+    TaskGraph()
+        : checked(true), acyclic(true), failed(false), num_runs(0) {
+        // Do Nothing
+    }
+
+    TaskGraph(TaskGraph const&) = delete;
+    TaskGraph(TaskGraph&&) = delete;
+
+    TaskGraph& operator=(TaskGraph const&) = delete;
+    TaskGraph& operator=(TaskGraph&&) = delete;
+
+    // label should outlive the graph, typically a string literal
+    size_t Add(std::function<void()> task, char const* label = nullptr) {
+        nodes.emplace_back(std::move(task), label);
+        return nodes.size() - 1;
+    }
+
+    // `after` starts once `before` has finished
+    void Precede(size_t before, size_t after) {
+        nodes[before].successors.push_back(after);
+        nodes[after].num_deps += 1;
+        checked = false;
+    }
+
+    // Run every node and wait for them, helping the pool meanwhile. False
+    // without running anything if the graph has a cycle.
+    template <typename Pool>
+    bool Run(Pool& pool) {
+        if (!Acyclic()) {
+            return false;
+        }
+        if (nodes.empty()) {
+            return true;
+        }
+
+        auto start = clock::now();
+        pending.Add(nodes.size());
+        failed.store(false, std::memory_order_relaxed);
+        for (auto& node : nodes) {
+            node.remaining.store(node.num_deps, std::memory_order_relaxed);
+        }
+
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            if (nodes[i].num_deps == 0) {
+                pool.Add(nodes[i].label,
+                         [this, &pool, i] { execute(pool, i); });
+            }
+        }
+
+        pending.Wait(pool, this, "task graph");
+        elapsed = clock::now() - start;
+        num_runs += 1;
+
+        std::exception_ptr error;
+        {
+            std::unique_lock lock(mutex);
+            error = std::exchange(first, nullptr);
+        }
+        if (error != nullptr) {
+            std::rethrow_exception(error);
+        }
+        return true;
+    }
+
+    // false if the edges form a cycle
+    bool Acyclic() {
+        if (!checked) {
+            acyclic = order().size() == nodes.size();
+            checked = true;
+        }
+        return acyclic;
+    }
+
+    size_t Size() const {
+        return nodes.size();
+    }
+
+    char const* Label(size_t node) const {
+        return nodes[node].label;
+    }
+
+    // of the last run, zero for skipped nodes
+    std::chrono::nanoseconds Duration(size_t node) const {
+        return nodes[node].duration;
+    }
+
+    // wall clock time of the last run
+    std::chrono::nanoseconds Elapsed() const {
+        return elapsed;
+    }
+
+    // Sum of the node durations of the last run, Work over the critical
+    // path length bounds the speedup any number of workers may give.
+    std::chrono::nanoseconds Work() const {
+        std::chrono::nanoseconds work(0);
+        for (auto const& node : nodes) {
+            work += node.duration;
+        }
+        return work;
+    }
+
+    CriticalPath Critical() {
+        CriticalPath path{ {}, std::chrono::nanoseconds(0) };
+        if (!Acyclic() || nodes.empty()) {
+            return path;
+        }
+
+        // longest finish of each node along its chain of predecessors
+        std::vector<std::chrono::nanoseconds> finish(nodes.size());
+        std::vector<size_t> prev(nodes.size(), nodes.size());
+        for (size_t i : order()) {
+            finish[i] += nodes[i].duration;
+            for (size_t next : nodes[i].successors) {
+                if (prev[next] == nodes.size() || finish[i] > finish[next]) {
+                    finish[next] = finish[i];
+                    prev[next] = i;
+                }
+            }
+        }
+
+        size_t last = static_cast<size_t>(
+            std::max_element(finish.begin(), finish.end()) - finish.begin());
+        path.length = finish[last];
+        for (size_t i = last; i != nodes.size(); i = prev[i]) {
+            path.nodes.push_back(i);
+        }
+        std::reverse(path.nodes.begin(), path.nodes.end());
+        return path;
+    }
+
+    size_t Runs() const {
+        return num_runs;
+    }
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    struct Node {
+        Node(std::function<void()> task, char const* label)
+            : task(std::move(task)), label(label), num_deps(0),
+              remaining(0), duration(0) {
+            // Do Nothing
+        }
+
+        std::function<void()> task;
+        char const* label;
+        std::vector<size_t> successors;
+        size_t num_deps;
+        std::atomic<size_t> remaining;
+        std::chrono::nanoseconds duration;
+    };
+
+    template <typename Pool>
+    void execute(Pool& pool, size_t idx) {
+        while (true) {
+            Node& node = nodes[idx];
+            node.duration = std::chrono::nanoseconds(0);
+            if (!failed.load(std::memory_order_relaxed)) {
+                auto start = clock::now();
+                try {
+                    node.task();
+                }
+                catch (...) {
+                    fail(std::current_exception());
+                }
+                node.duration = clock::now() - start;
+            }
+
+            // skipped nodes release their successors all the same
+            size_t next = nodes.size();
+            for (size_t succ : node.successors) {
+                if (nodes[succ].remaining.fetch_sub(
+                        1, std::memory_order_acq_rel)
+                    != 1) {
+                    continue;
+                }
+
+                if (next == nodes.size()) {
+                    next = succ;
+                }
+                else {
+                    pool.Add(nodes[succ].label,
+                             [this, &pool, succ] { execute(pool, succ); });
+                }
+            }
+
+            // the graph may be gone as soon as the count drops to zero,
+            // which a ready successor holds off, nothing of it is read
+            // after the last decrement
+            bool done = next == nodes.size();
+            pending.Done();
+            if (done) {
+                return;
+            }
+            idx = next;
+        }
+    }
+
+    void fail(std::exception_ptr error) {
+        std::unique_lock lock(mutex);
+        if (first == nullptr) {
+            first = std::move(error);
+        }
+        failed.store(true, std::memory_order_relaxed);
+    }
+
+    // topological order, shorter than the graph if it has a cycle
+    std::vector<size_t> order() const {
+        std::vector<size_t> deps(nodes.size());
+        std::vector<size_t> sorted;
+        sorted.reserve(nodes.size());
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            deps[i] = nodes[i].num_deps;
+            if (deps[i] == 0) {
+                sorted.push_back(i);
+            }
+        }
+
+        for (size_t pos = 0; pos < sorted.size(); ++pos) {
+            for (size_t next : nodes[sorted[pos]].successors) {
+                if (--deps[next] == 0) {
+                    sorted.push_back(next);
+                }
+            }
+        }
+        return sorted;
+    }
+
+    std::deque<Node> nodes;
+    bool checked;
+    bool acyclic;
+
+    JoinCount pending;
+    std::atomic<bool> failed;
+    std::mutex mutex;
+    std::exception_ptr first;
+
+    std::chrono::nanoseconds elapsed{ 0 };
+    size_t num_runs;
+};
+
+#endif
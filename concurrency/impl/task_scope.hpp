@@ -0,0 +1,142 @@
+#ifndef TASK_SCOPE_HPP
+#define TASK_SCOPE_HPP
+
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <utility>
+
+#include "blocking.hpp"
+#include "thread_pool.hpp"
+
+// Structured fan out over a ThreadPool<void>, children never outlive the
+// scope. The first child to throw cancels the scope, children still
+// queued are then skipped, and the exception is rethrown by Join or by
+// the destructor. Running children may poll Cancelled to stop early.
+//
+// Joining runs queued pool tasks on the joining thread, so scopes nested
+// inside children keep every worker busy instead of parking them.
+//
+//     TaskScope scope(pool);
+//     for (auto const& part : parts) {
+//         scope.Spawn([&] { process(part); });
+//     }
+//     scope.Join();
+template <typename Pool>
+class TaskScope {
+public:
+    TaskScope(Pool& pool)
+        : pool(pool), cancelled(false), num_skipped(0),
+          uncaught(std::uncaught_exceptions()) {
+        // Do Nothing
+    }
+
+    // joins, rethrows unless the scope is left by an exception
+    ~TaskScope() noexcept(false) {
+        wait();
+        if (std::uncaught_exceptions() == uncaught) {
+            rethrow();
+        }
+    }
+
+    TaskScope(TaskScope const&) = delete;
+    TaskScope(TaskScope&&) = delete;
+
+    TaskScope& operator=(TaskScope const&) = delete;
+    TaskScope& operator=(TaskScope&&) = delete;
+
+    // children may spawn siblings into the scope
+    template <typename F>
+    void Spawn(F&& task) {
+        Spawn(nullptr, std::forward<F>(task));
+    }
+
+    template <typename F>
+    void Spawn(char const* label, F&& task) {
+        if (Cancelled()) {
+            num_skipped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        pending.Add();
+        pool.Add(label, [this, task = std::forward<F>(task)]() mutable {
+            run(task);
+        });
+    }
+
+    // wait for every child, rethrow the first exception
+    void Join() {
+        wait();
+        rethrow();
+    }
+
+    // skip children not started yet
+    void Cancel() {
+        cancelled.store(true, std::memory_order_release);
+    }
+
+    bool Cancelled() const {
+        return cancelled.load(std::memory_order_acquire);
+    }
+
+    // children spawned or queued after the scope was cancelled
+    size_t Skipped() const {
+        return num_skipped.load(std::memory_order_relaxed);
+    }
+
+private:
+    template <typename F>
+    void run(F& task) {
+        if (Cancelled()) {
+            num_skipped.fetch_add(1, std::memory_order_relaxed);
+        }
+        else {
+            try {
+                task();
+            }
+            catch (...) {
+                fail(std::current_exception());
+            }
+        }
+
+        BlockingRegistry::Instance().Progress();
+        // the scope may be gone as soon as the count drops
+        pending.Done();
+    }
+
+    void fail(std::exception_ptr error) {
+        {
+            std::unique_lock lock(mutex);
+            if (first == nullptr) {
+                first = std::move(error);
+            }
+        }
+        Cancel();
+    }
+
+    void wait() {
+        pending.Wait(pool, this, "task scope");
+    }
+
+    void rethrow() {
+        std::exception_ptr error;
+        {
+            std::unique_lock lock(mutex);
+            error = std::exchange(first, nullptr);
+        }
+        if (error != nullptr) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    Pool& pool;
+    JoinCount pending;
+    std::atomic<bool> cancelled;
+    std::atomic<size_t> num_skipped;
+    int uncaught;
+
+    std::mutex mutex;
+    std::exception_ptr first;
+};
+
+#endif
@@ -1,9 +1,50 @@
 #ifndef THREAD_POOL_HPP
 #define THREAD_POOL_HPP
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <future>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
+#include "blocking.hpp"
 #include "channel.hpp"
+#include "histogram.hpp"
+#include "platform/signal.hpp"
+#include "platform/thread.hpp"
+
+struct WorkerSnapshot {
+    size_t id;
+    WorkerState state;
+    char const* label;
+    std::chrono::nanoseconds elapsed;
+};
+
+struct PoolSnapshot {
+    std::vector<WorkerSnapshot> workers;
+    size_t queue_depth;
+    size_t executed;
+    size_t parks;
+    size_t spurious_wakeups;
+};
+
+struct TaskStat {
+    Histogram queue_wait;
+    Histogram wall_time;
+    Histogram cpu_time;
+
+    void Merge(TaskStat const& other) {
+        queue_wait.Merge(other.queue_wait);
+        wall_time.Merge(other.wall_time);
+        cpu_time.Merge(other.cpu_time);
+    }
+};
 
 template <typename T,
           template <typename> class ChannelType = RChannel>
@@ -15,19 +56,14 @@ public:
 
     template <typename... Args>
     ThreadPool(size_t num_threads, Args&&... args)
-        : runnable(true), num_threads(num_threads),
+        : runnable(true), num_threads(num_threads), pool_id(++num_pools),
+          signal_id(0), accounting(false),
           channel(std::forward<Args>(args)...),
+          workers(std::make_unique<WorkerStatus[]>(num_threads)),
+          accounts(std::make_unique<Account[]>(num_threads)),
           threads(std::make_unique<std::thread[]>(num_threads)) {
         for (size_t i = 0; i < num_threads; ++i) {
-            threads[i] = std::thread([this] {
-                while (runnable) {
-                    auto given = channel.Get();
-                    if (!given.has_value()) {
-                        break;
-                    }
-                    given.value()();
-                }
-            });
+            threads[i] = std::thread([this, i] { Run(i); });
         }
     }
 
@@ -43,17 +79,135 @@ public:
 
     template <typename F>
     std::future<T> Add(F&& task) {
+        return Add(nullptr, std::forward<F>(task));
+    }
+
+    // label should outlive the task, typically a string literal
+    template <typename F>
+    std::future<T> Add(char const* label, F&& task) {
         std::packaged_task<T()> ptask(std::forward<F>(task));
         std::future<T> fut = ptask.get_future();
-        channel.Add(std::move(ptask));
+
+        WorkerStatus::clock::rep submitted = 0;
+        if (accounting.load(std::memory_order_relaxed)) {
+            submitted = WorkerStatus::clock::now().time_since_epoch().count();
+        }
+        channel.Add(Task{ std::move(ptask), label, submitted });
         return fut;
     }
 
+    // Run one queued task on the calling thread, false if none is queued.
+    // Threads waiting for pool tasks help with the queue instead, so
+    // waits nested inside tasks never leave the workers idle.
+    bool RunPending() {
+        auto given = channel.TryGet();
+        if (!given.has_value()) {
+            return false;
+        }
+
+        // accounted to the helping worker, the first for other threads
+        size_t idx = 0;
+        WorkerStatus* status = WorkerStatus::current();
+        if (status >= workers.get() && status < workers.get() + num_threads) {
+            idx = static_cast<size_t>(status - workers.get());
+        }
+        Execute(idx, given.value());
+        return true;
+    }
+
+    // Record queue wait, wall clock and thread cpu time of each task,
+    // aggregated per label. Queue wait growing while wall time stays
+    // flat means the pool is undersized, otherwise the tasks are slow.
+    void EnableAccounting(bool enable = true) {
+        accounting.store(enable, std::memory_order_relaxed);
+    }
+
+    std::map<std::string, TaskStat> Accounting() const {
+        std::map<std::string, TaskStat> merged;
+        for (size_t i = 0; i < num_threads; ++i) {
+            std::unique_lock lock(accounts[i].mutex);
+            for (auto const& [label, stat] : accounts[i].stats) {
+                merged[label != nullptr ? label : "(unnamed)"].Merge(*stat);
+            }
+        }
+        return merged;
+    }
+
     size_t GetNumThreads() const {
         return num_threads;
     }
 
+    // tasks waiting for a worker
+    size_t Queued() const {
+        return channel.Stat().size;
+    }
+
+    PoolSnapshot Snapshot() const {
+        auto now = WorkerStatus::clock::now().time_since_epoch().count();
+        auto stat = channel.Stat();
+
+        PoolSnapshot snapshot{
+            {}, stat.size, 0, stat.pop_parks, stat.spurious_wakeups
+        };
+        snapshot.workers.reserve(num_threads);
+
+        for (size_t i = 0; i < num_threads; ++i) {
+            WorkerStatus const& status = workers[i];
+            WorkerState state = status.state.load(std::memory_order_acquire);
+
+            WorkerSnapshot worker{ i, state, nullptr, {} };
+            if (state != WorkerState::Idle) {
+                worker.label = status.label.load(std::memory_order_relaxed);
+                worker.elapsed = WorkerStatus::clock::duration(
+                    now - status.since.load(std::memory_order_relaxed));
+            }
+            snapshot.workers.push_back(worker);
+            snapshot.executed
+                += status.executed.load(std::memory_order_relaxed);
+        }
+        return snapshot;
+    }
+
+    void Dump(std::ostream& os) const {
+        using ms = std::chrono::milliseconds;
+        PoolSnapshot snapshot = Snapshot();
+
+        os << "pool " << pool_id << ": " << num_threads << " workers, "
+           << "queue depth " << snapshot.queue_depth << ", executed "
+           << snapshot.executed << ", parks " << snapshot.parks
+           << ", spurious wakeups " << snapshot.spurious_wakeups << '\n';
+
+        for (auto const& worker : snapshot.workers) {
+            os << "worker " << worker.id << " [" << to_string(worker.state);
+            if (worker.state != WorkerState::Idle) {
+                os << ", "
+                   << std::chrono::duration_cast<ms>(worker.elapsed).count()
+                   << "ms]: "
+                   << (worker.label != nullptr ? worker.label : "(unnamed)");
+            }
+            else {
+                os << ']';
+            }
+            os << '\n';
+        }
+        os.flush();
+    }
+
+    // Dump snapshot to stderr whenever the process receives `signo`,
+    // eg. `kill -USR1 <pid>` like goroutine dump of golang.
+    void DumpOnSignal(int signo = platform::dump_signal) {
+        if (signal_id == 0) {
+            signal_id = platform::SignalWatcher::instance().attach(
+                signo, [this] { Dump(std::cerr); });
+        }
+    }
+
     void Stop() {
+        if (signal_id != 0) {
+            platform::SignalWatcher::instance().detach(signal_id);
+            signal_id = 0;
+        }
+
         if (threads != nullptr) {
             runnable = false;
             channel.Close();
@@ -68,14 +222,168 @@ public:
     }
 
 private:
+    struct Task {
+        std::packaged_task<T()> run;
+        char const* label = nullptr;
+        WorkerStatus::clock::rep submitted = 0;
+    };
+
+    struct Account {
+        std::mutex mutex;
+        std::unordered_map<char const*, std::unique_ptr<TaskStat>> stats;
+
+        TaskStat& operator[](char const* label) {
+            std::unique_lock lock(mutex);
+            auto& stat = stats[label];
+            if (stat == nullptr) {
+                stat = std::make_unique<TaskStat>();
+            }
+            return *stat;
+        }
+    };
+
+    void Execute(size_t idx, Task& task) {
+        using clock = WorkerStatus::clock;
+        if (!accounting.load(std::memory_order_relaxed)) {
+            task.run();
+            return;
+        }
+
+        clock::time_point start = clock::now();
+        std::chrono::nanoseconds cpu_start = platform::thread_cpu_time();
+
+        task.run();
+
+        std::chrono::nanoseconds cpu_end = platform::thread_cpu_time();
+        clock::time_point end = clock::now();
+
+        TaskStat& stat = accounts[idx][task.label];
+        if (task.submitted != 0) {
+            clock::time_point submitted{ clock::duration(task.submitted) };
+            stat.queue_wait.Record(start - submitted);
+        }
+        stat.wall_time.Record(end - start);
+        stat.cpu_time.Record(cpu_end - cpu_start);
+    }
+
+    void Run(size_t idx) {
+        WorkerStatus& status = workers[idx];
+        WorkerStatus::current() = &status;
+
+        std::string name =
+            "pool" + std::to_string(pool_id) + "-w" + std::to_string(idx);
+        platform::set_thread_name(name.c_str());
+        BlockingRegistry::Instance().Describe(name, true);
+
+        while (runnable) {
+            auto given = channel.Get();
+            if (!given.has_value()) {
+                break;
+            }
+
+            status.start(given->label);
+            Execute(idx, given.value());
+            status.finish();
+        }
+        WorkerStatus::current() = nullptr;
+    }
+
+    inline static std::atomic<size_t> num_pools = 0;
+
     bool runnable;
     size_t num_threads;
+    size_t pool_id;
+    size_t signal_id;
+    std::atomic<bool> accounting;
 
-    ChannelType<std::packaged_task<T()>> channel;
+    ChannelType<Task> channel;
+    std::unique_ptr<WorkerStatus[]> workers;
+    std::unique_ptr<Account[]> accounts;
     std::unique_ptr<std::thread[]> threads;
 };
 
 template <typename T>
 using LThreadPool = ThreadPool<T, LChannel>;
 
-#endif
\ No newline at end of file
+// Unfinished children of a TaskScope or TaskGraph, joined by a thread
+// which helps the pool meanwhile. With nothing queued the joiner yields
+// a few times, then parks until the last child is done, looking at the
+// queue every millisecond as a try_pop may miss a task. Children count
+// down without locking, the last one wakes the joiner under the lock,
+// which the joiner takes before returning, so the owner may be gone
+// once the last Done returns.
+class JoinCount {
+public:
+    JoinCount() : count(0) {
+        // Do Nothing
+    }
+
+    JoinCount(JoinCount const&) = delete;
+    JoinCount(JoinCount&&) = delete;
+
+    JoinCount& operator=(JoinCount const&) = delete;
+    JoinCount& operator=(JoinCount&&) = delete;
+
+    void Add(size_t num = 1) {
+        count.fetch_add(num, std::memory_order_relaxed);
+    }
+
+    void Done() {
+        size_t now = count.load(std::memory_order_relaxed);
+        while (now > 1
+               && !count.compare_exchange_weak(now, now - 1,
+                                               std::memory_order_release,
+                                               std::memory_order_relaxed)) {
+            // Do Nothing
+        }
+        if (now > 1) {
+            return;
+        }
+
+        // children may have added siblings meanwhile
+        std::unique_lock lock(mutex);
+        if (count.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            cond.notify_all();
+        }
+    }
+
+    template <typename Pool>
+    void Wait(Pool& pool, void const* object, char const* kind) {
+        size_t idle = 0;
+        while (count.load(std::memory_order_acquire) > 0) {
+            if (pool.RunPending()) {
+                idle = 0;
+            }
+            else if (++idle < 16) {
+                std::this_thread::yield();
+            }
+            else {
+                park(pool, object, kind);
+                idle = 0;
+            }
+        }
+
+        // the last Done may still hold the lock
+        std::unique_lock lock(mutex);
+    }
+
+private:
+    template <typename Pool>
+    void park(Pool& pool, void const* object, char const* kind) {
+        BlockingScope scope(object, kind);
+        std::unique_lock lock(mutex);
+        while (count.load(std::memory_order_acquire) > 0) {
+            if (cond.wait_for(lock, std::chrono::milliseconds(1))
+                    == std::cv_status::timeout
+                && pool.Queued() > 0) {
+                return;
+            }
+        }
+    }
+
+    std::atomic<size_t> count;
+    std::mutex mutex;
+    std::condition_variable cond;
+};
+
+#endif
@@ -4,34 +4,50 @@
 #include <atomic>
 #include <thread>
 
+#include "blocking.hpp"
+
 using ull = unsigned long long;
 
 class WaitGroup {
 public:
-    WaitGroup() : visit(0) {
+    WaitGroup() : visit(0), waiters(0) {
         // Do Nothing
     }
 
-    WaitGroup(ull visit) : visit(visit) {
+    WaitGroup(ull visit) : visit(visit), waiters(0) {
         // Do Nothing
     }
 
     ull Add() {
+        BlockingRegistry::Instance().Progress();
         return (visit += 1);
     }
 
     ull Done() {
+        BlockingRegistry::Instance().Progress();
         return (visit -= 1);
     }
 
     void Wait() {
+        BlockingScope scope(this, "wait group");
+        waiters += 1;
         while (visit > 0) {
             std::this_thread::yield();
         }
+        waiters -= 1;
+    }
+
+    ull Count() const {
+        return visit.load(std::memory_order_relaxed);
+    }
+
+    ull Waiters() const {
+        return waiters.load(std::memory_order_relaxed);
     }
 
 private:
     std::atomic<ull> visit;
+    std::atomic<ull> waiters;
 };
 
-#endif
\ No newline at end of file
+#endif
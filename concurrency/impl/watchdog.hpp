@@ -0,0 +1,205 @@
+#ifndef WATCHDOG_HPP
+#define WATCHDOG_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "blocking.hpp"
+
+// Opt-in deadlock detector, like "all goroutines are asleep" of golang.
+// While alive it tracks threads blocked on channels and wait groups,
+// and reports the wait graph once every tracked thread has been blocked
+// without any channel or wait group progress for `threshold`.
+// At least one thread must wait outside an idle pool worker loop, so
+// an idle pool alone is not a deadlock. Threads which never touch a
+// tracked primitive are invisible, so keep the threshold generous. The
+// graph is printed to stderr, pass Abort to end the process as well.
+class Watchdog {
+public:
+    using Reporter = std::function<void(std::string const&)>;
+
+    static void Print(std::string const& graph) {
+        std::cerr << graph << std::flush;
+    }
+
+    static void Abort(std::string const& graph) {
+        Print(graph);
+        std::abort();
+    }
+
+    template <typename Rep, typename Period>
+    Watchdog(std::chrono::duration<Rep, Period> threshold,
+             Reporter reporter = Print)
+        : threshold(std::chrono::duration_cast<clock::duration>(threshold)),
+          reporter(std::move(reporter)), runnable(true), stalled(false),
+          reported(false), stall_epoch(0) {
+        BlockingRegistry::Instance().Enable(true);
+
+        auto period = this->threshold / 4;
+        if (period < std::chrono::milliseconds(1)) {
+            period = std::chrono::milliseconds(1);
+        }
+
+        monitor = std::thread([this, period] {
+            std::unique_lock lock(mutex);
+            while (runnable) {
+                cond.wait_for(lock, period, [this] { return !runnable; });
+                if (!runnable) {
+                    break;
+                }
+
+                lock.unlock();
+                if (auto graph = Check()) {
+                    this->reporter(graph.value());
+                }
+                lock.lock();
+            }
+        });
+    }
+
+    ~Watchdog() {
+        {
+            std::unique_lock lock(mutex);
+            runnable = false;
+        }
+        cond.notify_all();
+        monitor.join();
+
+        BlockingRegistry::Instance().Enable(false);
+    }
+
+    Watchdog(Watchdog const&) = delete;
+    Watchdog(Watchdog&&) = delete;
+
+    Watchdog& operator=(Watchdog const&) = delete;
+    Watchdog& operator=(Watchdog&&) = delete;
+
+    // label an object in the wait graph, eg. Name(&channel, "jobs")
+    static void Name(void const* object, std::string name) {
+        BlockingRegistry::Instance().Name(object, std::move(name));
+    }
+
+    static void Unname(void const* object) {
+        BlockingRegistry::Instance().Unname(object);
+    }
+
+    // wait graph if the process has been stuck longer than threshold,
+    // reported once per stall
+    std::optional<std::string> Check() {
+        BlockingRegistry& registry = BlockingRegistry::Instance();
+        size_t epoch = registry.Epoch();
+
+        std::vector<Waiter> waiters;
+        bool all_blocked = true;
+        bool any_waiting = false;
+
+        registry.ForEach([&](ThreadRecord const& record) {
+            void const* object =
+                record.object.load(std::memory_order_acquire);
+            if (object == nullptr) {
+                all_blocked = false;
+                return;
+            }
+
+            bool idle = record.idle.load(std::memory_order_relaxed);
+            any_waiting = any_waiting || !idle;
+            waiters.push_back(
+                Waiter{ object,
+                        record.kind.load(std::memory_order_relaxed),
+                        record.name,
+                        idle,
+                        record.since.load(std::memory_order_relaxed) });
+        });
+
+        auto now = clock::now();
+        if (!all_blocked || !any_waiting || epoch != registry.Epoch()) {
+            stalled = false;
+            reported = false;
+            return std::nullopt;
+        }
+
+        if (!stalled || epoch != stall_epoch) {
+            stalled = true;
+            reported = false;
+            stall_epoch = epoch;
+            stall_start = now;
+            return std::nullopt;
+        }
+
+        if (reported || now - stall_start < threshold) {
+            return std::nullopt;
+        }
+        reported = true;
+        return Graph(waiters, now);
+    }
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    struct Waiter {
+        void const* object;
+        char const* kind;
+        std::string thread;
+        bool idle;
+        clock::rep since;
+    };
+
+    static std::string Graph(std::vector<Waiter> const& waiters,
+                             clock::time_point now) {
+        using ms = std::chrono::milliseconds;
+
+        std::map<void const*, std::vector<Waiter const*>> graph;
+        for (auto const& waiter : waiters) {
+            graph[waiter.object].push_back(&waiter);
+        }
+
+        std::ostringstream stream;
+        stream << "all threads are asleep - deadlock!\n";
+        for (auto const& [object, edges] : graph) {
+            stream << '\n' << object;
+
+            std::string name = BlockingRegistry::Instance().NameOf(object);
+            if (!name.empty()) {
+                stream << " (" << name << ')';
+            }
+            stream << '\n';
+
+            for (auto const* waiter : edges) {
+                auto blocked =
+                    now - clock::time_point(clock::duration(waiter->since));
+                stream << "    " << waiter->thread << " [" << waiter->kind
+                       << ", "
+                       << std::chrono::duration_cast<ms>(blocked).count()
+                       << "ms" << (waiter->idle ? ", idle worker" : "")
+                       << "]\n";
+            }
+        }
+        return stream.str();
+    }
+
+    clock::duration threshold;
+    Reporter reporter;
+
+    bool runnable;
+    std::mutex mutex;
+    std::condition_variable cond;
+
+    bool stalled;
+    bool reported;
+    size_t stall_epoch;
+    clock::time_point stall_start;
+
+    std::thread monitor;
+};
+
+#endif
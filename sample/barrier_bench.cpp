@@ -0,0 +1,60 @@
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "../concurrency.hpp"
+
+namespace chrono = std::chrono;
+
+template <typename F>
+void bench(char const* name,
+           size_t num_threads,
+           size_t num_phases,
+           F&& step) {
+    auto start = chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < num_threads; ++i) {
+        threads.emplace_back([&, i] {
+            for (size_t phase = 0; phase < num_phases; ++phase) {
+                step(i, phase);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    auto end = chrono::steady_clock::now();
+
+    auto elapsed = chrono::duration_cast<chrono::nanoseconds>(end - start);
+    std::cout << name << " " << num_threads << " threads: "
+              << elapsed.count() / num_phases << " ns/phase\n";
+}
+
+int main() {
+    constexpr size_t num_phases = 2'000;
+
+    for (size_t num_threads : { 2, 8, 32 }) {
+        Barrier barrier(num_threads);
+        bench("barrier", num_threads, num_phases, [&](size_t, size_t) {
+            barrier.ArriveAndWait();
+        });
+
+        Phaser phaser(num_threads);
+        bench("phaser", num_threads, num_phases, [&](size_t, size_t) {
+            phaser.ArriveAndAwait();
+        });
+
+        // wait groups are not reusable, one per phase
+        std::vector<std::unique_ptr<WaitGroup>> groups(num_phases);
+        for (auto& group : groups) {
+            group = std::make_unique<WaitGroup>(num_threads);
+        }
+        bench("wait group", num_threads, num_phases, [&](size_t, size_t i) {
+            groups[i]->Done();
+            groups[i]->Wait();
+        });
+    }
+    return 0;
+}
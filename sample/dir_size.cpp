@@ -58,6 +58,29 @@ ull par_sizeof_dir(fs::path const& path) {
     return res;
 }
 
+ull scope_sizeof_dir(fs::path const& path) {
+    std::atomic<ull> size = 0;
+    LThreadPool<void> pool;
+
+    using Scope = TaskScope<LThreadPool<void>>;
+    std::function<void(Scope&, fs::path const&)> par =
+        [&](Scope& scope, fs::path const& path) {
+            for (auto const& dir : fs::directory_iterator(path)) {
+                if (dir.is_regular_file()) {
+                    size += dir.file_size();
+                }
+                else if (dir.is_directory()) {
+                    scope.Spawn([&, path = dir.path()] { par(scope, path); });
+                }
+            }
+        };
+
+    TaskScope scope(pool);
+    par(scope, path);
+    scope.Join();
+    return size;
+}
+
 template <typename T, typename F, typename... Args>
 auto perf(F&& func, Args&&... args) {
     auto start = chrono::steady_clock::now();
@@ -80,7 +103,7 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
-    for (auto const& f : { sizeof_dir, par_sizeof_dir }) {
+    for (auto const& f : { sizeof_dir, par_sizeof_dir, scope_sizeof_dir }) {
         auto [res, dur] = perf<chrono::nanoseconds>(f, path);
         std::cout << "size: " << res << " / time: " << dur.count() << "ns\n";
     }
@@ -0,0 +1,119 @@
+#include <chrono>
+#include <iostream>
+
+#include "../concurrency.hpp"
+
+namespace chrono = std::chrono;
+
+struct Adjacent {
+    std::atomic<size_t> producer{ 0 };
+    std::atomic<size_t> consumer{ 0 };
+};
+
+struct Padded {
+    alignas(platform::cache_line) std::atomic<size_t> producer{ 0 };
+    alignas(platform::cache_line) std::atomic<size_t> consumer{ 0 };
+};
+
+template <typename F>
+auto perf(F&& func) {
+    auto start = chrono::steady_clock::now();
+    func();
+    auto end = chrono::steady_clock::now();
+
+    return chrono::duration_cast<chrono::milliseconds>(end - start);
+}
+
+template <typename Counters>
+auto counters(size_t num_iter) {
+    Counters counters;
+    return perf([&] {
+        auto producer = std::async(std::launch::async, [&] {
+            for (size_t i = 0; i < num_iter; ++i) {
+                counters.producer.fetch_add(1, std::memory_order_relaxed);
+            }
+        });
+        for (size_t i = 0; i < num_iter; ++i) {
+            counters.consumer.fetch_add(1, std::memory_order_relaxed);
+        }
+        producer.wait();
+    });
+}
+
+template <typename Channel>
+auto channels(size_t num_pairs, size_t num_iter) {
+    auto buffer = std::make_unique<Channel[]>(num_pairs);
+    return perf([&] {
+        std::vector<std::future<void>> futs;
+        for (size_t i = 0; i < num_pairs; ++i) {
+            futs.emplace_back(std::async(std::launch::async, [&, i] {
+                for (size_t j = 0; j < num_iter; ++j) {
+                    buffer[i].Add(static_cast<int>(j));
+                }
+            }));
+            futs.emplace_back(std::async(std::launch::async, [&, i] {
+                for (size_t j = 0; j < num_iter; ++j) {
+                    buffer[i].Get();
+                }
+            }));
+        }
+        for (auto& fut : futs) {
+            fut.wait();
+        }
+    });
+}
+
+// one producer and one consumer on the head and tail of one list
+template <typename List>
+auto lists(size_t num_iter) {
+    List list;
+    return perf([&] {
+        std::atomic<bool> done(false);
+        auto producer = std::async(std::launch::async, [&] {
+            for (size_t i = 0; i < num_iter; ++i) {
+                list.push_back(i);
+            }
+            done = true;
+        });
+        while (!done.load()) {
+            list.try_pop();
+        }
+        producer.wait();
+        while (list.try_pop()) {
+            // drain
+        }
+    });
+}
+
+int main() {
+    constexpr size_t num_iter = 50'000'000;
+    std::cout << "cache line: " << platform::cache_line << " bytes\n";
+
+    std::cout << "adjacent counters: " << counters<Adjacent>(num_iter).count()
+              << "ms\n";
+    std::cout << "padded counters: " << counters<Padded>(num_iter).count()
+              << "ms\n";
+
+    using PackedList = LockFree::List<size_t, false>;
+    using PaddedList = LockFree::List<size_t>;
+    std::cout << "sizeof(packed list): " << sizeof(PackedList)
+              << " bytes, sizeof(padded list): " << sizeof(PaddedList)
+              << " bytes\n";
+    std::cout << "packed list: " << lists<PackedList>(2'000'000).count()
+              << "ms\n";
+    std::cout << "padded list: " << lists<PaddedList>(2'000'000).count()
+              << "ms\n";
+
+    using PackedChannel =
+        Channel<ThreadSafe<StaticRingBuffer<int, 8>, std::mutex, false>>;
+    using PaddedChannel = StaticRChannel<int, 8>;
+    std::cout << "sizeof(packed channel): " << sizeof(PackedChannel)
+              << " bytes, sizeof(padded channel): " << sizeof(PaddedChannel)
+              << " bytes\n";
+    std::cout << "4 packed channel pairs: "
+              << channels<PackedChannel>(4, 200'000).count() << "ms\n";
+    std::cout << "4 padded channel pairs: "
+              << channels<PaddedChannel>(4, 200'000).count() << "ms\n";
+
+    return 0;
+}
@@ -0,0 +1,84 @@
+#include <chrono>
+#include <future>
+#include <iostream>
+#include <vector>
+
+#include "../concurrency.hpp"
+
+namespace chrono = std::chrono;
+
+// layers of `width` empty nodes, each depending on two nodes above
+void bench_graph(LThreadPool<void>& pool,
+                 size_t num_layers,
+                 size_t width,
+                 size_t num_runs) {
+    TaskGraph graph;
+    std::vector<size_t> above;
+    for (size_t layer = 0; layer < num_layers; ++layer) {
+        std::vector<size_t> current;
+        for (size_t i = 0; i < width; ++i) {
+            size_t node = graph.Add([] {});
+            if (!above.empty()) {
+                graph.Precede(above[i], node);
+                graph.Precede(above[(i + 1) % width], node);
+            }
+            current.push_back(node);
+        }
+        above = std::move(current);
+    }
+
+    auto start = chrono::steady_clock::now();
+    for (size_t run = 0; run < num_runs; ++run) {
+        graph.Run(pool);
+    }
+    auto end = chrono::steady_clock::now();
+
+    auto elapsed = chrono::duration_cast<chrono::nanoseconds>(end - start);
+    std::cout << "graph " << num_layers << "x" << width << ": "
+              << elapsed.count() / (num_runs * graph.Size()) << " ns/node\n";
+}
+
+// the same graph chained with futures, a thread blocks on every edge
+void bench_futures(LThreadPool<void>& pool,
+                   size_t num_layers,
+                   size_t width,
+                   size_t num_runs) {
+    auto start = chrono::steady_clock::now();
+    for (size_t run = 0; run < num_runs; ++run) {
+        std::vector<std::shared_future<void>> above;
+        for (size_t layer = 0; layer < num_layers; ++layer) {
+            std::vector<std::shared_future<void>> current;
+            for (size_t i = 0; i < width; ++i) {
+                if (above.empty()) {
+                    current.push_back(pool.Add([] {}).share());
+                    continue;
+                }
+
+                auto left = above[i];
+                auto right = above[(i + 1) % width];
+                current.push_back(std::async(std::launch::async, [=] {
+                                      left.get();
+                                      right.get();
+                                  }).share());
+            }
+            above = std::move(current);
+        }
+        for (auto& fut : above) {
+            fut.get();
+        }
+    }
+    auto end = chrono::steady_clock::now();
+
+    auto elapsed = chrono::duration_cast<chrono::nanoseconds>(end - start);
+    std::cout << "futures " << num_layers << "x" << width << ": "
+              << elapsed.count() / (num_runs * num_layers * width)
+              << " ns/node\n";
+}
+
+int main() {
+    LThreadPool<void> pool;
+    bench_graph(pool, 100, 64, 50);
+    bench_graph(pool, 1000, 1, 500);
+    bench_futures(pool, 100, 64, 2);
+    return 0;
+}
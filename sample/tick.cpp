@@ -5,14 +5,14 @@
 using namespace std::literals;
 
 LThreadPool<void> global_pool;
-inline auto sleep = [](auto dur) { std::this_thread::sleep_for(dur); };
+inline auto sleep_for = [](auto dur) { std::this_thread::sleep_for(dur); };
 
 template <typename T>
 auto Tick(T dur, LThreadPool<void>& pool = global_pool) {
     auto tick = std::make_unique<LChannel<int>>();;
     pool.Add([tick = tick.get()]{
         while (tick->Runnable()) {
-            sleep(100ms);
+            sleep_for(100ms);
             tick->Add(0);
         }
     });
@@ -22,7 +22,7 @@ auto Tick(T dur, LThreadPool<void>& pool = global_pool) {
 template <typename T>
 auto After(T dur, LThreadPool<void>& pool = global_pool) {
     auto after = std::make_unique<LChannel<int>>();
-    pool.Add([=, after = after.get()]{ sleep(dur); after->Add(0); });
+    pool.Add([=, after = after.get()]{ sleep_for(dur); after->Add(0); });
     return std::move(after);
 }
 
@@ -42,7 +42,7 @@ int main() {
             },
             default_m >> [&]{
                 std::cout << "." << std::endl;
-                sleep(50ms);
+                sleep_for(50ms);
             }
         );
     }
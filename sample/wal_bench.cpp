@@ -0,0 +1,75 @@
+#include <chrono>
+#include <cstdio>
+#include <future>
+#include <iostream>
+#include <vector>
+
+#include "../concurrency.hpp"
+
+namespace chrono = std::chrono;
+
+struct Order {
+    long id;
+    double price;
+    int quantity;
+};
+
+void clear(std::string const& directory) {
+    for (auto const& name : platform::list_directory(directory)) {
+        platform::remove_file(directory + '/' + name);
+    }
+    std::remove(directory.c_str());
+}
+
+// producers add concurrently, a consumer receives and acknowledges
+void bench(chrono::microseconds window,
+           size_t num_producers,
+           size_t num_iter) {
+    std::string directory = "./wal-bench";
+    clear(directory);
+
+    DurableChannel<Order> channel(directory, window);
+    auto consumer = std::async(std::launch::async, [&] {
+        for (auto const& delivery : channel) {
+            channel.Ack(delivery.seq);
+        }
+    });
+
+    auto start = chrono::steady_clock::now();
+    std::vector<std::future<void>> producers;
+    for (size_t i = 0; i < num_producers; ++i) {
+        producers.emplace_back(std::async(std::launch::async, [&, i] {
+            for (size_t j = 0; j < num_iter; ++j) {
+                channel.Add(Order{ static_cast<long>(i * num_iter + j),
+                                   100.0,
+                                   1 });
+            }
+        }));
+    }
+    for (auto& producer : producers) {
+        producer.wait();
+    }
+    auto end = chrono::steady_clock::now();
+
+    channel.Close();
+    consumer.wait();
+
+    auto elapsed = chrono::duration<double>(end - start).count();
+    size_t total = num_producers * num_iter;
+    std::cout << "window " << window.count() << "us: "
+              << static_cast<size_t>(total / elapsed) << " msg/s, "
+              << total / std::max<size_t>(channel.Syncs(), 1)
+              << " msg/sync\n";
+
+    clear(directory);
+}
+
+int main() {
+    constexpr size_t num_producers = 8;
+    constexpr size_t num_iter = 2'000;
+
+    for (auto window : { 0, 100, 500, 1000, 5000 }) {
+        bench(chrono::microseconds(window), num_producers, num_iter);
+    }
+    return 0;
+}
@@ -120,7 +120,7 @@ def file_list(dirname, ban_dir=[]):
 
 def in_endswith(name, files):
     for f in files:
-        if f.endswith(name):
+        if os.path.basename(f) == name:
             return f
     return None
 
@@ -128,8 +128,9 @@ def in_endswith(name, files):
 def order_dep(deps, files, done):
     info = SourceInfo()
     for dep in deps:
-        if in_endswith(dep, done) is None:
-            path = in_endswith(dep.split('/')[-1], files)
+        name = dep.split('/')[-1]
+        if in_endswith(name, done) is None:
+            path = in_endswith(name, files)
 
             if path is not None:
                 new = SourceInfo.read_file(path)
@@ -207,7 +208,8 @@ def merge(dirname):
 
 def write_hpp(outfile, merged):
     info, preproc_dep = merged
-    dep_check = lambda file: not any(file.endswith(dep) for dep in preproc_dep)
+    dep_check = lambda file: not any(
+        file == dep or file.endswith('/' + dep) for dep in preproc_dep)
 
     idx = outfile.rfind('/')
     if idx > -1:
@@ -0,0 +1,88 @@
+#include <catch2/catch.hpp>
+#include <barrier.hpp>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+TEST_CASE("Barrier runs the completion once per phase", "[barrier]") {
+    constexpr size_t num_threads = 4;
+    constexpr size_t num_phases = 200;
+
+    std::atomic<size_t> completed(0);
+    std::atomic<size_t> serial(0);
+    std::atomic<bool> ordered(true);
+    Barrier barrier(num_threads, [&] { ++completed; }, 64);
+
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < num_threads; ++i) {
+        threads.emplace_back([&] {
+            for (size_t phase = 0; phase < num_phases; ++phase) {
+                if (completed.load() != 2 * phase) {
+                    ordered = false;
+                }
+                if (barrier.ArriveAndWait()) {
+                    ++serial;
+                }
+                if (completed.load() != 2 * phase + 1) {
+                    ordered = false;
+                }
+                // every party checked before the next completion
+                barrier.ArriveAndWait();
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    REQUIRE(ordered);
+    REQUIRE(serial == num_phases);
+    REQUIRE(barrier.Phase() == 2 * num_phases);
+}
+
+TEST_CASE("Phaser registers parties dynamically", "[barrier]") {
+    std::vector<uint32_t> completions;
+    Phaser phaser(1, [&](uint32_t phase) { completions.push_back(phase); });
+
+    // phase 0 waits for the initial party only
+    REQUIRE(phaser.Arrive() == 0);
+    REQUIRE(phaser.Phase() == 1);
+
+    // workers join phase 1 and leave after different numbers of phases
+    constexpr size_t num_workers = 4;
+    std::atomic<size_t> arrivals(0);
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < num_workers; ++i) {
+        REQUIRE(phaser.Register() == 1);
+        workers.emplace_back([&, i] {
+            for (size_t step = 0; step <= i; ++step) {
+                ++arrivals;
+                phaser.ArriveAndAwait();
+            }
+            phaser.ArriveAndDeregister();
+        });
+    }
+    REQUIRE(phaser.Registered() == num_workers + 1);
+
+    // the coordinator steps along until every worker left
+    while (phaser.Registered() > 1) {
+        phaser.ArriveAndAwait();
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    REQUIRE(arrivals == 1 + 2 + 3 + 4);
+    REQUIRE(phaser.Registered() == 1);
+    REQUIRE(completions.size() == phaser.Phase());
+    for (uint32_t phase = 0; phase < completions.size(); ++phase) {
+        REQUIRE(completions[phase] == phase);
+    }
+
+    // the last party leaving still completes the phase
+    uint32_t last = phaser.ArriveAndDeregister();
+    REQUIRE(phaser.Phase() == last + 1);
+    REQUIRE(phaser.Registered() == 0);
+    REQUIRE(phaser.Arrive() == last + 1);
+}
@@ -0,0 +1,67 @@
+#include <catch2/catch.hpp>
+#include <byte_channel.hpp>
+
+#include <cstring>
+#include <future>
+#include <string>
+
+TEST_CASE("ByteRing wrap-around padding", "[byte_channel]") {
+    ByteRing ring(64);
+    REQUIRE(ring.max_length() == 56);
+
+    // 24 + 24 bytes, then a 24 byte record needs padding of 16
+    uint64_t first = ring.claim(10);
+    ring.commit(first);
+    uint64_t second = ring.claim(16);
+    ring.commit(second);
+    REQUIRE(ring.size() == 2);
+    REQUIRE(!ring.fits(16));
+
+    ring.release(ring.borrow());
+    REQUIRE(ring.fits(16));
+
+    uint64_t third = ring.claim(16);
+    REQUIRE((third & 63) == 0);
+    std::memcpy(ring.data(third), "0123456789abcdef", 16);
+    ring.commit(third);
+    REQUIRE(ring.used() == 24 + 16 + 24);
+
+    ring.release(ring.borrow());
+    uint64_t pos = ring.borrow();
+    REQUIRE(pos == third);
+    REQUIRE(ring.length(pos) == 16);
+    REQUIRE(std::memcmp(ring.data(pos), "0123456789abcdef", 16) == 0);
+    ring.release(pos);
+    REQUIRE(ring.used() == 0);
+}
+
+TEST_CASE("ByteChannel::Claim, Get", "[byte_channel]") {
+    ByteChannel channel(256);
+    REQUIRE(!channel.Claim(channel.MaxRecord() + 1));
+
+    auto producer = std::async(std::launch::async, [&] {
+        for (size_t i = 1; i <= 100; ++i) {
+            std::string record(i, static_cast<char>('a' + i % 26));
+            channel.Add(record.data(), record.size());
+        }
+        {
+            auto claim = channel.Claim(8);
+        }
+        channel.Close();
+    });
+
+    size_t expected = 1;
+    while (auto record = channel.Get()) {
+        std::string given(reinterpret_cast<char const*>(record.data()),
+                          record.size());
+        if (given != std::string(expected, 'a' + expected % 26)) {
+            break;
+        }
+        ++expected;
+    }
+    producer.get();
+
+    REQUIRE(expected == 101);
+    REQUIRE(channel.Stat().popped == 100);
+    REQUIRE(channel.Stat().size == 0);
+}
@@ -0,0 +1,56 @@
+#include <catch2/catch.hpp>
+#include <channel.hpp>
+#include <container/budgeted.hpp>
+
+#include <chrono>
+#include <future>
+#include <list>
+#include <string>
+
+namespace {
+    size_t length(std::string const& str) {
+        return str.size();
+    }
+}  // namespace
+
+TEST_CASE("Budgeted::full", "[budgeted]") {
+    Budgeted<std::list<std::string>> buffer(10, length);
+    REQUIRE(!buffer.full());
+
+    buffer.emplace_back(4, 'a');
+    buffer.push_back(std::string(4, 'b'));
+    REQUIRE(buffer.bytes() == 8);
+    REQUIRE(!buffer.full());
+
+    buffer.push_back(std::string(4, 'c'));
+    REQUIRE(buffer.bytes() == 12);
+    REQUIRE(buffer.full());
+
+    buffer.pop_front();
+    REQUIRE(buffer.bytes() == 8);
+    REQUIRE(!buffer.full());
+    REQUIRE(buffer.front() == "bbbb");
+}
+
+TEST_CASE("BLChannel blocks on byte budget", "[budgeted]") {
+    BLChannel<std::string> channel(16, length);
+
+    // larger than the whole budget, still accepted while empty
+    channel.Add(std::string(32, 'a'));
+
+    auto blocked = std::async(std::launch::async, [&] {
+        channel.Add(std::string(1, 'b'));
+    });
+    REQUIRE(blocked.wait_for(std::chrono::milliseconds(50))
+            == std::future_status::timeout);
+
+    REQUIRE(channel.Get().value().size() == 32);
+    blocked.get();
+    REQUIRE(channel.Get().value() == "b");
+
+    BRChannel<std::string> ring(16, length, 2);
+    ring.Add("a");
+    ring.Add("b");
+    REQUIRE(channel.Stat().size == 0);
+    REQUIRE(ring.Stat().size == 2);
+}
@@ -0,0 +1,70 @@
+#include <catch2/catch.hpp>
+#include <channel.hpp>
+#include <container/conflating.hpp>
+
+#include <string>
+#include <utility>
+
+TEST_CASE("Conflating keeps the latest value per key", "[conflating]") {
+    Conflating<std::string, int> buffer;
+    buffer.emplace_back("b", 1);
+    buffer.emplace_back("a", 1);
+    buffer.emplace_back("b", 2);
+    buffer.push_back(std::make_pair(std::string("c"), 1));
+    buffer.emplace_back("a", 2);
+
+    REQUIRE(buffer.size() == 3);
+    REQUIRE(buffer.conflated() == 2);
+
+    std::pair<std::string, int> given = std::move(buffer.front());
+    buffer.pop_front();
+    REQUIRE(given == std::make_pair(std::string("b"), 2));
+
+    // popped key becomes pending again at the back
+    buffer.emplace_back("b", 3);
+
+    std::pair<std::string, int> batch[4];
+    REQUIRE(buffer.pop_bulk(batch, 4) == 3);
+    REQUIRE(batch[0] == std::make_pair(std::string("a"), 2));
+    REQUIRE(batch[1] == std::make_pair(std::string("c"), 1));
+    REQUIRE(batch[2] == std::make_pair(std::string("b"), 3));
+    REQUIRE(buffer.size() == 0);
+}
+
+TEST_CASE("ConflatingChannel drains dirty keys", "[conflating]") {
+    ConflatingChannel<int, double> prices;
+    for (int tick = 0; tick < 100; ++tick) {
+        prices.Add(tick % 3, tick * 0.5);
+    }
+
+    std::pair<int, double> dirty[8];
+    REQUIRE(prices.GetBulk(dirty, 8) == 3);
+    REQUIRE(dirty[0] == std::make_pair(0, 49.5));
+    REQUIRE(dirty[1] == std::make_pair(1, 48.5));
+    REQUIRE(dirty[2] == std::make_pair(2, 49.0));
+
+    prices.Add(7, 1.0);
+    REQUIRE(prices.Get().value() == std::make_pair(7, 1.0));
+    REQUIRE(prices.Stat().pushed == 101);
+}
+
+TEST_CASE("Full ConflatingChannel replaces pending values", "[conflating]") {
+    ConflatingChannel<int, double> rejecting(Overflow::Fail, 2);
+    REQUIRE(rejecting.Add(1, 1.0) == SendStatus::Sent);
+    REQUIRE(rejecting.Add(2, 1.0) == SendStatus::Sent);
+    REQUIRE(rejecting.Add(1, 2.0) == SendStatus::Sent);
+    REQUIRE(rejecting.Add(3, 1.0) == SendStatus::Full);
+
+    std::pair<int, double> batch[2] = { { 1, 3.0 }, { 3, 1.0 } };
+    REQUIRE(rejecting.AddBulk(batch, 2) == 1);
+    REQUIRE(rejecting.Get().value() == std::make_pair(1, 3.0));
+
+    // a blocking channel does not wait for space either
+    ConflatingChannel<int, double> blocking(2);
+    blocking.Add(1, 1.0);
+    blocking.Add(2, 1.0);
+    REQUIRE(blocking.Add(2, 2.0) == SendStatus::Sent);
+    REQUIRE(blocking.Stat().size == 2);
+    REQUIRE(blocking.Get().value() == std::make_pair(1, 1.0));
+    REQUIRE(blocking.Get().value() == std::make_pair(2, 2.0));
+}
@@ -1,6 +1,263 @@
-#include <container/ring_buffer.hpp>
 #include <catch2/catch.hpp>
+#include <channel.hpp>
+#include <container/ring_buffer.hpp>
+#include <container/thread_safe.hpp>
+
+#include <future>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+    struct Counted {
+        static inline int alive = 0;
+        static inline int constructed = 0;
+
+        int value;
+
+        explicit Counted(int value) : value(value) {
+            ++alive;
+            ++constructed;
+        }
+
+        Counted(Counted&& other) : value(other.value) {
+            ++alive;
+            ++constructed;
+        }
+
+        Counted(Counted const&) = delete;
+        Counted& operator=(Counted const&) = delete;
+
+        ~Counted() {
+            --alive;
+        }
+    };
+
+    // copies and moves of a negative value throw
+    struct Throwing {
+        int value;
+
+        explicit Throwing(int value) : value(value) {
+            // Do Nothing
+        }
+
+        Throwing(Throwing const& other) : value(other.value) {
+            if (value < 0) {
+                throw std::runtime_error("negative");
+            }
+        }
+
+        Throwing(Throwing&& other) : Throwing(other) {
+            // Do Nothing
+        }
+    };
+}  // namespace
+
+TEST_CASE("RingBuffer::emplace_back, pop_front", "[ring_buffer]") {
+    RingBuffer<std::string> buffer(3);
+    REQUIRE(buffer.max_size() == 3);
+    REQUIRE(buffer.size() == 0);
+
+    for (int round = 0; round < 5; ++round) {
+        buffer.emplace_back(3, 'a');
+        buffer.push_back("b");
+        buffer.emplace_back("c");
+        REQUIRE(buffer.size() == 3);
+
+        REQUIRE(buffer.front() == "aaa");
+        buffer.pop_front();
+        REQUIRE(buffer.front() == "b");
+        buffer.pop_front();
+        REQUIRE(buffer.front() == "c");
+        buffer.pop_front();
+        REQUIRE(buffer.size() == 0);
+    }
+}
+
+TEST_CASE("RingBuffer in-place construction", "[ring_buffer]") {
+    Counted::alive = 0;
+    Counted::constructed = 0;
+    {
+        RingBuffer<Counted> buffer(4);
+        REQUIRE(Counted::constructed == 0);
+
+        buffer.emplace_back(1);
+        buffer.emplace_back(2);
+        REQUIRE(Counted::constructed == 2);
+        REQUIRE(Counted::alive == 2);
+
+        buffer.pop_front();
+        REQUIRE(Counted::alive == 1);
+        REQUIRE(buffer.front().value == 2);
+    }
+    REQUIRE(Counted::alive == 0);
+}
+
+TEST_CASE("TSRingBuffer with move-only type", "[ring_buffer]") {
+    TSRingBuffer<std::unique_ptr<int>> buffer(2);
+    buffer.emplace_back(std::make_unique<int>(1));
+    buffer.push_back(std::make_unique<int>(2));
+
+    REQUIRE(*buffer.pop_front().value() == 1);
+    REQUIRE(*buffer.try_pop().value() == 2);
+}
+
+TEST_CASE("StaticRingBuffer", "[ring_buffer]") {
+    StaticRingBuffer<int, 3> buffer;
+    static_assert(sizeof(buffer) <= 4 * sizeof(int) + 9 * sizeof(size_t));
+    REQUIRE(buffer.max_size() == 3);
+
+    for (int i = 0; i < 10; ++i) {
+        buffer.emplace_back(i);
+        buffer.emplace_back(i + 1);
+        REQUIRE(buffer.front() == i);
+        buffer.pop_front();
+        REQUIRE(buffer.front() == i + 1);
+        buffer.pop_front();
+    }
+    REQUIRE(buffer.size() == 0);
+}
+
+TEST_CASE("StaticRChannel", "[ring_buffer]") {
+    StaticRChannel<int, 4> channel;
+    channel << 1 << 2;
+
+    int value = 0;
+    channel >> value;
+    REQUIRE(value == 1);
+    REQUIRE(channel.Get().value() == 2);
+}
+
+TEST_CASE("RingBuffer::push_bulk, pop_bulk", "[ring_buffer]") {
+    RingBuffer<int> buffer(6);
+    int src[8] = { 0, 1, 2, 3, 4, 5, 6, 7 };
+    int dst[8] = {};
+
+    buffer.emplace_back(-1);
+    buffer.emplace_back(-2);
+    buffer.emplace_back(-3);
+    buffer.pop_front();
+    buffer.pop_front();
+
+    REQUIRE(buffer.push_bulk(src, 8) == 5);
+    REQUIRE(buffer.size() == 6);
+
+    REQUIRE(buffer.pop_bulk(dst, 8) == 6);
+    REQUIRE(dst[0] == -3);
+    for (int i = 0; i < 5; ++i) {
+        REQUIRE(dst[i + 1] == i);
+    }
+
+    RingBuffer<std::string> strings(2);
+    std::string words[3] = { "a", "b", "c" };
+    REQUIRE(strings.push_bulk(words, 3) == 2);
+
+    std::string out[2];
+    REQUIRE(strings.pop_bulk(out, 2) == 2);
+    REQUIRE(out[1] == "b");
+}
+
+TEST_CASE("Channel::AddBulk, GetBulk", "[ring_buffer]") {
+    std::vector<int> values(1000);
+    for (size_t i = 0; i < values.size(); ++i) {
+        values[i] = static_cast<int>(i);
+    }
+
+    RChannel<int> ring(64);
+    LChannel<int> list;
+
+    auto producer = std::async(std::launch::async, [&] {
+        size_t num = ring.AddBulk(values.data(), values.size());
+        ring.Close();
+        return num;
+    });
+    REQUIRE(list.AddBulk(values.data(), values.size()) == values.size());
+    list.Close();
+
+    std::vector<int> from_ring, from_list;
+    int buf[100];
+    while (size_t num = ring.GetBulk(buf, 100)) {
+        from_ring.insert(from_ring.end(), buf, buf + num);
+    }
+    while (size_t num = list.GetBulk(buf, 100)) {
+        from_list.insert(from_list.end(), buf, buf + num);
+    }
+    REQUIRE(producer.get() == values.size());
+    REQUIRE(from_ring == values);
+    REQUIRE(from_list == values);
+}
+
+TEST_CASE("RingBuffer::claim, commit out of order", "[ring_buffer]") {
+    RingBuffer<std::string> buffer(3);
+
+    size_t first = buffer.claim();
+    size_t second = buffer.claim();
+    size_t third = buffer.claim();
+    REQUIRE(buffer.full());
+
+    new (buffer.storage(third)) std::string("c");
+    buffer.commit(third);
+    REQUIRE(buffer.size() == 0);
+
+    buffer.abandon(second);
+    REQUIRE(buffer.size() == 0);
+
+    new (buffer.storage(first)) std::string("a");
+    buffer.commit(first);
+    REQUIRE(buffer.size() == 2);
+
+    size_t borrowed = buffer.borrow();
+    REQUIRE(*buffer.at(borrowed) == "a");
+    REQUIRE(buffer.front() == "c");
+    buffer.pop_front();
+    REQUIRE(buffer.full());
+
+    buffer.release(borrowed);
+    REQUIRE(!buffer.full());
+    REQUIRE(buffer.size() == 0);
+}
+
+TEST_CASE("RChannel survives a throwing constructor", "[ring_buffer]") {
+    RChannel<Throwing> channel(2);
+    REQUIRE(channel.Add(Throwing(1)) == SendStatus::Sent);
+    REQUIRE_THROWS_AS(channel.Add(Throwing(-1)), std::runtime_error);
+    REQUIRE(channel.Add(Throwing(2)) == SendStatus::Sent);
+
+    REQUIRE(channel.Get()->value == 1);
+    REQUIRE(channel.Get()->value == 2);
+    REQUIRE(channel.Stat().size == 0);
+}
+
+TEST_CASE("Channel::Claim, Borrow", "[ring_buffer]") {
+    Counted::alive = 0;
+    Counted::constructed = 0;
+    {
+        RChannel<Counted> channel(2);
+        auto producer = std::async(std::launch::async, [&] {
+            for (int i = 0; i < 100; ++i) {
+                if (auto slot = channel.Claim()) {
+                    slot.emplace(i);
+                    slot.Commit();
+                }
+            }
+            {
+                auto slot = channel.Claim();
+                slot.emplace(-1);
+            }
+            channel.Close();
+        });
+
+        int expected = 0;
+        while (auto slot = channel.Borrow()) {
+            if (slot->value != expected) {
+                break;
+            }
+            ++expected;
+        }
+        producer.get();
 
-TEST_CASE("First Test", "[ring_buffer]") {
-    REQUIRE(true);
-}
\ No newline at end of file
+        REQUIRE(expected == 100);
+        REQUIRE(Counted::constructed == 101);
+    }
+    REQUIRE(Counted::alive == 0);
+}
@@ -0,0 +1,106 @@
+#include <catch2/catch.hpp>
+#include <channel.hpp>
+#include <container/spilling.hpp>
+
+#include <cstring>
+#include <filesystem>
+#include <future>
+#include <string>
+
+namespace {
+    struct StringCodec {
+        size_t size(std::string const& value) const {
+            return value.size();
+        }
+
+        void encode(std::string const& value, unsigned char* dst) const {
+            std::memcpy(dst, value.data(), value.size());
+        }
+
+        std::string decode(unsigned char const* src, size_t size) const {
+            return std::string(reinterpret_cast<char const*>(src), size);
+        }
+    };
+
+    // fresh directory under the system temp directory, removed with its
+    // segments
+    struct SpillDirectory {
+        SpillDirectory(char const* tag)
+            : path(std::filesystem::temp_directory_path()
+                   / (std::string("cc-spill-") + tag + '-'
+                      + std::to_string(platform::process_id()))) {
+            std::filesystem::remove_all(path);
+            std::filesystem::create_directories(path);
+        }
+
+        ~SpillDirectory() {
+            std::filesystem::remove_all(path);
+        }
+
+        bool empty() const {
+            return std::filesystem::is_empty(path);
+        }
+
+        std::filesystem::path path;
+    };
+}  // namespace
+
+TEST_CASE("Spilling keeps order across segments", "[spilling]") {
+    SpillDirectory directory("order");
+    Spilling<std::string, StringCodec> buffer(
+        directory.path.string(), 4, StringCodec(), 64);
+    for (int i = 0; i < 20; ++i) {
+        buffer.push_back(std::to_string(i) + std::string(i, 'x'));
+    }
+    REQUIRE(buffer.size() == 20);
+    REQUIRE(buffer.spilled() == 16);
+    REQUIRE(buffer.segments_created() > 1);
+
+    for (int i = 0; i < 20; ++i) {
+        REQUIRE(buffer.front() == std::to_string(i) + std::string(i, 'x'));
+        buffer.pop_front();
+    }
+    REQUIRE(buffer.size() == 0);
+    REQUIRE(buffer.spilled() == 0);
+    REQUIRE(directory.empty());
+}
+
+TEST_CASE("SpillChannel drains spilled messages", "[spilling]") {
+    SpillDirectory directory("drain");
+    SpillChannel<int> channel(directory.path.string(), 8);
+    auto producer = std::async(std::launch::async, [&] {
+        for (int i = 0; i < 1000; ++i) {
+            channel.Add(i);
+        }
+        channel.Close();
+    });
+    producer.get();
+    REQUIRE(channel.Stat().size == 1000);
+
+    int expected = 0;
+    for (int value : channel) {
+        if (value != expected) {
+            break;
+        }
+        ++expected;
+    }
+    REQUIRE(expected == 1000);
+}
+
+TEST_CASE("SpillChannel charges only messages in memory", "[spilling]") {
+    SpillDirectory directory("govern");
+    MemoryGovernor governor;
+    SpillChannel<int> channel(directory.path.string(), 8);
+    REQUIRE(channel.Govern(governor));
+
+    for (int i = 0; i < 1000; ++i) {
+        channel.Add(i);
+    }
+    REQUIRE(channel.Stat().size == 1000);
+    REQUIRE(governor.Bytes() == 8 * sizeof(int));
+
+    for (int i = 0; i < 996; ++i) {
+        REQUIRE(channel.Get() == i);
+    }
+    REQUIRE(governor.Bytes() == 4 * sizeof(int));
+}
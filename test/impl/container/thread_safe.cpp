@@ -0,0 +1,120 @@
+#include <catch2/catch.hpp>
+#include <channel.hpp>
+#include <container/thread_safe.hpp>
+#include <platform/socket.hpp>
+
+#include <chrono>
+#include <vector>
+
+TEST_CASE("Overflow::DropNewest", "[thread_safe]") {
+    RChannel<int> channel(Overflow::DropNewest, 2);
+    REQUIRE(channel.Add(0) == SendStatus::Sent);
+    REQUIRE(channel.Add(1) == SendStatus::Sent);
+    REQUIRE(channel.Add(2) == SendStatus::Dropped);
+
+    int bulk[] = { 3, 4, 5 };
+    REQUIRE(channel.AddBulk(bulk, 3) == 0);
+
+    REQUIRE(channel.Get().value() == 0);
+    REQUIRE(channel.Get().value() == 1);
+    REQUIRE(channel.Stat().dropped == 4);
+}
+
+TEST_CASE("Overflow::DropOldest", "[thread_safe]") {
+    RChannel<int> channel(Overflow::DropOldest, 2);
+    channel.Add(0);
+    channel.Add(1);
+    REQUIRE(channel.Add(2) == SendStatus::Evicted);
+
+    int bulk[] = { 3, 4, 5 };
+    REQUIRE(channel.AddBulk(bulk, 3) == 3);
+
+    REQUIRE(channel.Get().value() == 4);
+    REQUIRE(channel.Get().value() == 5);
+    REQUIRE(channel.Stat().evicted == 4);
+
+    LChannel<int> unbounded(Overflow::DropOldest);
+    REQUIRE(unbounded.Add(0) == SendStatus::Sent);
+}
+
+TEST_CASE("Overflow::Fail", "[thread_safe]") {
+    RChannel<int> channel(Overflow::Fail, 1);
+    REQUIRE(channel.Add(0) == SendStatus::Sent);
+    REQUIRE(channel.Add(1) == SendStatus::Full);
+    REQUIRE(!channel.Claim());
+    REQUIRE(channel.Stat().rejected == 2);
+
+    channel.Close();
+    REQUIRE(channel.Add(2) == SendStatus::Closed);
+}
+
+#ifndef _WIN32
+TEST_CASE("Channel ready fd signals the empty transition", "[thread_safe]") {
+    using namespace std::chrono_literals;
+    LChannel<int> channel;
+    int fd = channel.ReadyFd();
+    REQUIRE(fd >= 0);
+    REQUIRE(fd == channel.ReadyFd());
+    REQUIRE_FALSE(platform::wait_readable(fd, 0ms));
+
+    channel.Add(1);
+    channel.Add(2);
+    REQUIRE(platform::wait_readable(fd, 0ms));
+
+    // messages left keep the fd readable
+    REQUIRE(channel.TryGet() == 1);
+    channel.ClearReady();
+    REQUIRE(platform::wait_readable(fd, 0ms));
+
+    REQUIRE(channel.TryGet() == 2);
+    channel.ClearReady();
+    REQUIRE_FALSE(platform::wait_readable(fd, 0ms));
+
+    channel.Add(3);
+    REQUIRE(platform::wait_readable(fd, 0ms));
+    REQUIRE(channel.TryGet() == 3);
+    channel.ClearReady();
+    REQUIRE_FALSE(platform::wait_readable(fd, 0ms));
+
+    channel.Close();
+    REQUIRE(platform::wait_readable(fd, 0ms));
+}
+
+TEST_CASE("Channel ready fd with commits out of claim order",
+          "[thread_safe]") {
+    using namespace std::chrono_literals;
+    RChannel<int> channel(8);
+    int fd = channel.ReadyFd();
+
+    auto first = channel.Claim();
+    auto second = channel.Claim();
+    REQUIRE(first);
+    REQUIRE(second);
+
+    // the later slot is not readable before the earlier one
+    second.emplace(2);
+    second.Commit();
+    channel.ClearReady();
+    REQUIRE_FALSE(platform::wait_readable(fd, 0ms));
+
+    first.emplace(1);
+    first.Commit();
+    REQUIRE(platform::wait_readable(fd, 0ms));
+    REQUIRE(channel.TryGet() == 1);
+    REQUIRE(channel.TryGet() == 2);
+
+    // abandoning the earlier slot publishes the later one
+    channel.ClearReady();
+    {
+        auto abandoned = channel.Claim();
+        auto third = channel.Claim();
+        third.emplace(3);
+        third.Commit();
+        REQUIRE_FALSE(platform::wait_readable(fd, 0ms));
+        REQUIRE(channel.Stat().size == 0);
+    }
+    REQUIRE(platform::wait_readable(fd, 0ms));
+    REQUIRE(channel.Stat().size == 1);
+    REQUIRE(channel.TryGet() == 3);
+}
+#endif
@@ -0,0 +1,160 @@
+#include <catch2/catch.hpp>
+#include <durable_channel.hpp>
+
+#include <cstdio>
+#include <future>
+#include <string>
+#include <vector>
+
+namespace {
+    void clear(std::string const& directory) {
+        for (auto const& name : platform::list_directory(directory)) {
+            platform::remove_file(directory + '/' + name);
+        }
+        std::remove(directory.c_str());
+    }
+
+    size_t num_segments(std::string const& directory) {
+        size_t num = 0;
+        for (auto const& name : platform::list_directory(directory)) {
+            num += name.compare(0, 4, "wal-") == 0;
+        }
+        return num;
+    }
+}  // namespace
+
+TEST_CASE("DurableChannel replays unacknowledged messages", "[durable]") {
+    std::string directory = "./durable-replay";
+    clear(directory);
+    {
+        DurableChannel<int> channel(directory);
+        for (int i = 0; i < 10; ++i) {
+            REQUIRE(channel.Add(i));
+        }
+
+        for (uint64_t seq = 1; seq <= 10; ++seq) {
+            auto delivery = channel.Get();
+            REQUIRE(delivery.has_value());
+            REQUIRE(delivery->seq == seq);
+            REQUIRE(delivery->value == static_cast<int>(seq) - 1);
+        }
+
+        // out of order acks, only the contiguous prefix is durable
+        channel.Ack(2);
+        channel.Ack(1);
+        channel.Ack(4);
+        channel.Checkpoint();
+        REQUIRE(channel.Checkpointed() == 2);
+    }
+
+    // a torn record at the tail of the last segment is ignored
+    for (auto const& name : platform::list_directory(directory)) {
+        if (name.compare(0, 4, "wal-") == 0) {
+            std::FILE* file =
+                std::fopen((directory + '/' + name).c_str(), "ab");
+            std::fputs("torn", file);
+            std::fclose(file);
+        }
+    }
+
+    {
+        DurableChannel<int> channel(directory);
+        REQUIRE(channel.Replayed() == 8);
+        REQUIRE(channel.Add(10));
+
+        std::vector<uint64_t> seqs;
+        for (int i = 0; i < 9; ++i) {
+            auto delivery = channel.Get();
+            seqs.push_back(delivery->seq);
+            REQUIRE(delivery->value == static_cast<int>(delivery->seq) - 1);
+            channel.Ack(delivery->seq);
+        }
+        REQUIRE(seqs.front() == 3);
+        REQUIRE(seqs.back() == 11);
+    }
+
+    {
+        DurableChannel<int> channel(directory);
+        REQUIRE(channel.Replayed() == 0);
+        REQUIRE(channel.Checkpointed() == 11);
+    }
+    clear(directory);
+}
+
+TEST_CASE("DurableChannel restarts a segment torn at its first record",
+          "[durable]") {
+    std::string directory = "./durable-torn";
+    clear(directory);
+    {
+        DurableChannel<int> channel(directory);
+        REQUIRE(channel.Add(1));
+    }
+
+    // a crash while the first record of the next segment was written
+    {
+        std::FILE* file =
+            std::fopen((directory + "/wal-00000000000000000002.log").c_str(),
+                       "wb");
+        std::fputs("torn", file);
+        std::fclose(file);
+    }
+
+    {
+        DurableChannel<int> channel(directory);
+        REQUIRE(channel.Replayed() == 1);
+        REQUIRE(channel.Add(2));
+        REQUIRE(channel.Add(3));
+    }
+
+    {
+        DurableChannel<int> channel(directory);
+        REQUIRE(channel.Replayed() == 3);
+        for (int value = 1; value <= 3; ++value) {
+            auto delivery = channel.Get();
+            REQUIRE(delivery->seq == static_cast<uint64_t>(value));
+            REQUIRE(delivery->value == value);
+        }
+    }
+    clear(directory);
+}
+
+TEST_CASE("DurableChannel groups concurrent commits", "[durable]") {
+    std::string directory = "./durable-group";
+    clear(directory);
+    {
+        DurableChannel<int> channel(directory,
+                                    std::chrono::milliseconds(2),
+                                    std::chrono::milliseconds(0),
+                                    256);
+
+        std::vector<std::future<void>> producers;
+        for (int i = 0; i < 4; ++i) {
+            producers.emplace_back(std::async(std::launch::async, [&] {
+                for (int j = 0; j < 50; ++j) {
+                    channel.Add(j);
+                }
+            }));
+        }
+        for (auto& producer : producers) {
+            producer.get();
+        }
+        REQUIRE(channel.Syncs() < 200);
+        REQUIRE(num_segments(directory) > 1);
+
+        uint64_t expected = 1;
+        channel.Close();
+        for (auto const& delivery : channel) {
+            if (delivery.seq != expected) {
+                break;
+            }
+            channel.Ack(delivery.seq);
+            ++expected;
+        }
+        REQUIRE(expected == 201);
+
+        // acknowledged segments are deleted, the current one stays
+        REQUIRE(channel.Checkpointed() == 200);
+        REQUIRE(num_segments(directory) == 1);
+    }
+    clear(directory);
+}
@@ -0,0 +1,131 @@
+#include <catch2/catch.hpp>
+#include <channel.hpp>
+#include <file_source.hpp>
+
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <platform/mapped_file.hpp>
+
+namespace {
+    std::vector<std::string> write_lines(std::string const& path) {
+        std::vector<std::string> lines;
+        std::FILE* file = std::fopen(path.c_str(), "wb");
+        for (size_t i = 0; i < 500; ++i) {
+            // some lines are empty, some span several chunks
+            char fill = static_cast<char>('a' + i % 26);
+            lines.push_back(std::string(i * 7 % 150, fill));
+            std::fputs(lines.back().c_str(), file);
+            std::fputc('\n', file);
+        }
+        lines.push_back("unterminated");
+        std::fputs(lines.back().c_str(), file);
+        std::fclose(file);
+        return lines;
+    }
+}  // namespace
+
+TEST_CASE("FileSource reads chunks without copies", "[file]") {
+    std::string path = "./file-source-chunks";
+    write_lines(path);
+    auto mode = GENERATE(ChunkMode::Read, ChunkMode::Map);
+
+    std::string expected;
+    {
+        platform::InputFile file;
+        REQUIRE(file.open(path));
+        expected.resize(file.size());
+        REQUIRE(file.read(expected.data(), expected.size(), 0)
+                == static_cast<long>(expected.size()));
+    }
+
+    FileSource source(path, 256, 4, mode);
+    REQUIRE(source.Ok());
+    REQUIRE(source.Size() == expected.size());
+
+    LChannel<FileChunk> chunks;
+    bool read = false;
+    std::thread producer([&] { read = source.Run(chunks); });
+
+    std::string content;
+    size_t index = 0;
+    while (auto chunk = chunks.Get()) {
+        REQUIRE(chunk->index == index++);
+        REQUIRE(chunk->offset == content.size());
+        content.append(chunk->view());
+    }
+    producer.join();
+    REQUIRE(read);
+    REQUIRE(content == expected);
+
+    // every chunk was released, the four buffers were enough
+    REQUIRE(source.Held() == 0);
+    if (mode == ChunkMode::Read) {
+        REQUIRE(index > 4);
+        REQUIRE(source.Buffers() <= 4);
+    }
+    else {
+        REQUIRE(source.Buffers() == 0);
+    }
+    platform::remove_file(path);
+
+    FileSource missing("./file-source-missing");
+    REQUIRE_FALSE(missing.Ok());
+    REQUIRE_FALSE(missing.Next().has_value());
+}
+
+TEST_CASE("FileSource throttles on held buffers", "[file]") {
+    using namespace std::chrono_literals;
+    std::string path = "./file-source-stall";
+    write_lines(path);
+
+    FileSource source(path, 128, 2);
+    auto first = source.Next();
+    auto second = source.Next();
+    REQUIRE(second.has_value());
+
+    std::thread release([&] {
+        std::this_thread::sleep_for(20ms);
+        first.reset();
+    });
+    auto third = source.Next();
+    release.join();
+    REQUIRE(third->offset == 256);
+    REQUIRE(source.Stalls() == 1);
+    platform::remove_file(path);
+}
+
+TEST_CASE("SplitLines fixes up lines across chunks", "[file]") {
+    std::string path = "./file-source-lines";
+    auto expected = write_lines(path);
+    auto mode = GENERATE(ChunkMode::Read, ChunkMode::Map);
+    // fewer source buffers than chunks scanned at once
+    auto buffers = GENERATE(size_t(8), size_t(2));
+
+    LThreadPool<void> pool(4);
+    FileSource source(path, 64, buffers, mode);
+    LChannel<FileChunk> chunks;
+    LChannel<LineBatch> batches;
+
+    std::thread producer([&] { source.Run(chunks); });
+    std::thread splitter([&] { SplitLines(chunks, batches, pool, 4); });
+
+    std::vector<std::string> lines;
+    size_t index = 0;
+    while (auto batch = batches.Get()) {
+        REQUIRE(batch->index >= index);
+        index = batch->index;
+        for (auto line : batch->lines) {
+            lines.emplace_back(line);
+        }
+    }
+    producer.join();
+    splitter.join();
+
+    REQUIRE(lines == expected);
+    platform::remove_file(path);
+}
+#endif
@@ -0,0 +1,148 @@
+#include <catch2/catch.hpp>
+#include <channel.hpp>
+#include <io_service.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <platform/mapped_file.hpp>
+
+namespace {
+    void round_trip(IoService& service) {
+        std::string directory = "./io-service";
+        for (auto const& name : platform::list_directory(directory)) {
+            platform::remove_file(directory + '/' + name);
+        }
+        platform::make_directory(directory);
+
+        std::string path = directory + "/data";
+        long fd = service.Open(path, O_RDWR | O_CREAT | O_TRUNC).get();
+        REQUIRE(fd >= 0);
+
+        // many writes in flight at once, completed into a channel
+        constexpr size_t num_blocks = 512;
+        std::vector<std::string> blocks(num_blocks);
+        LChannel<IoCompletion> completions;
+        for (size_t i = 0; i < num_blocks; ++i) {
+            blocks[i] = std::string(64, static_cast<char>('a' + i % 26));
+            service.Write(static_cast<int>(fd), blocks[i].data(), 64, i * 64,
+                          complete_to(completions, i));
+        }
+
+        std::vector<bool> seen(num_blocks, false);
+        for (size_t i = 0; i < num_blocks; ++i) {
+            auto completion = completions.Get();
+            REQUIRE(completion->result == 64);
+            seen[completion->tag] = true;
+        }
+        REQUIRE(std::count(seen.begin(), seen.end(), true) == num_blocks);
+
+        auto stat = service.Stat(path).get();
+        REQUIRE(stat.has_value());
+        REQUIRE(stat->size == num_blocks * 64);
+        REQUIRE(S_ISREG(stat->mode));
+        REQUIRE_FALSE(service.Stat(directory + "/missing").get());
+
+        char buf[64];
+        REQUIRE(service.Read(static_cast<int>(fd), buf, 64, 27 * 64).get()
+                == 64);
+        REQUIRE(std::string(buf, 64) == std::string(64, 'b'));
+        REQUIRE(service.Read(static_cast<int>(fd), buf, 64, 1 << 20).get()
+                == 0);
+        REQUIRE(service.Read(-1, buf, 64, 0).get() == -EBADF);
+
+        auto names = service.ListDir(directory).get();
+        REQUIRE(names == std::vector<std::string>{ "data" });
+        REQUIRE(service.InFlight() == 0);
+
+        ::close(static_cast<int>(fd));
+        platform::remove_file(path);
+        std::remove(directory.c_str());
+    }
+}  // namespace
+
+TEST_CASE("IoService batches requests on io_uring", "[io]") {
+    IoService service(256);
+    round_trip(service);
+    if (service.Uring()) {
+        REQUIRE(service.Batches() <= service.Submitted());
+    }
+}
+
+TEST_CASE("IoService waits for requests chained from callbacks", "[io]") {
+    using namespace std::chrono_literals;
+    auto entries = GENERATE(256u, 0u);
+    std::string path = "./io-service-chain";
+
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    REQUIRE(fd >= 0);
+    char out[4] = { 'a', 'b', 'c', 'd' };
+    char in[4] = {};
+    long written = -1;
+    long chained = -1;
+    {
+        IoService service(entries, 2);
+        service.Write(fd, out, 4, 0, [&](long result) {
+            // the destructor is already waiting
+            std::this_thread::sleep_for(20ms);
+            written = result;
+            service.Read(fd, in, 4, 0, [&](long result) {
+                chained = result;
+            });
+        });
+    }
+    REQUIRE(written == 4);
+    REQUIRE(chained == 4);
+    REQUIRE(std::string(in, 4) == "abcd");
+
+    ::close(fd);
+    platform::remove_file(path);
+}
+
+TEST_CASE("IoRing takes back requests the kernel did not consume",
+          "[io]") {
+    platform::IoRing ring;
+    if (!ring.open(8)) {
+        return;
+    }
+
+    platform::IoRequest request;
+    for (uint64_t key = 1; key <= 3; ++key) {
+        request.key = key;
+        REQUIRE(ring.push(request));
+    }
+    REQUIRE(ring.drop(2) == std::vector<uint64_t>{ 1, 2 });
+
+    request.key = 4;
+    REQUIRE(ring.push(request));
+    REQUIRE(ring.submit(2) == 2);
+
+    std::vector<uint64_t> keys;
+    platform::IoEvent events[8];
+    while (keys.size() < 2) {
+        size_t num = ring.reap(events, 8, true);
+        for (size_t i = 0; i < num; ++i) {
+            REQUIRE(events[i].result == 0);
+            keys.push_back(events[i].key);
+        }
+    }
+    std::sort(keys.begin(), keys.end());
+    REQUIRE(keys == std::vector<uint64_t>{ 3, 4 });
+}
+
+TEST_CASE("IoService falls back to a blocking pool", "[io]") {
+    IoService service(0, 2);
+    REQUIRE_FALSE(service.Uring());
+    round_trip(service);
+    REQUIRE(service.Submitted() == 0);
+}
+#endif
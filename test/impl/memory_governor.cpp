@@ -0,0 +1,79 @@
+#include <catch2/catch.hpp>
+#include <channel.hpp>
+#include <memory_governor.hpp>
+
+#include <chrono>
+#include <future>
+
+TEST_CASE("MemoryGovernor throttles the largest channel", "[memory_governor]") {
+    MemoryGovernor governor(10 * sizeof(int), 5 * sizeof(int));
+
+    LChannel<int> large;
+    LChannel<int> small;
+    REQUIRE(large.Govern(governor));
+    REQUIRE(small.Govern(governor));
+
+    for (int i = 0; i < 10; ++i) {
+        large.Add(i);
+    }
+    REQUIRE(!governor.Throttling());
+
+    large.Add(10);
+    REQUIRE(governor.Throttling());
+    REQUIRE(governor.Bytes() == 11 * sizeof(int));
+
+    // below its share of the low water mark, still admitted
+    small.Add(0);
+
+    auto blocked = std::async(std::launch::async, [&] { large.Add(11); });
+    REQUIRE(blocked.wait_for(std::chrono::milliseconds(50))
+            == std::future_status::timeout);
+
+    for (int i = 0; i < 7; ++i) {
+        large.Get();
+    }
+    blocked.get();
+
+    REQUIRE(!governor.Throttling());
+    REQUIRE(governor.Parks() == 1);
+    REQUIRE(governor.Bytes() == 6 * sizeof(int));
+}
+
+TEST_CASE("MemoryGovernor releases closed channels", "[memory_governor]") {
+    MemoryGovernor governor(sizeof(int), 0);
+    {
+        LChannel<int> channel;
+        channel.Govern(governor);
+        channel.Add(0);
+        channel.Add(1);
+        REQUIRE(governor.Throttling());
+
+        auto blocked = std::async(std::launch::async, [&] { channel.Add(2); });
+        REQUIRE(blocked.wait_for(std::chrono::milliseconds(50))
+                == std::future_status::timeout);
+
+        channel.Close();
+        blocked.get();
+    }
+    REQUIRE(governor.Bytes() == 0);
+    REQUIRE(!governor.Throttling());
+}
+
+TEST_CASE("MemoryGovernor joins a running channel", "[memory_governor]") {
+    MemoryGovernor governor;
+    MemoryGovernor other;
+    LChannel<int> channel;
+
+    // producers already run when the channel joins
+    auto producer = std::async(std::launch::async, [&] {
+        for (int i = 0; i < 10'000; ++i) {
+            channel.Add(i);
+        }
+    });
+    REQUIRE(channel.Govern(governor));
+    REQUIRE_FALSE(channel.Govern(other));
+    producer.get();
+
+    REQUIRE(governor.Bytes() == 10'000 * sizeof(int));
+    REQUIRE(other.Bytes() == 0);
+}
@@ -0,0 +1,82 @@
+#include <catch2/catch.hpp>
+#include <metrics.hpp>
+
+#include <chrono>
+#include <sstream>
+
+TEST_CASE("MetricRegistry::Render", "[metrics]") {
+    MetricRegistry registry;
+
+    RChannel<int> channel(4);
+    channel.Add(1);
+    channel.Add(2);
+    channel.Get();
+
+    WaitGroup wg(3);
+    InstrumentedMutex<> mutex;
+    {
+        std::unique_lock lock(mutex);
+    }
+
+    ThreadPool<void> pool(2);
+    pool.EnableAccounting();
+    pool.Add("job", [] {}).get();
+
+    // the future is ready before the run time is recorded
+    while (pool.Snapshot().executed == 0) {
+        std::this_thread::yield();
+    }
+
+    {
+        auto handle = registry.Register("jobs", channel);
+        auto wg_handle = registry.Register("fanout", wg);
+        auto mutex_handle = registry.Register("state", mutex);
+        auto pool_handle = registry.Register("workers", pool);
+
+        std::string text = registry.Render();
+        REQUIRE(text.find("# TYPE concurrency_channel_depth gauge")
+                != std::string::npos);
+        REQUIRE(text.find("concurrency_channel_depth{channel=\"jobs\"} 1")
+                != std::string::npos);
+        REQUIRE(text.find("concurrency_channel_sent_total{channel=\"jobs\"} 2")
+                != std::string::npos);
+        REQUIRE(text.find("concurrency_wait_group_count{wait_group=\"fanout\"} 3")
+                != std::string::npos);
+        REQUIRE(text.find("concurrency_mutex_acquisitions_total{mutex=\"state\"} 1")
+                != std::string::npos);
+        REQUIRE(text.find("concurrency_pool_task_wall_seconds_count{pool="
+                          "\"workers\",task=\"job\"} 1")
+                != std::string::npos);
+        REQUIRE(text.find("le=\"+Inf\"") != std::string::npos);
+    }
+
+    REQUIRE(registry.Render().empty());
+}
+
+TEST_CASE("ThreadSafe with InstrumentedMutex", "[metrics]") {
+    Channel<ThreadSafe<std::list<int>, InstrumentedMutex<>>> channel;
+    channel.Add(1);
+    REQUIRE(channel.Get().value() == 1);
+}
+
+TEST_CASE("Histogram bounds are inclusive", "[metrics]") {
+    Histogram hist;
+    hist.Record(std::chrono::nanoseconds(1024));
+    REQUIRE(hist.Bucket(10) == 1);
+    REQUIRE(Histogram::UpperBound(10) == std::chrono::nanoseconds(1024));
+    REQUIRE(hist.Quantile(0.5) == std::chrono::nanoseconds(1024));
+
+    hist.Record(std::chrono::nanoseconds(1025));
+    REQUIRE(hist.Bucket(11) == 1);
+
+    MetricWriter writer;
+    writer.Histogram("wait", "Waits.", {}, hist);
+    std::ostringstream text;
+    writer.Render(text);
+    REQUIRE(text.str().find("wait_bucket{le=\"5.12e-07\"} 0\n")
+            != std::string::npos);
+    REQUIRE(text.str().find("wait_bucket{le=\"1.024e-06\"} 1\n")
+            != std::string::npos);
+    REQUIRE(text.str().find("wait_bucket{le=\"2.048e-06\"} 2\n")
+            != std::string::npos);
+}
@@ -0,0 +1,124 @@
+#include <catch2/catch.hpp>
+#include <channel.hpp>
+#include <net_channel.hpp>
+
+#include <future>
+
+#ifndef _WIN32
+namespace {
+    // hands out sockets queued by the test, one per connection
+    NetConnector queued(LChannel<platform::socket_t>& sockets) {
+        return [&sockets] {
+            return sockets.TryGet().value_or(platform::invalid_socket);
+        };
+    }
+}  // namespace
+
+TEST_CASE("NetChannel over a socketpair", "[net]") {
+    platform::socket_t fds[2];
+    REQUIRE(platform::socket_pair(fds));
+
+    LChannel<platform::socket_t> left;
+    LChannel<platform::socket_t> right;
+    left.Add(fds[0]);
+    right.Add(fds[1]);
+
+    NetChannel<int> sender(queued(left), 16);
+    NetChannel<int> receiver(queued(right), 16);
+
+    auto producer = std::async(std::launch::async, [&] {
+        for (int i = 0; i < 2000; ++i) {
+            sender.Add(i);
+        }
+        sender.Close();
+    });
+
+    int expected = 0;
+    for (int value : receiver) {
+        if (value != expected) {
+            break;
+        }
+        ++expected;
+    }
+    producer.get();
+
+    REQUIRE(expected == 2000);
+    REQUIRE_FALSE(sender.Add(0));
+
+    // the receiver holds at most a window of unconsumed messages
+    REQUIRE(sender.Stat().push_parks > 0);
+    REQUIRE(sender.Batches() < 2000);
+}
+
+TEST_CASE("NetChannel resends after a reconnect", "[net]") {
+    platform::socket_t first[2];
+    platform::socket_t second[2];
+    REQUIRE(platform::socket_pair(first));
+    REQUIRE(platform::socket_pair(second));
+
+    LChannel<platform::socket_t> left;
+    LChannel<platform::socket_t> right;
+    left.Add(first[0]);
+    right.Add(first[1]);
+
+    NetChannel<int> sender(queued(left), 32);
+    NetChannel<int> receiver(queued(right), 32);
+
+    auto producer = std::async(std::launch::async, [&] {
+        for (int i = 0; i < 1000; ++i) {
+            sender.Add(i);
+        }
+        sender.Close();
+    });
+
+    int expected = 0;
+    for (int value : receiver) {
+        if (value != expected) {
+            break;
+        }
+        ++expected;
+
+        // drop the connection midway, both ends dial again
+        if (expected == 100) {
+            platform::shutdown_socket(first[0]);
+            left.Add(second[0]);
+            right.Add(second[1]);
+        }
+    }
+    producer.get();
+
+    REQUIRE(expected == 1000);
+    REQUIRE(sender.Connects() == 2);
+    REQUIRE(receiver.Connects() == 2);
+}
+
+TEST_CASE("NetChannel over tcp loopback in both directions", "[net]") {
+    platform::socket_t listener = platform::listen_local(0);
+    REQUIRE(listener != platform::invalid_socket);
+    uint16_t port = platform::local_port(listener);
+
+    NetChannel<int> server(net_accept(listener));
+    NetChannel<int> client(net_dial("127.0.0.1", port));
+
+    auto echo = std::async(std::launch::async, [&] {
+        for (int value : server) {
+            server.Add(value * 2);
+        }
+        server.Close();
+    });
+
+    for (int i = 0; i < 100; ++i) {
+        client.Add(i);
+    }
+    client.Close();
+
+    int sum = 0;
+    for (int value : client) {
+        sum += value;
+    }
+    echo.get();
+    platform::close_socket(listener);
+
+    REQUIRE(sum == 99 * 100);
+}
+#endif
@@ -0,0 +1,228 @@
+#include <catch2/catch.hpp>
+#include <netpoller.hpp>
+#include <select.hpp>
+#include <watchdog.hpp>
+
+#include <array>
+#include <future>
+#include <vector>
+
+#ifndef _WIN32
+#include <platform/socket.hpp>
+
+TEST_CASE("Netpoller waits for readiness", "[netpoller]") {
+    using namespace std::chrono_literals;
+    Netpoller netpoller;
+
+    platform::socket_t fds[2];
+    REQUIRE(platform::socket_pair(fds));
+
+    auto watch = netpoller.Watch(fds[0]);
+    REQUIRE(netpoller.Watch(fds[0]) == watch);
+    REQUIRE_FALSE(netpoller.Wait(*watch, platform::poll_read, 20ms));
+    REQUIRE(netpoller.Wait(*watch, platform::poll_write, 1s));
+
+    auto writer = std::async(std::launch::async, [&] {
+        std::this_thread::sleep_for(20ms);
+        platform::send_all(fds[1], "x", 1);
+    });
+    REQUIRE(netpoller.Wait(*watch, platform::poll_read, 5s));
+    writer.get();
+
+    // level triggered, unread data is reported again
+    REQUIRE(netpoller.Wait(*watch, platform::poll_read, 1s));
+
+    char buf;
+    REQUIRE(platform::recv_some(fds[0], &buf, 1) == 1);
+    REQUIRE_FALSE(netpoller.Wait(*watch, platform::poll_read, 20ms));
+
+    netpoller.Forget(fds[0]);
+    REQUIRE(netpoller.Watched() == 0);
+    platform::close_socket(fds[0]);
+    platform::close_socket(fds[1]);
+}
+
+TEST_CASE("Netpoller scales to many descriptors", "[netpoller]") {
+    using namespace std::chrono_literals;
+    Netpoller netpoller;
+
+    std::vector<std::array<platform::socket_t, 2>> pairs(256);
+    std::vector<std::shared_ptr<FdWatch>> watches;
+    for (auto& pair : pairs) {
+        platform::socket_t fds[2];
+        REQUIRE(platform::socket_pair(fds));
+        pair = { fds[0], fds[1] };
+        watches.push_back(netpoller.Watch(fds[0]));
+        netpoller.TryTake(*watches.back(), platform::poll_read);
+    }
+
+    for (size_t i = 0; i < pairs.size(); i += 2) {
+        platform::send_all(pairs[i][1], "x", 1);
+    }
+
+    size_t num_ready = 0;
+    for (size_t i = 0; i < pairs.size(); ++i) {
+        bool ready = netpoller.Wait(*watches[i], platform::poll_read,
+                                    i % 2 == 0 ? 5000ms : 0ms);
+        num_ready += ready;
+        REQUIRE(ready == (i % 2 == 0));
+    }
+    REQUIRE(num_ready == pairs.size() / 2);
+
+    for (auto& pair : pairs) {
+        netpoller.Forget(pair[0]);
+        platform::close_socket(pair[0]);
+        platform::close_socket(pair[1]);
+    }
+}
+
+TEST_CASE("select over a socket and a channel", "[netpoller]") {
+    platform::socket_t fds[2];
+    REQUIRE(platform::socket_pair(fds));
+
+    LChannel<int> channel;
+    channel.Add(1);
+    platform::send_all(fds[1], "x", 1);
+
+    int from_channel = 0;
+    int from_socket = 0;
+    auto once = [&] {
+        select(case_m(channel) >> [&] { ++from_channel; },
+               fd_readable_m(fds[0]) >> [&](int fd) {
+                   char buf;
+                   platform::recv_some(fd, &buf, 1);
+                   ++from_socket;
+               });
+    };
+
+    // both ready, cases are tried in order
+    once();
+    REQUIRE(from_channel == 1);
+    REQUIRE(from_socket == 0);
+    once();
+    REQUIRE(from_socket == 1);
+
+    Netpoller::Global().Forget(fds[0]);
+    platform::close_socket(fds[0]);
+    platform::close_socket(fds[1]);
+}
+
+TEST_CASE("select blocks until a case fires", "[netpoller]") {
+    using namespace std::chrono_literals;
+    platform::socket_t fds[2];
+    REQUIRE(platform::socket_pair(fds));
+
+    LChannel<int> channel;
+    int from_channel = 0;
+    int from_socket = 0;
+    auto once = [&] {
+        select(case_m(channel) >> [&](int value) { from_channel = value; },
+               fd_readable_m(fds[0]) >> [&](int fd) {
+                   char buf;
+                   platform::recv_some(fd, &buf, 1);
+                   ++from_socket;
+               });
+    };
+
+    // parked until the peer writes
+    auto writer = std::async(std::launch::async, [&] {
+        std::this_thread::sleep_for(20ms);
+        platform::send_all(fds[1], "x", 1);
+    });
+    auto start = std::chrono::steady_clock::now();
+    once();
+    REQUIRE(std::chrono::steady_clock::now() - start >= 20ms);
+    REQUIRE(from_socket == 1);
+    REQUIRE(from_channel == 0);
+    writer.get();
+
+    // parked until a message is sent
+    auto sender = std::async(std::launch::async, [&] {
+        std::this_thread::sleep_for(20ms);
+        channel.Add(7);
+    });
+    once();
+    REQUIRE(from_channel == 7);
+    REQUIRE(from_socket == 1);
+    sender.get();
+
+    // every case closed, nothing left to wait for
+    LChannel<int> closed;
+    closed.Close();
+    bool ran = false;
+    select(case_m(closed) >> [&] { ran = true; });
+    REQUIRE_FALSE(ran);
+
+    Netpoller::Global().Forget(fds[0]);
+    platform::close_socket(fds[0]);
+    platform::close_socket(fds[1]);
+}
+
+TEST_CASE("select over channels parks on the channels", "[netpoller]") {
+    using namespace std::chrono_literals;
+    LChannel<int> first;
+    RChannel<int> second(4);
+
+    int from_first = 0;
+    int from_second = 0;
+    auto once = [&] {
+        select(case_m(first) >> [&](int value) { from_first = value; },
+               case_m(second) >> [&](int value) { from_second = value; });
+    };
+
+    auto sender = std::async(std::launch::async, [&] {
+        std::this_thread::sleep_for(20ms);
+        second.Add(3);
+        std::this_thread::sleep_for(20ms);
+        first.Close();
+        second.Close();
+    });
+    auto start = std::chrono::steady_clock::now();
+    once();
+    REQUIRE(std::chrono::steady_clock::now() - start >= 20ms);
+    REQUIRE(from_second == 3);
+
+    // woken by the closes, every case is closed and drained
+    once();
+    REQUIRE(from_first == 0);
+    sender.get();
+}
+
+TEST_CASE("Watchdog ignores waits on descriptors", "[netpoller]") {
+    using namespace std::chrono_literals;
+    platform::socket_t fds[2];
+    REQUIRE(platform::socket_pair(fds));
+
+    std::atomic<bool> reported(false);
+    Watchdog watchdog(20ms, [&](std::string const&) { reported = true; });
+
+    LChannel<int> channel;
+    auto consumer = std::async(std::launch::async, [&] {
+        int sum = 0;
+        for (int value : channel) {
+            sum += value;
+        }
+        return sum;
+    });
+
+    // an idle server waits for its clients, not on the consumer
+    auto writer = std::async(std::launch::async, [&] {
+        std::this_thread::sleep_for(100ms);
+        platform::send_all(fds[1], "x", 1);
+    });
+    select(fd_readable_m(fds[0]) >> [&](int fd) {
+        char buf;
+        platform::recv_some(fd, &buf, 1);
+        channel.Add(1);
+    });
+    writer.get();
+
+    channel.Close();
+    REQUIRE(consumer.get() == 1);
+    REQUIRE(!reported);
+
+    Netpoller::Global().Forget(fds[0]);
+    platform::close_socket(fds[0]);
+    platform::close_socket(fds[1]);
+}
+#endif
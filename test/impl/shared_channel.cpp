@@ -0,0 +1,132 @@
+#include <catch2/catch.hpp>
+#include <shared_channel.hpp>
+
+#include <future>
+#include <memory>
+#include <string>
+
+#ifndef _WIN32
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+    std::string unique_name(char const* tag) {
+        return std::string("/cc-test-") + tag + '-'
+               + std::to_string(platform::process_id());
+    }
+}  // namespace
+
+TEST_CASE("SharedChannel between threads", "[shared]") {
+    std::string name = unique_name("threads");
+    SharedChannel<int> sender(name, 4);
+    SharedChannel<int> receiver(name);
+    REQUIRE(sender.Attached());
+    REQUIRE(receiver.Attached());
+
+    // a third end is refused while both are alive
+    SharedChannel<int> third(name);
+    REQUIRE_FALSE(third.Attached());
+
+    auto producer = std::async(std::launch::async, [&] {
+        for (int i = 0; i < 1000; ++i) {
+            sender.Add(i);
+        }
+        sender.Close();
+    });
+
+    int expected = 0;
+    for (int value : receiver) {
+        if (value != expected) {
+            break;
+        }
+        ++expected;
+    }
+    producer.get();
+
+    REQUIRE(expected == 1000);
+    REQUIRE_FALSE(receiver.Add(0));
+}
+
+TEST_CASE("SharedChannel between processes", "[shared]") {
+    std::string name = unique_name("fork");
+    SharedChannel<long> channel(name, 64);
+    REQUIRE(channel.Attached());
+
+    pid_t child = fork();
+    if (child == 0) {
+        SharedChannel<long> peer(name);
+        for (long i = 0; i < 10000; ++i) {
+            peer.Add(i);
+        }
+        peer.Close();
+        _exit(0);
+    }
+
+    long sum = 0;
+    long count = 0;
+    for (long value : channel) {
+        sum += value;
+        ++count;
+    }
+    waitpid(child, nullptr, 0);
+
+    REQUIRE(count == 10000);
+    REQUIRE(sum == 9999L * 10000 / 2);
+}
+
+TEST_CASE("SharedChannel closes when the peer dies", "[shared]") {
+    std::string name = unique_name("death");
+    SharedChannel<int> channel(name, 16);
+
+    pid_t child = fork();
+    if (child == 0) {
+        // exits without closing, as if killed
+        auto peer = new SharedChannel<int>(name);
+        for (int i = 0; i < 5; ++i) {
+            peer->Add(i);
+        }
+        _exit(0);
+    }
+
+    // the exited child is not reaped before the channel notices
+    int count = 0;
+    for (int value : channel) {
+        REQUIRE(value == count);
+        ++count;
+    }
+    REQUIRE(count == 5);
+    REQUIRE_FALSE(channel.Runnable());
+    waitpid(child, nullptr, 0);
+}
+
+TEST_CASE("SharedChannel keeps its name while an end is left",
+          "[shared]") {
+    std::string name = unique_name("unlink");
+    auto creator = std::make_unique<SharedChannel<int>>(name, 4);
+    SharedChannel<int> peer(name);
+    REQUIRE(peer.Attached());
+
+    creator->Add(7);
+    creator.reset();
+
+    // closed by the creator, the message is still received
+    platform::SharedMemory probe;
+    REQUIRE(probe.open(name));
+    probe.close();
+    REQUIRE(peer.Get() == 7);
+    REQUIRE_FALSE(peer.Get().has_value());
+    REQUIRE(peer.Reclaimed() == 0);
+}
+
+TEST_CASE("SharedChannel removes its name with the last end", "[shared]") {
+    std::string name = unique_name("last");
+    {
+        SharedChannel<int> creator(name, 4);
+        SharedChannel<int> peer(name);
+        REQUIRE(peer.Attached());
+    }
+
+    platform::SharedMemory probe;
+    REQUIRE_FALSE(probe.open(name));
+}
+#endif
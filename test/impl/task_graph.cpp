@@ -0,0 +1,98 @@
+#include <catch2/catch.hpp>
+#include <task_graph.hpp>
+
+#include <atomic>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+TEST_CASE("TaskGraph runs nodes after their predecessors", "[task_graph]") {
+    LThreadPool<void> pool(4);
+    TaskGraph graph;
+
+    // layers of a wide graph, every node depends on the whole layer above
+    constexpr size_t num_layers = 6;
+    constexpr size_t width = 8;
+    std::vector<std::atomic<size_t>> done(num_layers);
+    std::atomic<bool> ordered(true);
+
+    std::vector<size_t> above;
+    for (size_t layer = 0; layer < num_layers; ++layer) {
+        std::vector<size_t> current;
+        for (size_t i = 0; i < width; ++i) {
+            size_t node = graph.Add([&, layer] {
+                if (layer > 0 && done[layer - 1].load() != width) {
+                    ordered = false;
+                }
+                done[layer].fetch_add(1);
+            });
+            for (size_t pred : above) {
+                graph.Precede(pred, node);
+            }
+            current.push_back(node);
+        }
+        above = std::move(current);
+    }
+
+    // reusable, the counters are reset on every run
+    for (size_t run = 1; run <= 3; ++run) {
+        for (auto& count : done) {
+            count = 0;
+        }
+        REQUIRE(graph.Run(pool));
+        REQUIRE(ordered);
+        REQUIRE(done.back() == width);
+        REQUIRE(graph.Runs() == run);
+    }
+}
+
+TEST_CASE("TaskGraph reports the critical path", "[task_graph]") {
+    using namespace std::chrono_literals;
+    LThreadPool<void> pool(4);
+    TaskGraph graph;
+
+    // load -> slow -> merge
+    // load -> fast -> merge
+    auto load = graph.Add([] {}, "load");
+    auto slow = graph.Add([] { std::this_thread::sleep_for(30ms); }, "slow");
+    auto fast = graph.Add([] { std::this_thread::sleep_for(1ms); }, "fast");
+    auto merge = graph.Add([] {}, "merge");
+    graph.Precede(load, slow);
+    graph.Precede(load, fast);
+    graph.Precede(slow, merge);
+    graph.Precede(fast, merge);
+
+    REQUIRE(graph.Run(pool));
+    CriticalPath path = graph.Critical();
+    REQUIRE(path.nodes == std::vector<size_t>{ load, slow, merge });
+    REQUIRE(path.length >= 30ms);
+    REQUIRE(graph.Work() >= path.length);
+    REQUIRE(graph.Elapsed() >= path.length);
+    REQUIRE(std::string(graph.Label(path.nodes[1])) == "slow");
+}
+
+TEST_CASE("TaskGraph skips nodes after a failure", "[task_graph]") {
+    LThreadPool<void> pool(2);
+    TaskGraph graph;
+    std::atomic<size_t> ran(0);
+
+    auto root = graph.Add([] { throw std::runtime_error("root"); });
+    size_t prev = root;
+    for (int i = 0; i < 10; ++i) {
+        size_t node = graph.Add([&] { ++ran; });
+        graph.Precede(prev, node);
+        prev = node;
+    }
+    REQUIRE_THROWS_WITH(graph.Run(pool), "root");
+    REQUIRE(ran == 0);
+
+    TaskGraph cyclic;
+    auto a = cyclic.Add([&] { ++ran; });
+    auto b = cyclic.Add([&] { ++ran; });
+    cyclic.Precede(a, b);
+    cyclic.Precede(b, a);
+    REQUIRE_FALSE(cyclic.Acyclic());
+    REQUIRE_FALSE(cyclic.Run(pool));
+    REQUIRE(ran == 0);
+}
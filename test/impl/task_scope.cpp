@@ -0,0 +1,105 @@
+#include <catch2/catch.hpp>
+#include <task_scope.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+    size_t fib(LThreadPool<void>& pool, size_t n) {
+        if (n < 2) {
+            return n;
+        }
+
+        size_t left = 0;
+        size_t right = 0;
+        {
+            TaskScope scope(pool);
+            scope.Spawn([&] { left = fib(pool, n - 1); });
+            scope.Spawn([&] { right = fib(pool, n - 2); });
+        }
+        return left + right;
+    }
+}  // namespace
+
+TEST_CASE("TaskScope joins nested scopes by helping", "[task_scope]") {
+    // every worker joins a nested scope, none may park
+    LThreadPool<void> pool(2);
+    REQUIRE(fib(pool, 16) == 987);
+    REQUIRE_FALSE(pool.RunPending());
+}
+
+TEST_CASE("TaskScope propagates the first exception", "[task_scope]") {
+    LThreadPool<void> pool(1);
+    std::atomic<bool> started(false);
+    std::atomic<bool> go(false);
+    std::atomic<size_t> ran(0);
+
+    TaskScope scope(pool);
+    scope.Spawn([&] {
+        started = true;
+        while (!go) {
+            std::this_thread::yield();
+        }
+        throw std::runtime_error("first");
+    });
+    for (int i = 0; i < 10; ++i) {
+        scope.Spawn([&] { ++ran; });
+    }
+
+    while (!started) {
+        std::this_thread::yield();
+    }
+    go = true;
+    while (!scope.Cancelled()) {
+        std::this_thread::yield();
+    }
+
+    scope.Spawn([&] { ++ran; });
+    REQUIRE_THROWS_WITH(scope.Join(), "first");
+    REQUIRE(ran == 0);
+    REQUIRE(scope.Skipped() == 11);
+
+    // the exception is reported once
+    scope.Join();
+}
+
+TEST_CASE("TaskScope rethrows when destroyed", "[task_scope]") {
+    LThreadPool<void> pool(2);
+    std::atomic<size_t> ran(0);
+
+    auto run = [&] {
+        TaskScope scope(pool);
+        for (int i = 0; i < 8; ++i) {
+            scope.Spawn([&] { ++ran; });
+        }
+        scope.Spawn([] { throw std::logic_error("child"); });
+    };
+    REQUIRE_THROWS_AS(run(), std::logic_error);
+    REQUIRE(ran == 8);
+}
+
+TEST_CASE("TaskScope parks while a child runs", "[task_scope]") {
+    LThreadPool<void> pool(1);
+    std::atomic<bool> started(false);
+    std::clock_t before;
+    {
+        TaskScope scope(pool);
+        scope.Spawn([&] {
+            started.store(true);
+            std::this_thread::sleep_for(std::chrono::milliseconds(300));
+        });
+
+        // joined while the worker runs the child
+        while (!started.load()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        before = std::clock();
+    }
+
+    // a spinning joiner would take about as much cpu time as the child
+    double cpu = double(std::clock() - before) / CLOCKS_PER_SEC;
+    REQUIRE(cpu < 0.15);
+}
@@ -0,0 +1,105 @@
+#include <catch2/catch.hpp>
+#include <sstream>
+#include <thread_pool.hpp>
+#include <wait_group.hpp>
+
+TEST_CASE("ThreadPool::Snapshot", "[thread_pool]") {
+    using namespace std::literals;
+
+    ThreadPool<void> pool(3, 4);
+    WaitGroup start(2);
+    WaitGroup release(1);
+    std::atomic<bool> spin(true);
+
+    auto running = pool.Add("running", [&] {
+        start.Done();
+        while (spin) {
+            std::this_thread::yield();
+        }
+    });
+    auto blocked = pool.Add("blocked", [&] {
+        start.Done();
+        release.Wait();
+    });
+    start.Wait();
+    std::this_thread::sleep_for(10ms);
+
+    PoolSnapshot snapshot = pool.Snapshot();
+    REQUIRE(snapshot.workers.size() == 3);
+
+    size_t num_running = 0, num_blocked = 0, num_idle = 0;
+    for (auto const& worker : snapshot.workers) {
+        switch (worker.state) {
+        case WorkerState::Running:
+            REQUIRE(std::string(worker.label) == "running");
+            ++num_running;
+            break;
+        case WorkerState::Blocked:
+            REQUIRE(std::string(worker.label) == "blocked");
+            ++num_blocked;
+            break;
+        case WorkerState::Idle:
+            ++num_idle;
+            break;
+        }
+    }
+    REQUIRE(num_running == 1);
+    REQUIRE(num_blocked == 1);
+    REQUIRE(num_idle == 1);
+
+    spin = false;
+    release.Done();
+    running.get();
+    blocked.get();
+
+    pool.Stop();
+    snapshot = pool.Snapshot();
+    REQUIRE(snapshot.executed == 2);
+    REQUIRE(snapshot.queue_depth == 0);
+}
+
+TEST_CASE("ThreadPool::Dump", "[thread_pool]") {
+    LThreadPool<int> pool(2);
+    REQUIRE(pool.Add("answer", [] { return 42; }).get() == 42);
+
+    // the future is ready before the worker goes back to idle
+    while (pool.Snapshot().executed == 0) {
+        std::this_thread::yield();
+    }
+
+    std::ostringstream stream;
+    pool.Dump(stream);
+
+    std::string dump = stream.str();
+    REQUIRE(dump.find("2 workers") != std::string::npos);
+    REQUIRE(dump.find("worker 1 [idle]") != std::string::npos);
+}
+
+TEST_CASE("ThreadPool::Accounting", "[thread_pool]") {
+    using namespace std::literals;
+
+    ThreadPool<void> pool(1, 4);
+    pool.Add("untracked", [] {}).get();
+
+    // the single worker waits until both tasks are queued, so "queued"
+    // waits for the whole sleep of "slow"
+    pool.EnableAccounting();
+    WaitGroup submitted(1);
+    auto slow = pool.Add("slow", [&] {
+        submitted.Wait();
+        std::this_thread::sleep_for(20ms);
+    });
+    auto queued = pool.Add("queued", [] {});
+    submitted.Done();
+    slow.get();
+    queued.get();
+
+    pool.Stop();
+    auto stats = pool.Accounting();
+
+    REQUIRE(stats.count("untracked") == 0);
+    REQUIRE(stats.at("slow").wall_time.Count() == 1);
+    REQUIRE(stats.at("slow").wall_time.Sum() >= 20ms);
+    REQUIRE(stats.at("slow").cpu_time.Sum() < 20ms);
+    REQUIRE(stats.at("queued").queue_wait.Sum() >= 20ms);
+}
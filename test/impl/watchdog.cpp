@@ -0,0 +1,78 @@
+#include <catch2/catch.hpp>
+#include <thread_pool.hpp>
+#include <wait_group.hpp>
+#include <watchdog.hpp>
+
+TEST_CASE("Watchdog reports forgotten Close", "[watchdog]") {
+    using namespace std::literals;
+
+    LChannel<int> channel;
+    std::mutex mutex;
+    std::string report;
+    Watchdog watchdog(50ms, [&](std::string const& graph) {
+        {
+            std::unique_lock lock(mutex);
+            report = graph;
+        }
+        channel.Close();
+    });
+    Watchdog::Name(&channel, "results");
+
+    WaitGroup consumed(1);
+    auto consumer = std::async(std::launch::async, [&] {
+        int sum = 0;
+        for (int value : channel) {
+            sum += value;
+        }
+        consumed.Done();
+        return sum;
+    });
+    channel.Add(1);
+
+    // stuck until the reporter closes the channel
+    consumed.Wait();
+    REQUIRE(consumer.get() == 1);
+    Watchdog::Unname(&channel);
+
+    std::unique_lock lock(mutex);
+    REQUIRE(report.find("deadlock") != std::string::npos);
+    REQUIRE(report.find("(results)") != std::string::npos);
+    REQUIRE(report.find("receive") != std::string::npos);
+    REQUIRE(report.find("wait group") != std::string::npos);
+}
+
+TEST_CASE("Watchdog ignores a sender busy elsewhere", "[watchdog]") {
+    using namespace std::literals;
+
+    std::atomic<bool> reported(false);
+    Watchdog watchdog(20ms, [&](std::string const&) { reported = true; });
+
+    LChannel<int> channel;
+    auto consumer = std::async(std::launch::async, [&] {
+        int sum = 0;
+        for (int value : channel) {
+            sum += value;
+        }
+        return sum;
+    });
+    channel.Add(1);
+
+    // the consumer waits for a sender which is running
+    std::this_thread::sleep_for(100ms);
+    channel.Close();
+    REQUIRE(consumer.get() == 1);
+    REQUIRE(!reported);
+}
+
+TEST_CASE("Watchdog ignores idle pool", "[watchdog]") {
+    using namespace std::literals;
+
+    std::atomic<bool> reported(false);
+    Watchdog watchdog(20ms, [&](std::string const&) { reported = true; });
+
+    ThreadPool<void> pool(2);
+    std::this_thread::sleep_for(100ms);
+    pool.Stop();
+
+    REQUIRE(!reported);
+}